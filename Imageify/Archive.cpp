@@ -0,0 +1,122 @@
+#include "Archive.hpp"
+#include "Platform.hpp"
+
+#include <algorithm>
+#include <limits>
+
+#include <zlib.h>
+
+
+
+// Layout: version, 3 reserved bytes, member count, size of the member list, then the member
+// list deflated. Paths repeat their directories over and over, and deflate removes most of it
+static constexpr size_t manifestHeaderBytes = 4 + 4 + 8;
+
+// Each member: offset, size, CRC-32C, name length, then the name
+static constexpr size_t memberBytes = 8 + 8 + 4 + 2;
+
+// A chunk holds at most 2^31 - 1 bytes, and a list that large is not a manifest worth reading
+static constexpr uint64_t maxListBytes = 1ull << 30;
+
+// Deflate cannot expand its input by more than about this much, 258 bytes from every 2 bits
+static constexpr uint64_t maxInflateRatio = 1032;
+
+
+
+std::vector<uint8_t> serializeArchiveManifest(const archiveManifest_t& manifest)
+{
+    std::vector<uint8_t> list;
+
+    for (const archiveMember_t& member : manifest.members)
+    {
+        const size_t nameLength = std::min<size_t>(member.name.size(), std::numeric_limits<uint16_t>::max());
+
+        putBE64(list, member.offset);
+        putBE64(list, member.size);
+        putBE32(list, member.crc);
+        putBE16(list, static_cast<uint16_t>(nameLength));
+        list.insert(list.end(), member.name.begin(), member.name.begin() + nameLength);
+    }
+
+    std::vector<uint8_t> out;
+    out.reserve(manifestHeaderBytes + compressBound(static_cast<uLong>(list.size())));
+
+    out.push_back(manifest.version);
+    out.insert(out.end(), 3, 0x00);
+    putBE32(out, static_cast<uint32_t>(manifest.members.size()));
+    putBE64(out, list.size());
+
+    uLongf compressedSize = compressBound(static_cast<uLong>(list.size()));
+    out.resize(manifestHeaderBytes + compressedSize);
+
+    compress2(out.data() + manifestHeaderBytes, &compressedSize, list.data(), static_cast<uLong>(list.size()), Z_BEST_COMPRESSION);
+    out.resize(manifestHeaderBytes + compressedSize);
+
+    return out;
+}
+
+
+
+bool parseArchiveManifest(const uint8_t* data, size_t length, archiveManifest_t& manifest)
+{
+    if (length < manifestHeaderBytes || data[0] == 0 || data[0] > archiveVersion)
+        return false;
+
+    const uint32_t count = getBE32(data + 4);
+    const uint64_t listBytes = getBE64(data + 8);
+    const uint64_t compressedBytes = length - manifestHeaderBytes;
+
+    // The size is only believed as far as the count and the compressed bytes bear it out,
+    // before anything is allocated for it
+    if (listBytes > maxListBytes || count > listBytes / memberBytes
+        || listBytes > count * (memberBytes + UINT16_MAX) || listBytes > compressedBytes * maxInflateRatio)
+        return false;
+
+    std::vector<uint8_t> list(static_cast<size_t>(listBytes));
+    uLongf inflatedSize = static_cast<uLongf>(listBytes);
+
+    if (uncompress(list.data(), &inflatedSize, data + manifestHeaderBytes, static_cast<uLong>(compressedBytes)) != Z_OK
+        || inflatedSize != listBytes)
+        return false;
+
+    manifest.version = data[0];
+    manifest.members.clear();
+    manifest.members.reserve(count);
+
+    size_t position{ 0 };
+
+    for (uint32_t i{ 0 }; i < count; ++i)
+    {
+        if (list.size() - position < memberBytes)
+            return false;
+
+        archiveMember_t member;
+        member.offset = getBE64(list.data() + position);
+        member.size   = getBE64(list.data() + position + 8);
+        member.crc    = getBE32(list.data() + position + 16);
+
+        const uint16_t nameLength = getBE16(list.data() + position + 20);
+        position += memberBytes;
+
+        if (list.size() - position < nameLength || member.offset + member.size < member.offset)
+            return false;
+
+        member.name.assign(reinterpret_cast<const char*>(list.data() + position), nameLength);
+        position += nameLength;
+
+        manifest.members.push_back(std::move(member));
+    }
+
+    return position == list.size();
+}
+
+
+
+const archiveMember_t* findArchiveMember(const archiveManifest_t& manifest, const std::string& name)
+{
+    for (const archiveMember_t& member : manifest.members)
+        if (member.name == name)
+            return &member;
+
+    return nullptr;
+}
@@ -0,0 +1,68 @@
+#ifndef _ARCHIVE_H_
+#define _ARCHIVE_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+// Private, ancillary, not safe to copy. Written before the image data, so a listing never
+// has to read past the first IDAT
+constexpr char archiveChunkName[5] = "ifAR";
+constexpr uint8_t archiveVersion = 1;
+
+
+
+/**
+* @brief One file packed into an archive image, at [offset, offset + size) of the payload.
+*/
+struct archiveMember_t
+{
+	// Relative path with / separators, as given when packing
+	std::string name;
+
+	uint64_t offset{ 0 };
+	uint64_t size{ 0 };
+
+	// CRC-32C of the member's bytes
+	uint32_t crc{ 0 };
+};
+
+
+
+/**
+* @brief The manifest of an archive image, kept in an ifAR chunk.
+*
+* An archive is an ordinary Imageify payload holding its members back to back. The manifest
+* says where each one starts, so a single member can be decoded as a byte range.
+*/
+struct archiveManifest_t
+{
+	// 0 when the image is not an archive
+	uint8_t version{ 0 };
+
+	std::vector<archiveMember_t> members{};
+};
+
+
+
+/**
+* @brief Serializes a manifest into the payload of an ifAR chunk, deflating the member list.
+*/
+std::vector<uint8_t> serializeArchiveManifest(const archiveManifest_t&);
+
+/**
+* @brief Reads an ifAR chunk. Returns false if it is damaged or from a newer version.
+*/
+bool parseArchiveManifest(const uint8_t*, size_t, archiveManifest_t&);
+
+/**
+* @brief The member with the given name, or null.
+*/
+const archiveMember_t* findArchiveMember(const archiveManifest_t&, const std::string& name);
+
+
+#endif // !_ARCHIVE_H_
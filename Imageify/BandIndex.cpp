@@ -0,0 +1,420 @@
+#include "BandIndex.hpp"
+#include "PixelFormat.hpp"
+#include "Platform.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <new>
+
+#include <png.h>
+#include <zlib.h>
+
+
+
+// Layout: version, 3 reserved bytes, payload size, band count, then one fixed-size record per band
+static constexpr size_t indexHeaderBytes = 4 + 8 + 4;
+static constexpr size_t indexRecordBytes = 4 + 4 + 8 + 8;
+
+
+
+std::vector<uint8_t> serializeBandIndex(uint64_t payloadSize, const std::vector<band_t>& bands)
+{
+    std::vector<uint8_t> out;
+    out.reserve(indexHeaderBytes + bands.size() * indexRecordBytes);
+
+    out.push_back(bandIndexVersion);
+    out.push_back(0x00);
+    out.push_back(0x00);
+    out.push_back(0x00);
+    putBE64(out, payloadSize);
+    putBE32(out, static_cast<uint32_t>(bands.size()));
+
+    for (const band_t& band : bands)
+    {
+        putBE32(out, band.firstRow);
+        putBE32(out, band.rowCount);
+        putBE64(out, band.streamOffset);
+        putBE64(out, band.compressedSize);
+    }
+
+    return out;
+}
+
+
+
+static bool parseBandIndex(const uint8_t* data, size_t length, imageLayout_t& layout)
+{
+    if (length < indexHeaderBytes || data[0] != bandIndexVersion)
+        return false;
+
+    const uint32_t bandCount = getBE32(data + 12);
+    if ((length - indexHeaderBytes) / indexRecordBytes < bandCount)
+        return false;
+
+    layout.payloadSize = getBE64(data + 4);
+    layout.bands.resize(bandCount);
+
+    const uint8_t* record = data + indexHeaderBytes;
+    for (band_t& band : layout.bands)
+    {
+        band.firstRow       = getBE32(record);
+        band.rowCount       = getBE32(record + 4);
+        band.streamOffset   = getBE64(record + 8);
+        band.compressedSize = getBE64(record + 16);
+
+        record += indexRecordBytes;
+    }
+
+    return true;
+}
+
+
+
+// The bit depths the PNG specification allows for each colour type
+static bool validBitDepth(uint8_t colorType, uint8_t bitDepth)
+{
+    switch (colorType)
+    {
+        case PNG_COLOR_TYPE_GRAY:
+            return bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8 || bitDepth == 16;
+
+        case PNG_COLOR_TYPE_PALETTE:
+            return bitDepth == 1 || bitDepth == 2 || bitDepth == 4 || bitDepth == 8;
+
+        case PNG_COLOR_TYPE_RGB:
+        case PNG_COLOR_TYPE_GRAY_ALPHA:
+        case PNG_COLOR_TYPE_RGB_ALPHA:
+            return bitDepth == 8 || bitDepth == 16;
+
+        default:
+            return false;
+    }
+}
+
+
+
+PNGManipErrorCode scanImageLayout(const uint8_t* data, size_t size, imageLayout_t& layout, uint64_t idatLimit)
+{
+    layout = imageLayout_t{};
+
+    if (size < 8 || png_sig_cmp(data, 0, 8) != 0)
+        return PNGManipErrorCode::InvalidFileFormat;
+
+    bool haveHeader{ false };
+    size_t position{ 8 };
+
+    while (size - position >= 12)
+    {
+        const size_t length = getBE32(data + position);
+        const uint8_t* type = data + position + 4;
+        const uint8_t* body = data + position + 8;
+
+        if (length > size - position - 12)
+            return PNGManipErrorCode::InvalidFileFormat;
+
+        if (memcmp(type, "IHDR", 4) == 0 && length == 13)
+        {
+            layout.width     = getBE32(body);
+            layout.height    = getBE32(body + 4);
+            layout.bitDepth  = body[8];
+            layout.colorType = body[9];
+            layout.interlace = body[12];
+            haveHeader = true;
+
+            // libpng rejects these on the serial path. The banded paths size their buffers from
+            // the header alone, so they must never see one libpng would not have accepted
+            if (layout.width == 0 || layout.height == 0 || layout.width > maxImageSide || layout.height > maxImageSide
+                || !validBitDepth(layout.colorType, layout.bitDepth) || body[10] != PNG_COMPRESSION_TYPE_BASE
+                || body[11] != PNG_FILTER_TYPE_BASE || layout.interlace > PNG_INTERLACE_ADAM7)
+                return PNGManipErrorCode::InvalidFileFormat;
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            layout.idat.push_back({ position + 8, length, layout.streamSize, getBE32(body + length) });
+            layout.streamSize += length;
+
+            if (layout.streamSize >= idatLimit)
+                break;
+        }
+        else if (memcmp(type, formatChunkName, 4) == 0)
+        {
+            // A newer format could mean anything by the chunks that follow
+            if (length < 1 || body[0] == 0 || body[0] > imageFormatVersion)
+                return PNGManipErrorCode::InvalidFileFormat;
+
+            layout.formatVersion = body[0];
+        }
+        else if (memcmp(type, bandIndexChunkName, 4) == 0)
+        {
+            // A damaged index only costs us the fast path
+            if (!parseBandIndex(body, length, layout))
+                layout.bands.clear();
+        }
+        else if (memcmp(type, payloadHeaderChunkName, 4) == 0)
+        {
+            // Unlike a lost index, a lost header would hand back the compressed bytes
+            if (!parsePayloadHeader(body, length, layout.payloadHeader))
+                return PNGManipErrorCode::InvalidFileFormat;
+        }
+        else if (memcmp(type, shardHeaderChunkName, 4) == 0)
+        {
+            // Without it the image would pass for the whole payload
+            if (!parseShardHeader(body, length, layout.shard))
+                return PNGManipErrorCode::InvalidFileFormat;
+        }
+        else if (memcmp(type, archiveChunkName, 4) == 0)
+        {
+            // Without it the members would run together into one payload
+            if (!parseArchiveManifest(body, length, layout.archive))
+                return PNGManipErrorCode::InvalidFileFormat;
+        }
+        else if (memcmp(type, encryptionChunkName, 4) == 0)
+        {
+            // Without it the ciphertext would be handed back as the payload
+            if (!parseEncryptionHeader(body, length, layout.encryption))
+                return PNGManipErrorCode::InvalidFileFormat;
+        }
+        else if (memcmp(type, checksumChunkName, 4) == 0)
+        {
+            // Damaged, it could only ever fail a good payload
+            if (!parseChecksum(body, length, layout.checksum))
+                return PNGManipErrorCode::InvalidFileFormat;
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            break;
+        }
+
+        position += length + 12;
+    }
+
+    if (!haveHeader || layout.idat.empty())
+        return PNGManipErrorCode::InvalidFileFormat;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+bool verifySegment(const uint8_t* file, const idatSegment_t& segment)
+{
+    uLong crc = crc32(0, reinterpret_cast<const Bytef*>("IDAT"), 4);
+    crc = crc32(crc, file + segment.fileOffset, static_cast<uInt>(segment.length));
+
+    return crc == segment.crc;
+}
+
+
+
+const uint8_t* bandBytes(const uint8_t* file, const imageLayout_t& layout, const band_t& band, std::vector<uint8_t>& scratch)
+{
+    if (band.streamOffset > layout.streamSize || band.compressedSize > layout.streamSize - band.streamOffset)
+        return nullptr;
+
+    // Last segment starting at or before the band
+    auto segment = std::upper_bound(layout.idat.begin(), layout.idat.end(), band.streamOffset,
+        [](uint64_t offset, const idatSegment_t& s) { return offset < s.streamOffset; }) - 1;
+
+    uint64_t skip = band.streamOffset - segment->streamOffset;
+
+    if (skip + band.compressedSize <= segment->length)
+        return file + segment->fileOffset + skip;
+
+    // The band straddles IDAT chunks, stitch it together
+    scratch.clear();
+    scratch.reserve(band.compressedSize);
+
+    for (; scratch.size() < band.compressedSize; ++segment, skip = 0)
+    {
+        const size_t take = std::min<uint64_t>(segment->length - skip, band.compressedSize - scratch.size());
+        scratch.insert(scratch.end(), file + segment->fileOffset + skip, file + segment->fileOffset + skip + take);
+    }
+
+    return scratch.data();
+}
+
+
+
+static uint8_t paethPredictor(int a, int b, int c)
+{
+    const int p = a + b - c;
+    const int pa = std::abs(p - a);
+    const int pb = std::abs(p - b);
+    const int pc = std::abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return static_cast<uint8_t>(a);
+
+    return static_cast<uint8_t>((pb <= pc) ? b : c);
+}
+
+
+
+// Undoes the filters of rowCount rows. Stride is the pixel size as a constant, or 0 to use pixelSize
+template <size_t Stride>
+static PNGManipErrorCode unfilterRows(const uint8_t* filtered, uint8_t* rows, size_t rowBytes, size_t pixelSize, uint32_t rowCount)
+{
+    const size_t lineBytes = rowBytes + 1;
+    const size_t stride = Stride ? Stride : pixelSize;
+
+    for (size_t r{ 0 }; r < rowCount; ++r)
+    {
+        const uint8_t filter = filtered[r * lineBytes];
+        uint8_t* row = rows + r * rowBytes;
+        const uint8_t* prior = row - rowBytes;
+
+        memcpy(row, filtered + r * lineBytes + 1, rowBytes);
+
+        // Bands must not reach back into the previous band
+        if (r == 0 && filter > 1)
+            return PNGManipErrorCode::DecodingError;
+
+        switch (filter)
+        {
+            case 0:
+                break;
+
+            case 1:
+                for (size_t i{ stride }; i < rowBytes; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + row[i - stride]);
+                break;
+
+            case 2:
+                for (size_t i{ 0 }; i < rowBytes; ++i)
+                    row[i] = static_cast<uint8_t>(row[i] + prior[i]);
+                break;
+
+            case 3:
+                for (size_t i{ 0 }; i < rowBytes; ++i)
+                {
+                    const int left = (i >= stride) ? row[i - stride] : 0;
+                    row[i] = static_cast<uint8_t>(row[i] + ((left + prior[i]) >> 1));
+                }
+                break;
+
+            case 4:
+                for (size_t i{ 0 }; i < rowBytes; ++i)
+                {
+                    const int left = (i >= stride) ? row[i - stride] : 0;
+                    const int upperLeft = (i >= stride) ? prior[i - stride] : 0;
+                    row[i] = static_cast<uint8_t>(row[i] + paethPredictor(left, prior[i], upperLeft));
+                }
+                break;
+
+            default:
+                return PNGManipErrorCode::DecodingError;
+        }
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+PNGManipErrorCode inflateBand(const uint8_t* compressed, size_t length, size_t rowBytes, size_t pixelSize, uint32_t rowCount, std::vector<uint8_t>& rows)
+{
+    const size_t lineBytes = rowBytes + 1;
+
+    // zlib counts its output in uInt, and no band an encoder writes comes near that
+    if (rowCount > std::numeric_limits<uInt>::max() / lineBytes)
+        return PNGManipErrorCode::DecodingError;
+
+    std::vector<uint8_t> filtered;
+
+    try
+    {
+        filtered.resize(static_cast<size_t>(rowCount) * lineBytes);
+        rows.resize(static_cast<size_t>(rowCount) * rowBytes);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return PNGManipErrorCode::MemoryAllocationError;
+    }
+
+    z_stream stream{};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+        return PNGManipErrorCode::MemoryAllocationError;
+
+    stream.next_in = const_cast<Bytef*>(compressed);
+    stream.avail_in = static_cast<uInt>(length);
+    stream.next_out = filtered.data();
+    stream.avail_out = static_cast<uInt>(filtered.size());
+
+    int status{ Z_OK };
+    while (stream.avail_out != 0 && status == Z_OK)
+        status = inflate(&stream, Z_SYNC_FLUSH);
+
+    inflateEnd(&stream);
+
+    if (stream.avail_out != 0)
+        return PNGManipErrorCode::DecodingError;
+
+
+    // A constant stride lets the compiler unroll and vectorize the Sub, Average and Paeth loops
+    switch (pixelSize)
+    {
+        case bytesPerPixel<PixelFormat::Gray8>:  return unfilterRows<bytesPerPixel<PixelFormat::Gray8>>(filtered.data(), rows.data(), rowBytes, pixelSize, rowCount);
+        case bytesPerPixel<PixelFormat::RGB8>:   return unfilterRows<bytesPerPixel<PixelFormat::RGB8>>(filtered.data(), rows.data(), rowBytes, pixelSize, rowCount);
+        case bytesPerPixel<PixelFormat::RGBA8>:  return unfilterRows<bytesPerPixel<PixelFormat::RGBA8>>(filtered.data(), rows.data(), rowBytes, pixelSize, rowCount);
+        case bytesPerPixel<PixelFormat::RGBA16>: return unfilterRows<bytesPerPixel<PixelFormat::RGBA16>>(filtered.data(), rows.data(), rowBytes, pixelSize, rowCount);
+        default:                                 return unfilterRows<0>(filtered.data(), rows.data(), rowBytes, pixelSize, rowCount);
+    }
+}
+
+
+
+PNGManipErrorCode extractRange(const uint8_t* file, const imageLayout_t& layout, size_t bytesPerPixel, uint64_t offset, uint64_t length, std::vector<uint8_t>& out)
+{
+    out.clear();
+
+    if (layout.bands.empty())
+        return PNGManipErrorCode::InvalidFileFormat;
+
+    if (offset > layout.payloadSize || length > layout.payloadSize - offset)
+        return PNGManipErrorCode::DecodingError;
+
+    if (length == 0)
+        return PNGManipErrorCode::Success;
+
+    // Positions in the row byte stream, which starts with the 4-byte size prefix
+    const uint64_t rowBytes = static_cast<uint64_t>(layout.width) * bytesPerPixel;
+    const uint64_t start = sizeof(uint32_t) + offset;
+    const uint64_t end = start + length;
+    const uint64_t lastRow = (end - 1) / rowBytes;
+
+    auto band = std::upper_bound(layout.bands.begin(), layout.bands.end(), start / rowBytes,
+        [](uint64_t row, const band_t& b) { return row < b.firstRow; });
+
+    if (band == layout.bands.begin())
+        return PNGManipErrorCode::DecodingError;
+
+    out.reserve(static_cast<size_t>(length));
+
+    std::vector<uint8_t> scratch, rows;
+
+    for (--band; band != layout.bands.end() && band->firstRow <= lastRow; ++band)
+    {
+        const uint32_t rowsNeeded = static_cast<uint32_t>(std::min<uint64_t>(band->rowCount, lastRow + 1 - band->firstRow));
+
+        const uint8_t* compressed = bandBytes(file, layout, *band, scratch);
+        if (!compressed)
+            return PNGManipErrorCode::DecodingError;
+
+        PNGManipErrorCode result = inflateBand(compressed, band->compressedSize, static_cast<size_t>(rowBytes), bytesPerPixel, rowsNeeded, rows);
+        if (result != PNGManipErrorCode::Success)
+            return result;
+
+        const uint64_t bandStart = band->firstRow * rowBytes;
+        const uint64_t from = std::max(bandStart, start);
+        const uint64_t to = std::min<uint64_t>(bandStart + rows.size(), end);
+
+        // Only an index whose bands overlap or run out of order gets here
+        if (from > to || out.size() + (to - from) > length)
+            return PNGManipErrorCode::DecodingError;
+
+        out.insert(out.end(), rows.begin() + static_cast<ptrdiff_t>(from - bandStart), rows.begin() + static_cast<ptrdiff_t>(to - bandStart));
+    }
+
+    return (out.size() == length) ? PNGManipErrorCode::Success : PNGManipErrorCode::DecodingError;
+}
@@ -0,0 +1,133 @@
+#ifndef _BANDINDEX_H_
+#define _BANDINDEX_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "ErrorHandling.hpp"
+#include "Archive.hpp"
+#include "Checksum.hpp"
+#include "Encryption.hpp"
+#include "PayloadCodec.hpp"
+
+
+// Private, ancillary, not safe to copy: the index describes this exact IDAT layout
+constexpr char bandIndexChunkName[5] = "ifBI";
+constexpr uint8_t bandIndexVersion = 1;
+
+// Private, ancillary, not safe to copy. Every encoder writes it ahead of everything else of
+// ours, so an Imageify PNG can be told from any other without inflating a byte of it
+constexpr char formatChunkName[5] = "ifVR";
+constexpr uint8_t imageFormatVersion = 1;
+
+// Widest and tallest image the decoders take: as much as bitmap_t holds, and more than any
+// encoder writes. Far inside both PNG's 2^31 - 1 and libpng's default user limits
+constexpr uint32_t maxImageSide = UINT16_MAX;
+
+
+
+/**
+* @brief A run of rows deflated independently of the rest of the image.
+*
+* streamOffset and compressedSize locate the band's raw deflate data inside the zlib stream
+* formed by concatenating every IDAT chunk. The first row of a band is always filtered with
+* None or Sub, so it can be inflated and unfiltered without any earlier data.
+*/
+struct band_t
+{
+	uint32_t firstRow;
+	uint32_t rowCount;
+	uint64_t streamOffset;
+	uint64_t compressedSize;
+};
+
+/**
+* @brief Where one IDAT chunk's data sits in the file and in the zlib stream.
+*/
+struct idatSegment_t
+{
+	size_t fileOffset;
+	size_t length;
+	uint64_t streamOffset;
+	uint32_t crc;
+};
+
+/**
+* @brief The chunk layout of a PNG file, as needed to inflate its bands directly.
+*/
+struct imageLayout_t
+{
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+	uint8_t bitDepth{ 0 };
+	uint8_t colorType{ 0 };
+	uint8_t interlace{ 0 };
+
+	std::vector<idatSegment_t> idat;
+	uint64_t streamSize{ 0 };
+
+	// Filled in from the band index, left empty for plain PNGs
+	uint64_t payloadSize{ 0 };
+	std::vector<band_t> bands;
+
+	// Filled in from the ifVR chunk, 0 for images made before it
+	uint8_t formatVersion{ 0 };
+
+	// Filled in from the ifPH chunk, codec None when the payload was stored as is
+	payloadHeader_t payloadHeader{};
+
+	// Filled in from the ifSH chunk, count 0 unless the image is one shard of a set or the final frame of a stream
+	shardHeader_t shard{};
+
+	// Filled in from the ifCK chunk, version 0 for images made before checksums
+	payloadChecksum_t checksum{};
+
+	// Filled in from the ifAR chunk, version 0 unless the image is an archive
+	archiveManifest_t archive{};
+
+	// Filled in from the ifEN chunk, version 0 unless the payload is encrypted
+	encryptionHeader_t encryption{};
+};
+
+
+
+/**
+* @brief Serializes a band index into the payload of an ifBI chunk.
+*/
+std::vector<uint8_t> serializeBandIndex(uint64_t payloadSize, const std::vector<band_t>&);
+
+/**
+* @brief Walks the chunks of an in-memory PNG, recording IHDR, the IDAT segments, the format version, any band index, payload, shard and encryption headers, archive manifest and checksum.
+*        An IHDR with a side of 0 or over maxImageSide, or a bit depth its colour type does not allow, fails the walk.
+*        With an idatLimit the walk stops once that many bytes of IDAT data are recorded, leaving the
+*        chunks after them (the band index among them) unread.
+*/
+PNGManipErrorCode scanImageLayout(const uint8_t*, size_t, imageLayout_t&, uint64_t idatLimit = UINT64_MAX);
+
+/**
+* @brief Checks the CRC of one IDAT segment.
+*/
+bool verifySegment(const uint8_t*, const idatSegment_t&);
+
+/**
+* @brief Returns the compressed bytes of a band, pointing into the file when they sit in one
+*        IDAT chunk and gathering them into the scratch buffer otherwise.
+*/
+const uint8_t* bandBytes(const uint8_t*, const imageLayout_t&, const band_t&, std::vector<uint8_t>&);
+
+/**
+* @brief Inflates and unfilters a band into rowCount rows of rowBytes bytes each.
+*/
+PNGManipErrorCode inflateBand(const uint8_t*, size_t, size_t rowBytes, size_t bytesPerPixel, uint32_t rowCount, std::vector<uint8_t>&);
+
+/**
+* @brief Extracts payload bytes [offset, offset + length) using the band index, inflating
+*        only the bands that overlap the range and stopping each one at the last row needed.
+*/
+PNGManipErrorCode extractRange(const uint8_t*, const imageLayout_t&, size_t bytesPerPixel, uint64_t offset, uint64_t length, std::vector<uint8_t>&);
+
+
+#endif // !_BANDINDEX_H_
@@ -0,0 +1,520 @@
+#include "BitPlane.hpp"
+#include "Platform.hpp"
+
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define IMAGEIFY_BITPLANE_X86
+    #include <immintrin.h>
+#endif
+
+// SSE2 is part of x86-64, AVX2 is only emitted where a function asks for it, as in Checksum.cpp
+#if defined(IMAGEIFY_BITPLANE_X86) && !defined(_MSC_VER)
+    #define IMAGEIFY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define IMAGEIFY_TARGET_AVX2
+#endif
+
+
+
+/**
+* Hidden header ---------------------------------------
+*/
+
+void serializeHiddenHeader(const hiddenHeader_t& header, uint8_t (&out)[hiddenHeaderBytes])
+{
+    memcpy(out, hiddenMagic, sizeof(hiddenMagic));
+
+    out[4] = header.version;
+    out[5] = header.bits;
+    out[6] = 0;
+    out[7] = 0;
+
+    putBE32(out + 8, static_cast<uint32_t>(header.length >> 32));
+    putBE32(out + 12, static_cast<uint32_t>(header.length));
+    putBE32(out + 16, header.crc);
+}
+
+
+
+bool parseHiddenHeader(const uint8_t (&in)[hiddenHeaderBytes], hiddenHeader_t& header)
+{
+    if (memcmp(in, hiddenMagic, sizeof(hiddenMagic)) != 0 || in[4] == 0 || in[4] > hiddenVersion || in[5] < 1 || in[5] > 4)
+        return false;
+
+    header.version = in[4];
+    header.bits = in[5];
+    header.length = (static_cast<uint64_t>(getBE32(in + 8)) << 32) | getBE32(in + 12);
+    header.crc = getBE32(in + 16);
+
+    return true;
+}
+
+
+
+
+/**
+* Scalar ----------------------------------------------
+*
+* A group is Bits bytes of payload, read as one little-endian number, spread over 8 samples.
+*/
+
+template <unsigned Bits>
+static void embedScalar(uint8_t* carriers, const uint8_t* payload, size_t groups)
+{
+    constexpr uint32_t mask = (1u << Bits) - 1;
+
+    for (size_t group{ 0 }; group < groups; ++group, payload += Bits, carriers += 8)
+    {
+        uint32_t value{ 0 };
+        for (unsigned i{ 0 }; i < Bits; ++i)
+            value |= static_cast<uint32_t>(payload[i]) << (8 * i);
+
+        for (unsigned j{ 0 }; j < 8; ++j)
+            carriers[j] = static_cast<uint8_t>((carriers[j] & ~mask) | ((value >> (Bits * j)) & mask));
+    }
+}
+
+
+
+template <unsigned Bits>
+static void extractScalar(const uint8_t* carriers, uint8_t* payload, size_t groups)
+{
+    constexpr uint32_t mask = (1u << Bits) - 1;
+
+    for (size_t group{ 0 }; group < groups; ++group, payload += Bits, carriers += 8)
+    {
+        uint32_t value{ 0 };
+        for (unsigned j{ 0 }; j < 8; ++j)
+            value |= (carriers[j] & mask) << (Bits * j);
+
+        for (unsigned i{ 0 }; i < Bits; ++i)
+            payload[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+}
+
+
+
+
+#ifdef IMAGEIFY_BITPLANE_X86
+
+/**
+* SSE2 ------------------------------------------------
+*
+* Four groups at a time, one per 32-bit lane. Each lane's low 4*Bits bits are spread over
+* the four bytes of one lane and the high ones over another, and unpacking the two puts each
+* group's 8 samples together. SSE2 cannot move bytes between lanes any other way, so only
+* the depths whose groups are whole bytes (1, 2 and 4) have a kernel here.
+*/
+
+// Moves field k of every 32-bit lane (bits k*Bits onwards) to the bottom of byte k
+template <unsigned Bits>
+static inline __m128i spread(__m128i value)
+{
+    const __m128i field = _mm_set1_epi32((1 << Bits) - 1);
+
+    __m128i out = _mm_and_si128(value, field);
+    out = _mm_or_si128(out, _mm_and_si128(_mm_slli_epi32(value, 8 - Bits), _mm_slli_epi32(field, 8)));
+    out = _mm_or_si128(out, _mm_and_si128(_mm_slli_epi32(value, 16 - 2 * Bits), _mm_slli_epi32(field, 16)));
+    out = _mm_or_si128(out, _mm_and_si128(_mm_slli_epi32(value, 24 - 3 * Bits), _mm_slli_epi32(field, 24)));
+
+    return out;
+}
+
+// The inverse, with the carriers already masked to their low bits
+template <unsigned Bits>
+static inline __m128i gather(__m128i carriers)
+{
+    const __m128i field = _mm_set1_epi32((1 << Bits) - 1);
+
+    __m128i out = _mm_and_si128(carriers, field);
+    out = _mm_or_si128(out, _mm_and_si128(_mm_srli_epi32(carriers, 8 - Bits), _mm_slli_epi32(field, Bits)));
+    out = _mm_or_si128(out, _mm_and_si128(_mm_srli_epi32(carriers, 16 - 2 * Bits), _mm_slli_epi32(field, 2 * Bits)));
+    out = _mm_or_si128(out, _mm_and_si128(_mm_srli_epi32(carriers, 24 - 3 * Bits), _mm_slli_epi32(field, 3 * Bits)));
+
+    return out;
+}
+
+
+
+// Four groups, one to a 32-bit lane
+template <unsigned Bits>
+static inline __m128i loadGroups(const uint8_t* payload)
+{
+    const __m128i zero = _mm_setzero_si128();
+
+    if constexpr (Bits == 1)
+    {
+        int32_t bytes;
+        memcpy(&bytes, payload, sizeof(bytes));
+        return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+    }
+    else if constexpr (Bits == 2)
+        return _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(payload)), zero);
+    else
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(payload));
+}
+
+template <unsigned Bits>
+static inline void storeGroups(uint8_t* payload, __m128i groups)
+{
+    if constexpr (Bits == 1)
+    {
+        const __m128i words = _mm_packs_epi32(groups, groups);
+        const __m128i bytes = _mm_packus_epi16(words, words);
+        const int32_t value = _mm_cvtsi128_si32(bytes);
+        memcpy(payload, &value, sizeof(value));
+    }
+    else if constexpr (Bits == 2)
+    {
+        // The low half of every lane, gathered into the low 8 bytes
+        __m128i words = _mm_shufflelo_epi16(groups, _MM_SHUFFLE(3, 3, 2, 0));
+        words = _mm_shufflehi_epi16(words, _MM_SHUFFLE(3, 3, 2, 0));
+        words = _mm_shuffle_epi32(words, _MM_SHUFFLE(3, 3, 2, 0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(payload), words);
+    }
+    else
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(payload), groups);
+}
+
+
+
+template <unsigned Bits>
+static size_t embedSSE2(uint8_t* carriers, const uint8_t* payload, size_t groups)
+{
+    const __m128i keep = _mm_set1_epi8(static_cast<char>(~((1 << Bits) - 1)));
+    size_t done{ 0 };
+
+    for (; done + 4 <= groups; done += 4, payload += 4 * Bits, carriers += 32)
+    {
+        const __m128i value = loadGroups<Bits>(payload);
+
+        const __m128i low = spread<Bits>(value);
+        const __m128i high = spread<Bits>(_mm_srli_epi32(value, 4 * Bits));
+
+        __m128i* out = reinterpret_cast<__m128i*>(carriers);
+        const __m128i first = _mm_and_si128(_mm_loadu_si128(out), keep);
+        const __m128i second = _mm_and_si128(_mm_loadu_si128(out + 1), keep);
+
+        _mm_storeu_si128(out, _mm_or_si128(first, _mm_unpacklo_epi32(low, high)));
+        _mm_storeu_si128(out + 1, _mm_or_si128(second, _mm_unpackhi_epi32(low, high)));
+    }
+
+    return done;
+}
+
+
+
+template <unsigned Bits>
+static size_t extractSSE2(const uint8_t* carriers, uint8_t* payload, size_t groups)
+{
+    const __m128i field = _mm_set1_epi8(static_cast<char>((1 << Bits) - 1));
+    size_t done{ 0 };
+
+    for (; done + 4 <= groups; done += 4, payload += 4 * Bits, carriers += 32)
+    {
+        const __m128 first = _mm_castsi128_ps(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(carriers)), field));
+        const __m128 second = _mm_castsi128_ps(_mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(carriers) + 1), field));
+
+        // The first four samples of each group, then the last four
+        const __m128i low = _mm_castps_si128(_mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i high = _mm_castps_si128(_mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        storeGroups<Bits>(payload, _mm_or_si128(gather<Bits>(low), _mm_slli_epi32(gather<Bits>(high), 4 * Bits)));
+    }
+
+    return done;
+}
+
+
+
+
+/**
+* AVX2 ------------------------------------------------
+*
+* The same, eight groups at a time. A byte shuffle lines up 3-byte groups in their lanes too.
+* Unpacking stays within each 128-bit half, so the halves are swapped into order around it.
+*/
+
+template <unsigned Bits>
+IMAGEIFY_TARGET_AVX2 static inline __m256i spread256(__m256i value)
+{
+    const __m256i field = _mm256_set1_epi32((1 << Bits) - 1);
+
+    __m256i out = _mm256_and_si256(value, field);
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_slli_epi32(value, 8 - Bits), _mm256_slli_epi32(field, 8)));
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_slli_epi32(value, 16 - 2 * Bits), _mm256_slli_epi32(field, 16)));
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_slli_epi32(value, 24 - 3 * Bits), _mm256_slli_epi32(field, 24)));
+
+    return out;
+}
+
+template <unsigned Bits>
+IMAGEIFY_TARGET_AVX2 static inline __m256i gather256(__m256i carriers)
+{
+    const __m256i field = _mm256_set1_epi32((1 << Bits) - 1);
+
+    __m256i out = _mm256_and_si256(carriers, field);
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_srli_epi32(carriers, 8 - Bits), _mm256_slli_epi32(field, Bits)));
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_srli_epi32(carriers, 16 - 2 * Bits), _mm256_slli_epi32(field, 2 * Bits)));
+    out = _mm256_or_si256(out, _mm256_and_si256(_mm256_srli_epi32(carriers, 24 - 3 * Bits), _mm256_slli_epi32(field, 3 * Bits)));
+
+    return out;
+}
+
+
+
+// Eight groups, one to a 32-bit lane
+template <unsigned Bits>
+IMAGEIFY_TARGET_AVX2 static inline __m256i loadGroups256(const uint8_t* payload)
+{
+    if constexpr (Bits == 1)
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(payload)));
+    else if constexpr (Bits == 2)
+        return _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(payload)));
+    else if constexpr (Bits == 3)
+    {
+        // Bytes 0-15 and 8-23, so nothing past the 24 bytes of the groups is read
+        const __m256i bytes = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(payload))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(payload + 8)), 1);
+
+        const __m256i lanes = _mm256_setr_epi8(
+            0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+            4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+
+        return _mm256_shuffle_epi8(bytes, lanes);
+    }
+    else
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(payload));
+}
+
+template <unsigned Bits>
+IMAGEIFY_TARGET_AVX2 static inline void storeGroups256(uint8_t* payload, __m256i groups)
+{
+    if constexpr (Bits == 1)
+    {
+        const __m256i words = _mm256_packus_epi32(groups, groups);
+        const __m256i bytes = _mm256_packus_epi16(words, words);
+        const __m256i ordered = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 4, 0, 4, 0, 4, 0, 4));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(payload), _mm256_castsi256_si128(ordered));
+    }
+    else if constexpr (Bits == 2)
+    {
+        const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(groups, groups), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(payload), _mm256_castsi256_si128(words));
+    }
+    else if constexpr (Bits == 3)
+    {
+        const __m256i lanes = _mm256_setr_epi8(
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+        const __m256i packed = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(groups, lanes), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(payload), _mm256_castsi256_si128(packed));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(payload + 16), _mm256_extracti128_si256(packed, 1));
+    }
+    else
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(payload), groups);
+}
+
+
+
+template <unsigned Bits>
+IMAGEIFY_TARGET_AVX2 static size_t embedAVX2(uint8_t* carriers, const uint8_t* payload, size_t groups)
+{
+    const __m256i keep = _mm256_set1_epi8(static_cast<char>(~((1 << Bits) - 1)));
+    size_t done{ 0 };
+
+    for (; done + 8 <= groups; done += 8, payload += 8 * Bits, carriers += 64)
+    {
+        const __m256i value = loadGroups256<Bits>(payload);
+
+        const __m256i low = spread256<Bits>(value);
+        const __m256i high = spread256<Bits>(_mm256_srli_epi32(value, 4 * Bits));
+
+        // Groups 0, 1 | 4, 5 and 2, 3 | 6, 7
+        const __m256i even = _mm256_unpacklo_epi32(low, high);
+        const __m256i odd = _mm256_unpackhi_epi32(low, high);
+
+        __m256i* out = reinterpret_cast<__m256i*>(carriers);
+        const __m256i first = _mm256_and_si256(_mm256_loadu_si256(out), keep);
+        const __m256i second = _mm256_and_si256(_mm256_loadu_si256(out + 1), keep);
+
+        _mm256_storeu_si256(out, _mm256_or_si256(first, _mm256_permute2x128_si256(even, odd, 0x20)));
+        _mm256_storeu_si256(out + 1, _mm256_or_si256(second, _mm256_permute2x128_si256(even, odd, 0x31)));
+    }
+
+    return done;
+}
+
+
+
+template <unsigned Bits>
+IMAGEIFY_TARGET_AVX2 static size_t extractAVX2(const uint8_t* carriers, uint8_t* payload, size_t groups)
+{
+    const __m256i field = _mm256_set1_epi8(static_cast<char>((1 << Bits) - 1));
+    size_t done{ 0 };
+
+    for (; done + 8 <= groups; done += 8, payload += 8 * Bits, carriers += 64)
+    {
+        const __m256i first = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(carriers)), field);
+        const __m256i second = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(carriers) + 1), field);
+
+        // Back to groups 0, 1 | 4, 5 and 2, 3 | 6, 7, then apart into first and last four samples
+        const __m256 even = _mm256_castsi256_ps(_mm256_permute2x128_si256(first, second, 0x20));
+        const __m256 odd = _mm256_castsi256_ps(_mm256_permute2x128_si256(first, second, 0x31));
+
+        const __m256i low = _mm256_castps_si256(_mm256_shuffle_ps(even, odd, _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m256i high = _mm256_castps_si256(_mm256_shuffle_ps(even, odd, _MM_SHUFFLE(3, 1, 3, 1)));
+
+        storeGroups256<Bits>(payload, _mm256_or_si256(gather256<Bits>(low), _mm256_slli_epi32(gather256<Bits>(high), 4 * Bits)));
+    }
+
+    return done;
+}
+
+#endif
+
+
+/**
+* Dispatch --------------------------------------------
+*/
+
+template <unsigned Bits>
+static void embedGroups(uint8_t* carriers, const uint8_t* payload, size_t groups, [[maybe_unused]] BitPlaneKernel kernel)
+{
+    size_t done{ 0 };
+
+#ifdef IMAGEIFY_BITPLANE_X86
+    if (kernel == BitPlaneKernel::AVX2)
+        done = embedAVX2<Bits>(carriers, payload, groups);
+    else if constexpr (Bits != 3)
+        if (kernel == BitPlaneKernel::SSE2)
+            done = embedSSE2<Bits>(carriers, payload, groups);
+#endif
+
+    embedScalar<Bits>(carriers + 8 * done, payload + Bits * done, groups - done);
+}
+
+template <unsigned Bits>
+static void extractGroups(const uint8_t* carriers, uint8_t* payload, size_t groups, [[maybe_unused]] BitPlaneKernel kernel)
+{
+    size_t done{ 0 };
+
+#ifdef IMAGEIFY_BITPLANE_X86
+    if (kernel == BitPlaneKernel::AVX2)
+        done = extractAVX2<Bits>(carriers, payload, groups);
+    else if constexpr (Bits != 3)
+        if (kernel == BitPlaneKernel::SSE2)
+            done = extractSSE2<Bits>(carriers, payload, groups);
+#endif
+
+    extractScalar<Bits>(carriers + 8 * done, payload + Bits * done, groups - done);
+}
+
+
+
+template <typename Fn>
+static void dispatchBits(unsigned bits, Fn&& fn)
+{
+    switch (bits)
+    {
+        case 1: fn(std::integral_constant<unsigned, 1>{}); break;
+        case 2: fn(std::integral_constant<unsigned, 2>{}); break;
+        case 3: fn(std::integral_constant<unsigned, 3>{}); break;
+        case 4: fn(std::integral_constant<unsigned, 4>{}); break;
+        default: break;
+    }
+}
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+BitPlaneKernel bitPlaneKernel()
+{
+    static const BitPlaneKernel best = cpuHasAVX2() ? BitPlaneKernel::AVX2
+        : bitPlaneKernelSupported(BitPlaneKernel::SSE2) ? BitPlaneKernel::SSE2 : BitPlaneKernel::Scalar;
+
+    return best;
+}
+
+
+
+bool bitPlaneKernelSupported(BitPlaneKernel kernel)
+{
+    switch (kernel)
+    {
+        case BitPlaneKernel::Scalar: return true;
+#ifdef IMAGEIFY_BITPLANE_X86
+        case BitPlaneKernel::SSE2:   return true;
+        case BitPlaneKernel::AVX2:   return cpuHasAVX2();
+#endif
+        default:                     return false;
+    }
+}
+
+
+
+const char* bitPlaneKernelName(BitPlaneKernel kernel)
+{
+    switch (kernel)
+    {
+        case BitPlaneKernel::SSE2: return "sse2";
+        case BitPlaneKernel::AVX2: return "avx2";
+        default:                   return "scalar";
+    }
+}
+
+
+
+void embedBitPlanes(uint8_t* carriers, const uint8_t* payload, size_t bytes, unsigned bits, BitPlaneKernel kernel)
+{
+    if (!bitPlaneKernelSupported(kernel))
+        kernel = BitPlaneKernel::Scalar;
+
+    dispatchBits(bits, [&](auto width)
+    {
+        constexpr unsigned Bits = decltype(width)::value;
+        const size_t groups = bytes / Bits;
+
+        embedGroups<Bits>(carriers, payload, groups, kernel);
+
+        // A short last group goes in padded with zeros
+        if (const size_t rest = bytes % Bits)
+        {
+            uint8_t last[Bits]{};
+            memcpy(last, payload + groups * Bits, rest);
+            embedScalar<Bits>(carriers + groups * 8, last, 1);
+        }
+    });
+}
+
+
+
+void extractBitPlanes(const uint8_t* carriers, uint8_t* payload, size_t bytes, unsigned bits, BitPlaneKernel kernel)
+{
+    if (!bitPlaneKernelSupported(kernel))
+        kernel = BitPlaneKernel::Scalar;
+
+    dispatchBits(bits, [&](auto width)
+    {
+        constexpr unsigned Bits = decltype(width)::value;
+        const size_t groups = bytes / Bits;
+
+        extractGroups<Bits>(carriers, payload, groups, kernel);
+
+        if (const size_t rest = bytes % Bits)
+        {
+            uint8_t last[Bits];
+            extractScalar<Bits>(carriers + groups * 8, last, 1);
+            memcpy(payload + groups * Bits, last, rest);
+        }
+    });
+}
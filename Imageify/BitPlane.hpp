@@ -0,0 +1,92 @@
+#ifndef _BITPLANE_H_
+#define _BITPLANE_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+/**
+* @brief The bit-plane kernels a machine can run, slowest first.
+*/
+enum class BitPlaneKernel : uint8_t
+{
+	Scalar = 0,
+	SSE2,
+	AVX2
+};
+
+
+
+// Header hidden ahead of the payload, one bit per sample so it can be read before the depth is known.
+// Layout: magic, version, bits per sample, 2 reserved bytes, length, CRC-32C
+constexpr char hiddenMagic[4] = { 'i', 'f', 'L', 'S' };
+constexpr uint8_t hiddenVersion = 1;
+constexpr size_t hiddenHeaderBytes = 4 + 4 + 8 + 4;
+
+
+/**
+* @brief What a cover image says about the payload hidden in it.
+*/
+struct hiddenHeader_t
+{
+	// 0 when no header was found
+	uint8_t version{ 0 };
+
+	// Low bits of each sample that carry the payload, 1 to 4
+	uint8_t bits{ 0 };
+
+	uint64_t length{ 0 };
+	uint32_t crc{ 0 };
+};
+
+void serializeHiddenHeader(const hiddenHeader_t&, uint8_t (&out)[hiddenHeaderBytes]);
+
+/**
+* @brief Reads a hidden header. Returns false without the magic, or for a newer version or a bad depth.
+*/
+bool parseHiddenHeader(const uint8_t (&in)[hiddenHeaderBytes], hiddenHeader_t&);
+
+
+
+/**
+* @brief Samples needed to hold the given number of bytes at bits per sample.
+*
+* Every bits bytes of payload fill exactly 8 samples, so the kernels work in groups of
+* that size and a short last group is padded with zeros.
+*/
+constexpr uint64_t carriersFor(uint64_t bytes, unsigned bits)
+{
+	return (bytes + bits - 1) / bits * 8;
+}
+
+/**
+* @brief The fastest kernel this CPU runs.
+*/
+BitPlaneKernel bitPlaneKernel();
+
+/**
+* @brief True if this build and CPU can run the kernel.
+*/
+bool bitPlaneKernelSupported(BitPlaneKernel);
+
+/**
+* @brief "scalar", "sse2" or "avx2".
+*/
+const char* bitPlaneKernelName(BitPlaneKernel);
+
+/**
+* @brief Writes the payload into the low bits of the carrier samples, leaving their other bits alone.
+*        Bits 0 to bits-1 of sample i hold bits i*bits onwards of the payload, least significant first.
+*        SSE2 has no byte shuffle, so it leaves 3 bits per sample to the scalar kernel.
+*/
+void embedBitPlanes(uint8_t* carriers, const uint8_t* payload, size_t bytes, unsigned bits, BitPlaneKernel = bitPlaneKernel());
+
+/**
+* @brief Reads back bytes of payload written by embedBitPlanes() with the same bits per sample.
+*/
+void extractBitPlanes(const uint8_t* carriers, uint8_t* payload, size_t bytes, unsigned bits, BitPlaneKernel = bitPlaneKernel());
+
+
+#endif // !_BITPLANE_H_
@@ -0,0 +1,213 @@
+#ifndef _BYTESINK_H_
+#define _BYTESINK_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cstring>
+#include <new>
+#include <span>
+#include <vector>
+
+
+
+/**
+* @brief Where the codec puts its output bytes.
+*
+* Encoders and the serial decoders only ever append. The banded decoder first asks the sink
+* to resize() itself to the payload size and, if it agrees, writes each band into its slice
+* with writeAt() from several threads at once. An encoder that was not told the payload size
+* appends too, then goes back with writeAt() to the few bytes that depend on it.
+*/
+class ByteSink
+{
+public:
+
+	virtual ~ByteSink() = default;
+
+	/**
+	* @brief Appends the bytes to the output. Returns false if they could not be stored.
+	*/
+	virtual bool write(const uint8_t*, size_t) = 0;
+
+	/**
+	* @brief Sets the final size up front so writeAt() can fill it in any order.
+	*        Sinks that can only append return false.
+	*/
+	virtual bool resize(uint64_t) { return false; }
+
+	/**
+	* @brief Writes the bytes at an offset inside the resized output. Must be safe to call concurrently.
+	*/
+	virtual bool writeAt(uint64_t, const uint8_t*, size_t) { return false; }
+
+	/**
+	* @brief Passes on anything appends left buffered, so writeAt() can reach every byte appended so far.
+	*/
+	virtual bool flush() { return true; }
+};
+
+
+
+/**
+* @brief Collects the output in a caller-owned vector that grows as needed.
+*/
+class VectorSink : public ByteSink
+{
+private:
+
+	std::vector<std::byte>& m_buffer;
+
+public:
+
+	explicit VectorSink(std::vector<std::byte>& buffer) : m_buffer{ buffer } { m_buffer.clear(); }
+
+	bool write(const uint8_t* data, size_t length) override
+	{
+		// Never let bad_alloc unwind through libpng's C frames
+		try
+		{
+			const std::byte* bytes = reinterpret_cast<const std::byte*>(data);
+			m_buffer.insert(m_buffer.end(), bytes, bytes + length);
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	bool resize(uint64_t size) override
+	{
+		try
+		{
+			m_buffer.resize(static_cast<size_t>(size));
+		}
+		catch (const std::bad_alloc&)
+		{
+			return false;
+		}
+
+		return true;
+	}
+
+	bool writeAt(uint64_t offset, const uint8_t* data, size_t length) override
+	{
+		if (offset > m_buffer.size() || length > m_buffer.size() - offset)
+			return false;
+
+		memcpy(m_buffer.data() + offset, data, length);
+		return true;
+	}
+};
+
+
+
+/**
+* @brief Writes the output into a fixed, caller-supplied buffer, failing once it is full.
+*/
+class SpanSink : public ByteSink
+{
+private:
+
+	std::span<std::byte> m_buffer;
+	size_t m_size{ 0 };
+
+public:
+
+	explicit SpanSink(std::span<std::byte> buffer) : m_buffer{ buffer } {}
+
+	bool write(const uint8_t* data, size_t length) override
+	{
+		if (length > m_buffer.size() - m_size)
+			return false;
+
+		memcpy(m_buffer.data() + m_size, data, length);
+		m_size += length;
+		return true;
+	}
+
+	bool resize(uint64_t size) override
+	{
+		if (size > m_buffer.size())
+			return false;
+
+		m_size = static_cast<size_t>(size);
+		return true;
+	}
+
+	bool writeAt(uint64_t offset, const uint8_t* data, size_t length) override
+	{
+		if (offset > m_size || length > m_size - offset)
+			return false;
+
+		memcpy(m_buffer.data() + offset, data, length);
+		return true;
+	}
+
+	/**
+	* @brief Number of bytes of the buffer holding output.
+	*/
+	size_t size() const { return m_size; }
+};
+
+
+
+/**
+* @brief Throws the output away, for decoding an image only to check it.
+*/
+class DiscardSink : public ByteSink
+{
+public:
+
+	bool write(const uint8_t*, size_t) override { return true; }
+	bool resize(uint64_t) override { return true; }
+	bool writeAt(uint64_t, const uint8_t*, size_t) override { return true; }
+};
+
+
+
+/**
+* @brief One slice of another sink that was already resized to hold every slice.
+*
+* Appends and positional writes both land inside [offset, offset + length) of the target,
+* so several codecs can fill their slices of one output at the same time.
+*/
+class SliceSink : public ByteSink
+{
+private:
+
+	ByteSink& m_target;
+	const uint64_t m_offset;
+	const uint64_t m_length;
+	uint64_t m_position{ 0 };
+
+public:
+
+	SliceSink(ByteSink& target, uint64_t offset, uint64_t length) : m_target{ target }, m_offset{ offset }, m_length{ length } {}
+
+	bool write(const uint8_t* data, size_t length) override
+	{
+		if (!writeAt(m_position, data, length))
+			return false;
+
+		m_position += length;
+		return true;
+	}
+
+	// The target is already sized, so only the size of the slice itself is accepted
+	bool resize(uint64_t size) override { return size == m_length; }
+
+	bool writeAt(uint64_t offset, const uint8_t* data, size_t length) override
+	{
+		if (offset > m_length || length > m_length - offset)
+			return false;
+
+		return m_target.writeAt(m_offset + offset, data, length);
+	}
+};
+
+
+#endif // !_BYTESINK_H_
@@ -0,0 +1,107 @@
+#ifndef _BYTESOURCE_H_
+#define _BYTESOURCE_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cstring>
+#include <span>
+
+
+
+/**
+* @brief Where the pipelined encoder reads its input from, front to back.
+*
+* The size has to be known up front: it goes into the size prefix and decides the image
+* geometry before the first byte is read.
+*/
+class ByteSource
+{
+public:
+
+	virtual ~ByteSource() = default;
+
+	/**
+	* @brief Total number of bytes the source will deliver.
+	*/
+	virtual uint64_t size() const = 0;
+
+	/**
+	* @brief Reads exactly the requested number of bytes. Returns false on a short read or an error.
+	*/
+	virtual bool read(uint8_t*, size_t) = 0;
+
+	/**
+	* @brief Copies the first bytes of the source without consuming them, for sampling.
+	*        Sources that cannot look ahead return false.
+	*/
+	virtual bool peek(uint8_t*, size_t) { return false; }
+};
+
+
+
+/**
+* @brief A source read front to back whose size is only known once it ends, such as a pipe.
+*/
+class StreamSource
+{
+public:
+
+	virtual ~StreamSource() = default;
+
+	/**
+	* @brief Fills the buffer unless the source ends first, returning the bytes read.
+	*/
+	virtual size_t read(uint8_t*, size_t) = 0;
+
+	/**
+	* @brief True once a read stopped on an error rather than at the end.
+	*/
+	virtual bool failed() const = 0;
+};
+
+
+
+/**
+* @brief Reads from a buffer already in memory.
+*/
+class SpanSource : public ByteSource
+{
+private:
+
+	std::span<const std::byte> m_buffer;
+	size_t m_position{ 0 };
+
+public:
+
+	explicit SpanSource(std::span<const std::byte> buffer) : m_buffer{ buffer } {}
+
+	uint64_t size() const override { return m_buffer.size(); }
+
+	bool read(uint8_t* out, size_t length) override
+	{
+		if (length > m_buffer.size() - m_position)
+			return false;
+
+		if (length)
+			memcpy(out, m_buffer.data() + m_position, length);
+
+		m_position += length;
+		return true;
+	}
+
+	bool peek(uint8_t* out, size_t length) override
+	{
+		if (length > m_buffer.size())
+			return false;
+
+		if (length)
+			memcpy(out, m_buffer.data(), length);
+
+		return true;
+	}
+};
+
+
+#endif // !_BYTESOURCE_H_
@@ -0,0 +1,358 @@
+#include "Checksum.hpp"
+#include "Platform.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define IMAGEIFY_CRC32C_SSE42
+    #include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+    #define IMAGEIFY_CRC32C_ARMV8
+    #include <arm_acle.h>
+#endif
+
+// GCC and Clang only emit SSE 4.2 where a function asks for it, so the rest of the build
+// still runs on any x86-64
+#if defined(IMAGEIFY_CRC32C_SSE42) && !defined(_MSC_VER)
+    #define IMAGEIFY_TARGET_SSE42 __attribute__((target("sse4.2")))
+#else
+    #define IMAGEIFY_TARGET_SSE42
+#endif
+
+
+
+// Reflected Castagnoli polynomial
+static constexpr uint32_t castagnoli = 0x82F63B78;
+
+// Layout: version, 3 reserved bytes, length, CRC-32C
+static constexpr size_t checksumBytes = 4 + 8 + 4;
+
+// The hardware paths run three independent CRCs over neighbouring lanes of this many bytes,
+// hiding the latency of the crc32 instruction, and fold them together afterwards
+static constexpr size_t laneBytes = 8 * 1024;
+
+
+/**
+* GF(2) arithmetic on CRC registers, as in zlib's crc32_combine ---------------
+*/
+
+// a * b modulo the polynomial, both reflected
+static uint32_t multModP(uint32_t a, uint32_t b)
+{
+    uint32_t m = 1u << 31, p{ 0 };
+
+    for (;;)
+    {
+        if (a & m)
+        {
+            p ^= b;
+
+            if ((a & (m - 1)) == 0)
+                break;
+        }
+
+        m >>= 1;
+        b = (b & 1) ? (b >> 1) ^ castagnoli : b >> 1;
+    }
+
+    return p;
+}
+
+// x^(2^k) modulo the polynomial, for k up to 31
+static const std::array<uint32_t, 32>& powerTable()
+{
+    static const std::array<uint32_t, 32> table = []()
+    {
+        std::array<uint32_t, 32> powers{};
+        uint32_t p = 1u << 30; // x^1
+
+        powers[0] = p;
+        for (size_t k{ 1 }; k < powers.size(); ++k)
+            powers[k] = p = multModP(p, p);
+
+        return powers;
+    }();
+
+    return table;
+}
+
+// x^(8 * bytes), the operator that moves a CRC register past that many zero bytes
+static uint32_t shiftOperator(uint64_t bytes)
+{
+    const std::array<uint32_t, 32>& powers = powerTable();
+
+    uint32_t p = 1u << 31; // x^0
+    unsigned k{ 3 };
+
+    for (; bytes; bytes >>= 1, ++k)
+        if (bytes & 1)
+            p = multModP(powers[k & 31], p);
+
+    return p;
+}
+
+
+
+
+/**
+* Implementations --------------------------------------------------------------
+*/
+
+// Slicing-by-8, for CPUs without a CRC instruction
+static uint32_t crc32cTable(uint32_t crc, const uint8_t* data, size_t length)
+{
+    static const auto tables = []()
+    {
+        std::array<std::array<uint32_t, 256>, 8> t{};
+
+        for (uint32_t n{ 0 }; n < 256; ++n)
+        {
+            uint32_t c = n;
+            for (int bit{ 0 }; bit < 8; ++bit)
+                c = (c & 1) ? (c >> 1) ^ castagnoli : c >> 1;
+
+            t[0][n] = c;
+        }
+
+        for (size_t s{ 1 }; s < t.size(); ++s)
+            for (uint32_t n{ 0 }; n < 256; ++n)
+                t[s][n] = (t[s - 1][n] >> 8) ^ t[0][t[s - 1][n] & 0xFF];
+
+        return t;
+    }();
+
+    while (length >= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        word ^= crc;
+
+        crc = tables[7][word & 0xFF] ^ tables[6][(word >> 8) & 0xFF] ^ tables[5][(word >> 16) & 0xFF] ^ tables[4][(word >> 24) & 0xFF]
+            ^ tables[3][(word >> 32) & 0xFF] ^ tables[2][(word >> 40) & 0xFF] ^ tables[1][(word >> 48) & 0xFF] ^ tables[0][word >> 56];
+
+        data += 8;
+        length -= 8;
+    }
+
+    while (length--)
+        crc = (crc >> 8) ^ tables[0][(crc ^ *data++) & 0xFF];
+
+    return crc;
+}
+
+
+#if defined(IMAGEIFY_CRC32C_SSE42) || defined(IMAGEIFY_CRC32C_ARMV8)
+
+#ifdef IMAGEIFY_CRC32C_SSE42
+    #define CRC32C_U8(crc, byte)  _mm_crc32_u8(crc, byte)
+    #define CRC32C_U64(crc, word) static_cast<uint32_t>(_mm_crc32_u64(crc, word))
+#else
+    #define CRC32C_U8(crc, byte)  __crc32cb(crc, byte)
+    #define CRC32C_U64(crc, word) __crc32cd(crc, word)
+#endif
+
+IMAGEIFY_TARGET_SSE42 static uint32_t crc32cHardware(uint32_t crc, const uint8_t* data, size_t length)
+{
+    // Multiplying by these moves a lane's CRC past one or two lanes that follow it
+    static const uint32_t shiftOne = shiftOperator(laneBytes);
+    static const uint32_t shiftTwo = shiftOperator(2 * laneBytes);
+
+    while (length && (reinterpret_cast<uintptr_t>(data) & 7))
+    {
+        crc = CRC32C_U8(crc, *data++);
+        --length;
+    }
+
+    while (length >= 3 * laneBytes)
+    {
+        uint32_t crcA = crc, crcB{ 0 }, crcC{ 0 };
+
+        for (size_t i{ 0 }; i < laneBytes; i += 8)
+        {
+            uint64_t a, b, c;
+            memcpy(&a, data + i, 8);
+            memcpy(&b, data + laneBytes + i, 8);
+            memcpy(&c, data + 2 * laneBytes + i, 8);
+
+            crcA = CRC32C_U64(crcA, a);
+            crcB = CRC32C_U64(crcB, b);
+            crcC = CRC32C_U64(crcC, c);
+        }
+
+        crc = multModP(shiftTwo, crcA) ^ multModP(shiftOne, crcB) ^ crcC;
+
+        data += 3 * laneBytes;
+        length -= 3 * laneBytes;
+    }
+
+    for (; length >= 8; data += 8, length -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = CRC32C_U64(crc, word);
+    }
+
+    while (length--)
+        crc = CRC32C_U8(crc, *data++);
+
+    return crc;
+}
+
+#endif
+
+
+static bool hardwareSupported()
+{
+#if defined(IMAGEIFY_CRC32C_SSE42)
+    return cpuHasSSE42();
+#elif defined(IMAGEIFY_CRC32C_ARMV8)
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+uint32_t crc32c(uint32_t crc, const uint8_t* data, size_t length)
+{
+    [[maybe_unused]] static const bool hardware = hardwareSupported();
+
+    crc = ~crc;
+
+#if defined(IMAGEIFY_CRC32C_SSE42) || defined(IMAGEIFY_CRC32C_ARMV8)
+    if (hardware)
+        return ~crc32cHardware(crc, data, length);
+#endif
+
+    return ~crc32cTable(crc, data, length);
+}
+
+
+
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t lengthB)
+{
+    return multModP(shiftOperator(lengthB), crcA) ^ crcB;
+}
+
+
+
+const char* crc32cImplementation()
+{
+    if (!hardwareSupported())
+        return "table";
+
+#if defined(IMAGEIFY_CRC32C_SSE42)
+    return "sse4.2";
+#else
+    return "armv8";
+#endif
+}
+
+
+
+std::vector<uint8_t> serializeChecksum(const payloadChecksum_t& checksum)
+{
+    std::vector<uint8_t> out;
+    out.reserve(checksumBytes);
+
+    out.push_back(checksum.version);
+    out.insert(out.end(), 3, 0x00);
+    putBE64(out, checksum.length);
+    putBE32(out, checksum.crc);
+
+    return out;
+}
+
+
+
+bool parseChecksum(const uint8_t* data, size_t length, payloadChecksum_t& checksum)
+{
+    if (length < checksumBytes || data[0] == 0 || data[0] > checksumVersion)
+        return false;
+
+    checksum.version = data[0];
+    checksum.length  = getBE64(data + 4);
+    checksum.crc     = getBE32(data + 12);
+
+    return true;
+}
+
+
+
+
+/**
+* ChecksumSink ---------------------------------------
+*/
+
+void ChecksumSink::record(uint64_t offset, const uint8_t* data, size_t length)
+{
+    const auto started = m_stats.start();
+    const uint32_t crc = crc32c(0, data, length);
+    m_stats.stop(CodecStage::Checksum, started, length);
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_regions.push_back({ offset, length, crc });
+}
+
+
+
+bool ChecksumSink::write(const uint8_t* data, size_t length)
+{
+    if (!m_sink.write(data, length))
+        return false;
+
+    // Appends come in order from one thread and keep extending the same region
+    if (!m_regions.empty() && m_regions.back().offset + m_regions.back().length == m_position)
+    {
+        const auto started = m_stats.start();
+        m_regions.back().crc = crc32c(m_regions.back().crc, data, length);
+        m_regions.back().length += length;
+        m_stats.stop(CodecStage::Checksum, started, length);
+    }
+    else
+        record(m_position, data, length);
+
+    m_position += length;
+    return true;
+}
+
+
+
+bool ChecksumSink::writeAt(uint64_t offset, const uint8_t* data, size_t length)
+{
+    if (!m_sink.writeAt(offset, data, length))
+        return false;
+
+    record(offset, data, length);
+    return true;
+}
+
+
+
+bool ChecksumSink::result(payloadChecksum_t& checksum)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    std::sort(m_regions.begin(), m_regions.end(), [](const region_t& a, const region_t& b) { return a.offset < b.offset; });
+
+    checksum = payloadChecksum_t{ checksumVersion };
+
+    for (const region_t& region : m_regions)
+    {
+        if (region.offset != checksum.length)
+            return false;
+
+        checksum.crc = crc32cCombine(checksum.crc, region.crc, region.length);
+        checksum.length += region.length;
+    }
+
+    return true;
+}
@@ -0,0 +1,110 @@
+#ifndef _CHECKSUM_H_
+#define _CHECKSUM_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <mutex>
+#include <vector>
+
+#include "ByteSink.hpp"
+#include "CodecStats.hpp"
+
+
+// Private, ancillary, not safe to copy. Written after the image data, so encoders can
+// checksum the payload as they go
+constexpr char checksumChunkName[5] = "ifCK";
+constexpr uint8_t checksumVersion = 1;
+
+
+
+/**
+* @brief The CRC-32C of the bytes stored in the pixels, kept in an ifCK chunk.
+*
+* PNG's own CRCs only cover each chunk as written. This one covers the payload end to end:
+* packed, filtered, deflated, inflated and unpacked again. For a pre-compressed payload it
+* covers the compressed bytes, and the ifPH checksum the original ones.
+*/
+struct payloadChecksum_t
+{
+	// 0 when the image carries no checksum
+	uint8_t version{ 0 };
+
+	uint64_t length{ 0 };
+	uint32_t crc{ 0 };
+};
+
+
+
+/**
+* @brief Continues a CRC-32C (Castagnoli) over more bytes, starting from 0, the way zlib's crc32() does.
+*        Uses the SSE 4.2 or ARMv8 CRC instructions where the CPU has them.
+*/
+uint32_t crc32c(uint32_t crc, const uint8_t*, size_t);
+
+/**
+* @brief The CRC-32C of A followed by B, from the CRCs of A and B and the length of B.
+*/
+uint32_t crc32cCombine(uint32_t crcA, uint32_t crcB, uint64_t lengthB);
+
+/**
+* @brief Which crc32c() implementation this machine runs: "sse4.2", "armv8" or "table".
+*/
+const char* crc32cImplementation();
+
+/**
+* @brief Serializes a checksum into the payload of an ifCK chunk.
+*/
+std::vector<uint8_t> serializeChecksum(const payloadChecksum_t&);
+
+/**
+* @brief Reads an ifCK chunk. Returns false if it is truncated or from a newer version.
+*/
+bool parseChecksum(const uint8_t*, size_t, payloadChecksum_t&);
+
+
+
+/**
+* @brief Passes the output through to another sink, checksumming it on the way.
+*
+* Appends extend one running CRC. Positional writes may land in any order and from several
+* threads, so each is checksummed on its own thread and the pieces are combined in offset
+* order at the end.
+*/
+class ChecksumSink : public ByteSink
+{
+private:
+
+	struct region_t
+	{
+		uint64_t offset;
+		uint64_t length;
+		uint32_t crc;
+	};
+
+	ByteSink& m_sink;
+	CodecStats& m_stats;
+
+	std::mutex m_lock;
+	std::vector<region_t> m_regions;
+	uint64_t m_position{ 0 };
+
+	void record(uint64_t offset, const uint8_t*, size_t);
+
+public:
+
+	ChecksumSink(ByteSink& sink, CodecStats& stats) : m_sink{ sink }, m_stats{ stats } {}
+
+	bool write(const uint8_t*, size_t) override;
+	bool resize(uint64_t size) override { return m_sink.resize(size); }
+	bool writeAt(uint64_t, const uint8_t*, size_t) override;
+
+	/**
+	* @brief The CRC-32C of everything written. False if the writes left a gap or overlapped.
+	*/
+	bool result(payloadChecksum_t&);
+};
+
+
+#endif // !_CHECKSUM_H_
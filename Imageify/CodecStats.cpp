@@ -0,0 +1,195 @@
+#include "CodecStats.hpp"
+
+#include <iomanip>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+
+
+const char* stageName(CodecStage stage)
+{
+    switch (stage)
+    {
+        case CodecStage::Read: return "read";
+
+        case CodecStage::Precompress: return "precompress";
+
+        case CodecStage::Pack: return "pack";
+
+        case CodecStage::Filter: return "filter";
+
+        case CodecStage::Deflate: return "deflate";
+
+        case CodecStage::Inflate: return "inflate";
+
+        case CodecStage::Unpack: return "unpack";
+
+        case CodecStage::Decompress: return "decompress";
+
+        case CodecStage::Checksum: return "checksum";
+
+        case CodecStage::Encrypt: return "encrypt";
+
+        case CodecStage::Decrypt: return "decrypt";
+
+        case CodecStage::Write: return "write";
+
+        default: return "unknown";
+    }
+}
+
+
+
+void CodecStats::reset()
+{
+    for (counter_t& counter : m_stages)
+    {
+        counter.nanoseconds.store(0, std::memory_order_relaxed);
+        counter.bytes.store(0, std::memory_order_relaxed);
+        counter.calls.store(0, std::memory_order_relaxed);
+    }
+}
+
+
+
+void CodecStats::add(CodecStage stage, uint64_t nanoseconds, uint64_t bytes)
+{
+    if (!m_enabled)
+        return;
+
+    counter_t& counter = m_stages[static_cast<size_t>(stage)];
+
+    counter.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counter.calls.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+
+void CodecStats::merge(const CodecStats& other)
+{
+    if (!m_enabled)
+        return;
+
+    for (size_t s{ 0 }; s < codecStageCount; ++s)
+    {
+        const stageTotals_t stage = other.totals(static_cast<CodecStage>(s));
+
+        m_stages[s].nanoseconds.fetch_add(stage.nanoseconds, std::memory_order_relaxed);
+        m_stages[s].bytes.fetch_add(stage.bytes, std::memory_order_relaxed);
+        m_stages[s].calls.fetch_add(stage.calls, std::memory_order_relaxed);
+    }
+}
+
+
+
+stageTotals_t CodecStats::totals(CodecStage stage) const
+{
+    const counter_t& counter = m_stages[static_cast<size_t>(stage)];
+
+    return {
+        counter.nanoseconds.load(std::memory_order_relaxed),
+        counter.bytes.load(std::memory_order_relaxed),
+        counter.calls.load(std::memory_order_relaxed)
+    };
+}
+
+
+
+
+uint64_t peakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return counters.PeakWorkingSetSize;
+#else
+    rusage usage{};
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+
+    // Linux reports kilobytes, macOS bytes
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+
+
+
+// Input paths are the only free-form strings in the output
+static void writeJSONString(std::ostream& out, const std::string& text)
+{
+    out << '"';
+
+    for (const unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c < 0x20)
+            out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<unsigned>(c) << std::dec << std::setfill(' ');
+        else
+            out << c;
+    }
+
+    out << '"';
+}
+
+static double megabytesPerSecond(uint64_t bytes, double seconds)
+{
+    return (seconds > 0.0) ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+}
+
+
+
+void writeStatsJSON(std::ostream& out, const std::string& operation, const std::string& input, const CodecStats& stats, double wallSeconds, uint64_t payloadBytes)
+{
+    const auto flags = out.flags();
+    const auto precision = out.precision();
+
+    out << std::fixed << std::setprecision(6);
+
+    for (size_t s{ 0 }; s < codecStageCount; ++s)
+    {
+        const stageTotals_t stage = stats.totals(static_cast<CodecStage>(s));
+
+        if (stage.calls == 0)
+            continue;
+
+        const double seconds = stage.nanoseconds / 1e9;
+
+        out << "{\"event\":\"stage\",\"operation\":\"" << operation << "\",\"input\":";
+        writeJSONString(out, input);
+        out << ",\"stage\":\"" << stageName(static_cast<CodecStage>(s)) << "\""
+            << ",\"seconds\":" << seconds
+            << ",\"bytes\":" << stage.bytes
+            << ",\"calls\":" << stage.calls
+            << ",\"mb_per_s\":" << megabytesPerSecond(stage.bytes, seconds)
+            << "}\n";
+    }
+
+    out << "{\"event\":\"run\",\"operation\":\"" << operation << "\",\"input\":";
+    writeJSONString(out, input);
+    out << ",\"seconds\":" << wallSeconds
+        << ",\"bytes\":" << payloadBytes
+        << ",\"mb_per_s\":" << megabytesPerSecond(payloadBytes, wallSeconds)
+        << ",\"peak_rss_bytes\":" << peakResidentBytes()
+        << "}" << std::endl;
+
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,196 @@
+#ifndef _CODECSTATS_H_
+#define _CODECSTATS_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+#include "ByteSink.hpp"
+
+
+
+/**
+* @brief The stages an encode or decode is broken into for --stats.
+*
+* Filter is only reported where it runs as a pass of its own, the pipeline's packing stage.
+* libpng filters inside its deflate and unfilters inside its inflate, and the parallel
+* deflater writes the None filter byte while packing each row, so those paths count it
+* under Deflate, Inflate or Pack instead. Precompress and Decompress only show up for
+* payloads run through a PayloadCodec.
+*/
+enum class CodecStage : uint8_t
+{
+	Read = 0,
+	Precompress,
+	Pack,
+	Filter,
+	Deflate,
+	Inflate,
+	Unpack,
+	Decompress,
+	Checksum,
+	Encrypt,
+	Decrypt,
+	Write,
+	Count
+};
+
+constexpr size_t codecStageCount = static_cast<size_t>(CodecStage::Count);
+
+/**
+* @brief Name of a stage as it appears in the JSON output.
+*/
+const char* stageName(CodecStage);
+
+
+/**
+* @brief Time and bytes recorded for one stage.
+*/
+struct stageTotals_t
+{
+	uint64_t nanoseconds{ 0 };
+	uint64_t bytes{ 0 };
+	uint64_t calls{ 0 };
+};
+
+
+
+/**
+* @brief Per-stage timing for one codec call, filled in only when --stats is on.
+*
+* Stages may be recorded from several threads at once. Time is summed over every thread
+* that worked on a stage, so on the parallel paths a stage can add up to more than the wall
+* time of the whole call. When disabled, start() returns without reading the clock and
+* stop() returns on its first branch, so the hot paths pay one predictable branch each.
+*/
+class CodecStats
+{
+public:
+
+	using clock = std::chrono::steady_clock;
+
+private:
+
+	struct counter_t
+	{
+		std::atomic<uint64_t> nanoseconds{ 0 };
+		std::atomic<uint64_t> bytes{ 0 };
+		std::atomic<uint64_t> calls{ 0 };
+	};
+
+	bool m_enabled{ false };
+	std::array<counter_t, codecStageCount> m_stages;
+
+public:
+
+	explicit CodecStats(bool enabled = false) : m_enabled{ enabled } {}
+
+	CodecStats(const CodecStats&) = delete;
+	CodecStats& operator=(const CodecStats&) = delete;
+
+	bool enabled() const { return m_enabled; }
+
+	/**
+	* @brief Clears every stage, ready for the next call.
+	*/
+	void reset();
+
+	/**
+	* @brief Reads the clock, or returns a zero time point when disabled.
+	*/
+	clock::time_point start() const { return m_enabled ? clock::now() : clock::time_point{}; }
+
+	/**
+	* @brief Nanoseconds since start, 0 when disabled.
+	*/
+	uint64_t elapsed(clock::time_point started) const
+	{
+		if (!m_enabled)
+			return 0;
+
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - started).count());
+	}
+
+	/**
+	* @brief Adds the time since start, less any time already counted under a nested stage, to a stage.
+	*/
+	void stop(CodecStage stage, clock::time_point started, uint64_t bytes, uint64_t excludedNanoseconds = 0)
+	{
+		if (!m_enabled)
+			return;
+
+		const uint64_t nanoseconds = elapsed(started);
+		add(stage, nanoseconds > excludedNanoseconds ? nanoseconds - excludedNanoseconds : 0, bytes);
+	}
+
+	void add(CodecStage, uint64_t nanoseconds, uint64_t bytes);
+
+	/**
+	* @brief Adds every stage of another collector to this one, e.g. to total a batch.
+	*/
+	void merge(const CodecStats&);
+
+	stageTotals_t totals(CodecStage) const;
+};
+
+
+
+/**
+* @brief Forwards to another sink, recording every write under the Write stage.
+*/
+class StatsSink : public ByteSink
+{
+private:
+
+	ByteSink& m_sink;
+	CodecStats& m_stats;
+
+public:
+
+	StatsSink(ByteSink& sink, CodecStats& stats) : m_sink{ sink }, m_stats{ stats } {}
+
+	bool write(const uint8_t* data, size_t length) override
+	{
+		const auto started = m_stats.start();
+		const bool ok = m_sink.write(data, length);
+		m_stats.stop(CodecStage::Write, started, length);
+
+		return ok;
+	}
+
+	bool resize(uint64_t size) override { return m_sink.resize(size); }
+
+	bool writeAt(uint64_t offset, const uint8_t* data, size_t length) override
+	{
+		const auto started = m_stats.start();
+		const bool ok = m_sink.writeAt(offset, data, length);
+		m_stats.stop(CodecStage::Write, started, length);
+
+		return ok;
+	}
+
+	bool flush() override { return m_sink.flush(); }
+};
+
+
+
+/**
+* @brief Peak resident set size of the process so far, in bytes, or 0 where it cannot be read.
+*/
+uint64_t peakResidentBytes();
+
+/**
+* @brief Writes one JSON object per recorded stage, then a summary of the whole run, one per line.
+*
+* The summary carries the wall time, the payload bytes, MB/s and the process's peak RSS.
+*/
+void writeStatsJSON(std::ostream&, const std::string& operation, const std::string& input, const CodecStats&, double wallSeconds, uint64_t payloadBytes);
+
+
+#endif // !_CODECSTATS_H_
@@ -0,0 +1,106 @@
+#include "CompressionProfile.hpp"
+
+#include <array>
+#include <cmath>
+
+#include <png.h>
+#include <zlib.h>
+
+
+
+bool parseCompressionProfile(const std::string& name, CompressionProfile& profile)
+{
+    if (name == "fastest")
+        profile = CompressionProfile::Fastest;
+    else if (name == "balanced")
+        profile = CompressionProfile::Balanced;
+    else if (name == "smallest")
+        profile = CompressionProfile::Smallest;
+    else if (name == "auto")
+        profile = CompressionProfile::Auto;
+    else
+        return false;
+
+    return true;
+}
+
+
+
+const char* profileName(CompressionProfile profile)
+{
+    switch (profile)
+    {
+        case CompressionProfile::Default: return "default";
+
+        case CompressionProfile::Fastest: return "fastest";
+
+        case CompressionProfile::Balanced: return "balanced";
+
+        case CompressionProfile::Smallest: return "smallest";
+
+        case CompressionProfile::Auto: return "auto";
+
+        default: return "unknown";
+    }
+}
+
+
+
+double estimateEntropy(const uint8_t* data, size_t size)
+{
+    if (size == 0)
+        return 0.0;
+
+    std::array<size_t, 256> counts{};
+    for (size_t i{ 0 }; i < size; ++i)
+        ++counts[data[i]];
+
+    double entropy{ 0.0 };
+    for (const size_t count : counts)
+    {
+        if (count == 0)
+            continue;
+
+        const double p = static_cast<double>(count) / size;
+        entropy -= p * std::log2(p);
+    }
+
+    return entropy;
+}
+
+
+
+compressionSettings_t profileSettings(CompressionProfile profile, int level)
+{
+    switch (profile)
+    {
+        case CompressionProfile::Fastest:
+            return { 1, Z_DEFAULT_STRATEGY, 8, PNG_FILTER_NONE };
+
+        case CompressionProfile::Smallest:
+            return { 9, Z_DEFAULT_STRATEGY, 9, PNG_FILTER_NONE };
+
+        case CompressionProfile::Balanced:
+        case CompressionProfile::Auto:
+            return { 6, Z_DEFAULT_STRATEGY, 8, PNG_FILTER_NONE };
+
+        default:
+            return { level, Z_DEFAULT_STRATEGY, 8, PNG_ALL_FILTERS };
+    }
+}
+
+
+
+compressionSettings_t autoSettings(double entropy)
+{
+    // Stored deflate blocks, the PNG stays valid and costs little more than a copy
+    if (entropy >= 7.5)
+        return { 0, Z_DEFAULT_STRATEGY, 8, PNG_FILTER_NONE };
+
+    // Skewed byte frequencies but few repeats worth searching for
+    if (entropy >= 6.0)
+        return { 1, Z_HUFFMAN_ONLY, 8, PNG_FILTER_NONE };
+
+    // Compressible: level 1 already gets most of the gain at several times the speed of level 6
+    return profileSettings(CompressionProfile::Fastest, Z_DEFAULT_COMPRESSION);
+}
@@ -0,0 +1,77 @@
+#ifndef _COMPRESSIONPROFILE_H_
+#define _COMPRESSIONPROFILE_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+
+
+/**
+* @brief Presets for how hard the encoders compress, chosen with --profile.
+*
+* Default keeps the behaviour from before profiles existed: the configured zlib level and,
+* on the libpng paths, libpng's adaptive row filtering. The presets filter every row with
+* None, which suits byte streams far better than filters designed for photographs.
+*/
+enum class CompressionProfile
+{
+	Default = 0,
+	Fastest,
+	Balanced,
+	Smallest,
+	Auto
+};
+
+
+/**
+* @brief zlib and PNG filter settings every encoder applies.
+*/
+struct compressionSettings_t
+{
+	int level;
+	int strategy;
+	int memLevel;
+
+	// PNG_FILTER_* flags offered to libpng; the parallel and pipelined encoders always use None
+	int filters;
+};
+
+
+
+/**
+* @brief Parses fastest, balanced, smallest or auto. Returns false for anything else.
+*/
+bool parseCompressionProfile(const std::string&, CompressionProfile&);
+
+const char* profileName(CompressionProfile);
+
+/**
+* @brief Order-0 Shannon entropy of the bytes, in bits per byte (0 to 8).
+*/
+double estimateEntropy(const uint8_t*, size_t);
+
+/**
+* @brief Settings for a fixed profile. Default uses the given level, Auto without a sample resolves to Balanced.
+*/
+compressionSettings_t profileSettings(CompressionProfile, int level);
+
+/**
+* @brief Picks the cheapest settings that still pay off, given the entropy of a payload sample.
+*
+* Near-random samples (7.5 bits per byte or more, e.g. ciphertext or already compressed
+* data) are stored without compression, since deflate cannot shrink them and costs the
+* most time on exactly that kind of data. Samples of 6 bits per byte or more get Huffman
+* coding only. Everything else gets the Fastest settings.
+*/
+compressionSettings_t autoSettings(double bitsPerByte);
+
+/**
+* @brief Payload bytes the auto profile looks at.
+*/
+constexpr size_t autoSampleBytes = 64 * 1024;
+
+
+#endif // !_COMPRESSIONPROFILE_H_
@@ -0,0 +1,285 @@
+#include "EncodePipeline.hpp"
+#include "Checksum.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <thread>
+
+
+
+EncodePipeline::EncodePipeline(CodecStats& stats, const compressionSettings_t& compression, size_t queueDepth, size_t bandBytes) :
+    m_stats{ stats },
+    m_queueDepth{ std::max<size_t>(1, queueDepth) },
+    m_bandBytes{ std::max<size_t>(1, bandBytes) },
+    m_compression{ compression }
+{
+}
+
+
+
+// Reuses a buffer sent back from downstream when there is one
+EncodePipeline::piece_t EncodePipeline::takeSpent(PieceQueue& spent)
+{
+    piece_t piece;
+    spent.tryPop(piece);
+
+    piece.last = false;
+    piece.failed = false;
+
+    return piece;
+}
+
+
+
+void EncodePipeline::readStage(ByteSource& source, uint32_t payloadSize, size_t rowBytes, size_t rowCount, PieceQueue& output, PieceQueue& spent, uint32_t& checksum) const
+{
+    const size_t rowsPerBand = std::max<size_t>(1, m_bandBytes / rowBytes);
+
+    // Position in the size prefix + payload byte stream
+    uint64_t position{ 0 };
+
+    for (size_t row{ 0 }; row < rowCount; row += rowsPerBand)
+    {
+        piece_t piece = takeSpent(spent);
+        piece.last = (row + rowsPerBand >= rowCount);
+
+        try
+        {
+            piece.data.resize(std::min(rowsPerBand, rowCount - row) * rowBytes);
+        }
+        catch (const std::bad_alloc&)
+        {
+            piece.failed = piece.last = true;
+            output.push(std::move(piece));
+            return;
+        }
+
+        auto started = m_stats.start();
+        size_t filled{ 0 };
+
+        if (position < sizeof(uint32_t))
+        {
+            filled = std::min<size_t>(sizeof(uint32_t) - position, piece.data.size());
+            memcpy(piece.data.data(), reinterpret_cast<const uint8_t*>(&payloadSize) + position, filled);
+        }
+
+        const uint64_t payloadOffset = position + filled - sizeof(uint32_t);
+        if (payloadOffset < payloadSize)
+        {
+            const size_t toRead = static_cast<size_t>(std::min<uint64_t>(piece.data.size() - filled, payloadSize - payloadOffset));
+
+            m_stats.stop(CodecStage::Pack, started, filled);
+            started = m_stats.start();
+
+            if (!source.read(piece.data.data() + filled, toRead))
+            {
+                piece.failed = piece.last = true;
+                output.push(std::move(piece));
+                return;
+            }
+
+            m_stats.stop(CodecStage::Read, started, toRead);
+            started = m_stats.start();
+
+            // Still in cache from the read
+            checksum = crc32c(checksum, piece.data.data() + filled, toRead);
+            m_stats.stop(CodecStage::Checksum, started, toRead);
+            started = m_stats.start();
+
+            filled += toRead;
+        }
+
+        // The size prefix and the zero padding are what this stage packs around the payload
+        memset(piece.data.data() + filled, 0x00, piece.data.size() - filled);
+        m_stats.stop(CodecStage::Pack, started, piece.data.size() - filled);
+        position += piece.data.size();
+
+        output.push(std::move(piece));
+    }
+}
+
+
+
+void EncodePipeline::packStage(size_t rowBytes, PieceQueue& input, PieceQueue& inputSpent, PieceQueue& output, PieceQueue& spent) const
+{
+    const size_t lineBytes = rowBytes + 1;
+    bool failed{ false };
+
+    for (;;)
+    {
+        piece_t rows = input.pop();
+        failed = failed || rows.failed;
+
+        // After a failure keep draining, so the reader is never left blocked on a full queue
+        if (!failed)
+        {
+            piece_t lines = takeSpent(spent);
+            const size_t rowCount = rows.data.size() / rowBytes;
+
+            try
+            {
+                const auto started = m_stats.start();
+
+                lines.data.resize(rowCount * lineBytes);
+
+                for (size_t r{ 0 }; r < rowCount; ++r)
+                {
+                    lines.data[r * lineBytes] = 0; // Filter type None
+                    memcpy(lines.data.data() + r * lineBytes + 1, rows.data.data() + r * rowBytes, rowBytes);
+                }
+
+                m_stats.stop(CodecStage::Filter, started, lines.data.size());
+
+                lines.last = rows.last;
+                output.push(std::move(lines));
+            }
+            catch (const std::bad_alloc&)
+            {
+                failed = true;
+            }
+        }
+
+        const bool last = rows.last;
+        inputSpent.tryPush(rows);
+
+        if (last)
+            break;
+    }
+
+    if (failed)
+    {
+        piece_t marker;
+        marker.failed = marker.last = true;
+        output.push(std::move(marker));
+    }
+}
+
+
+
+void EncodePipeline::compressStage(PieceQueue& input, PieceQueue& inputSpent, PieceQueue& output, PieceQueue& spent) const
+{
+    z_stream stream{};
+    bool failed = (deflateInit2(&stream, m_compression.level, Z_DEFLATED, MAX_WBITS, m_compression.memLevel, m_compression.strategy) != Z_OK);
+
+    piece_t chunk = takeSpent(spent);
+
+    auto startChunk = [&]()
+    {
+        chunk.data.resize(m_bandBytes);
+        stream.next_out = chunk.data.data();
+        stream.avail_out = static_cast<uInt>(chunk.data.size());
+    };
+
+    try
+    {
+        if (!failed)
+            startChunk();
+    }
+    catch (const std::bad_alloc&)
+    {
+        failed = true;
+    }
+
+    for (;;)
+    {
+        piece_t lines = input.pop();
+        failed = failed || lines.failed;
+
+        if (!failed)
+        {
+            try
+            {
+                const int flush = lines.last ? Z_FINISH : Z_NO_FLUSH;
+                int status{ Z_OK };
+
+                // Handing a full chunk downstream can block on the queue, which is not deflate time
+                const auto started = m_stats.start();
+                uint64_t blockedNanoseconds{ 0 };
+
+                stream.next_in = lines.data.data();
+                stream.avail_in = static_cast<uInt>(lines.data.size());
+
+                do
+                {
+                    if (stream.avail_out == 0)
+                    {
+                        const auto pushed = m_stats.start();
+                        output.push(std::move(chunk));
+                        blockedNanoseconds += m_stats.elapsed(pushed);
+
+                        chunk = takeSpent(spent);
+                        startChunk();
+                    }
+
+                    status = deflate(&stream, flush);
+                }
+                while (status != Z_STREAM_ERROR && (stream.avail_in != 0 || (flush == Z_FINISH && status != Z_STREAM_END)));
+
+                m_stats.stop(CodecStage::Deflate, started, lines.data.size(), blockedNanoseconds);
+
+                failed = (status == Z_STREAM_ERROR);
+            }
+            catch (const std::bad_alloc&)
+            {
+                failed = true;
+            }
+        }
+
+        const bool last = lines.last;
+        inputSpent.tryPush(lines);
+
+        if (last)
+            break;
+    }
+
+    deflateEnd(&stream);
+
+    if (!failed)
+        chunk.data.resize(chunk.data.size() - stream.avail_out);
+    else
+        chunk.data.clear();
+
+    chunk.last = true;
+    chunk.failed = failed;
+    output.push(std::move(chunk));
+}
+
+
+
+PNGManipErrorCode EncodePipeline::run(ByteSource& source, uint32_t payloadSize, size_t rowBytes, size_t rowCount, const StreamSink& sink, uint32_t& checksum) const
+{
+    if (rowBytes == 0 || source.size() != payloadSize)
+        return PNGManipErrorCode::EncodingError;
+
+    // Forward queues carry work downstream, the spent ones bring emptied buffers back
+    PieceQueue rows(m_queueDepth), lines(m_queueDepth), chunks(m_queueDepth);
+    PieceQueue rowsSpent(m_queueDepth + 2), linesSpent(m_queueDepth + 2), chunksSpent(m_queueDepth + 2);
+
+    std::thread reader([&]() { readStage(source, payloadSize, rowBytes, rowCount, rows, rowsSpent, checksum); });
+    std::thread packer([&]() { packStage(rowBytes, rows, rowsSpent, lines, linesSpent); });
+    std::thread compressor([&]() { compressStage(lines, linesSpent, chunks, chunksSpent); });
+
+    bool failed{ false };
+
+    for (;;)
+    {
+        piece_t chunk = chunks.pop();
+        failed = failed || chunk.failed;
+
+        if (!failed && !chunk.data.empty())
+            sink(chunk.data.data(), chunk.data.size());
+
+        const bool last = chunk.last;
+        chunksSpent.tryPush(chunk);
+
+        if (last)
+            break;
+    }
+
+    reader.join();
+    packer.join();
+    compressor.join();
+
+    return failed ? PNGManipErrorCode::EncodingError : PNGManipErrorCode::Success;
+}
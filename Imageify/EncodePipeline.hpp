@@ -0,0 +1,74 @@
+#ifndef _ENCODEPIPELINE_H_
+#define _ENCODEPIPELINE_H_
+
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include <zlib.h>
+
+#include "ByteSource.hpp"
+#include "CodecStats.hpp"
+#include "CompressionProfile.hpp"
+#include "ErrorHandling.hpp"
+#include "SPSCQueue.hpp"
+
+
+
+/**
+* @brief Encodes a source into a zlib stream of PNG scanlines with every stage on its own thread.
+*
+* A reader thread lays the size prefix, the payload and the zero padding out as bands of rows,
+* a packing thread turns each band into filtered scanlines (filter type None), a compressor
+* thread deflates them, and the calling thread hands the compressed pieces to the sink. The
+* stages are connected by bounded SPSC queues, so reading, packing, deflating and writing all
+* overlap and the total time approaches that of the slowest stage. Spent buffers travel back
+* upstream through a second set of queues and are refilled rather than reallocated.
+*/
+class EncodePipeline
+{
+public:
+
+	// Receives consecutive pieces of the zlib stream, in order, on the calling thread
+	using StreamSink = std::function<void(const uint8_t* data, size_t length)>;
+
+	static constexpr size_t defaultQueueDepth = 4;
+
+private:
+
+	struct piece_t
+	{
+		std::vector<uint8_t> data;
+		bool last{ false };
+		bool failed{ false };
+	};
+
+	using PieceQueue = SPSCQueue<piece_t>;
+
+	CodecStats& m_stats;
+
+	const size_t m_queueDepth;
+	const size_t m_bandBytes;
+	const compressionSettings_t m_compression;
+
+	static piece_t takeSpent(PieceQueue&);
+
+	void readStage(ByteSource&, uint32_t payloadSize, size_t rowBytes, size_t rowCount, PieceQueue& output, PieceQueue& spent, uint32_t& checksum) const;
+	void packStage(size_t rowBytes, PieceQueue& input, PieceQueue& inputSpent, PieceQueue& output, PieceQueue& spent) const;
+	void compressStage(PieceQueue& input, PieceQueue& inputSpent, PieceQueue& output, PieceQueue& spent) const;
+
+public:
+
+	EncodePipeline(CodecStats&, const compressionSettings_t&, size_t queueDepth = defaultQueueDepth, size_t bandBytes = 1024 * 1024);
+
+	/**
+	* @brief Encodes rowCount rows of rowBytes bytes: the 4-byte payload size, the payload read from the source, then zeros.
+	*        checksum receives the CRC-32C of the payload, taken by the reader as it goes.
+	*/
+	PNGManipErrorCode run(ByteSource&, uint32_t payloadSize, size_t rowBytes, size_t rowCount, const StreamSink&, uint32_t& checksum) const;
+};
+
+
+#endif // !_ENCODEPIPELINE_H_
@@ -0,0 +1,1192 @@
+#include "Encryption.hpp"
+#include "Platform.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+    #include <bcrypt.h>
+#elif defined(__linux__)
+    #include <cerrno>
+    #include <sys/random.h>
+#else
+    #include <stdlib.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define IMAGEIFY_CIPHER_X86
+    #include <immintrin.h>
+#endif
+
+// SSE2 is part of x86-64, AVX2 is only emitted where a function asks for it, as in Checksum.cpp
+#if defined(IMAGEIFY_CIPHER_X86) && !defined(_MSC_VER)
+    #define IMAGEIFY_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define IMAGEIFY_TARGET_AVX2
+#endif
+
+
+
+static constexpr size_t encryptionHeaderBytes = 4 + 4 + 4 + 8 + kdfSaltBytes + cipherNonceBytes;
+
+// Chunks larger than this are refused on decoding, the decoder holds one back at a time
+static constexpr uint32_t maxSealChunkBytes = 64 * 1024 * 1024;
+
+
+/**
+* Header ----------------------------------------------
+*/
+
+std::vector<uint8_t> serializeEncryptionHeader(const encryptionHeader_t& header)
+{
+    std::vector<uint8_t> out;
+    out.reserve(encryptionHeaderBytes);
+
+    out.push_back(header.version);
+    out.push_back(static_cast<uint8_t>(header.cipher));
+    out.push_back(static_cast<uint8_t>(header.kdf));
+    out.push_back(0x00);
+    putBE32(out, header.iterations);
+    putBE32(out, header.chunkBytes);
+    putBE64(out, header.length);
+    out.insert(out.end(), header.salt, header.salt + kdfSaltBytes);
+    out.insert(out.end(), header.nonce, header.nonce + cipherNonceBytes);
+
+    return out;
+}
+
+
+
+bool parseEncryptionHeader(const uint8_t* data, size_t length, encryptionHeader_t& header)
+{
+    // Later versions may append fields, but must keep these where they are
+    if (length < encryptionHeaderBytes || data[0] == 0 || data[0] > encryptionVersion)
+        return false;
+
+    header.version    = data[0];
+    header.cipher     = static_cast<PayloadCipher>(data[1]);
+    header.kdf        = static_cast<KeyDerivation>(data[2]);
+    header.iterations = getBE32(data + 4);
+    header.chunkBytes = getBE32(data + 8);
+    header.length     = getBE64(data + 12);
+    memcpy(header.salt, data + 20, kdfSaltBytes);
+    memcpy(header.nonce, data + 20 + kdfSaltBytes, cipherNonceBytes);
+
+    return header.cipher == PayloadCipher::ChaCha20Poly1305
+        && (header.kdf == KeyDerivation::Raw || header.kdf == KeyDerivation::PBKDF2SHA256)
+        && header.chunkBytes != 0 && header.chunkBytes <= maxSealChunkBytes;
+}
+
+
+
+uint64_t sealedSize(uint64_t length, uint32_t chunkBytes)
+{
+    const uint64_t chunks = std::max<uint64_t>(1, (length + chunkBytes - 1) / chunkBytes);
+    return length + chunks * cipherTagBytes;
+}
+
+
+
+// Bytes of plaintext in one chunk, only the last one runs short
+static size_t chunkLength(const encryptionHeader_t& header, uint64_t chunk)
+{
+    const uint64_t start = chunk * header.chunkBytes;
+    return static_cast<size_t>(std::min<uint64_t>(header.chunkBytes, header.length - std::min(header.length, start)));
+}
+
+static bool finalChunk(const encryptionHeader_t& header, uint64_t chunk)
+{
+    return (chunk + 1) * header.chunkBytes >= header.length;
+}
+
+
+
+const char* payloadCipherName(PayloadCipher cipher)
+{
+    return (cipher == PayloadCipher::ChaCha20Poly1305) ? "chacha20-poly1305" : "none";
+}
+
+const char* keyDerivationName(KeyDerivation kdf)
+{
+    return (kdf == KeyDerivation::PBKDF2SHA256) ? "pbkdf2-sha256" : "raw key";
+}
+
+
+
+
+/**
+* Keys ------------------------------------------------
+*/
+
+void wipeSecret(void* data, size_t length)
+{
+    volatile uint8_t* bytes = static_cast<volatile uint8_t*>(data);
+
+    for (size_t i{ 0 }; i < length; ++i)
+        bytes[i] = 0;
+}
+
+
+
+// Straight from the operating system's generator. std::random_device is allowed to be a
+// deterministic engine, and a nonce that repeats gives the keystream away, so there is no fallback
+static bool randomBytes(uint8_t* out, size_t length)
+{
+#if defined(_WIN32)
+    return BCRYPT_SUCCESS(BCryptGenRandom(nullptr, out, static_cast<ULONG>(length), BCRYPT_USE_SYSTEM_PREFERRED_RNG));
+#elif defined(__linux__)
+    for (size_t filled{ 0 }; filled < length; )
+    {
+        const ssize_t got = getrandom(out + filled, length - filled, 0);
+
+        if (got < 0 && errno != EINTR)
+            return false;
+
+        if (got > 0)
+            filled += static_cast<size_t>(got);
+    }
+
+    return true;
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__) || defined(__DragonFly__)
+    arc4random_buf(out, length);
+    return true;
+#else
+    #error "No cryptographic random generator known for this platform"
+#endif
+}
+
+
+
+// Stretching a passphrase is slow on purpose. Shards and stream frames of one run share a salt,
+// so the key is derived once and remembered, keyed by a hash of the passphrase
+struct derivedKey_t
+{
+    bool valid{ false };
+    uint8_t passphrase[32]{};
+    uint8_t salt[kdfSaltBytes]{};
+    uint32_t iterations{ 0 };
+    uint8_t key[payloadKeyBytes]{};
+};
+
+static std::mutex derivedKeyLock;
+static derivedKey_t derivedKey;
+
+// Null if the generator failed, which it is then asked again for on the next call
+static const uint8_t* sessionSalt()
+{
+    static std::mutex lock;
+    static uint8_t salt[kdfSaltBytes]{};
+    static bool drawn{ false };
+
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (!drawn)
+        drawn = randomBytes(salt, sizeof(salt));
+
+    return drawn ? salt : nullptr;
+}
+
+
+
+bool newEncryptionHeader(const payloadKey_t& key, uint64_t length, encryptionHeader_t& header)
+{
+    header = encryptionHeader_t{};
+    header.version = encryptionVersion;
+    header.length = length;
+
+    if (key.source == KeySource::Passphrase)
+    {
+        const uint8_t* salt = sessionSalt();
+        if (!salt)
+            return false;
+
+        header.kdf = KeyDerivation::PBKDF2SHA256;
+        header.iterations = defaultKdfIterations;
+        memcpy(header.salt, salt, kdfSaltBytes);
+    }
+
+    return randomBytes(header.nonce, cipherNonceBytes);
+}
+
+
+
+bool deriveKey(const payloadKey_t& secret, const encryptionHeader_t& header, uint8_t (&key)[payloadKeyBytes])
+{
+    if (secret.source == KeySource::KeyFile)
+    {
+        if (header.kdf != KeyDerivation::Raw || secret.secret.size() != payloadKeyBytes)
+            return false;
+
+        memcpy(key, secret.secret.data(), payloadKeyBytes);
+        return true;
+    }
+
+    if (secret.source != KeySource::Passphrase || header.kdf != KeyDerivation::PBKDF2SHA256
+        || header.iterations == 0 || header.iterations > maxKdfIterations)
+        return false;
+
+    uint8_t passphrase[32];
+    sha256(reinterpret_cast<const uint8_t*>(secret.secret.data()), secret.secret.size(), passphrase);
+
+    std::lock_guard<std::mutex> lock(derivedKeyLock);
+
+    if (!derivedKey.valid || memcmp(derivedKey.passphrase, passphrase, sizeof(passphrase)) != 0
+        || memcmp(derivedKey.salt, header.salt, kdfSaltBytes) != 0 || derivedKey.iterations != header.iterations)
+    {
+        pbkdf2SHA256(reinterpret_cast<const uint8_t*>(secret.secret.data()), secret.secret.size(),
+            header.salt, kdfSaltBytes, header.iterations, derivedKey.key, payloadKeyBytes);
+
+        memcpy(derivedKey.passphrase, passphrase, sizeof(passphrase));
+        memcpy(derivedKey.salt, header.salt, kdfSaltBytes);
+        derivedKey.iterations = header.iterations;
+        derivedKey.valid = true;
+    }
+
+    memcpy(key, derivedKey.key, payloadKeyBytes);
+    wipeSecret(passphrase, sizeof(passphrase));
+
+    return true;
+}
+
+
+
+
+/**
+* SHA-256 and PBKDF2 ----------------------------------
+*/
+
+static constexpr uint32_t sha256Constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static constexpr uint32_t sha256Initial[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static inline uint32_t rotr32(uint32_t value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static void sha256Compress(uint32_t (&state)[8], const uint8_t* block)
+{
+    uint32_t w[64];
+
+    for (int i{ 0 }; i < 16; ++i)
+        w[i] = getBE32(block + 4 * i);
+
+    for (int i{ 16 }; i < 64; ++i)
+    {
+        const uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        const uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for (int i{ 0 }; i < 64; ++i)
+    {
+        const uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256Constants[i] + w[i];
+        const uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+
+        h = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+
+
+// Streaming SHA-256, which can also carry on from a state that already absorbed some blocks
+struct sha256_t
+{
+    uint32_t state[8];
+    uint8_t buffer[64];
+    size_t buffered{ 0 };
+    uint64_t length{ 0 };
+
+    sha256_t() { memcpy(state, sha256Initial, sizeof(state)); }
+
+    sha256_t(const uint32_t (&from)[8], uint64_t absorbed) : length{ absorbed } { memcpy(state, from, sizeof(state)); }
+
+    ~sha256_t() { wipeSecret(buffer, sizeof(buffer)); }
+
+    void update(const uint8_t* data, size_t size)
+    {
+        length += size;
+
+        while (size)
+        {
+            const size_t take = std::min(size, sizeof(buffer) - buffered);
+            memcpy(buffer + buffered, data, take);
+            buffered += take;
+            data += take;
+            size -= take;
+
+            if (buffered == sizeof(buffer))
+            {
+                sha256Compress(state, buffer);
+                buffered = 0;
+            }
+        }
+    }
+
+    void finish(uint8_t (&digest)[32])
+    {
+        const uint64_t bits = length * 8;
+
+        buffer[buffered++] = 0x80;
+
+        if (buffered > 56)
+        {
+            memset(buffer + buffered, 0, sizeof(buffer) - buffered);
+            sha256Compress(state, buffer);
+            buffered = 0;
+        }
+
+        memset(buffer + buffered, 0, 56 - buffered);
+
+        for (int i{ 0 }; i < 8; ++i)
+            buffer[56 + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+
+        sha256Compress(state, buffer);
+
+        for (int i{ 0 }; i < 8; ++i)
+            for (int j{ 0 }; j < 4; ++j)
+                digest[4 * i + j] = static_cast<uint8_t>(state[i] >> (24 - 8 * j));
+    }
+};
+
+
+
+void sha256(const uint8_t* data, size_t length, uint8_t (&digest)[32])
+{
+    sha256_t hash;
+    hash.update(data, length);
+    hash.finish(digest);
+}
+
+
+
+void pbkdf2SHA256(const uint8_t* password, size_t passwordLength, const uint8_t* salt, size_t saltLength, uint32_t iterations, uint8_t* out, size_t outLength)
+{
+    // HMAC keys longer than a block are hashed first
+    uint8_t key[64]{};
+    if (passwordLength > sizeof(key))
+    {
+        uint8_t digest[32];
+        sha256(password, passwordLength, digest);
+        memcpy(key, digest, sizeof(digest));
+        wipeSecret(digest, sizeof(digest));
+    }
+    else if (passwordLength)
+        memcpy(key, password, passwordLength);
+
+    // The keyed inner and outer states are computed once, every iteration starts from them
+    uint32_t inner[8], outer[8];
+    uint8_t pad[64];
+
+    memcpy(inner, sha256Initial, sizeof(inner));
+    for (size_t i{ 0 }; i < sizeof(pad); ++i)
+        pad[i] = key[i] ^ 0x36;
+    sha256Compress(inner, pad);
+
+    memcpy(outer, sha256Initial, sizeof(outer));
+    for (size_t i{ 0 }; i < sizeof(pad); ++i)
+        pad[i] = key[i] ^ 0x5c;
+    sha256Compress(outer, pad);
+
+    // A 32-byte message after the keyed block always pads out to exactly one more block
+    uint8_t block[64]{};
+    block[32] = 0x80;
+    block[62] = static_cast<uint8_t>(((64 + 32) * 8) >> 8);
+    block[63] = static_cast<uint8_t>((64 + 32) * 8);
+
+    uint8_t u[32], t[32];
+
+    for (uint32_t index{ 1 }; outLength; ++index)
+    {
+        uint8_t counter[4] = { static_cast<uint8_t>(index >> 24), static_cast<uint8_t>(index >> 16), static_cast<uint8_t>(index >> 8), static_cast<uint8_t>(index) };
+
+        sha256_t first(inner, 64);
+        first.update(salt, saltLength);
+        first.update(counter, sizeof(counter));
+        first.finish(u);
+
+        sha256_t second(outer, 64);
+        second.update(u, sizeof(u));
+        second.finish(u);
+
+        memcpy(t, u, sizeof(t));
+
+        for (uint32_t iteration{ 1 }; iteration < iterations; ++iteration)
+        {
+            for (const uint32_t* keyed : { inner, outer })
+            {
+                uint32_t state[8];
+                memcpy(state, keyed, sizeof(state));
+                memcpy(block, u, sizeof(u));
+                sha256Compress(state, block);
+
+                for (int i{ 0 }; i < 8; ++i)
+                    for (int j{ 0 }; j < 4; ++j)
+                        u[4 * i + j] = static_cast<uint8_t>(state[i] >> (24 - 8 * j));
+            }
+
+            for (size_t i{ 0 }; i < sizeof(t); ++i)
+                t[i] ^= u[i];
+        }
+
+        const size_t take = std::min(outLength, sizeof(t));
+        memcpy(out, t, take);
+        out += take;
+        outLength -= take;
+    }
+
+    wipeSecret(key, sizeof(key));
+    wipeSecret(pad, sizeof(pad));
+    wipeSecret(block, sizeof(block));
+    wipeSecret(u, sizeof(u));
+    wipeSecret(t, sizeof(t));
+    wipeSecret(inner, sizeof(inner));
+    wipeSecret(outer, sizeof(outer));
+}
+
+
+
+
+/**
+* Poly1305 --------------------------------------------
+*/
+
+#if defined(__SIZEOF_INT128__)
+
+using wide_t = unsigned __int128;
+
+static inline wide_t mul64(uint64_t a, uint64_t b) { return static_cast<wide_t>(a) * b; }
+static inline wide_t add128(wide_t a, wide_t b) { return a + b; }
+static inline uint64_t low64(wide_t a) { return static_cast<uint64_t>(a); }
+static inline uint64_t shift128(wide_t a, int bits) { return static_cast<uint64_t>(a >> bits); }
+
+#else
+
+// MSVC has no 128-bit integer, only the multiply
+struct wide_t
+{
+    uint64_t low, high;
+};
+
+static inline wide_t mul64(uint64_t a, uint64_t b)
+{
+    wide_t result;
+    result.low = _umul128(a, b, &result.high);
+    return result;
+}
+
+static inline wide_t add128(wide_t a, wide_t b)
+{
+    wide_t result{ a.low + b.low, a.high + b.high };
+    result.high += (result.low < a.low);
+    return result;
+}
+
+static inline uint64_t low64(wide_t a) { return a.low; }
+static inline uint64_t shift128(wide_t a, int bits) { return (a.low >> bits) | (a.high << (64 - bits)); }
+
+#endif
+
+static constexpr uint64_t mask44 = 0xfffffffffff;
+static constexpr uint64_t mask42 = 0x3ffffffffff;
+
+
+
+Poly1305::~Poly1305()
+{
+    wipeSecret(m_r, sizeof(m_r));
+    wipeSecret(m_pad, sizeof(m_pad));
+}
+
+
+
+void Poly1305::reset(const uint8_t (&key)[32])
+{
+    const uint64_t t0 = getLE64(key);
+    const uint64_t t1 = getLE64(key + 8);
+
+    // r is clamped as the RFC requires, and kept in 44, 44 and 42 bit limbs
+    m_r[0] = t0 & 0xffc0fffffff;
+    m_r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffff;
+    m_r[2] = (t1 >> 24) & 0x00ffffffc0f;
+
+    m_h[0] = m_h[1] = m_h[2] = 0;
+
+    m_pad[0] = getLE64(key + 16);
+    m_pad[1] = getLE64(key + 24);
+
+    m_buffered = 0;
+}
+
+
+
+void Poly1305::blocks(const uint8_t* data, size_t length, uint64_t highBit)
+{
+    const uint64_t r0 = m_r[0], r1 = m_r[1], r2 = m_r[2];
+    const uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+
+    uint64_t h0 = m_h[0], h1 = m_h[1], h2 = m_h[2];
+
+    for (; length >= 16; data += 16, length -= 16)
+    {
+        const uint64_t t0 = getLE64(data);
+        const uint64_t t1 = getLE64(data + 8);
+
+        h0 += t0 & mask44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & mask44;
+        h2 += ((t1 >> 24) & mask42) | highBit;
+
+        wide_t d0 = add128(add128(mul64(h0, r0), mul64(h1, s2)), mul64(h2, s1));
+        wide_t d1 = add128(add128(mul64(h0, r1), mul64(h1, r0)), mul64(h2, s2));
+        wide_t d2 = add128(add128(mul64(h0, r2), mul64(h1, r1)), mul64(h2, r0));
+
+        uint64_t carry = shift128(d0, 44);
+        h0 = low64(d0) & mask44;
+        d1 = add128(d1, mul64(carry, 1));
+        carry = shift128(d1, 44);
+        h1 = low64(d1) & mask44;
+        d2 = add128(d2, mul64(carry, 1));
+        carry = shift128(d2, 42);
+        h2 = low64(d2) & mask42;
+        h0 += carry * 5;
+        carry = h0 >> 44;
+        h0 &= mask44;
+        h1 += carry;
+    }
+
+    m_h[0] = h0;
+    m_h[1] = h1;
+    m_h[2] = h2;
+}
+
+
+
+void Poly1305::update(const uint8_t* data, size_t length)
+{
+    // An empty payload comes with no buffer at all
+    if (length == 0)
+        return;
+
+    if (m_buffered)
+    {
+        const size_t take = std::min(length, sizeof(m_buffer) - m_buffered);
+        memcpy(m_buffer + m_buffered, data, take);
+        m_buffered += take;
+        data += take;
+        length -= take;
+
+        if (m_buffered < sizeof(m_buffer))
+            return;
+
+        blocks(m_buffer, sizeof(m_buffer), 1ull << 40);
+        m_buffered = 0;
+    }
+
+    const size_t whole = length & ~static_cast<size_t>(15);
+    blocks(data, whole, 1ull << 40);
+
+    if (length != whole)
+        memcpy(m_buffer, data + whole, length - whole);
+
+    m_buffered = length - whole;
+}
+
+
+
+void Poly1305::pad()
+{
+    if (!m_buffered)
+        return;
+
+    memset(m_buffer + m_buffered, 0, sizeof(m_buffer) - m_buffered);
+    blocks(m_buffer, sizeof(m_buffer), 1ull << 40);
+    m_buffered = 0;
+}
+
+
+
+void Poly1305::finish(uint8_t (&tag)[cipherTagBytes])
+{
+    // A short last block carries its own 1 bit instead of the one above 128
+    if (m_buffered)
+    {
+        m_buffer[m_buffered] = 1;
+        memset(m_buffer + m_buffered + 1, 0, sizeof(m_buffer) - m_buffered - 1);
+        blocks(m_buffer, sizeof(m_buffer), 0);
+        m_buffered = 0;
+    }
+
+    uint64_t h0 = m_h[0], h1 = m_h[1], h2 = m_h[2];
+
+    // Fully carry h
+    uint64_t carry = h1 >> 44; h1 &= mask44;
+    h2 += carry; carry = h2 >> 42; h2 &= mask42;
+    h0 += carry * 5; carry = h0 >> 44; h0 &= mask44;
+    h1 += carry; carry = h1 >> 44; h1 &= mask44;
+    h2 += carry; carry = h2 >> 42; h2 &= mask42;
+    h0 += carry * 5; carry = h0 >> 44; h0 &= mask44;
+    h1 += carry;
+
+    // h - p, kept only if it did not go negative, chosen without a branch
+    uint64_t g0 = h0 + 5; carry = g0 >> 44; g0 &= mask44;
+    uint64_t g1 = h1 + carry; carry = g1 >> 44; g1 &= mask44;
+    uint64_t g2 = h2 + carry - (1ull << 42);
+
+    const uint64_t keep = (g2 >> 63) - 1;
+    h0 = (h0 & ~keep) | (g0 & keep);
+    h1 = (h1 & ~keep) | (g1 & keep);
+    h2 = (h2 & ~keep) | (g2 & keep);
+
+    // tag = (h + pad) mod 2^128
+    const uint64_t t0 = m_pad[0], t1 = m_pad[1];
+
+    h0 += t0 & mask44; carry = h0 >> 44; h0 &= mask44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & mask44) + carry; carry = h1 >> 44; h1 &= mask44;
+    h2 += ((t1 >> 24) & mask42) + carry; h2 &= mask42;
+
+    putLE64(tag, h0 | (h1 << 44));
+    putLE64(tag + 8, (h1 >> 20) | (h2 << 24));
+
+    m_h[0] = m_h[1] = m_h[2] = 0;
+}
+
+
+
+
+/**
+* ChaCha20 --------------------------------------------
+*/
+
+static inline uint32_t rotl32(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+#define CHACHA_QUARTER(a, b, c, d)                      \
+    a += b; d ^= a; d = rotl32(d, 16);                  \
+    c += d; b ^= c; b = rotl32(b, 12);                  \
+    a += b; d ^= a; d = rotl32(d, 8);                   \
+    c += d; b ^= c; b = rotl32(b, 7);
+
+
+static void chachaSetup(uint32_t (&state)[16], const uint8_t (&key)[payloadKeyBytes], const uint8_t (&nonce)[cipherNonceBytes], uint32_t counter)
+{
+    // "expand 32-byte k"
+    state[0] = 0x61707865;
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+
+    for (int i{ 0 }; i < 8; ++i)
+        state[4 + i] = getLE32(key + 4 * i);
+
+    state[12] = counter;
+
+    for (int i{ 0 }; i < 3; ++i)
+        state[13 + i] = getLE32(nonce + 4 * i);
+}
+
+
+
+static void chachaBlock(const uint32_t (&state)[16], uint8_t (&out)[64])
+{
+    uint32_t x[16];
+    memcpy(x, state, sizeof(x));
+
+    for (int round{ 0 }; round < 10; ++round)
+    {
+        CHACHA_QUARTER(x[0], x[4], x[8],  x[12]);
+        CHACHA_QUARTER(x[1], x[5], x[9],  x[13]);
+        CHACHA_QUARTER(x[2], x[6], x[10], x[14]);
+        CHACHA_QUARTER(x[3], x[7], x[11], x[15]);
+        CHACHA_QUARTER(x[0], x[5], x[10], x[15]);
+        CHACHA_QUARTER(x[1], x[6], x[11], x[12]);
+        CHACHA_QUARTER(x[2], x[7], x[8],  x[13]);
+        CHACHA_QUARTER(x[3], x[4], x[9],  x[14]);
+    }
+
+    for (int i{ 0 }; i < 16; ++i)
+        putLE32(out + 4 * i, x[i] + state[i]);
+
+    wipeSecret(x, sizeof(x));
+}
+
+#undef CHACHA_QUARTER
+
+
+
+#ifdef IMAGEIFY_CIPHER_X86
+
+#define CHACHA_ROTL128(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define CHACHA_QUARTER128(a, b, c, d)                                                           \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_ROTL128(d, 16);                \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_ROTL128(b, 12);                \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_ROTL128(d, 8);                 \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_ROTL128(b, 7);
+
+// Four consecutive blocks, one per lane: each register holds the same state word of every block
+static void chachaBlocksSSE2(const uint32_t (&state)[16], uint8_t* data)
+{
+    __m128i x[16], start[16];
+
+    for (int i{ 0 }; i < 16; ++i)
+        x[i] = _mm_set1_epi32(static_cast<int>(state[i]));
+
+    x[12] = _mm_add_epi32(x[12], _mm_set_epi32(3, 2, 1, 0));
+
+    for (int i{ 0 }; i < 16; ++i)
+        start[i] = x[i];
+
+    for (int round{ 0 }; round < 10; ++round)
+    {
+        CHACHA_QUARTER128(x[0], x[4], x[8],  x[12]);
+        CHACHA_QUARTER128(x[1], x[5], x[9],  x[13]);
+        CHACHA_QUARTER128(x[2], x[6], x[10], x[14]);
+        CHACHA_QUARTER128(x[3], x[7], x[11], x[15]);
+        CHACHA_QUARTER128(x[0], x[5], x[10], x[15]);
+        CHACHA_QUARTER128(x[1], x[6], x[11], x[12]);
+        CHACHA_QUARTER128(x[2], x[7], x[8],  x[13]);
+        CHACHA_QUARTER128(x[3], x[4], x[9],  x[14]);
+    }
+
+    // Transposing each group of four words turns lanes back into blocks
+    for (int group{ 0 }; group < 4; ++group)
+    {
+        const __m128i a = _mm_add_epi32(x[4 * group + 0], start[4 * group + 0]);
+        const __m128i b = _mm_add_epi32(x[4 * group + 1], start[4 * group + 1]);
+        const __m128i c = _mm_add_epi32(x[4 * group + 2], start[4 * group + 2]);
+        const __m128i d = _mm_add_epi32(x[4 * group + 3], start[4 * group + 3]);
+
+        const __m128i ab0 = _mm_unpacklo_epi32(a, b), cd0 = _mm_unpacklo_epi32(c, d);
+        const __m128i ab1 = _mm_unpackhi_epi32(a, b), cd1 = _mm_unpackhi_epi32(c, d);
+
+        const __m128i blocks[4] = {
+            _mm_unpacklo_epi64(ab0, cd0), _mm_unpackhi_epi64(ab0, cd0),
+            _mm_unpacklo_epi64(ab1, cd1), _mm_unpackhi_epi64(ab1, cd1)
+        };
+
+        for (int block{ 0 }; block < 4; ++block)
+        {
+            __m128i* at = reinterpret_cast<__m128i*>(data + 64 * block + 16 * group);
+            _mm_storeu_si128(at, _mm_xor_si128(_mm_loadu_si128(at), blocks[block]));
+        }
+    }
+}
+
+#undef CHACHA_QUARTER128
+#undef CHACHA_ROTL128
+
+
+
+#define CHACHA_QUARTER256(a, b, c, d)                                                                                   \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rotate16);                              \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = _mm256_or_si256(_mm256_slli_epi32(b, 12), _mm256_srli_epi32(b, 20)); \
+    a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rotate8);                               \
+    c = _mm256_add_epi32(c, d); b = _mm256_xor_si256(b, c); b = _mm256_or_si256(_mm256_slli_epi32(b, 7), _mm256_srli_epi32(b, 25));
+
+// Eight blocks, the same layout as the SSE2 kernel, with the byte rotations done as shuffles
+IMAGEIFY_TARGET_AVX2
+static void chachaBlocksAVX2(const uint32_t (&state)[16], uint8_t* data)
+{
+    const __m256i rotate16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                              2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+    const __m256i rotate8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                             3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+
+    __m256i x[16], start[16];
+
+    for (int i{ 0 }; i < 16; ++i)
+        x[i] = _mm256_set1_epi32(static_cast<int>(state[i]));
+
+    x[12] = _mm256_add_epi32(x[12], _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+
+    for (int i{ 0 }; i < 16; ++i)
+        start[i] = x[i];
+
+    for (int round{ 0 }; round < 10; ++round)
+    {
+        CHACHA_QUARTER256(x[0], x[4], x[8],  x[12]);
+        CHACHA_QUARTER256(x[1], x[5], x[9],  x[13]);
+        CHACHA_QUARTER256(x[2], x[6], x[10], x[14]);
+        CHACHA_QUARTER256(x[3], x[7], x[11], x[15]);
+        CHACHA_QUARTER256(x[0], x[5], x[10], x[15]);
+        CHACHA_QUARTER256(x[1], x[6], x[11], x[12]);
+        CHACHA_QUARTER256(x[2], x[7], x[8],  x[13]);
+        CHACHA_QUARTER256(x[3], x[4], x[9],  x[14]);
+    }
+
+    // Unpacking works within each 128-bit half: the low one ends up holding blocks 0 to 3 and
+    // the high one blocks 4 to 7, four words of each per group
+    __m256i words[4][4];
+
+    for (int group{ 0 }; group < 4; ++group)
+    {
+        const __m256i a = _mm256_add_epi32(x[4 * group + 0], start[4 * group + 0]);
+        const __m256i b = _mm256_add_epi32(x[4 * group + 1], start[4 * group + 1]);
+        const __m256i c = _mm256_add_epi32(x[4 * group + 2], start[4 * group + 2]);
+        const __m256i d = _mm256_add_epi32(x[4 * group + 3], start[4 * group + 3]);
+
+        const __m256i ab0 = _mm256_unpacklo_epi32(a, b), cd0 = _mm256_unpacklo_epi32(c, d);
+        const __m256i ab1 = _mm256_unpackhi_epi32(a, b), cd1 = _mm256_unpackhi_epi32(c, d);
+
+        words[group][0] = _mm256_unpacklo_epi64(ab0, cd0);
+        words[group][1] = _mm256_unpackhi_epi64(ab0, cd0);
+        words[group][2] = _mm256_unpacklo_epi64(ab1, cd1);
+        words[group][3] = _mm256_unpackhi_epi64(ab1, cd1);
+    }
+
+    // Pairs of groups make 32 contiguous bytes of one block
+    for (int block{ 0 }; block < 4; ++block)
+    {
+        for (int half{ 0 }; half < 2; ++half)
+        {
+            const __m256i& first = words[2 * half][block];
+            const __m256i& second = words[2 * half + 1][block];
+
+            __m256i* low = reinterpret_cast<__m256i*>(data + 64 * block + 32 * half);
+            __m256i* high = reinterpret_cast<__m256i*>(data + 64 * (block + 4) + 32 * half);
+
+            _mm256_storeu_si256(low, _mm256_xor_si256(_mm256_loadu_si256(low), _mm256_permute2x128_si256(first, second, 0x20)));
+            _mm256_storeu_si256(high, _mm256_xor_si256(_mm256_loadu_si256(high), _mm256_permute2x128_si256(first, second, 0x31)));
+        }
+    }
+}
+
+#undef CHACHA_QUARTER256
+
+#endif
+
+
+
+CipherKernel cipherKernel()
+{
+    static const CipherKernel best = cpuHasAVX2() ? CipherKernel::AVX2
+        : cipherKernelSupported(CipherKernel::SSE2) ? CipherKernel::SSE2 : CipherKernel::Scalar;
+
+    return best;
+}
+
+
+
+bool cipherKernelSupported(CipherKernel kernel)
+{
+    switch (kernel)
+    {
+        case CipherKernel::Scalar: return true;
+#ifdef IMAGEIFY_CIPHER_X86
+        case CipherKernel::SSE2:   return true;
+        case CipherKernel::AVX2:   return cpuHasAVX2();
+#endif
+        default:                   return false;
+    }
+}
+
+
+
+const char* cipherKernelName(CipherKernel kernel)
+{
+    switch (kernel)
+    {
+        case CipherKernel::SSE2: return "sse2";
+        case CipherKernel::AVX2: return "avx2";
+        default:                 return "scalar";
+    }
+}
+
+
+
+void chacha20Xor(const uint8_t (&key)[payloadKeyBytes], const uint8_t (&nonce)[cipherNonceBytes], uint32_t counter, uint64_t position,
+    uint8_t* data, size_t length, CipherKernel kernel)
+{
+    if (!cipherKernelSupported(kernel))
+        kernel = CipherKernel::Scalar;
+
+    uint32_t state[16];
+    chachaSetup(state, key, nonce, counter + static_cast<uint32_t>(position / 64));
+
+    uint8_t stream[64];
+
+    // A start inside a block uses the rest of that block first
+    if (const size_t skip = static_cast<size_t>(position % 64); skip && length)
+    {
+        chachaBlock(state, stream);
+        ++state[12];
+
+        const size_t take = std::min(length, sizeof(stream) - skip);
+        for (size_t i{ 0 }; i < take; ++i)
+            data[i] ^= stream[skip + i];
+
+        data += take;
+        length -= take;
+    }
+
+#ifdef IMAGEIFY_CIPHER_X86
+    if (kernel == CipherKernel::AVX2)
+        for (; length >= 8 * 64; data += 8 * 64, length -= 8 * 64, state[12] += 8)
+            chachaBlocksAVX2(state, data);
+
+    if (kernel != CipherKernel::Scalar)
+        for (; length >= 4 * 64; data += 4 * 64, length -= 4 * 64, state[12] += 4)
+            chachaBlocksSSE2(state, data);
+#endif
+
+    for (; length; ++state[12])
+    {
+        chachaBlock(state, stream);
+
+        const size_t take = std::min(length, sizeof(stream));
+        for (size_t i{ 0 }; i < take; ++i)
+            data[i] ^= stream[i];
+
+        data += take;
+        length -= take;
+    }
+
+    wipeSecret(state, sizeof(state));
+    wipeSecret(stream, sizeof(stream));
+}
+
+
+
+
+/**
+* Chunked AEAD ----------------------------------------
+*/
+
+// Chunk i's nonce, its Poly1305 key from block 0, and the associated data every tag covers
+static void startChunk(const encryptionHeader_t& header, const std::vector<uint8_t>& headerBytes, const uint8_t (&key)[payloadKeyBytes],
+    uint64_t chunk, uint8_t (&nonce)[cipherNonceBytes], Poly1305& mac)
+{
+    memcpy(nonce, header.nonce, cipherNonceBytes);
+
+    for (int i{ 0 }; i < 8; ++i)
+        nonce[4 + i] ^= static_cast<uint8_t>(chunk >> (8 * i));
+
+    uint8_t macKey[32]{};
+    chacha20Xor(key, nonce, 0, 0, macKey, sizeof(macKey));
+    mac.reset(macKey);
+    wipeSecret(macKey, sizeof(macKey));
+
+    uint8_t position[9];
+    putLE64(position, chunk);
+    position[8] = finalChunk(header, chunk) ? 1 : 0;
+
+    mac.update(headerBytes.data(), headerBytes.size());
+    mac.update(position, sizeof(position));
+    mac.pad();
+}
+
+static void endChunk(const std::vector<uint8_t>& headerBytes, size_t length, Poly1305& mac, uint8_t (&tag)[cipherTagBytes])
+{
+    uint8_t lengths[16];
+    putLE64(lengths, headerBytes.size() + 9);
+    putLE64(lengths + 8, length);
+
+    mac.pad();
+    mac.update(lengths, sizeof(lengths));
+    mac.finish(tag);
+}
+
+
+
+EncryptingSource::EncryptingSource(ByteSource& input, const encryptionHeader_t& header, const uint8_t (&key)[payloadKeyBytes], CodecStats& stats) :
+    m_input{ input },
+    m_stats{ stats },
+    m_header{ header },
+    m_headerBytes{ serializeEncryptionHeader(header) }
+{
+    memcpy(m_key, key, payloadKeyBytes);
+}
+
+EncryptingSource::~EncryptingSource()
+{
+    wipeSecret(m_key, sizeof(m_key));
+}
+
+
+
+bool EncryptingSource::read(uint8_t* out, size_t length)
+{
+    const uint64_t unit = static_cast<uint64_t>(m_header.chunkBytes) + cipherTagBytes;
+
+    if (length > size() - m_position)
+        return false;
+
+    while (length)
+    {
+        const uint64_t chunk = m_position / unit;
+        const uint64_t within = m_position % unit;
+        const size_t body = chunkLength(m_header, chunk);
+
+        size_t take;
+
+        if (chunk != m_chunk)
+        {
+            startChunk(m_header, m_headerBytes, m_key, chunk, m_nonce, m_mac);
+            m_chunk = chunk;
+
+            if (body == 0)
+                endChunk(m_headerBytes, 0, m_mac, m_tag);
+        }
+
+        if (within < body)
+        {
+            take = static_cast<size_t>(std::min<uint64_t>(length, body - within));
+
+            if (!m_input.read(out, take))
+                return false;
+
+            // Read time is the reader stage's, only the cipher itself is counted here
+            const auto started = m_stats.start();
+
+            chacha20Xor(m_key, m_nonce, 1, within, out, take);
+            m_mac.update(out, take);
+
+            if (within + take == body)
+                endChunk(m_headerBytes, body, m_mac, m_tag);
+
+            m_stats.stop(CodecStage::Encrypt, started, take);
+        }
+        else
+        {
+            const size_t offset = static_cast<size_t>(within - body);
+            take = std::min(length, cipherTagBytes - offset);
+            memcpy(out, m_tag + offset, take);
+        }
+
+        out += take;
+        length -= take;
+        m_position += take;
+    }
+
+    return true;
+}
+
+
+
+DecryptingSink::DecryptingSink(ByteSink& output, const encryptionHeader_t& header, const uint8_t (&key)[payloadKeyBytes],
+    uint64_t rangeStart, uint64_t rangeEnd, CodecStats& stats) :
+    m_output{ output },
+    m_stats{ stats },
+    m_header{ header },
+    m_headerBytes{ serializeEncryptionHeader(header) },
+    m_rangeStart{ rangeStart },
+    m_rangeEnd{ rangeEnd }
+{
+    memcpy(m_key, key, payloadKeyBytes);
+    m_chunk.reserve(static_cast<size_t>(std::min<uint64_t>(header.chunkBytes, header.length)));
+}
+
+DecryptingSink::~DecryptingSink()
+{
+    wipeSecret(m_key, sizeof(m_key));
+
+    if (m_chunk.capacity())
+        wipeSecret(m_chunk.data(), m_chunk.capacity());
+}
+
+
+
+bool DecryptingSink::openChunk(uint64_t chunk)
+{
+    const auto started = m_stats.start();
+
+    uint8_t nonce[cipherNonceBytes], tag[cipherTagBytes];
+    Poly1305 mac;
+
+    startChunk(m_header, m_headerBytes, m_key, chunk, nonce, mac);
+    mac.update(m_chunk.data(), m_chunk.size());
+    endChunk(m_headerBytes, m_chunk.size(), mac, tag);
+
+    // Compared in constant time, nothing is decrypted before the tag matches
+    uint8_t difference{ 0 };
+    for (size_t i{ 0 }; i < cipherTagBytes; ++i)
+        difference |= static_cast<uint8_t>(tag[i] ^ m_tag[i]);
+
+    if (difference)
+    {
+        m_authentic = false;
+        return false;
+    }
+
+    chacha20Xor(m_key, nonce, 1, 0, m_chunk.data(), m_chunk.size());
+
+    m_stats.stop(CodecStage::Decrypt, started, m_chunk.size());
+
+    const uint64_t chunkStart = chunk * m_header.chunkBytes;
+    const uint64_t from = std::max(chunkStart, m_rangeStart);
+    const uint64_t to = std::min<uint64_t>(chunkStart + m_chunk.size(), m_rangeEnd);
+
+    const bool written = (from >= to) || m_output.write(m_chunk.data() + (from - chunkStart), static_cast<size_t>(to - from));
+
+    // The plaintext has just gone to the output, so it is only wiped once, when the sink goes
+    m_chunk.clear();
+
+    return written;
+}
+
+
+
+bool DecryptingSink::write(const uint8_t* data, size_t length)
+{
+    const uint64_t unit = static_cast<uint64_t>(m_header.chunkBytes) + cipherTagBytes;
+
+    // More than was sealed means the size prefix and the header disagree
+    if (length > sealedSize(m_header.length, m_header.chunkBytes) - m_position)
+    {
+        m_authentic = false;
+        return false;
+    }
+
+    while (length)
+    {
+        const uint64_t chunk = m_position / unit;
+        const uint64_t within = m_position % unit;
+        const size_t body = chunkLength(m_header, chunk);
+
+        size_t take;
+
+        if (within < body)
+        {
+            take = static_cast<size_t>(std::min<uint64_t>(length, body - within));
+            m_chunk.insert(m_chunk.end(), data, data + take);
+        }
+        else
+        {
+            const size_t offset = static_cast<size_t>(within - body);
+            take = std::min(length, cipherTagBytes - offset);
+            memcpy(m_tag + offset, data, take);
+
+            if (offset + take == cipherTagBytes && !openChunk(chunk))
+                return false;
+        }
+
+        data += take;
+        length -= take;
+        m_position += take;
+    }
+
+    return true;
+}
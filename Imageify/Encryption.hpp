@@ -0,0 +1,311 @@
+#ifndef _ENCRYPTION_H_
+#define _ENCRYPTION_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ByteSink.hpp"
+#include "ByteSource.hpp"
+#include "CodecStats.hpp"
+
+
+// Private, ancillary, not safe to copy: the header describes exactly how the pixels were sealed
+constexpr char encryptionChunkName[5] = "ifEN";
+constexpr uint8_t encryptionVersion = 1;
+
+constexpr size_t payloadKeyBytes = 32;
+constexpr size_t cipherNonceBytes = 12;
+constexpr size_t cipherTagBytes = 16;
+constexpr size_t kdfSaltBytes = 16;
+
+// PBKDF2-HMAC-SHA256 work factor for new images. Decoding refuses headers asking for far more,
+// so a crafted image cannot keep the decoder busy for hours
+constexpr uint32_t defaultKdfIterations = 600000;
+constexpr uint32_t maxKdfIterations = 10000000;
+
+// Plaintext sealed under each tag. One chunk is all the decoder ever holds back while it checks it
+constexpr uint32_t defaultSealChunkBytes = 64 * 1024;
+
+
+
+/**
+* @brief Where the key of an encrypted payload comes from.
+*/
+enum class KeySource : uint8_t
+{
+	None = 0,
+	KeyFile,
+	Passphrase
+};
+
+/**
+* @brief The secret given on the command line: 32 raw key bytes, or a passphrase to stretch.
+*/
+struct payloadKey_t
+{
+	KeySource source{ KeySource::None };
+	std::string secret;
+
+	bool enabled() const { return source != KeySource::None; }
+};
+
+
+enum class PayloadCipher : uint8_t
+{
+	None = 0,
+	ChaCha20Poly1305
+};
+
+enum class KeyDerivation : uint8_t
+{
+	Raw = 0,
+	PBKDF2SHA256
+};
+
+
+/**
+* @brief The header of an encrypted payload, stored in an ifEN chunk.
+*
+* The bytes stored in the pixels are the payload cut into chunks of chunkBytes, each one
+* encrypted with ChaCha20 and followed by its 16-byte Poly1305 tag (RFC 8439). Chunk i uses the
+* nonce with i XORed into its last 8 bytes, and authenticates this header, i and whether it is
+* the last chunk, so chunks cannot be reordered, dropped or cut short. An empty payload still
+* has one chunk, holding only a tag.
+*/
+struct encryptionHeader_t
+{
+	// 0 when the payload is not encrypted
+	uint8_t version{ 0 };
+	PayloadCipher cipher{ PayloadCipher::ChaCha20Poly1305 };
+	KeyDerivation kdf{ KeyDerivation::Raw };
+
+	uint32_t iterations{ 0 };
+	uint8_t salt[kdfSaltBytes]{};
+	uint8_t nonce[cipherNonceBytes]{};
+
+	uint32_t chunkBytes{ defaultSealChunkBytes };
+
+	// Plaintext bytes, the encrypted ones add a tag per chunk
+	uint64_t length{ 0 };
+};
+
+/**
+* @brief Serializes a header into the payload of an ifEN chunk.
+*/
+std::vector<uint8_t> serializeEncryptionHeader(const encryptionHeader_t&);
+
+/**
+* @brief Reads an ifEN chunk. Returns false if it is truncated, from a newer version or names an unknown cipher.
+*/
+bool parseEncryptionHeader(const uint8_t*, size_t, encryptionHeader_t&);
+
+/**
+* @brief Size of the bytes stored for a payload of the given length: the payload and one tag per chunk.
+*/
+uint64_t sealedSize(uint64_t length, uint32_t chunkBytes);
+
+/**
+* @brief A header for a new payload of the given length, with a fresh random nonce. Passphrases are
+*        stretched with a salt drawn once per process, so the key is only derived once per run.
+*        False if the operating system's random generator fails, as nothing may be sealed then.
+*/
+bool newEncryptionHeader(const payloadKey_t&, uint64_t length, encryptionHeader_t&);
+
+/**
+* @brief The key a header was sealed with. Fails if the secret is the wrong kind for the header,
+*        or the header asks for more iterations than maxKdfIterations.
+*/
+bool deriveKey(const payloadKey_t&, const encryptionHeader_t&, uint8_t (&key)[payloadKeyBytes]);
+
+/**
+* @brief "chacha20-poly1305", or "none".
+*/
+const char* payloadCipherName(PayloadCipher);
+
+/**
+* @brief "pbkdf2-sha256" or "raw key".
+*/
+const char* keyDerivationName(KeyDerivation);
+
+
+
+/**
+* @brief The ChaCha20 kernels a machine can run, slowest first.
+*/
+enum class CipherKernel : uint8_t
+{
+	Scalar = 0,
+	SSE2,
+	AVX2
+};
+
+/**
+* @brief The fastest kernel this CPU runs.
+*/
+CipherKernel cipherKernel();
+
+/**
+* @brief True if this build and CPU can run the kernel.
+*/
+bool cipherKernelSupported(CipherKernel);
+
+/**
+* @brief "scalar", "sse2" or "avx2".
+*/
+const char* cipherKernelName(CipherKernel);
+
+/**
+* @brief XORs the ChaCha20 keystream into the data in place, starting position bytes into the
+*        stream of the given block counter. SSE2 runs 4 blocks at a time, AVX2 8.
+*/
+void chacha20Xor(const uint8_t (&key)[payloadKeyBytes], const uint8_t (&nonce)[cipherNonceBytes], uint32_t counter, uint64_t position,
+	uint8_t* data, size_t length, CipherKernel = cipherKernel());
+
+
+/**
+* @brief Incremental Poly1305 one-time authenticator, 44-bit limbs.
+*/
+class Poly1305
+{
+private:
+
+	uint64_t m_r[3]{}, m_h[3]{}, m_pad[2]{};
+	uint8_t m_buffer[16]{};
+	size_t m_buffered{ 0 };
+
+	void blocks(const uint8_t*, size_t, uint64_t highBit);
+
+public:
+
+	Poly1305() = default;
+	explicit Poly1305(const uint8_t (&key)[32]) { reset(key); }
+	~Poly1305();
+
+	/**
+	* @brief Starts over with a new one-time key.
+	*/
+	void reset(const uint8_t (&key)[32]);
+
+	void update(const uint8_t*, size_t);
+
+	/**
+	* @brief Pads what was buffered so far to 16 bytes with zeros, as the AEAD construction does between its parts.
+	*/
+	void pad();
+
+	void finish(uint8_t (&tag)[cipherTagBytes]);
+};
+
+
+/**
+* @brief PBKDF2 with HMAC-SHA256 (RFC 8018).
+*/
+void pbkdf2SHA256(const uint8_t* password, size_t passwordLength, const uint8_t* salt, size_t saltLength, uint32_t iterations, uint8_t* out, size_t outLength);
+
+/**
+* @brief SHA-256 of a buffer.
+*/
+void sha256(const uint8_t*, size_t, uint8_t (&digest)[32]);
+
+/**
+* @brief Overwrites secret bytes in a way the compiler cannot drop as a dead store.
+*/
+void wipeSecret(void*, size_t);
+
+
+
+/**
+* @brief Seals a payload chunk by chunk as the encoder reads it.
+*
+* Each read encrypts the bytes in place in the reader's own buffer and feeds them to the chunk's
+* Poly1305 state, then hands out the tag once the chunk is complete, so nothing beyond the
+* reader's buffers is ever held. size() is the sealed size.
+*/
+class EncryptingSource : public ByteSource
+{
+private:
+
+	ByteSource& m_input;
+	CodecStats& m_stats;
+
+	const encryptionHeader_t m_header;
+	const std::vector<uint8_t> m_headerBytes;
+	uint8_t m_key[payloadKeyBytes];
+
+	uint64_t m_position{ 0 };
+	uint64_t m_chunk{ UINT64_MAX };
+	uint8_t m_nonce[cipherNonceBytes]{};
+	uint8_t m_tag[cipherTagBytes]{};
+
+	Poly1305 m_mac;
+
+	void beginChunk(uint64_t);
+	void finishChunk();
+
+public:
+
+	EncryptingSource(ByteSource&, const encryptionHeader_t&, const uint8_t (&key)[payloadKeyBytes], CodecStats&);
+	~EncryptingSource() override;
+
+	EncryptingSource(const EncryptingSource&) = delete;
+	EncryptingSource& operator=(const EncryptingSource&) = delete;
+
+	uint64_t size() const override { return sealedSize(m_header.length, m_header.chunkBytes); }
+	bool read(uint8_t*, size_t) override;
+};
+
+
+
+/**
+* @brief Opens a sealed payload as the decoder writes it, passing on only checked plaintext.
+*
+* Each chunk is held back until its tag has arrived and matched, then decrypted and the part of
+* it inside [rangeStart, rangeEnd) written on. A mismatch stops the decode: write() returns false
+* and authentic() tells that apart from the output failing.
+*/
+class DecryptingSink : public ByteSink
+{
+private:
+
+	ByteSink& m_output;
+	CodecStats& m_stats;
+
+	const encryptionHeader_t m_header;
+	const std::vector<uint8_t> m_headerBytes;
+	uint8_t m_key[payloadKeyBytes];
+
+	const uint64_t m_rangeStart, m_rangeEnd;
+
+	uint64_t m_position{ 0 };
+	std::vector<uint8_t> m_chunk;
+	uint8_t m_tag[cipherTagBytes]{};
+	size_t m_tagBytes{ 0 };
+
+	bool m_authentic{ true };
+
+	bool openChunk(uint64_t);
+
+public:
+
+	DecryptingSink(ByteSink&, const encryptionHeader_t&, const uint8_t (&key)[payloadKeyBytes], uint64_t rangeStart, uint64_t rangeEnd, CodecStats&);
+	~DecryptingSink() override;
+
+	DecryptingSink(const DecryptingSink&) = delete;
+	DecryptingSink& operator=(const DecryptingSink&) = delete;
+
+	bool write(const uint8_t*, size_t) override;
+
+	/**
+	* @brief True once every sealed byte has arrived and every chunk matched its tag.
+	*/
+	bool complete() const { return m_authentic && m_position == sealedSize(m_header.length, m_header.chunkBytes); }
+
+	bool authentic() const { return m_authentic; }
+};
+
+
+#endif // !_ENCRYPTION_H_
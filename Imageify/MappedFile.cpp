@@ -0,0 +1,287 @@
+#include "MappedFile.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+
+
+FileSource::~FileSource()
+{
+    close();
+}
+
+
+
+#ifdef _WIN32
+
+PNGManipErrorCode MappedFile::open(const std::string& path)
+{
+    unmap();
+
+    m_fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_fileHandle == INVALID_HANDLE_VALUE)
+    {
+        m_fileHandle = nullptr;
+        return (GetLastError() == ERROR_FILE_NOT_FOUND) ? PNGManipErrorCode::FileNotFound : PNGManipErrorCode::FileNotReadable;
+    }
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(m_fileHandle, &fileSize))
+        return PNGManipErrorCode::FileNotReadable;
+
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+    if (m_size == 0)
+        return PNGManipErrorCode::Success;
+
+    m_mappingHandle = CreateFileMappingA(m_fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mappingHandle)
+        return PNGManipErrorCode::FileNotReadable;
+
+    m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if (!m_data)
+        return PNGManipErrorCode::MemoryAllocationError;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+void MappedFile::unmap()
+{
+    if (m_data)
+        UnmapViewOfFile(m_data);
+
+    if (m_mappingHandle)
+        CloseHandle(m_mappingHandle);
+
+    if (m_fileHandle)
+        CloseHandle(m_fileHandle);
+
+    m_data = nullptr;
+    m_mappingHandle = nullptr;
+    m_fileHandle = nullptr;
+    m_size = 0;
+}
+
+
+
+PNGManipErrorCode FileSource::open(const std::string& path)
+{
+    close();
+
+    m_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_handle == INVALID_HANDLE_VALUE)
+    {
+        m_handle = nullptr;
+        return (GetLastError() == ERROR_FILE_NOT_FOUND) ? PNGManipErrorCode::FileNotFound : PNGManipErrorCode::FileNotReadable;
+    }
+
+    LARGE_INTEGER fileSize{};
+    if (!GetFileSizeEx(m_handle, &fileSize))
+        return PNGManipErrorCode::FileNotReadable;
+
+    m_size = static_cast<uint64_t>(fileSize.QuadPart);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+bool FileSource::read(uint8_t* out, size_t length)
+{
+    while (length)
+    {
+        DWORD bytesRead{ 0 };
+        const DWORD toRead = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+
+        if (!ReadFile(m_handle, out, toRead, &bytesRead, nullptr) || bytesRead == 0)
+            return false;
+
+        out += bytesRead;
+        length -= bytesRead;
+    }
+
+    return true;
+}
+
+
+
+bool FileSource::peek(uint8_t* out, size_t length)
+{
+    if (length > m_size)
+        return false;
+
+    // Read from the start, then put the file pointer back where read() left it
+    LARGE_INTEGER position{}, start{};
+    if (!SetFilePointerEx(m_handle, start, &position, FILE_CURRENT) || !SetFilePointerEx(m_handle, start, nullptr, FILE_BEGIN))
+        return false;
+
+    const bool ok = read(out, length);
+
+    return SetFilePointerEx(m_handle, position, nullptr, FILE_BEGIN) && ok;
+}
+
+
+
+void FileSource::close()
+{
+    if (m_handle)
+        CloseHandle(m_handle);
+
+    m_handle = nullptr;
+    m_size = 0;
+}
+
+#else
+
+PNGManipErrorCode MappedFile::open(const std::string& path)
+{
+    unmap();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return (errno == ENOENT) ? PNGManipErrorCode::FileNotFound : PNGManipErrorCode::FileNotReadable;
+
+    struct stat fileInfo{};
+    if (fstat(fd, &fileInfo) != 0 || !S_ISREG(fileInfo.st_mode))
+    {
+        ::close(fd);
+        return PNGManipErrorCode::FileNotReadable;
+    }
+
+    m_size = static_cast<size_t>(fileInfo.st_size);
+    if (m_size == 0)
+    {
+        ::close(fd);
+        return PNGManipErrorCode::Success;
+    }
+
+    void* mapping = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        m_size = 0;
+        return PNGManipErrorCode::MemoryAllocationError;
+    }
+
+    madvise(mapping, m_size, MADV_SEQUENTIAL);
+
+    m_data = static_cast<const uint8_t*>(mapping);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+void MappedFile::unmap()
+{
+    if (m_data)
+        munmap(const_cast<uint8_t*>(m_data), m_size);
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+
+
+PNGManipErrorCode FileSource::open(const std::string& path)
+{
+    close();
+
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+        return (errno == ENOENT) ? PNGManipErrorCode::FileNotFound : PNGManipErrorCode::FileNotReadable;
+
+    struct stat fileInfo{};
+    if (fstat(m_fd, &fileInfo) != 0 || !S_ISREG(fileInfo.st_mode))
+    {
+        close();
+        return PNGManipErrorCode::FileNotReadable;
+    }
+
+    m_size = static_cast<uint64_t>(fileInfo.st_size);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+bool FileSource::read(uint8_t* out, size_t length)
+{
+    while (length)
+    {
+        ssize_t bytesRead = ::read(m_fd, out, length);
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+
+        if (bytesRead <= 0)
+            return false;
+
+        out += bytesRead;
+        length -= static_cast<size_t>(bytesRead);
+    }
+
+    return true;
+}
+
+
+
+bool FileSource::peek(uint8_t* out, size_t length)
+{
+    if (length > m_size)
+        return false;
+
+    // pread leaves the file offset alone, so read() carries on where it was
+    size_t done{ 0 };
+    while (done < length)
+    {
+        ssize_t bytesRead = ::pread(m_fd, out + done, length - done, static_cast<off_t>(done));
+        if (bytesRead < 0 && errno == EINTR)
+            continue;
+
+        if (bytesRead <= 0)
+            return false;
+
+        done += static_cast<size_t>(bytesRead);
+    }
+
+    return true;
+}
+
+
+
+void FileSource::close()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    m_fd = -1;
+    m_size = 0;
+}
+
+#endif
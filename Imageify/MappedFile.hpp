@@ -0,0 +1,93 @@
+#ifndef _MAPPEDFILE_H_
+#define _MAPPEDFILE_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "ErrorHandling.hpp"
+#include "ByteSource.hpp"
+
+
+
+/**
+* @brief A read-only memory mapping of a whole file.
+*
+* The file is opened once, sized with a single fstat and mapped for sequential access.
+* An empty file maps to a null pointer with a size of zero.
+*/
+class MappedFile
+{
+private:
+
+	const uint8_t* m_data{ nullptr };
+	size_t m_size{ 0 };
+
+#ifdef _WIN32
+	void* m_fileHandle{ nullptr };
+	void* m_mappingHandle{ nullptr };
+#endif
+
+	void unmap();
+
+public:
+
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	/**
+	* @brief Maps the file at the given path, replacing any previous mapping.
+	*/
+	PNGManipErrorCode open(const std::string&);
+
+	const uint8_t* data() const { return m_data; }
+	size_t size() const { return m_size; }
+};
+
+
+
+/**
+* @brief A ByteSource reading a file front to back with plain reads instead of a mapping.
+*
+* Used by the pipelined encoder, whose reader thread then does the actual disk I/O while the
+* other stages work on what it has already read.
+*/
+class FileSource : public ByteSource
+{
+private:
+
+#ifdef _WIN32
+	void* m_handle{ nullptr };
+#else
+	int m_fd{ -1 };
+#endif
+
+	uint64_t m_size{ 0 };
+
+	void close();
+
+public:
+
+	FileSource() = default;
+	~FileSource();
+
+	FileSource(const FileSource&) = delete;
+	FileSource& operator=(const FileSource&) = delete;
+
+	/**
+	* @brief Opens the file at the given path for sequential reading.
+	*/
+	PNGManipErrorCode open(const std::string&);
+
+	uint64_t size() const override { return m_size; }
+	bool read(uint8_t*, size_t) override;
+	bool peek(uint8_t*, size_t) override;
+};
+
+
+#endif // !_MAPPEDFILE_H_
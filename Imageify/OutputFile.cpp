@@ -0,0 +1,316 @@
+#include "OutputFile.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <cerrno>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+
+
+OutputFile::~OutputFile()
+{
+    close();
+}
+
+
+
+#ifdef _WIN32
+
+PNGManipErrorCode OutputFile::open(const std::string& path)
+{
+    close();
+
+    if (isStandardStream(path))
+    {
+        m_handle = GetStdHandle(STD_OUTPUT_HANDLE);
+        m_stream = true;
+
+        return (m_handle && m_handle != INVALID_HANDLE_VALUE) ? PNGManipErrorCode::Success : PNGManipErrorCode::FileNotWritable;
+    }
+
+    m_handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_handle == INVALID_HANDLE_VALUE)
+    {
+        m_handle = nullptr;
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+PNGManipErrorCode OutputFile::resize(uint64_t size)
+{
+    if (m_stream)
+        return PNGManipErrorCode::FileNotWritable;
+
+    LARGE_INTEGER position{};
+    position.QuadPart = static_cast<LONGLONG>(size);
+
+    if (!SetFilePointerEx(m_handle, position, nullptr, FILE_BEGIN) || !SetEndOfFile(m_handle))
+        return PNGManipErrorCode::FileNotWritable;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+bool OutputFile::writeAt(uint64_t offset, const uint8_t* data, size_t length)
+{
+    while (length)
+    {
+        OVERLAPPED position{};
+        position.Offset = static_cast<DWORD>(offset);
+        position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+        DWORD written{ 0 };
+        const DWORD toWrite = static_cast<DWORD>(std::min<size_t>(length, 1u << 30));
+
+        if (!WriteFile(m_handle, data, toWrite, &written, m_stream ? nullptr : &position) || written == 0)
+            return false;
+
+        data += written;
+        offset += written;
+        length -= written;
+    }
+
+    return true;
+}
+
+
+
+void OutputFile::close()
+{
+    // Standard output belongs to the process
+    if (m_handle && !m_stream)
+        CloseHandle(m_handle);
+
+    m_handle = nullptr;
+    m_stream = false;
+}
+
+#else
+
+PNGManipErrorCode OutputFile::open(const std::string& path)
+{
+    close();
+
+    if (isStandardStream(path))
+    {
+        m_fd = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        m_stream = true;
+
+        return (m_fd >= 0) ? PNGManipErrorCode::Success : PNGManipErrorCode::FileNotWritable;
+    }
+
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd < 0)
+        return PNGManipErrorCode::FileNotWritable;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+PNGManipErrorCode OutputFile::resize(uint64_t size)
+{
+    if (m_stream || ftruncate(m_fd, static_cast<off_t>(size)) != 0)
+        return PNGManipErrorCode::FileNotWritable;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+bool OutputFile::writeAt(uint64_t offset, const uint8_t* data, size_t length)
+{
+    while (length)
+    {
+        ssize_t written = m_stream ? ::write(m_fd, data, length) : pwrite(m_fd, data, length, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR)
+            continue;
+
+        if (written <= 0)
+            return false;
+
+        data += written;
+        offset += static_cast<uint64_t>(written);
+        length -= static_cast<size_t>(written);
+    }
+
+    return true;
+}
+
+
+
+void OutputFile::close()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+
+    m_fd = -1;
+    m_stream = false;
+}
+
+#endif
+
+
+
+FileSink::~FileSink()
+{
+    discard();
+}
+
+
+
+void FileSink::discard()
+{
+    m_file.close();
+
+    if (!m_temporary.empty())
+    {
+        std::error_code ignored;
+        std::filesystem::remove(m_temporary, ignored);
+    }
+
+    m_temporary.clear();
+}
+
+
+
+PNGManipErrorCode FileSink::open(const std::string& path, std::ostream* echo)
+{
+    discard();
+
+    m_path = path;
+    m_buffer.clear();
+    m_position = 0;
+    m_echo = echo;
+
+    return m_file.open(path);
+}
+
+
+
+bool FileSink::flushBuffer()
+{
+    if (m_buffer.empty())
+        return true;
+
+    const bool written = m_file.writeAt(m_position, m_buffer.data(), m_buffer.size());
+
+    m_position += m_buffer.size();
+    m_buffer.clear();
+
+    return written;
+}
+
+
+
+bool FileSink::write(const uint8_t* data, size_t length)
+{
+    if (m_echo)
+        m_echo->write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(length));
+
+    // Large pieces skip the buffer
+    if (length >= bufferBytes)
+    {
+        if (!flushBuffer() || !m_file.writeAt(m_position, data, length))
+            return false;
+
+        m_position += length;
+        return true;
+    }
+
+    if (m_buffer.size() + length > bufferBytes && !flushBuffer())
+        return false;
+
+    if (m_buffer.capacity() < bufferBytes)
+        m_buffer.reserve(bufferBytes);
+
+    m_buffer.insert(m_buffer.end(), data, data + length);
+    return true;
+}
+
+
+
+bool FileSink::resize(uint64_t size)
+{
+    if (m_echo || !m_buffer.empty() || m_position != 0)
+        return false;
+
+    return m_file.resize(size) == PNGManipErrorCode::Success;
+}
+
+
+
+bool FileSink::writeAt(uint64_t offset, const uint8_t* data, size_t length)
+{
+    return m_file.writeAt(offset, data, length);
+}
+
+
+
+bool FileSink::flush()
+{
+    return flushBuffer();
+}
+
+
+
+PNGManipErrorCode FileSink::close()
+{
+    const bool flushed = flushBuffer();
+    m_file.close();
+
+    return flushed ? PNGManipErrorCode::Success : PNGManipErrorCode::FileNotWritable;
+}
+
+
+
+PNGManipErrorCode FileSink::openReplacing(const std::string& path, std::ostream* echo)
+{
+    if (isStandardStream(path))
+        return open(path, echo);
+
+    const PNGManipErrorCode result = open(path + ".part", echo);
+
+    if (result == PNGManipErrorCode::Success)
+        m_temporary = path + ".part";
+
+    m_path = path;
+    return result;
+}
+
+
+
+PNGManipErrorCode FileSink::commit()
+{
+    PNGManipErrorCode result = close();
+
+    if (m_temporary.empty())
+        return result;
+
+    std::error_code error;
+    if (result == PNGManipErrorCode::Success)
+        std::filesystem::rename(m_temporary, m_path, error);
+
+    if (result != PNGManipErrorCode::Success || error)
+    {
+        discard();
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    m_temporary.clear();
+    return PNGManipErrorCode::Success;
+}
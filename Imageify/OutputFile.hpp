@@ -0,0 +1,132 @@
+#ifndef _OUTPUTFILE_H_
+#define _OUTPUTFILE_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ErrorHandling.hpp"
+#include "ByteSink.hpp"
+
+
+
+/**
+* @brief Whether a path given on the command line names standard input or output, "-".
+*/
+inline bool isStandardStream(const std::string& path) { return path == "-"; }
+
+
+
+/**
+* @brief An output file that several threads can write into at independent offsets.
+*
+* Opening "-" writes to standard output instead. A pipe cannot seek, so it cannot be
+* resized and takes every write at its end, in the order they come.
+*/
+class OutputFile
+{
+private:
+
+#ifdef _WIN32
+	void* m_handle{ nullptr };
+#else
+	int m_fd{ -1 };
+#endif
+
+	bool m_stream{ false };
+
+public:
+
+	OutputFile() = default;
+	~OutputFile();
+
+	OutputFile(const OutputFile&) = delete;
+	OutputFile& operator=(const OutputFile&) = delete;
+
+	/**
+	* @brief Creates or truncates the file at the given path, or opens standard output for "-".
+	*/
+	PNGManipErrorCode open(const std::string&);
+
+	/**
+	* @brief Sets the final size of the file up front, so writes can land anywhere in it.
+	*/
+	PNGManipErrorCode resize(uint64_t);
+
+	/**
+	* @brief Writes the whole buffer at the given offset. Safe to call concurrently.
+	*/
+	bool writeAt(uint64_t, const uint8_t*, size_t);
+
+	void close();
+};
+
+
+
+/**
+* @brief A ByteSink writing to an OutputFile, buffering appends into large writes.
+*
+* When an echo stream is given every appended byte is also copied to it, which is how
+* --show prints the decoded payload. Positional writes are refused in that case, so the
+* codec falls back to appending in order and the echo stays readable.
+*
+* A decode is only known to be good once its checksum matched, after the last write. Opened
+* with openReplacing(), the bytes go to path.part and only commit() moves them onto the path,
+* so a failed decode never leaves a damaged file where the output should be.
+*/
+class FileSink : public ByteSink
+{
+private:
+
+	static constexpr size_t bufferBytes = 1024 * 1024;
+
+	OutputFile m_file;
+	std::string m_path, m_temporary;
+	std::vector<uint8_t> m_buffer;
+	uint64_t m_position{ 0 };
+	std::ostream* m_echo{ nullptr };
+
+	bool flushBuffer();
+
+public:
+
+	FileSink() = default;
+	~FileSink();
+
+	/**
+	* @brief Creates or truncates the file at the given path, or opens standard output for "-".
+	*/
+	PNGManipErrorCode open(const std::string&, std::ostream* echo = nullptr);
+
+	/**
+	* @brief Like open(), but writes to a temporary file next to the path until commit().
+	*/
+	PNGManipErrorCode openReplacing(const std::string&, std::ostream* echo = nullptr);
+
+	bool write(const uint8_t*, size_t) override;
+	bool resize(uint64_t) override;
+	bool writeAt(uint64_t, const uint8_t*, size_t) override;
+	bool flush() override;
+
+	/**
+	* @brief Writes out anything still buffered and closes the file.
+	*/
+	PNGManipErrorCode close();
+
+	/**
+	* @brief Closes the file and, after openReplacing(), renames it onto the path it stands in for.
+	*/
+	PNGManipErrorCode commit();
+
+	/**
+	* @brief Closes the file, removing the temporary one of openReplacing() if commit() never moved it.
+	*/
+	void discard();
+};
+
+
+#endif // !_OUTPUTFILE_H_
@@ -0,0 +1,633 @@
+#include "PNGArchive.hpp"
+#include "OutputFile.hpp"
+#include "WorkStealingPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+
+
+namespace fs = std::filesystem;
+
+
+
+// A file to pack, and where it goes in the payload
+struct packFile_t
+{
+    fs::path path;
+    std::string name;
+    uint64_t size;
+
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+    uint32_t crc{ 0 };
+};
+
+
+
+// Refuses names that would write outside the output directory when unpacked
+static bool safeMemberName(const std::string& name)
+{
+    const fs::path path(name);
+
+    if (name.empty() || path.has_root_name() || path.has_root_directory())
+        return false;
+
+    for (const fs::path& part : path)
+        if (part == ".." || part == ".")
+            return false;
+
+    return true;
+}
+
+
+
+static std::string formatCRC(uint32_t crc)
+{
+    char text[9];
+    std::snprintf(text, sizeof(text), "%08x", crc);
+    return text;
+}
+
+
+
+/**
+* @brief Takes the payload of a whole archive front to back and writes each member to its own file.
+*
+* Members are written in offset order, one file open at a time, and checksummed as they go.
+* Each goes to a temporary file that only replaces the member's path once its CRC matched.
+* A member that cannot be written or does not match its CRC is recorded and the rest carry on.
+*/
+class memberWriter_t : public ByteSink
+{
+private:
+
+    const fs::path m_directory;
+    const std::vector<archiveMember_t>& m_members;
+
+    FileSink m_file;
+    bool m_open{ false };
+    uint32_t m_crc{ 0 };
+
+    size_t m_current{ 0 };
+    uint64_t m_position{ 0 };
+
+    bool openMember(const archiveMember_t& member)
+    {
+        const fs::path path = m_directory / fs::path(member.name);
+
+        std::error_code error;
+        fs::create_directories(path.parent_path(), error);
+
+        m_open = (m_file.openReplacing(path.string()) == PNGManipErrorCode::Success);
+        m_crc = 0;
+
+        if (!m_open)
+            failures.push_back(member.name + ": cannot open output file " + path.string());
+
+        return m_open;
+    }
+
+    // Closes the member being written, or creates an empty one
+    void finishMember(const archiveMember_t& member)
+    {
+        if (!m_open && member.size == 0)
+            openMember(member);
+
+        if (m_open)
+        {
+            if (m_crc != member.crc)
+            {
+                m_file.discard();
+                failures.push_back(member.name + ": checksum mismatch, the member is damaged");
+            }
+            else if (m_file.commit() != PNGManipErrorCode::Success)
+                failures.push_back(member.name + ": error writing the output file");
+            else
+                ++written;
+        }
+
+        m_open = false;
+    }
+
+public:
+
+    std::vector<std::string> failures;
+    size_t written{ 0 };
+
+    // The members must be sorted by offset and must not overlap
+    memberWriter_t(const fs::path& directory, const std::vector<archiveMember_t>& members) : m_directory{ directory }, m_members{ members } {}
+
+    bool write(const uint8_t* data, size_t length) override
+    {
+        while (length)
+        {
+            while (m_current < m_members.size() && m_position >= m_members[m_current].offset + m_members[m_current].size)
+                finishMember(m_members[m_current++]);
+
+            if (m_current == m_members.size())
+                break;
+
+            const archiveMember_t& member = m_members[m_current];
+
+            // Bytes no member owns
+            size_t take = static_cast<size_t>(std::min<uint64_t>(length, member.offset > m_position ? member.offset - m_position : 0));
+
+            if (take == 0)
+            {
+                take = static_cast<size_t>(std::min<uint64_t>(length, member.offset + member.size - m_position));
+
+                // A member that cannot be opened is skipped, the others still get written
+                if ((m_open || (m_position == member.offset && openMember(member))) && !m_file.write(data, take))
+                {
+                    failures.push_back(member.name + ": error writing the output file");
+                    m_file.discard();
+                    m_open = false;
+                }
+
+                if (m_open)
+                    m_crc = crc32c(m_crc, data, take);
+            }
+
+            data += take;
+            length -= take;
+            m_position += take;
+        }
+
+        return true;
+    }
+
+    /**
+    * @brief Closes the last member and creates any empty ones left at the end.
+    */
+    void finish()
+    {
+        for (; m_current < m_members.size(); ++m_current)
+        {
+            if (m_position < m_members[m_current].offset + m_members[m_current].size)
+            {
+                failures.push_back(m_members[m_current].name + ": the payload ends before it does");
+                m_file.discard();
+                m_open = false;
+                continue;
+            }
+
+            finishMember(m_members[m_current]);
+        }
+    }
+};
+
+
+
+
+PNGManipErrorCode PNGArchive::pack()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> inputs{ inputFile };
+    inputs.insert(inputs.end(), archive.inputs.begin(), archive.inputs.end());
+
+    // Directories keep their own name at the top of their members, as tar does
+    std::vector<packFile_t> files;
+
+    for (const std::string& input : inputs)
+    {
+        std::error_code error;
+        fs::path root = fs::absolute(input, error).lexically_normal();
+
+        if (root.filename().empty())
+            root = root.parent_path();
+
+        if (!fs::exists(root, error))
+        {
+            logError("Input file not found: " + input);
+            return PNGManipErrorCode::FileNotFound;
+        }
+
+        const fs::path base = root.parent_path();
+
+        if (fs::is_directory(root, error))
+        {
+            for (auto entry = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, error);
+                 entry != fs::recursive_directory_iterator(); entry.increment(error))
+            {
+                if (error)
+                    break;
+
+                std::error_code fileError;
+                if (entry->is_regular_file(fileError))
+                    files.push_back({ entry->path(), entry->path().lexically_relative(base).generic_string(), entry->file_size(fileError) });
+            }
+        }
+        else
+            files.push_back({ root, root.filename().generic_string(), fs::file_size(root, error) });
+
+        if (error)
+        {
+            logError("Input file not readable: " + input);
+            return PNGManipErrorCode::FileNotReadable;
+        }
+    }
+
+    if (files.empty())
+    {
+        logError("No files to pack.");
+        return PNGManipErrorCode::FileNotFound;
+    }
+
+    std::sort(files.begin(), files.end(), [](const packFile_t& a, const packFile_t& b) { return a.name < b.name; });
+
+    uint64_t total{ 0 };
+    archiveManifest_t manifest{ .version = archiveVersion };
+
+    for (size_t i{ 0 }; i < files.size(); ++i)
+    {
+        if (i && files[i].name == files[i - 1].name)
+        {
+            logError("Two inputs would both be named " + files[i].name + " in the archive.");
+            return PNGManipErrorCode::InvalidFileFormat;
+        }
+
+        if (files[i].name.size() > UINT16_MAX)
+        {
+            logError("Name too long for the archive: " + files[i].name);
+            return PNGManipErrorCode::InvalidFileFormat;
+        }
+
+        manifest.members.push_back({ files[i].name, total, files[i].size, 0 });
+        total += files[i].size;
+    }
+
+    if (total > PNGCodec::maxPayloadBytesFor(options.format))
+    {
+        logError("The files add up to more than one image can hold, pack fewer of them at a time.");
+        return PNGManipErrorCode::EncodingError;
+    }
+
+
+    // Every file is read into its own slice of the payload at once
+    std::unique_ptr<uint8_t[]> payload;
+
+    try
+    {
+        payload = std::make_unique_for_overwrite<uint8_t[]>(static_cast<size_t>(std::max<uint64_t>(total, 1)));
+    }
+    catch (const std::bad_alloc&)
+    {
+        logError("Not enough memory to pack the files.");
+        return PNGManipErrorCode::MemoryAllocationError;
+    }
+
+    WorkStealingPool pool(archive.jobs);
+
+    pool.run(files.size(), [&](size_t i, unsigned)
+    {
+        packFile_t& file = files[i];
+        uint8_t* slice = payload.get() + manifest.members[i].offset;
+
+        FileSource source;
+        file.result = source.open(file.path.string());
+
+        // A file that grew or shrank since it was listed would spill into its neighbours
+        if (file.result == PNGManipErrorCode::Success && (source.size() != file.size || !source.read(slice, static_cast<size_t>(file.size))))
+            file.result = PNGManipErrorCode::FileNotReadable;
+
+        if (file.result == PNGManipErrorCode::Success)
+            file.crc = crc32c(0, slice, static_cast<size_t>(file.size));
+    });
+
+    const auto readEnd = std::chrono::high_resolution_clock::now();
+
+    for (size_t i{ 0 }; i < files.size(); ++i)
+    {
+        if (files[i].result != PNGManipErrorCode::Success)
+        {
+            logError(((files[i].result == PNGManipErrorCode::FileNotFound) ? "Input file not found: " : "Input file not readable: ") + files[i].path.string());
+            return files[i].result;
+        }
+
+        manifest.members[i].crc = files[i].crc;
+    }
+
+
+    // Banded, so extracting one member only inflates the bands that hold it
+    PNGManipOptions packOptions = options;
+    packOptions.archive = std::move(manifest);
+    packOptions.bands = true;
+
+    PNGCodec codec(packOptions);
+
+    FileSink output;
+    if (output.open(outputFile) != PNGManipErrorCode::Success)
+    {
+        logError("Cannot open output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    PNGManipErrorCode result = codec.encode({ reinterpret_cast<const std::byte*>(payload.get()), static_cast<size_t>(total) }, output);
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(codec.errorMessage());
+        return result;
+    }
+
+    if (output.close() != PNGManipErrorCode::Success)
+    {
+        logError("Error writing output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+
+    const imageInfo_t& info = codec.info();
+
+    std::cout << "[INFO] Packed \033[36m" << files.size() << "\033[0m files, \033[36m" << static_cast<float>(total / 1024.0)
+        << " KB\033[0m, read on \033[36m" << pool.size() << "\033[0m workers" << std::endl
+        << "[INFO] Resultant Image Dimensions: \033[36m" << info.width << " x " << info.height << "\033[0m" << std::endl
+        << "\n\033[32m" << "Archive encoded successfully!" << "\033[0m\n"
+        << "\nArchive took: \033[36m" << seconds << " seconds\033[0m\n";
+
+    if (options.stats)
+    {
+        CodecStats report(true);
+        report.add(CodecStage::Read, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(readEnd - start).count()), total);
+        report.merge(codec.stats());
+
+        writeStatsJSON(std::cerr, "archive-encode", inputFile, report, seconds, total);
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGArchive::readManifest(PNGCodec& codec)
+{
+    PNGManipErrorCode result = inputMapping.open(inputFile);
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(((result == PNGManipErrorCode::FileNotFound) ? "Input file not found: " : "Input file not readable: ") + inputFile);
+        return result;
+    }
+
+    result = codec.probe({ reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() });
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(codec.errorMessage());
+        return result;
+    }
+
+    const imageInfo_t& info = codec.info();
+
+    if (info.archive.version == 0)
+    {
+        logError("The image is not an archive, decode it without --archive or --extract.");
+        return PNGManipErrorCode::InvalidFileFormat;
+    }
+
+    // Members must tile the payload without overlapping, or one would be written over another
+    std::vector<archiveMember_t> members = info.archive.members;
+    std::sort(members.begin(), members.end(), [](const archiveMember_t& a, const archiveMember_t& b) { return a.offset < b.offset; });
+
+    uint64_t end{ 0 };
+    for (const archiveMember_t& member : members)
+    {
+        if (member.offset < end || member.offset + member.size > info.payloadSize)
+        {
+            logError("The archive manifest does not match its payload, the image is damaged.");
+            return PNGManipErrorCode::InvalidFileFormat;
+        }
+
+        end = member.offset + member.size;
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGArchive::list()
+{
+    PNGCodec codec;
+
+    PNGManipErrorCode result = readManifest(codec);
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    const imageInfo_t& info = codec.info();
+
+    std::cout << "[INFO] Archive of \033[36m" << info.archive.members.size() << "\033[0m files, \033[36m"
+        << static_cast<float>(info.payloadSize / 1024.0) << " KB\033[0m in a \033[36m" << info.width << " x " << info.height
+        << "\033[0m image, manifest \033[36mv" << static_cast<int>(info.archive.version) << "\033[0m\n\n";
+
+    std::cout << std::setw(14) << "bytes" << "  crc32c    name\n";
+
+    for (const archiveMember_t& member : info.archive.members)
+        std::cout << std::setw(14) << member.size << "  " << formatCRC(member.crc) << "  " << member.name << "\n";
+
+    std::cout << std::flush;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGArchive::extractMember()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    PNGCodec probe;
+
+    PNGManipErrorCode result = readManifest(probe);
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    const archiveMember_t* member = findArchiveMember(probe.info().archive, archive.member);
+    if (!member)
+    {
+        logError("No member named " + archive.member + " in the archive.");
+        return PNGManipErrorCode::FileNotFound;
+    }
+
+    const std::string output = outputFile.empty() ? fs::path(member->name).filename().string() : outputFile;
+    const bool showOutput = (terminalOutput == "TRUE");
+
+    // Written beside the output until the member's CRC matched
+    FileSink sink;
+    if (sink.openReplacing(output, showOutput ? &std::cout : nullptr) != PNGManipErrorCode::Success)
+    {
+        logError("Cannot open output file: " + output);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    if (showOutput)
+        std::cout << "\nDecoded Output:\n";
+
+    // Only the member's bytes are decoded, and checked against its own CRC
+    PNGManipOptions rangeOptions = options;
+    rangeOptions.hasRange = true;
+    rangeOptions.rangeOffset = member->offset;
+    rangeOptions.rangeLength = member->size;
+
+    PNGCodec codec(rangeOptions);
+    CodecStats checksumStats(options.stats);
+    ChecksumSink checked(sink, checksumStats);
+
+    if (member->size)
+        result = codec.decode({ reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() }, checked);
+
+    payloadChecksum_t computed;
+
+    if (result == PNGManipErrorCode::Success && (!checked.result(computed) || computed.length != member->size || computed.crc != member->crc))
+        result = PNGManipErrorCode::DecodingError;
+
+    if (result == PNGManipErrorCode::Success && sink.commit() != PNGManipErrorCode::Success)
+    {
+        logError("Error writing output file: " + output);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    if (showOutput)
+        std::cout << std::endl;
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(codec.errorMessage().empty() ? member->name + ": checksum mismatch, the member is damaged." : codec.errorMessage());
+        return result;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << "\n[INFO] Extracted \033[36m" << member->name << "\033[0m, \033[36m" << member->size << " bytes\033[0m (CRC-32C "
+        << formatCRC(member->crc) << ") to \033[36m" << output << "\033[0m" << std::endl
+        << "\n\033[32m" << "Member extracted successfully!" << "\033[0m\n"
+        << "\nExtraction took: \033[36m" << seconds * 1e3 << " milliseconds\033[0m\n";
+
+    if (options.stats)
+    {
+        CodecStats report(true);
+        report.merge(codec.stats());
+        report.merge(checksumStats);
+
+        writeStatsJSON(std::cerr, "archive-extract", inputFile, report, seconds, member->size);
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGArchive::extractAll()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    PNGCodec probe;
+
+    PNGManipErrorCode result = readManifest(probe);
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    std::vector<archiveMember_t> members = probe.info().archive.members;
+    std::sort(members.begin(), members.end(), [](const archiveMember_t& a, const archiveMember_t& b) { return a.offset < b.offset; });
+
+    for (const archiveMember_t& member : members)
+    {
+        if (!safeMemberName(member.name))
+        {
+            logError("Refusing to unpack a member named " + member.name + ", it would land outside the output directory.");
+            return PNGManipErrorCode::InvalidFileFormat;
+        }
+    }
+
+    const fs::path directory = outputFile.empty() ? fs::path(".") : fs::path(outputFile);
+
+    std::error_code error;
+    if (!fs::create_directories(directory, error) && error)
+    {
+        logError("Cannot create output directory: " + directory.string());
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    // The whole payload in one pass, each member checked against its own CRC instead of ifCK
+    PNGManipOptions decodeOptions = options;
+    decodeOptions.hasRange = false;
+
+    PNGCodec codec(decodeOptions);
+    memberWriter_t writer(directory, members);
+
+    result = codec.decode({ reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() }, writer);
+    writer.finish();
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(codec.errorMessage());
+        return result;
+    }
+
+    for (const std::string& failure : writer.failures)
+        logError(failure);
+
+    const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    const uint64_t payloadBytes = codec.info().payloadSize;
+
+    std::cout << "\n" << (writer.failures.empty() ? "\033[32m" : "\033[33m") << writer.written << " of " << members.size()
+        << " files unpacked\033[0m to \033[36m" << directory.string() << "\033[0m\n"
+        << "\nUnpacking took: \033[36m" << seconds << " seconds\033[0m\n";
+
+    if (options.stats)
+    {
+        CodecStats report(true);
+        report.merge(codec.stats());
+
+        writeStatsJSON(std::cerr, "archive-decode", inputFile, report, seconds, payloadBytes);
+    }
+
+    return writer.failures.empty() ? PNGManipErrorCode::Success : PNGManipErrorCode::DecodingError;
+}
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+PNGArchive::PNGArchive(const std::string& type, const std::string& input, const std::string& output, const std::string& terminalDisp, const PNGManipOptions& opts, const PNGArchiveOptions& archiveOpts) :
+    processType{ type },
+    inputFile{ input },
+    outputFile{ output },
+    terminalOutput{ terminalDisp },
+    options{ opts },
+    archive{ archiveOpts }
+{
+}
+
+
+
+PNGManipErrorCode PNGArchive::startProcess()
+{
+    if (processType == "LIST")
+        return list();
+
+    if (processType == "ENCODE" && archive.member.empty())
+        return pack();
+
+    if (processType == "DECODE")
+        return archive.member.empty() ? extractAll() : extractMember();
+
+    logError("Archives are packed with --encode and --archive, and read with --list, or --decode and --archive or --extract.");
+    return PNGManipErrorCode::UnknownError;
+}
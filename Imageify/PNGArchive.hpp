@@ -0,0 +1,79 @@
+#ifndef _PNGARCHIVE_H_
+#define _PNGARCHIVE_H_
+
+
+#include <string>
+#include <vector>
+
+#include "ErrorHandling.hpp"
+#include "MappedFile.hpp"
+#include "PNGCodec.hpp"
+
+
+
+/**
+* @brief Archive mode switches, filled in from the command line.
+*/
+struct PNGArchiveOptions
+{
+	// --archive: pack every input into one image, or unpack every member of one
+	bool enabled{ false };
+
+	// --extract: decode only this member
+	std::string member;
+
+	// Files read at once while packing, 0 for one per core
+	unsigned jobs{ 0 };
+
+	// Further files and directories to pack after the -e input
+	std::vector<std::string> inputs;
+};
+
+
+
+/**
+* @brief Packs many files into one image with a manifest, lists it, and extracts from it.
+*
+* Packing reads every file at once on a work-stealing pool, each straight into its slice of
+* one payload and checksummed on the way, then encodes the payload as a single banded image
+* with the manifest of names, offsets, sizes and CRC-32Cs in an ifAR chunk ahead of the image
+* data. One image costs one set of PNG headers and one zlib stream for any number of files.
+*
+* Listing reads only the chunks before the image data. Extracting one member decodes just its
+* byte range, inflating only the bands that hold it; unpacking everything decodes the payload
+* once, front to back, into one file after another. Either way every member is checked against
+* its CRC-32C, and names that would land outside the output directory are refused.
+*/
+class PNGArchive
+{
+private:
+
+	const std::string processType, inputFile, outputFile, terminalOutput;
+	const PNGManipOptions options;
+	const PNGArchiveOptions archive;
+
+	MappedFile inputMapping;
+
+
+	PNGManipErrorCode pack();
+	PNGManipErrorCode list();
+	PNGManipErrorCode extractMember();
+	PNGManipErrorCode extractAll();
+
+	/**
+	* @brief Maps the input image and reads its manifest, failing if it is not an archive.
+	*/
+	PNGManipErrorCode readManifest(PNGCodec&);
+
+public:
+
+	/**
+	* @brief Constructor for PNGArchive class.
+	*/
+	PNGArchive(const std::string&, const std::string&, const std::string&, const std::string&, const PNGManipOptions&, const PNGArchiveOptions&);
+
+	PNGManipErrorCode startProcess();
+};
+
+
+#endif // !_PNGARCHIVE_H_
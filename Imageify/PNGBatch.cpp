@@ -0,0 +1,236 @@
+#include "PNGBatch.hpp"
+#include "WorkStealingPool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <new>
+
+
+
+PNGManipErrorCode PNGBatch::collectInputs()
+{
+    std::vector<std::string> paths;
+
+    for (const std::string& input : batch.inputs)
+    {
+        std::error_code error;
+
+        if (input.size() > 1 && input[0] == '@')
+        {
+            std::ifstream list(input.substr(1));
+            if (!list.is_open())
+            {
+                logError("Cannot read list file: " + input.substr(1));
+                return PNGManipErrorCode::FileNotReadable;
+            }
+
+            for (std::string line; std::getline(list, line); )
+            {
+                if (!line.empty() && line.back() == '\r')
+                    line.pop_back();
+
+                if (!line.empty())
+                    paths.push_back(line);
+            }
+        }
+        else if (std::filesystem::is_directory(input, error))
+        {
+            std::vector<std::string> files;
+
+            for (const auto& entry : std::filesystem::directory_iterator(input, error))
+                if (entry.is_regular_file(error))
+                    files.push_back(entry.path().string());
+
+            std::sort(files.begin(), files.end());
+            paths.insert(paths.end(), files.begin(), files.end());
+        }
+        else
+        {
+            // Missing files are reported with the rest of the batch
+            paths.push_back(input);
+        }
+    }
+
+    jobs.clear();
+    jobs.reserve(paths.size());
+
+    for (const std::string& path : paths)
+        jobs.push_back({ .input = path, .output = getOutputPath(path) });
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+std::string PNGBatch::getOutputPath(const std::string& input) const
+{
+    const std::filesystem::path inputPath(input);
+    std::filesystem::path name = inputPath.filename();
+
+    if (processType == "ENCODE")
+        name += ".png";
+    else if (name.extension() == ".png")
+        name = name.stem();
+    else
+        name += ".out";
+
+    const std::filesystem::path directory = outputDirectory.empty() ? inputPath.parent_path() : std::filesystem::path(outputDirectory);
+
+    return (directory / name).string();
+}
+
+
+
+void PNGBatch::runJob(job_t& job, worker_t& worker) const
+{
+    const auto started = worker.stats.start();
+    job.result = worker.input.open(job.input);
+    worker.stats.stop(CodecStage::Read, started, worker.input.size());
+
+    if (job.result != PNGManipErrorCode::Success)
+    {
+        job.message = (job.result == PNGManipErrorCode::FileNotFound) ? "Input file not found." : "Input file not readable.";
+        return;
+    }
+
+    // A decode only replaces its output once the payload matched its checksum
+    const PNGManipErrorCode opened = (processType == "DECODE") ? worker.output.openReplacing(job.output) : worker.output.open(job.output);
+
+    if (opened != PNGManipErrorCode::Success)
+    {
+        job.result = PNGManipErrorCode::FileNotWritable;
+        job.message = "Cannot open output file: " + job.output;
+        return;
+    }
+
+    const std::span<const std::byte> input{ reinterpret_cast<const std::byte*>(worker.input.data()), worker.input.size() };
+
+    try
+    {
+        job.result = (processType == "ENCODE") ? worker.codec.encode(input, worker.output) : worker.codec.decode(input, worker.output);
+    }
+    catch (const std::bad_alloc&)
+    {
+        job.result = PNGManipErrorCode::MemoryAllocationError;
+    }
+
+    const PNGManipErrorCode closed = (job.result == PNGManipErrorCode::Success) ? worker.output.commit() : PNGManipErrorCode::Success;
+    worker.stats.merge(worker.codec.stats());
+
+    if (job.result != PNGManipErrorCode::Success)
+    {
+        worker.output.discard();
+        job.message = worker.codec.errorMessage().empty() ? errorCodeToString(job.result) : worker.codec.errorMessage();
+        return;
+    }
+
+    if (closed != PNGManipErrorCode::Success)
+    {
+        job.result = closed;
+        job.message = "Error writing output file: " + job.output;
+        return;
+    }
+
+    const imageInfo_t& info = worker.codec.info();
+    job.payloadBytes = (processType == "ENCODE") ? input.size() : info.rangeEnd - info.rangeStart;
+}
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+PNGBatch::PNGBatch(const std::string& type, const std::string& outputDir, const PNGManipOptions& opts, const PNGBatchOptions& batchOpts) :
+    processType{ type },
+    outputDirectory{ outputDir },
+    options{ opts },
+    batch{ batchOpts }
+{
+}
+
+
+
+PNGManipErrorCode PNGBatch::startProcess()
+{
+    if (processType != "ENCODE" && processType != "DECODE")
+    {
+        logError("Invalid process type. Use 'ENCODE' or 'DECODE'.\n");
+        return PNGManipErrorCode::UnknownError;
+    }
+
+    PNGManipErrorCode result = collectInputs();
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    if (jobs.empty())
+    {
+        logError("No input files for the batch.");
+        return PNGManipErrorCode::FileNotFound;
+    }
+
+    std::error_code error;
+    if (!outputDirectory.empty() && !std::filesystem::create_directories(outputDirectory, error) && error)
+    {
+        logError("Cannot create output directory: " + outputDirectory);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+
+    WorkStealingPool pool(batch.jobs);
+
+    std::vector<std::unique_ptr<worker_t>> workers;
+    for (unsigned w{ 0 }; w < pool.size(); ++w)
+        workers.push_back(std::make_unique<worker_t>(options));
+
+    std::cout << "[INFO] Processing \033[36m" << jobs.size() << "\033[0m files on \033[36m" << pool.size() << "\033[0m workers" << std::endl;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    pool.run(jobs.size(), [&](size_t job, unsigned worker) { runJob(jobs[job], *workers[worker]); });
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+
+    // Reported after the run, in input order, so worker output never interleaves
+    size_t succeeded{ 0 };
+    uint64_t payloadBytes{ 0 };
+    result = PNGManipErrorCode::Success;
+
+    for (const job_t& job : jobs)
+    {
+        if (job.result == PNGManipErrorCode::Success)
+        {
+            ++succeeded;
+            payloadBytes += job.payloadBytes;
+            continue;
+        }
+
+        logError(job.input + ": " + job.message);
+
+        if (result == PNGManipErrorCode::Success)
+            result = job.result;
+    }
+
+    const double megabytes = payloadBytes / (1024.0 * 1024.0);
+
+    std::cout << "\n" << ((succeeded == jobs.size()) ? "\033[32m" : "\033[33m")
+        << succeeded << " of " << jobs.size() << " files " << ((processType == "ENCODE") ? "encoded" : "decoded") << "\033[0m\n"
+        << "\nBatch took: \033[36m" << seconds << " seconds\033[0m"
+        << "  (\033[36m" << jobs.size() / seconds << "\033[0m files/s, \033[36m" << megabytes / seconds << "\033[0m MB/s)\n";
+
+    if (options.stats)
+    {
+        CodecStats report(true);
+        for (const auto& worker : workers)
+            report.merge(worker->stats);
+
+        writeStatsJSON(std::cerr, (processType == "ENCODE") ? "batch-encode" : "batch-decode", "", report, seconds, payloadBytes);
+    }
+
+    return result;
+}
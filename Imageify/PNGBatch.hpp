@@ -0,0 +1,99 @@
+#ifndef _PNGBATCH_H_
+#define _PNGBATCH_H_
+
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ErrorHandling.hpp"
+#include "MappedFile.hpp"
+#include "OutputFile.hpp"
+#include "PNGCodec.hpp"
+
+
+
+/**
+* @brief Batch mode switches, filled in from the command line.
+*/
+struct PNGBatchOptions
+{
+	bool enabled{ false };
+
+	// Files processed at once, 0 for one per core
+	unsigned jobs{ 0 };
+
+	// Files, directories (every regular file directly inside) and @list files (one path per line)
+	std::vector<std::string> inputs;
+};
+
+
+
+/**
+* @brief Encodes or decodes many files in one process on a work-stealing pool.
+*
+* Each worker keeps its own codec, input mapping and output sink for the whole batch, so the
+* pixel, row and output buffers are allocated once per worker rather than once per file.
+* A failing file is recorded and reported at the end; it never stops the rest of the batch.
+*/
+class PNGBatch
+{
+private:
+
+	struct job_t
+	{
+		std::string input{}, output{};
+
+		PNGManipErrorCode result{ PNGManipErrorCode::UnknownError };
+		std::string message{};
+
+		// Payload bytes encoded or decoded
+		uint64_t payloadBytes{ 0 };
+	};
+
+	struct worker_t
+	{
+		PNGCodec codec;
+		MappedFile input;
+		FileSink output;
+
+		// Every file's stages added up, for --stats
+		CodecStats stats;
+
+		explicit worker_t(const PNGManipOptions& options) : codec{ options }, stats{ options.stats } {}
+	};
+
+	const std::string processType, outputDirectory;
+	const PNGManipOptions options;
+	const PNGBatchOptions batch;
+
+	std::vector<job_t> jobs;
+
+
+	/**
+	* @brief Expands directories and list files into one job per file.
+	*/
+	PNGManipErrorCode collectInputs();
+
+	/**
+	* @brief Names the output of one input: file.txt becomes file.txt.png and back again.
+	*/
+	std::string getOutputPath(const std::string&) const;
+
+	/**
+	* @brief Encodes or decodes one file with a worker's reusable state.
+	*/
+	void runJob(job_t&, worker_t&) const;
+
+public:
+
+	/**
+	* @brief Constructor for PNGBatch class. An empty output directory puts outputs next to their inputs.
+	*/
+	PNGBatch(const std::string&, const std::string&, const PNGManipOptions&, const PNGBatchOptions&);
+
+	PNGManipErrorCode startProcess();
+};
+
+
+#endif // !_PNGBATCH_H_
@@ -0,0 +1,2073 @@
+#include "PNGCodec.hpp"
+#include "ParallelDeflate.hpp"
+#include "EncodePipeline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <future>
+#include <thread>
+
+
+
+// libpng reports through these instead of printing, so the library stays silent
+static void recordPNGError(png_structp png_ptr, png_const_charp message)
+{
+    *static_cast<std::string*>(png_get_error_ptr(png_ptr)) = message;
+    png_longjmp(png_ptr, 1);
+}
+
+static void ignorePNGWarning(png_structp, png_const_charp)
+{
+}
+
+
+
+// Feeds libpng from the input buffer
+struct memoryReader_t
+{
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+};
+
+static void readFromMemory(png_structp png_ptr, png_bytep outBytes, size_t byteCount)
+{
+    auto* reader = static_cast<memoryReader_t*>(png_get_io_ptr(png_ptr));
+
+    if (byteCount > reader->size - reader->position)
+        png_error(png_ptr, "Unexpected end of PNG data");
+
+    memcpy(outBytes, reader->data + reader->position, byteCount);
+    reader->position += byteCount;
+}
+
+
+
+// Hands libpng output to a sink, recording failures instead of longjmp-ing out of C++ frames
+struct sinkWriter_t
+{
+    ByteSink* sink;
+    bool failed;
+};
+
+static void writeToSink(png_structp png_ptr, png_bytep bytes, size_t byteCount)
+{
+    auto* writer = static_cast<sinkWriter_t*>(png_get_io_ptr(png_ptr));
+
+    if (!writer->failed && !writer->sink->write(bytes, byteCount))
+        writer->failed = true;
+}
+
+static void flushSink(png_structp)
+{
+}
+
+
+
+
+PNGCodec::PNGCodec(const PNGManipOptions& opts) :
+    options{ opts },
+    m_stats{ opts.stats }
+{
+}
+
+
+
+PNGManipErrorCode PNGCodec::fail(PNGManipErrorCode code, const std::string& message)
+{
+    m_error = message;
+    return code;
+}
+
+
+
+png_structp PNGCodec::createReadStruct()
+{
+    m_pngError.clear();
+    return png_create_read_struct(PNG_LIBPNG_VER_STRING, &m_pngError, recordPNGError, ignorePNGWarning);
+}
+
+png_structp PNGCodec::createWriteStruct()
+{
+    m_pngError.clear();
+    return png_create_write_struct(PNG_LIBPNG_VER_STRING, &m_pngError, recordPNGError, ignorePNGWarning);
+}
+
+
+
+
+std::pair<size_t, size_t> PNGCodec::getDimensions(size_t size, size_t bytesPerPixel)
+{
+    // Find the next closest perfect square
+    size_t dimension = size / bytesPerPixel;
+
+    if (size % bytesPerPixel)
+        dimension += 1;
+
+    // Make it even
+    if (dimension % 2)
+        dimension++;
+
+    size_t row = static_cast<size_t>( std::sqrt(dimension) );
+
+    if (row * row < dimension)
+        row++;
+
+    size_t column = (dimension + row - 1) / row;
+
+    return std::make_pair(row, column);
+}
+
+
+
+
+uint64_t PNGCodec::maxPayloadBytesFor(PixelFormat format)
+{
+    // getDimensions() keeps the rows and the columns at or under the side of a square, which
+    // has to stay within 16 bits
+    constexpr uint64_t maxSide = UINT16_MAX - 1;
+    const uint64_t capacity = maxSide * maxSide * pixelFormatInfo(format).bytesPerPixel - 8;
+
+    return std::min(maxPayloadBytes, capacity);
+}
+
+
+
+PNGManipErrorCode PNGCodec::setImageGeometry(uint64_t inputSize)
+{
+    // Room for the size prefix, rounded up the same way as always
+    const size_t headerSize = 8;
+
+    const pixelFormatInfo_t& format = pixelFormatInfo(options.format);
+
+    if (inputSize > maxPayloadBytesFor(options.format))
+        return fail(PNGManipErrorCode::FileNotReadable, "Input is too large for one image (4 GB maximum), it has to be sharded.");
+
+    m_fileSize = static_cast<uint32_t>(inputSize);
+
+    auto dimensions = getDimensions( m_fileSize + headerSize, format.bytesPerPixel );
+
+    // The size prefix has to fit in the first row, which probe() reads on its own. Only the
+    // smallest Gray8 and RGB8 images are narrower than that
+    const size_t minimumWidth = (sizeof(uint32_t) + format.bytesPerPixel - 1) / format.bytesPerPixel;
+
+    if (dimensions.first < minimumWidth)
+    {
+        const size_t pixels = (m_fileSize + headerSize + format.bytesPerPixel - 1) / format.bytesPerPixel;
+        dimensions = { minimumWidth, (pixels + minimumWidth - 1) / minimumWidth };
+    }
+
+    pngImage.width = static_cast<uint16_t>(dimensions.first);
+    pngImage.height = static_cast<uint16_t>(dimensions.second);
+
+    pngImage.format = format.format;
+    pngImage.pixelDepth = static_cast<png_byte>(format.bitDepth);
+    pngImage.pixelSize = static_cast<png_byte>(format.bytesPerPixel);
+
+    m_info.width = pngImage.width;
+    m_info.height = pngImage.height;
+    m_info.pixelDepth = pngImage.pixelDepth;
+    m_info.pixelSize = pngImage.pixelSize;
+    m_info.format = pngImage.format;
+    m_info.payloadSize = m_fileSize;
+
+    // The streaming, pipelined, parallel and native encoders never materialize the whole image,
+    // and encrypted payloads always go through the pipeline.
+    // assign() rather than resize(), so a reused buffer gets its padding zeroed again
+    if (!options.streaming && !options.pipeline && !options.nativeWriter && options.threads == 1 && !options.bands && !m_encryption.version)
+        pngImage.pixels.assign(static_cast<size_t>(pngImage.width) * pngImage.height * pngImage.pixelSize, 0x00);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::acceptLayout(const imageLayout_t& layout)
+{
+    PixelFormat format;
+
+    if (!pixelFormatFromPNG(layout.colorType, layout.bitDepth, format) || layout.interlace != PNG_INTERLACE_NONE)
+        return fail(PNGManipErrorCode::InvalidFileFormat, "Not an Imageify PNG (expected Gray8, RGB8, RGBA8 or RGBA16).");
+
+    m_info.width      = layout.width;
+    m_info.height     = layout.height;
+    m_info.pixelDepth = layout.bitDepth;
+    m_info.pixelSize  = pixelFormatInfo(format).bytesPerPixel;
+    m_info.format     = format;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::checkBandIndex(const imageLayout_t& layout)
+{
+    const uint64_t rowBytes = static_cast<uint64_t>(layout.width) * m_info.pixelSize;
+
+    if (layout.payloadSize > rowBytes * layout.height - sizeof(uint32_t))
+        return fail(PNGManipErrorCode::DecodingError, "Invalid file size in band index.");
+
+    // The bands must tile the image exactly
+    uint64_t expectedRow{ 0 };
+    for (const band_t& band : layout.bands)
+    {
+        if (band.firstRow != expectedRow || band.rowCount == 0)
+            return fail(PNGManipErrorCode::DecodingError, "Corrupted band index.");
+
+        expectedRow += band.rowCount;
+    }
+
+    if (expectedRow != layout.height)
+        return fail(PNGManipErrorCode::DecodingError, "Corrupted band index.");
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+void PNGCodec::chooseCompression(const uint8_t* sample, size_t sampleSize)
+{
+    m_compression = profileSettings(options.profile, options.level);
+
+    // Pre-compressed and encrypted bytes leave deflate nothing to find, so the default profile samples them too
+    const bool sampled = options.profile == CompressionProfile::Auto
+        || (options.profile == CompressionProfile::Default && (m_header.codec != PayloadCodec::None || m_encryption.version));
+
+    // Ciphertext is as good as random, a sample of it would only say so
+    if (sampled && m_encryption.version)
+    {
+        m_info.sampleEntropy = 8.0;
+        m_compression = autoSettings(m_info.sampleEntropy);
+    }
+    else if (sampled && sample)
+    {
+        m_info.sampleEntropy = estimateEntropy(sample, sampleSize);
+        m_compression = autoSettings(m_info.sampleEntropy);
+    }
+
+    m_info.compression = m_compression;
+}
+
+
+
+void PNGCodec::applyCompression(png_structp png_ptr) const
+{
+    png_set_compression_level(png_ptr, m_compression.level);
+    png_set_compression_mem_level(png_ptr, m_compression.memLevel);
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, m_compression.filters);
+
+    // Left alone while libpng filters adaptively, so it keeps choosing Z_FILTERED for filtered rows
+    if (m_compression.filters != PNG_ALL_FILTERS)
+        png_set_compression_strategy(png_ptr, m_compression.strategy);
+}
+
+
+
+std::vector<std::pair<const char*, std::vector<uint8_t>>> PNGCodec::headerChunks() const
+{
+    std::vector<std::pair<const char*, std::vector<uint8_t>>> chunks;
+
+    chunks.emplace_back(formatChunkName, std::vector<uint8_t>{ imageFormatVersion });
+
+    if (m_header.codec != PayloadCodec::None)
+        chunks.emplace_back(payloadHeaderChunkName, serializePayloadHeader(m_header));
+
+    if (options.shard.count || (options.shard.flags & shardStreamed))
+        chunks.emplace_back(shardHeaderChunkName, serializeShardHeader(options.shard));
+
+    if (options.archive.version)
+        chunks.emplace_back(archiveChunkName, serializeArchiveManifest(options.archive));
+
+    if (m_encryption.version)
+        chunks.emplace_back(encryptionChunkName, serializeEncryptionHeader(m_encryption));
+
+    return chunks;
+}
+
+
+
+void PNGCodec::writeHeaderChunks(png_structp png_ptr)
+{
+    for (const auto& [name, data] : headerChunks())
+        png_write_chunk(png_ptr, reinterpret_cast<png_const_bytep>(name), data.data(), data.size());
+
+    m_info.formatVersion = imageFormatVersion;
+}
+
+void PNGCodec::writeHeaderChunks(PNGWriter& writer)
+{
+    for (const auto& [name, data] : headerChunks())
+        writer.chunk(name, data.data(), data.size());
+
+    m_info.formatVersion = imageFormatVersion;
+}
+
+
+
+void PNGCodec::writeTrailerChunks(png_structp png_ptr)
+{
+    std::vector<uint8_t> checksum = serializeChecksum(m_checksum);
+    png_write_chunk(png_ptr, reinterpret_cast<png_const_bytep>(checksumChunkName), checksum.data(), checksum.size());
+
+    m_info.checksum = m_checksum;
+}
+
+void PNGCodec::writeTrailerChunks(PNGWriter& writer)
+{
+    std::vector<uint8_t> checksum = serializeChecksum(m_checksum);
+    writer.chunk(checksumChunkName, checksum.data(), checksum.size());
+
+    m_info.checksum = m_checksum;
+}
+
+
+
+void PNGCodec::checksumInput()
+{
+    const auto started = m_stats.start();
+    m_checksum = payloadChecksum_t{ checksumVersion, m_input.size(), crc32c(0, m_input.data(), m_input.size()) };
+    m_stats.stop(CodecStage::Checksum, started, m_input.size());
+}
+
+
+
+PNGManipErrorCode PNGCodec::precompress(ByteSource& input)
+{
+    if (!payloadCodecAvailable(m_header.codec))
+        return fail(PNGManipErrorCode::EncodingError, std::string("This build cannot compress with ") + payloadCodecName(m_header.codec) + ".");
+
+    const unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+
+    VectorSink stored(m_stored);
+    PNGManipErrorCode result = compressPayload(input, stored, m_header, threads, m_stats);
+
+    if (result != PNGManipErrorCode::Success)
+        return fail(result, std::string("Pre-compressing the payload with ") + payloadCodecName(m_header.codec) + " failed.");
+
+    m_input = { reinterpret_cast<const uint8_t*>(m_stored.data()), m_stored.size() };
+    m_info.precompression = m_header;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+void PNGCodec::fillRow(size_t row, uint8_t* out) const
+{
+    const size_t rowBytes = static_cast<size_t>(pngImage.width) * pngImage.pixelSize;
+
+    // Position of the row in the size prefix + payload byte stream
+    size_t offset = row * rowBytes;
+    size_t filled{ 0 };
+
+    if (offset < sizeof(uint32_t))
+    {
+        filled = std::min(sizeof(uint32_t) - offset, rowBytes);
+        memcpy(out, reinterpret_cast<const uint8_t*>(&m_fileSize) + offset, filled);
+        offset += filled;
+    }
+
+    const size_t payloadOffset = offset - sizeof(uint32_t);
+    if (payloadOffset < m_fileSize)
+    {
+        const size_t toCopy = std::min<size_t>(rowBytes - filled, m_fileSize - payloadOffset);
+        memcpy(out + filled, m_input.data() + payloadOffset, toCopy);
+        filled += toCopy;
+    }
+
+    memset(out + filled, 0x00, rowBytes - filled);
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::encodeToImage()
+{
+    const auto started = m_stats.start();
+
+    // The pixel buffer is zero-initialized, so the padding past the payload is already in place
+    uint8_t* buffer = pngImage.bytes();
+
+    // Put the size of the file in the first 4 bytes
+    memcpy(buffer, &m_fileSize, sizeof(uint32_t));
+
+    // Copy the input straight into the pixels
+    if (m_fileSize)
+        memcpy( buffer + sizeof(uint32_t), m_input.data(), m_fileSize );
+
+    m_stats.stop(CodecStage::Pack, started, m_fileSize);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::decodeImage(bool cover)
+{
+    memoryReader_t reader{ m_input.data(), m_input.size(), 0 };
+
+
+    png_structp png_ptr = createReadStruct();
+    if (!png_ptr)
+        return fail(PNGManipErrorCode::DecodingError, "Cannot read PNG image (struct creation failed).");
+
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::DecodingError, "Cannot read PNG image (info struct failed).");
+    }
+
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::DecodingError, "PNG read error: " + m_pngError);
+    }
+
+
+    png_set_read_fn(png_ptr, &reader, readFromMemory);
+    png_read_info(png_ptr, info_ptr);
+
+    // A cover comes in as whatever PNG the user had. Palettes, transparency, grey with alpha,
+    // sub-byte and 16-bit samples are all turned into 8-bit Gray, RGB or RGBA, so that every
+    // byte of a row is one sample, and interlaced rows are put back in order
+    if (cover)
+    {
+        const png_byte colorType = png_get_color_type(png_ptr, info_ptr);
+        const bool transparency = png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS) != 0;
+
+        if (colorType == PNG_COLOR_TYPE_PALETTE)
+            png_set_palette_to_rgb(png_ptr);
+
+        if (transparency)
+            png_set_tRNS_to_alpha(png_ptr);
+
+        if (!(colorType & PNG_COLOR_MASK_COLOR) && ((colorType & PNG_COLOR_MASK_ALPHA) || transparency))
+            png_set_gray_to_rgb(png_ptr);
+
+        png_set_expand_gray_1_2_4_to_8(png_ptr);
+        png_set_strip_16(png_ptr);
+        png_set_interlace_handling(png_ptr);
+
+        png_read_update_info(png_ptr, info_ptr);
+    }
+
+    // bitmap_t holds 16-bit sides, anything larger would be cut short and overrun the pixels
+    if (png_get_image_width(png_ptr, info_ptr) > maxImageSide || png_get_image_height(png_ptr, info_ptr) > maxImageSide)
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::InvalidFileFormat, std::string(cover ? "Cover image" : "Image") + " is too large (65535 x 65535 maximum).");
+    }
+
+
+    pngImage.width      = static_cast<uint16_t>(png_get_image_width(png_ptr, info_ptr));
+    pngImage.height     = static_cast<uint16_t>(png_get_image_height(png_ptr, info_ptr));
+    pngImage.pixelDepth = png_get_bit_depth(png_ptr, info_ptr);
+
+    // Rows are read as they are stored, so only the formats Imageify writes can be taken apart
+    if (!pixelFormatFromPNG(png_get_color_type(png_ptr, info_ptr), pngImage.pixelDepth, pngImage.format)
+        || (!cover && png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::InvalidFileFormat, "Not an Imageify PNG (expected Gray8, RGB8, RGBA8 or RGBA16).");
+    }
+
+    pngImage.pixelSize = pixelFormatInfo(pngImage.format).bytesPerPixel;
+    pngImage.pixels.resize(static_cast<size_t>(pngImage.width) * pngImage.height * pngImage.pixelSize);
+
+    if (pngImage.pixels.empty())
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::MemoryAllocationError, "Memory allocation error for PNG pixels.");
+    }
+
+    m_info.width = pngImage.width;
+    m_info.height = pngImage.height;
+    m_info.pixelDepth = pngImage.pixelDepth;
+    m_info.pixelSize = pngImage.pixelSize;
+    m_info.format = pngImage.format;
+
+
+    // libpng inflates straight into the pixel buffer
+    m_rowPointers = pngImage.rowPointers();
+
+    const auto started = m_stats.start();
+    png_read_image(png_ptr, m_rowPointers.data());
+    m_stats.stop(CodecStage::Inflate, started, pngImage.pixels.size());
+
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::savePNG(ByteSink& output, bool cover)
+{
+    png_structp png_ptr = createWriteStruct();
+    if (!png_ptr)
+        return fail(PNGManipErrorCode::EncodingError, "Cannot create PNG write struct.");
+
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return fail(PNGManipErrorCode::EncodingError, "Cannot create PNG info struct.");
+    }
+
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return fail(PNGManipErrorCode::EncodingError, "PNG write error: " + m_pngError);
+    }
+
+
+    png_set_IHDR(
+        png_ptr,        info_ptr,
+        pngImage.width, pngImage.height,
+        pngImage.pixelDepth,
+        pixelFormatInfo(pngImage.format).colorType,
+        PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_DEFAULT,
+        PNG_FILTER_TYPE_DEFAULT
+    );
+
+    applyCompression(png_ptr);
+
+
+    // Rows point straight into the pixel buffer, nothing is copied
+    m_rowPointers = pngImage.rowPointers();
+
+
+    sinkWriter_t writer{ &output, false };
+    png_set_write_fn(png_ptr, &writer, writeToSink, flushSink);
+
+    png_write_info(png_ptr, info_ptr);
+
+    if (!cover)
+        writeHeaderChunks(png_ptr);
+
+    // libpng filters, deflates and writes in one call; the writes are already counted by the sink
+    const uint64_t writeBefore = m_stats.totals(CodecStage::Write).nanoseconds;
+    const auto started = m_stats.start();
+
+    png_write_image(png_ptr, m_rowPointers.data());
+
+    if (!cover)
+        writeTrailerChunks(png_ptr);
+
+    png_write_end(png_ptr, nullptr);
+
+    m_stats.stop(CodecStage::Deflate, started, pngImage.pixels.size(), m_stats.totals(CodecStage::Write).nanoseconds - writeBefore);
+
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+
+    if (writer.failed)
+        return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the PNG to the output.");
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::streamEncodeToPNG(ByteSink& output)
+{
+    png_structp png_ptr = createWriteStruct();
+    if (!png_ptr)
+        return fail(PNGManipErrorCode::EncodingError, "Cannot create PNG write struct.");
+
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return fail(PNGManipErrorCode::EncodingError, "Cannot create PNG info struct.");
+    }
+
+
+    // At most a single row is ever copied, whatever the size of the input
+    const size_t rowBytes = static_cast<size_t>(pngImage.width) * pngImage.pixelSize;
+    std::vector<uint8_t> rowBuffer(rowBytes);
+
+    sinkWriter_t writer{ &output, false };
+
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return fail(PNGManipErrorCode::EncodingError, "PNG write error: " + m_pngError);
+    }
+
+
+    png_set_write_fn(png_ptr, &writer, writeToSink, flushSink);
+
+    png_set_IHDR(
+        png_ptr,        info_ptr,
+        pngImage.width, pngImage.height,
+        pngImage.pixelDepth,
+        pixelFormatInfo(pngImage.format).colorType,
+        PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_DEFAULT,
+        PNG_FILTER_TYPE_DEFAULT
+    );
+
+    applyCompression(png_ptr);
+    png_write_info(png_ptr, info_ptr);
+    writeHeaderChunks(png_ptr);
+
+
+    const uint8_t* input = m_input.data();
+    size_t remaining{ m_fileSize };
+
+    // Only the partial rows are packed, everything else is libpng's filter, deflate and write
+    const uint64_t writeBefore = m_stats.totals(CodecStage::Write).nanoseconds;
+    const auto started = m_stats.start();
+    uint64_t packNanoseconds{ 0 }, packedBytes{ 0 };
+
+    for (size_t row{ 0 }; row < pngImage.height && !writer.failed; ++row)
+    {
+        // Full rows are handed to libpng straight from the input
+        if (row != 0 && remaining >= rowBytes)
+        {
+            png_write_row(png_ptr, input);
+
+            input += rowBytes;
+            remaining -= rowBytes;
+            continue;
+        }
+
+        const auto packStarted = m_stats.start();
+        size_t filled{ 0 };
+
+        // The first row carries the size of the file in its first 4 bytes, same as encodeToImage()
+        if (row == 0)
+        {
+            memcpy(rowBuffer.data(), &m_fileSize, sizeof(uint32_t));
+            filled = sizeof(uint32_t);
+        }
+
+        const size_t toCopy = std::min(rowBytes - filled, remaining);
+        if (toCopy)
+            memcpy(rowBuffer.data() + filled, input, toCopy);
+
+        input += toCopy;
+        remaining -= toCopy;
+        filled += toCopy;
+
+        // Zero out the padding past the end of the payload
+        memset(rowBuffer.data() + filled, 0x00, rowBytes - filled);
+
+        packNanoseconds += m_stats.elapsed(packStarted);
+        packedBytes += rowBytes;
+
+        png_write_row(png_ptr, rowBuffer.data());
+    }
+
+    if (!writer.failed)
+    {
+        writeTrailerChunks(png_ptr);
+        png_write_end(png_ptr, nullptr);
+    }
+
+    m_stats.add(CodecStage::Pack, packNanoseconds, packedBytes);
+    m_stats.stop(CodecStage::Deflate, started, rowBytes * pngImage.height, packNanoseconds + m_stats.totals(CodecStage::Write).nanoseconds - writeBefore);
+
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+
+    if (writer.failed)
+        return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the PNG to the output.");
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::streamDecodeFromPNG(ByteSink& output)
+{
+    memoryReader_t reader{ m_input.data(), m_input.size(), 0 };
+
+
+    png_structp png_ptr = createReadStruct();
+    if (!png_ptr)
+        return fail(PNGManipErrorCode::DecodingError, "Cannot read PNG image (struct creation failed).");
+
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::DecodingError, "Cannot read PNG image (info struct failed).");
+    }
+
+
+    // One reused row buffer, sized once the header has been read
+    std::vector<uint8_t> rowBuffer;
+
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::DecodingError, "PNG read error: " + m_pngError);
+    }
+
+
+    png_set_read_fn(png_ptr, &reader, readFromMemory);
+    png_read_info(png_ptr, info_ptr);
+
+
+    if (png_get_image_width(png_ptr, info_ptr) > maxImageSide || png_get_image_height(png_ptr, info_ptr) > maxImageSide)
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::InvalidFileFormat, "Image is too large (65535 x 65535 maximum).");
+    }
+
+    pngImage.width      = static_cast<uint16_t>(png_get_image_width(png_ptr, info_ptr));
+    pngImage.height     = static_cast<uint16_t>(png_get_image_height(png_ptr, info_ptr));
+    pngImage.pixelDepth = png_get_bit_depth(png_ptr, info_ptr);
+
+    const size_t rowBytes = png_get_rowbytes(png_ptr, info_ptr);
+
+    if (!pixelFormatFromPNG(png_get_color_type(png_ptr, info_ptr), pngImage.pixelDepth, pngImage.format)
+        || png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE || rowBytes < sizeof(uint32_t))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return fail(PNGManipErrorCode::InvalidFileFormat, "Not an Imageify PNG (expected Gray8, RGB8, RGBA8 or RGBA16).");
+    }
+
+    pngImage.pixelSize = pixelFormatInfo(pngImage.format).bytesPerPixel;
+
+    m_info.width = pngImage.width;
+    m_info.height = pngImage.height;
+    m_info.pixelDepth = pngImage.pixelDepth;
+    m_info.pixelSize = pngImage.pixelSize;
+    m_info.format = pngImage.format;
+
+
+    rowBuffer.resize(rowBytes);
+
+    uint32_t fileSize{};
+    uint64_t skip{ 0 }, remaining{ 0 };
+
+    // Rows are written out as they arrive; the writes are counted by the sink
+    const uint64_t writeBefore = m_stats.totals(CodecStage::Write).nanoseconds;
+    const auto started = m_stats.start();
+    uint64_t inflated{ 0 };
+
+    for (size_t row{ 0 }; row < pngImage.height; ++row)
+    {
+        png_read_row(png_ptr, rowBuffer.data(), nullptr);
+        inflated += rowBytes;
+
+        size_t offset{ 0 };
+
+        // Get file size from first 4 bytes of the first row
+        if (row == 0)
+        {
+            memcpy(&fileSize, rowBuffer.data(), sizeof(uint32_t));
+
+            if (fileSize > static_cast<uint64_t>(rowBytes) * pngImage.height - sizeof(uint32_t))
+            {
+                png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+                return fail(PNGManipErrorCode::DecodingError, "Invalid file size in header.");
+            }
+
+            m_info.payloadSize = fileSize;
+
+            if (getPayloadRange(fileSize, m_info.rangeStart, m_info.rangeEnd) != PNGManipErrorCode::Success)
+            {
+                png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+                return PNGManipErrorCode::DecodingError;
+            }
+
+            skip = m_info.rangeStart;
+            remaining = m_info.rangeEnd - m_info.rangeStart;
+            offset = sizeof(uint32_t);
+        }
+
+        // Without a band index a range still has to inflate everything before it
+        const size_t skipped = static_cast<size_t>(std::min<uint64_t>(rowBytes - offset, skip));
+        skip -= skipped;
+        offset += skipped;
+
+        const size_t toWrite = static_cast<size_t>(std::min<uint64_t>(rowBytes - offset, remaining));
+
+        if (!output.write(rowBuffer.data() + offset, toWrite))
+        {
+            png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+            return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the payload to the output.");
+        }
+
+        remaining -= toWrite;
+
+        // Everything past the payload (or the requested range) is padding, no need to inflate it
+        if (remaining == 0)
+            break;
+    }
+
+    m_stats.stop(CodecStage::Inflate, started, inflated, m_stats.totals(CodecStage::Write).nanoseconds - writeBefore);
+
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::nativeEncodeToPNG(ByteSink& output)
+{
+    PNGWriter writer(output);
+
+    writer.begin(pngImage.width, pngImage.height, pngImage.pixelDepth, pixelFormatInfo(pngImage.format).colorType);
+    writeHeaderChunks(writer);
+
+    if (!writer.beginImage(m_compression))
+        return fail(PNGManipErrorCode::EncodingError, "Cannot initialize deflate.");
+
+    // Every row is filtered with None, whatever the profile would have offered libpng
+    m_info.compression.filters = PNG_FILTER_NONE;
+
+
+    // Rows are packed a batch at a time, each behind its filter type byte, straight from the input
+    const size_t rowBytes = static_cast<size_t>(pngImage.width) * pngImage.pixelSize;
+    const size_t rowsPerBatch = std::max<size_t>(1, PNGWriter::idatBytes / (rowBytes + 1));
+
+    std::vector<uint8_t> batch(rowsPerBatch * (rowBytes + 1));
+
+    const uint64_t writeBefore = m_stats.totals(CodecStage::Write).nanoseconds;
+    const auto started = m_stats.start();
+    uint64_t packNanoseconds{ 0 }, packedBytes{ 0 };
+
+    for (size_t row{ 0 }; row < pngImage.height && !writer.failed(); row += rowsPerBatch)
+    {
+        const size_t rows = std::min<size_t>(rowsPerBatch, pngImage.height - row);
+        const auto packStarted = m_stats.start();
+
+        for (size_t i{ 0 }; i < rows; ++i)
+        {
+            uint8_t* line = batch.data() + i * (rowBytes + 1);
+
+            line[0] = PNG_FILTER_VALUE_NONE;
+            fillRow(row + i, line + 1);
+        }
+
+        packNanoseconds += m_stats.elapsed(packStarted);
+        packedBytes += rows * rowBytes;
+
+        if (!writer.imageData(batch.data(), rows * (rowBytes + 1)) && !writer.failed())
+            return fail(PNGManipErrorCode::EncodingError, "Deflate failed.");
+    }
+
+    if (!writer.endImage() && !writer.failed())
+        return fail(PNGManipErrorCode::EncodingError, "Deflate failed.");
+
+    writeTrailerChunks(writer);
+    writer.end();
+
+    m_stats.add(CodecStage::Pack, packNanoseconds, packedBytes);
+    m_stats.stop(CodecStage::Deflate, started, rowBytes * pngImage.height, packNanoseconds + m_stats.totals(CodecStage::Write).nanoseconds - writeBefore);
+
+
+    if (writer.failed())
+        return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the PNG to the output.");
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+// The bytes an unsized encode was handed already, then the rest of the stream
+struct unsizedReader_t
+{
+    std::span<const uint8_t> head;
+    StreamSource& rest;
+
+    size_t read(uint8_t* out, size_t length)
+    {
+        const size_t fromHead = std::min(length, head.size());
+
+        if (fromHead)
+            memcpy(out, head.data(), fromHead);
+
+        head = head.subspan(fromHead);
+
+        return (fromHead < length) ? fromHead + rest.read(out + fromHead, length - fromHead) : fromHead;
+    }
+};
+
+
+
+PNGManipErrorCode PNGCodec::unsizedEncodeToPNG(StreamSource& rest, ByteSink& output)
+{
+    const pixelFormatInfo_t& format = pixelFormatInfo(options.format);
+
+    pngImage.width = static_cast<uint16_t>(unsizedRowBytes / format.bytesPerPixel);
+    pngImage.height = 1;
+    pngImage.format = format.format;
+    pngImage.pixelDepth = static_cast<png_byte>(format.bitDepth);
+    pngImage.pixelSize = static_cast<png_byte>(format.bytesPerPixel);
+
+    const size_t rowBytes = static_cast<size_t>(pngImage.width) * pngImage.pixelSize;
+
+    // No taller than the sized encoders go, and no more than the size prefix can count
+    const size_t maxRows = maxImageSide - 1;
+    const uint64_t capacity = std::min<uint64_t>(maxPayloadBytesFor(options.format), static_cast<uint64_t>(maxRows) * rowBytes - sizeof(uint32_t));
+
+    PNGWriter writer(output);
+
+    // The height is rewritten with the rest once the last row is known
+    writer.begin(pngImage.width, pngImage.height, pngImage.pixelDepth, format.colorType);
+    writeHeaderChunks(writer);
+
+    if (!writer.beginImage(m_compression))
+        return fail(PNGManipErrorCode::EncodingError, "Cannot initialize deflate.");
+
+    m_info.compression.filters = PNG_FILTER_NONE;
+
+    unsizedReader_t input{ m_input, rest };
+    uint64_t payloadBytes{ 0 };
+    uint32_t crc{ 0 };
+
+    const uint64_t writeBefore = m_stats.totals(CodecStage::Write).nanoseconds;
+    const auto started = m_stats.start();
+    uint64_t packNanoseconds{ 0 }, checksumNanoseconds{ 0 };
+
+
+    // The first row stays stored as it is, with the size prefix left at 0 for now
+    std::vector<uint8_t> first(rowBytes + 1, 0x00);
+    first[0] = PNG_FILTER_VALUE_NONE;
+
+    size_t got = input.read(first.data() + 1 + sizeof(uint32_t), rowBytes - sizeof(uint32_t));
+    bool ended = (got < rowBytes - sizeof(uint32_t));
+
+    crc = crc32c(crc, first.data() + 1 + sizeof(uint32_t), got);
+    payloadBytes += got;
+
+    writer.imageHead(first.data(), first.size());
+
+    size_t rows{ 1 };
+
+
+    // The rest a batch of rows at a time, as far as the stream goes
+    const size_t rowsPerBatch = std::max<size_t>(1, PNGWriter::idatBytes / (rowBytes + 1));
+    std::vector<uint8_t> batch(rowsPerBatch * (rowBytes + 1));
+
+    while (!ended && !writer.failed())
+    {
+        size_t batched{ 0 };
+        const auto packStarted = m_stats.start();
+
+        while (batched < rowsPerBatch && !ended)
+        {
+            uint8_t* line = batch.data() + batched * (rowBytes + 1);
+
+            got = input.read(line + 1, rowBytes);
+            ended = (got < rowBytes);
+
+            // A stream ending on a row boundary leaves no row behind
+            if (got == 0)
+                break;
+
+            line[0] = PNG_FILTER_VALUE_NONE;
+            memset(line + 1 + got, 0x00, rowBytes - got);
+
+            const auto checksumStarted = m_stats.start();
+            crc = crc32c(crc, line + 1, got);
+            checksumNanoseconds += m_stats.elapsed(checksumStarted);
+
+            payloadBytes += got;
+            ++batched;
+        }
+
+        packNanoseconds += m_stats.elapsed(packStarted);
+
+        if (payloadBytes > capacity)
+            return fail(PNGManipErrorCode::FileNotReadable, "Input is too large for one image (" + std::to_string(capacity) + " bytes at most without its size up front).");
+
+        rows += batched;
+
+        if (batched && !writer.imageData(batch.data(), batched * (rowBytes + 1)) && !writer.failed())
+            return fail(PNGManipErrorCode::EncodingError, "Deflate failed.");
+    }
+
+    if (rest.failed())
+        return fail(PNGManipErrorCode::FileNotReadable, "Input not readable.");
+
+    if (!writer.endImage() && !writer.failed())
+        return fail(PNGManipErrorCode::EncodingError, "Deflate failed.");
+
+    m_fileSize = static_cast<uint32_t>(payloadBytes);
+    m_checksum = payloadChecksum_t{ checksumVersion, payloadBytes, crc };
+
+    writeTrailerChunks(writer);
+    writer.end();
+
+    m_stats.add(CodecStage::Pack, packNanoseconds - checksumNanoseconds, payloadBytes);
+    m_stats.add(CodecStage::Checksum, checksumNanoseconds, payloadBytes);
+    m_stats.stop(CodecStage::Deflate, started, rowBytes * rows, packNanoseconds + m_stats.totals(CodecStage::Write).nanoseconds - writeBefore);
+
+
+    // Now the size is known, the height and the prefix go where they were left open
+    pngImage.height = static_cast<uint16_t>(rows);
+    memcpy(first.data() + 1, &m_fileSize, sizeof(m_fileSize));
+
+    if (writer.failed() || !writer.rewrite(pngImage.height, first.data(), first.size()))
+        return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the PNG to the output.");
+
+    m_info.width = pngImage.width;
+    m_info.height = pngImage.height;
+    m_info.pixelDepth = pngImage.pixelDepth;
+    m_info.pixelSize = pngImage.pixelSize;
+    m_info.format = pngImage.format;
+    m_info.payloadSize = payloadBytes;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::pipelinedEncodeToPNG(ByteSource& input, ByteSink& output)
+{
+    png_structp png_ptr = createWriteStruct();
+    if (!png_ptr)
+        return fail(PNGManipErrorCode::EncodingError, "Cannot create PNG write struct.");
+
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return fail(PNGManipErrorCode::EncodingError, "Cannot create PNG info struct.");
+    }
+
+
+    sinkWriter_t writer{ &output, false };
+
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return fail(PNGManipErrorCode::EncodingError, "PNG write error: " + m_pngError);
+    }
+
+
+    png_set_write_fn(png_ptr, &writer, writeToSink, flushSink);
+
+    png_set_IHDR(
+        png_ptr,        info_ptr,
+        pngImage.width, pngImage.height,
+        pngImage.pixelDepth,
+        pixelFormatInfo(pngImage.format).colorType,
+        PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_DEFAULT,
+        PNG_FILTER_TYPE_DEFAULT
+    );
+
+    // Signature and IHDR come from libpng, the IDAT stream from the pipeline
+    png_write_info(png_ptr, info_ptr);
+    writeHeaderChunks(png_ptr);
+
+
+    const size_t rowBytes = static_cast<size_t>(pngImage.width) * pngImage.pixelSize;
+
+    EncodePipeline pipeline(m_stats, m_compression, options.queueDepth, options.bandBytes);
+
+    // The write stage runs on this thread, the only one libpng is ever called from
+    // The reader stage checksums the payload as it reads it
+    m_checksum = payloadChecksum_t{ checksumVersion, m_fileSize };
+
+    PNGManipErrorCode result = pipeline.run(
+        input, m_fileSize, rowBytes, pngImage.height,
+        [png_ptr](const uint8_t* data, size_t length) { png_write_chunk(png_ptr, reinterpret_cast<png_const_bytep>("IDAT"), data, length); },
+        m_checksum.crc
+    );
+
+    if (result == PNGManipErrorCode::Success)
+    {
+        writeTrailerChunks(png_ptr);
+        png_write_chunk(png_ptr, reinterpret_cast<png_const_bytep>("IEND"), nullptr, 0);
+    }
+
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+
+    if (result != PNGManipErrorCode::Success)
+        return fail(result, "Encoding pipeline failed.");
+
+    if (writer.failed)
+        return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the PNG to the output.");
+
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::parallelEncodeToPNG(ByteSink& output)
+{
+    png_structp png_ptr = createWriteStruct();
+    if (!png_ptr)
+        return fail(PNGManipErrorCode::EncodingError, "Cannot create PNG write struct.");
+
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if (!info_ptr)
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return fail(PNGManipErrorCode::EncodingError, "Cannot create PNG info struct.");
+    }
+
+
+    sinkWriter_t writer{ &output, false };
+
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return fail(PNGManipErrorCode::EncodingError, "PNG write error: " + m_pngError);
+    }
+
+
+    png_set_write_fn(png_ptr, &writer, writeToSink, flushSink);
+
+    png_set_IHDR(
+        png_ptr,        info_ptr,
+        pngImage.width, pngImage.height,
+        pngImage.pixelDepth,
+        pixelFormatInfo(pngImage.format).colorType,
+        PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_DEFAULT,
+        PNG_FILTER_TYPE_DEFAULT
+    );
+
+    // Signature and IHDR come from libpng, the IDAT stream is ours
+    png_write_info(png_ptr, info_ptr);
+    writeHeaderChunks(png_ptr);
+
+
+    const size_t rowBytes = static_cast<size_t>(pngImage.width) * pngImage.pixelSize;
+
+    ThreadPool pool(options.threads);
+    ParallelDeflate deflater(pool, m_stats, m_compression, options.bands, options.bands ? options.bandBytes : ParallelDeflate::defaultBlockBytes);
+
+    m_info.threads = pool.size();
+
+    PNGManipErrorCode result = deflater.compress(
+        rowBytes, pngImage.height,
+        [this](size_t row, uint8_t* out) { fillRow(row, out); },
+        [png_ptr](const uint8_t* data, size_t length) { png_write_chunk(png_ptr, reinterpret_cast<png_const_bytep>("IDAT"), data, length); }
+    );
+
+    if (result == PNGManipErrorCode::Success && options.bands)
+    {
+        std::vector<uint8_t> index = serializeBandIndex(m_fileSize, deflater.blocks());
+        png_write_chunk(png_ptr, reinterpret_cast<png_const_bytep>(bandIndexChunkName), index.data(), index.size());
+
+        m_info.bandCount = deflater.blocks().size();
+    }
+
+    if (result == PNGManipErrorCode::Success)
+    {
+        writeTrailerChunks(png_ptr);
+        png_write_chunk(png_ptr, reinterpret_cast<png_const_bytep>("IEND"), nullptr, 0);
+    }
+
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+
+    if (result != PNGManipErrorCode::Success)
+        return fail(result, "Parallel deflate failed.");
+
+    if (writer.failed)
+        return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the PNG to the output.");
+
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::parallelDecodeFromPNG(const imageLayout_t& layout, ByteSink& output)
+{
+    if (acceptLayout(layout) != PNGManipErrorCode::Success)
+        return PNGManipErrorCode::InvalidFileFormat;
+
+    if (checkBandIndex(layout) != PNGManipErrorCode::Success)
+        return PNGManipErrorCode::DecodingError;
+
+    const size_t rowBytes = static_cast<size_t>(layout.width) * m_info.pixelSize;
+
+    m_info.payloadSize = layout.payloadSize;
+    m_info.bandCount   = layout.bands.size();
+    m_info.rangeEnd    = layout.payloadSize;
+
+
+    // Sinks that can be written at any offset take each band as soon as it is ready,
+    // the others get the bands appended in order
+    const bool positional = output.resize(layout.payloadSize);
+
+    ThreadPool pool(options.threads);
+    m_info.threads = pool.size();
+
+    const uint8_t* file = m_input.data();
+    const uint64_t payloadEnd = sizeof(uint32_t) + layout.payloadSize;
+
+    std::vector<std::future<bool>> crcChecks;
+    crcChecks.reserve(layout.idat.size());
+
+    // Checking the chunk CRCs is part of inflating, as it is inside libpng
+    for (const idatSegment_t& segment : layout.idat)
+        crcChecks.push_back(pool.submit([this, file, &segment]()
+        {
+            const auto started = m_stats.start();
+            const bool ok = verifySegment(file, segment);
+            m_stats.stop(CodecStage::Inflate, started, segment.length);
+
+            return ok;
+        }));
+
+    std::vector<std::vector<uint8_t>> pending(positional ? 0 : layout.bands.size());
+    std::vector<std::future<PNGManipErrorCode>> bandResults;
+    bandResults.reserve(layout.bands.size());
+
+    for (size_t b{ 0 }; b < layout.bands.size(); ++b)
+    {
+        bandResults.push_back(pool.submit([&, b]()
+        {
+            const band_t& band = layout.bands[b];
+            std::vector<uint8_t> scratch, rows;
+
+            auto started = m_stats.start();
+
+            const uint8_t* compressed = bandBytes(file, layout, band, scratch);
+            if (!compressed)
+                return PNGManipErrorCode::DecodingError;
+
+            PNGManipErrorCode result = inflateBand(compressed, band.compressedSize, rowBytes, m_info.pixelSize, band.rowCount, rows);
+            if (result != PNGManipErrorCode::Success)
+                return result;
+
+            m_stats.stop(CodecStage::Inflate, started, rows.size());
+            started = m_stats.start();
+
+            // The size prefix must agree with the index
+            if (band.firstRow == 0)
+            {
+                uint32_t fileSize{};
+                memcpy(&fileSize, rows.data(), sizeof(uint32_t));
+
+                if (fileSize != layout.payloadSize)
+                    return PNGManipErrorCode::DecodingError;
+            }
+
+            // Clip the band to the payload and drop it into place
+            const uint64_t bandStart = static_cast<uint64_t>(band.firstRow) * rowBytes;
+            const uint64_t bandEnd = bandStart + rows.size();
+            const uint64_t from = std::max<uint64_t>(bandStart, sizeof(uint32_t));
+            const uint64_t to = std::min<uint64_t>(bandEnd, payloadEnd);
+
+            if (from >= to)
+                return PNGManipErrorCode::Success;
+
+            if (!positional)
+            {
+                rows.erase(rows.begin() + static_cast<ptrdiff_t>(to - bandStart), rows.end());
+                rows.erase(rows.begin(), rows.begin() + static_cast<ptrdiff_t>(from - bandStart));
+                pending[b] = std::move(rows);
+
+                m_stats.stop(CodecStage::Unpack, started, to - from);
+            }
+            else if (!output.writeAt(from - sizeof(uint32_t), rows.data() + (from - bandStart), static_cast<size_t>(to - from)))
+            {
+                return PNGManipErrorCode::FileNotWritable;
+            }
+
+            return PNGManipErrorCode::Success;
+        }));
+    }
+
+
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+
+    for (auto& check : crcChecks)
+        if (!check.get() && result == PNGManipErrorCode::Success)
+            result = PNGManipErrorCode::DecodingError;
+
+    for (size_t b{ 0 }; b < bandResults.size(); ++b)
+    {
+        PNGManipErrorCode bandStatus = bandResults[b].get();
+        if (bandStatus != PNGManipErrorCode::Success && result == PNGManipErrorCode::Success)
+            result = bandStatus;
+
+        if (!positional && result == PNGManipErrorCode::Success && !output.write(pending[b].data(), pending[b].size()))
+            result = PNGManipErrorCode::FileNotWritable;
+
+        if (!positional)
+            std::vector<uint8_t>().swap(pending[b]);
+    }
+
+    if (result != PNGManipErrorCode::Success)
+        return fail(result, "Banded decode failed: " + errorCodeToString(result));
+
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::getPayloadRange(uint64_t payloadSize, uint64_t& rangeStart, uint64_t& rangeEnd)
+{
+    if (m_header.codec == PayloadCodec::None && !m_encryption.version)
+        return clipRange(payloadSize, rangeStart, rangeEnd);
+
+    rangeStart = 0;
+    rangeEnd = payloadSize;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+PNGManipErrorCode PNGCodec::clipRange(uint64_t payloadSize, uint64_t& rangeStart, uint64_t& rangeEnd)
+{
+    rangeStart = 0;
+    rangeEnd = payloadSize;
+
+    if (!options.hasRange)
+        return PNGManipErrorCode::Success;
+
+    if (options.rangeOffset > payloadSize)
+        return fail(PNGManipErrorCode::DecodingError, "Range starts past the end of the payload (" + std::to_string(payloadSize) + " bytes).");
+
+    // Like dd, a range running off the end is cut short
+    rangeStart = options.rangeOffset;
+    rangeEnd = rangeStart + std::min(options.rangeLength, payloadSize - rangeStart);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::rangeDecodeFromPNG(const imageLayout_t& layout, ByteSink& output)
+{
+    if (acceptLayout(layout) != PNGManipErrorCode::Success)
+        return PNGManipErrorCode::InvalidFileFormat;
+
+    if (checkBandIndex(layout) != PNGManipErrorCode::Success)
+        return PNGManipErrorCode::DecodingError;
+
+    m_info.payloadSize = layout.payloadSize;
+    m_info.bandCount   = layout.bands.size();
+
+    if (getPayloadRange(layout.payloadSize, m_info.rangeStart, m_info.rangeEnd) != PNGManipErrorCode::Success)
+        return PNGManipErrorCode::DecodingError;
+
+
+    // Only the bands overlapping the range are inflated
+    std::vector<uint8_t> extracted;
+
+    const auto started = m_stats.start();
+    PNGManipErrorCode result = extractRange(m_input.data(), layout, m_info.pixelSize, m_info.rangeStart, m_info.rangeEnd - m_info.rangeStart, extracted);
+    m_stats.stop(CodecStage::Inflate, started, extracted.size());
+
+    if (result != PNGManipErrorCode::Success)
+        return fail(result, "Range extraction failed: " + errorCodeToString(result));
+
+    if (!output.write(extracted.data(), extracted.size()))
+        return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the payload to the output.");
+
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::saveDecodedPayload(ByteSink& output)
+{
+    const auto started = m_stats.start();
+
+    // The pixel buffer already is the flat byte stream
+    const uint8_t* buffer = pngImage.bytes();
+    const size_t bufferSize = pngImage.pixels.size();
+
+    // Get file size from first 4 bytes
+    if (bufferSize < sizeof(uint32_t))
+        return fail(PNGManipErrorCode::DecodingError, "Corrupted image: missing header.");
+
+    uint32_t fileSize{};
+    memcpy(&fileSize, buffer, sizeof(uint32_t));
+
+    if (fileSize > bufferSize - sizeof(uint32_t))
+        return fail(PNGManipErrorCode::DecodingError, "Invalid file size in header.");
+
+    m_info.payloadSize = fileSize;
+    m_info.rangeEnd = fileSize;
+
+    // Nothing is copied, unpacking is finding the payload inside the pixels
+    m_stats.stop(CodecStage::Unpack, started, fileSize);
+
+    // Write the actual file content
+    if (!output.write(buffer + sizeof(uint32_t), fileSize))
+        return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the payload to the output.");
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::decodeStoredPayload(const imageLayout_t& layout, bool indexed, ByteSink& sink)
+{
+    PNGManipErrorCode result;
+
+    const bool ranged = options.hasRange && m_header.codec == PayloadCodec::None && !m_encryption.version;
+
+    // Whole payloads are checked against the ifCK checksum as they are written out
+    ChecksumSink checked(sink, m_stats);
+    ByteSink& output = (layout.checksum.version && !ranged) ? static_cast<ByteSink&>(checked) : sink;
+
+    if (ranged)
+        result = indexed ? rangeDecodeFromPNG(layout, output) : streamDecodeFromPNG(output);
+    else if (indexed && options.threads != 1)
+        result = parallelDecodeFromPNG(layout, output);
+    else if (options.streaming)
+        result = streamDecodeFromPNG(output);
+    else if ((result = decodeImage()) == PNGManipErrorCode::Success)
+        result = saveDecodedPayload(output);
+
+    if (result != PNGManipErrorCode::Success || &output == &sink)
+        return result;
+
+    payloadChecksum_t computed;
+    if (!checked.result(computed) || computed.length != layout.checksum.length || computed.crc != layout.checksum.crc)
+        return fail(PNGManipErrorCode::DecodingError, "Payload checksum mismatch, the image is damaged.");
+
+    m_info.checksum = layout.checksum;
+    return PNGManipErrorCode::Success;
+}
+
+
+
+PNGManipErrorCode PNGCodec::decodePrecompressed(const imageLayout_t& layout, bool indexed, ByteSink& output)
+{
+    const payloadHeader_t header = m_header;
+
+    if (!payloadCodecAvailable(header.codec))
+        return fail(PNGManipErrorCode::DecodingError, std::string("The payload is compressed with ") + payloadCodecName(header.codec) + ", which this build cannot decompress.");
+
+    // The compressed bytes are only any use whole, whatever range was asked for
+    VectorSink stored(m_stored);
+
+    PNGManipErrorCode result = m_encryption.version ? decodeEncrypted(layout, stored) : decodeStoredPayload(layout, indexed, stored);
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    if (m_stored.size() != header.storedSize)
+        return fail(PNGManipErrorCode::DecodingError, "Payload header does not match the image.");
+
+    // The range, if any, now applies to the original bytes
+    m_header = payloadHeader_t{};
+    m_info.precompression = header;
+    m_info.payloadSize = header.originalSize;
+
+    if (getPayloadRange(header.originalSize, m_info.rangeStart, m_info.rangeEnd) != PNGManipErrorCode::Success)
+        return PNGManipErrorCode::DecodingError;
+
+    result = decompressPayload(header, reinterpret_cast<const uint8_t*>(m_stored.data()), m_stored.size(), m_info.rangeStart, m_info.rangeEnd, output, m_stats);
+
+    if (result == PNGManipErrorCode::FileNotWritable)
+        return fail(result, "Cannot write the payload to the output.");
+
+    if (result != PNGManipErrorCode::Success)
+        return fail(result, std::string("Corrupted ") + payloadCodecName(header.codec) + " payload (failed to decompress, or size or checksum mismatch).");
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGCodec::decodeEncrypted(const imageLayout_t& layout, ByteSink& output)
+{
+    const encryptionHeader_t header = m_encryption;
+
+    if (!options.key.enabled())
+        return fail(PNGManipErrorCode::DecodingError, "The payload is encrypted, decoding it needs --key-file or --passphrase-file.");
+
+    uint8_t key[payloadKeyBytes];
+    if (!deriveKey(options.key, header, key))
+    {
+        if (header.kdf == KeyDerivation::Raw)
+            return fail(PNGManipErrorCode::DecodingError, "The payload was encrypted with a key file, decoding it needs --key-file.");
+
+        if (header.iterations > maxKdfIterations)
+            return fail(PNGManipErrorCode::DecodingError, "The encryption header asks for more key derivation work than allowed.");
+
+        return fail(PNGManipErrorCode::DecodingError, "The payload was encrypted with a passphrase, decoding it needs --passphrase-file.");
+    }
+
+    // The range, if any, applies to the plaintext. Pre-compressed bytes are only any use whole
+    uint64_t rangeStart{ 0 }, rangeEnd{ header.length };
+
+    if (m_header.codec == PayloadCodec::None && clipRange(header.length, rangeStart, rangeEnd) != PNGManipErrorCode::Success)
+    {
+        wipeSecret(key, sizeof(key));
+        return PNGManipErrorCode::DecodingError;
+    }
+
+    DecryptingSink opened(output, header, key, rangeStart, rangeEnd, m_stats);
+    wipeSecret(key, sizeof(key));
+
+    // The sealed bytes go through the serial paths whole. An encrypted image has no band index,
+    // and one that claims to is not trusted with positional writes
+    PNGManipErrorCode result = decodeStoredPayload(layout, false, opened);
+
+    // From here on the range and the sizes are the plaintext's
+    m_encryption = encryptionHeader_t{};
+    m_info.encryption = header;
+
+    if (!opened.authentic())
+        return fail(PNGManipErrorCode::DecodingError, "The payload failed authentication: wrong key, or the image was altered.");
+
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    if (!opened.complete())
+        return fail(PNGManipErrorCode::DecodingError, "The encrypted payload is cut short.");
+
+    m_info.payloadSize = header.length;
+    m_info.rangeStart = rangeStart;
+    m_info.rangeEnd = rangeEnd;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+PNGManipErrorCode PNGCodec::encryptedEncodeToPNG(ByteSource& input, ByteSink& output)
+{
+    encryptionHeader_t header;
+    if (!newEncryptionHeader(options.key, input.size(), header))
+        return fail(PNGManipErrorCode::EncodingError, "The operating system's random generator failed, nothing was encrypted.");
+
+    uint8_t key[payloadKeyBytes];
+    if (!deriveKey(options.key, header, key))
+        return fail(PNGManipErrorCode::EncodingError, "The key file has to hold exactly " + std::to_string(payloadKeyBytes) + " bytes.");
+
+    EncryptingSource sealed(input, header, key, m_stats);
+    wipeSecret(key, sizeof(key));
+
+    m_encryption = header;
+    m_info.encryption = header;
+
+    PNGManipErrorCode result = setImageGeometry(sealed.size());
+
+    // The size prefix counts the tags too, callers want to hear about the payload
+    m_info.payloadSize = (m_header.codec != PayloadCodec::None) ? m_header.originalSize : header.length;
+
+    chooseCompression(nullptr, 0);
+
+    if (result == PNGManipErrorCode::Success)
+        result = pipelinedEncodeToPNG(sealed, output);
+
+    return result;
+}
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+PNGManipErrorCode PNGCodec::encode(std::span<const std::byte> input, ByteSink& sink)
+{
+    m_input = { reinterpret_cast<const uint8_t*>(input.data()), input.size() };
+    m_info = imageInfo_t{};
+    m_error.clear();
+    m_stats.reset();
+
+    StatsSink timedSink(sink, m_stats);
+    ByteSink& output = m_stats.enabled() ? static_cast<ByteSink&>(timedSink) : sink;
+
+    m_header = payloadHeader_t{ payloadHeaderVersion, options.precompress, options.precompressLevel };
+    m_encryption = encryptionHeader_t{};
+    m_info.shard = options.shard;
+
+    // From here on the pixels hold the compressed bytes
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+    if (m_header.codec != PayloadCodec::None)
+    {
+        SpanSource source(input);
+        result = precompress(source);
+    }
+
+    // Encrypted payloads are sealed by the pipeline's reader as it goes, whichever encoder was asked for
+    if (result == PNGManipErrorCode::Success && options.key.enabled())
+    {
+        SpanSource source({ reinterpret_cast<const std::byte*>(m_input.data()), m_input.size() });
+        result = encryptedEncodeToPNG(source, output);
+
+        m_input = {};
+        return result;
+    }
+
+    if (result == PNGManipErrorCode::Success)
+        result = setImageGeometry(m_input.size());
+
+    if (m_header.codec != PayloadCodec::None)
+        m_info.payloadSize = m_header.originalSize;
+
+    chooseCompression(m_input.data(), std::min(m_input.size(), autoSampleBytes));
+
+    if (result == PNGManipErrorCode::Success)
+    {
+        // The pipeline checksums the payload as its reader goes, the other encoders are handed it in memory
+        if (!options.pipeline || options.threads != 1 || options.bands)
+            checksumInput();
+
+        if (options.threads != 1 || options.bands)
+            result = parallelEncodeToPNG(output);
+        else if (options.pipeline)
+        {
+            SpanSource source({ reinterpret_cast<const std::byte*>(m_input.data()), m_input.size() });
+            result = pipelinedEncodeToPNG(source, output);
+        }
+        else if (options.nativeWriter)
+            result = nativeEncodeToPNG(output);
+        else if (options.streaming)
+            result = streamEncodeToPNG(output);
+        else if ((result = encodeToImage()) == PNGManipErrorCode::Success)
+            result = savePNG(output);
+    }
+
+    m_input = {};
+    return result;
+}
+
+
+
+PNGManipErrorCode PNGCodec::encode(ByteSource& input, ByteSink& sink)
+{
+    m_input = {};
+    m_info = imageInfo_t{};
+    m_error.clear();
+    m_stats.reset();
+
+    StatsSink timedSink(sink, m_stats);
+    ByteSink& output = m_stats.enabled() ? static_cast<ByteSink&>(timedSink) : sink;
+
+    m_header = payloadHeader_t{ payloadHeaderVersion, options.precompress, options.precompressLevel };
+    m_encryption = encryptionHeader_t{};
+    m_info.shard = options.shard;
+
+    // Pre-compression has to see the whole source before the geometry is known, so the
+    // pipeline then reads the compressed bytes from memory
+    ByteSource* source = &input;
+    SpanSource storedSource({});
+
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+    if (m_header.codec != PayloadCodec::None && (result = precompress(input)) == PNGManipErrorCode::Success)
+    {
+        storedSource = SpanSource(m_stored);
+        source = &storedSource;
+    }
+
+    if (result == PNGManipErrorCode::Success && options.key.enabled())
+    {
+        result = encryptedEncodeToPNG(*source, output);
+
+        m_input = {};
+        return result;
+    }
+
+    if (result == PNGManipErrorCode::Success)
+        result = setImageGeometry(source->size());
+
+    if (m_header.codec != PayloadCodec::None)
+        m_info.payloadSize = m_header.originalSize;
+
+    // The sample is read ahead of the pipeline, without consuming it
+    std::vector<uint8_t> sample;
+    if (result == PNGManipErrorCode::Success && (options.profile == CompressionProfile::Auto || m_header.codec != PayloadCodec::None))
+    {
+        sample.resize(static_cast<size_t>(std::min<uint64_t>(source->size(), autoSampleBytes)));
+
+        if (!source->peek(sample.data(), sample.size()))
+            sample.clear();
+    }
+
+    chooseCompression(sample.empty() ? nullptr : sample.data(), sample.size());
+
+    if (result == PNGManipErrorCode::Success)
+        result = pipelinedEncodeToPNG(*source, output);
+
+    m_input = {};
+    return result;
+}
+
+
+
+PNGManipErrorCode PNGCodec::encodeUnsized(std::span<const std::byte> head, StreamSource& rest, ByteSink& sink)
+{
+    m_input = { reinterpret_cast<const uint8_t*>(head.data()), head.size() };
+    m_info = imageInfo_t{};
+    m_error.clear();
+    m_stats.reset();
+
+    StatsSink timedSink(sink, m_stats);
+    ByteSink& output = m_stats.enabled() ? static_cast<ByteSink&>(timedSink) : sink;
+
+    m_header = payloadHeader_t{ payloadHeaderVersion, PayloadCodec::None, options.precompressLevel };
+    m_encryption = encryptionHeader_t{};
+    m_info.shard = options.shard;
+
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+
+    if (options.precompress != PayloadCodec::None || options.key.enabled() || options.bands
+        || options.shard.count || (options.shard.flags & shardStreamed) || options.archive.version)
+        result = fail(PNGManipErrorCode::EncodingError, "Pre-compression, encryption, bands, shards and archives need the size of the input up front.");
+
+    // Whatever was read ahead stands in for the sample
+    chooseCompression(m_input.data(), std::min(m_input.size(), autoSampleBytes));
+
+    if (result == PNGManipErrorCode::Success)
+        result = unsizedEncodeToPNG(rest, output);
+
+    m_input = {};
+    return result;
+}
+
+
+
+PNGManipErrorCode PNGCodec::decode(std::span<const std::byte> image, ByteSink& sink)
+{
+    m_input = { reinterpret_cast<const uint8_t*>(image.data()), image.size() };
+    m_info = imageInfo_t{};
+    m_error.clear();
+    m_stats.reset();
+
+    StatsSink timedSink(sink, m_stats);
+    ByteSink& output = m_stats.enabled() ? static_cast<ByteSink&>(timedSink) : sink;
+
+    // Images carrying a band index can be inflated in parallel and cut into ranges cheaply,
+    // anything else takes the serial path
+    imageLayout_t layout;
+    PNGManipErrorCode result = scanImageLayout(m_input.data(), m_input.size(), layout);
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        m_input = {};
+        return fail(result, "Not a PNG image, or a damaged one.");
+    }
+
+    const bool indexed = !layout.bands.empty();
+    m_header = layout.payloadHeader;
+    m_encryption = layout.encryption;
+    m_info.formatVersion = layout.formatVersion;
+    m_info.shard = layout.shard;
+
+    if (m_header.codec != PayloadCodec::None)
+        result = decodePrecompressed(layout, indexed, output);
+    else if (m_encryption.version)
+        result = decodeEncrypted(layout, output);
+    else
+        result = decodeStoredPayload(layout, indexed, output);
+
+    m_input = {};
+    return result;
+}
+
+
+
+PNGManipErrorCode PNGCodec::probe(std::span<const std::byte> image)
+{
+    // Comfortably more than a zlib header, a dynamic Huffman table and the first few bytes need
+    static constexpr uint64_t probeStreamBytes = 4096;
+
+    const uint8_t* file = reinterpret_cast<const uint8_t*>(image.data());
+
+    m_info = imageInfo_t{};
+    m_error.clear();
+    m_stats.reset();
+
+    imageLayout_t layout;
+    if (scanImageLayout(file, image.size(), layout, probeStreamBytes) != PNGManipErrorCode::Success)
+        return fail(PNGManipErrorCode::InvalidFileFormat, "Not a PNG image, or a damaged one.");
+
+    if (acceptLayout(layout) != PNGManipErrorCode::Success)
+        return PNGManipErrorCode::InvalidFileFormat;
+
+    // Images from before ifVR still carry an ifCK after the image data. Only the chunk headers
+    // are read on the way to it
+    if (!layout.formatVersion)
+    {
+        imageLayout_t whole;
+
+        if (scanImageLayout(file, image.size(), whole) != PNGManipErrorCode::Success || !whole.checksum.version)
+            return fail(PNGManipErrorCode::InvalidFileFormat, "Not an Imageify PNG: it has neither an ifVR nor an ifCK chunk.");
+    }
+
+    m_info.formatVersion  = layout.formatVersion;
+    m_info.precompression = layout.payloadHeader;
+    m_info.shard          = layout.shard;
+    m_info.archive        = layout.archive;
+    m_info.encryption     = layout.encryption;
+
+    const auto started = m_stats.start();
+
+    // The filter type byte of the first row, then the size prefix
+    uint8_t head[1 + sizeof(uint32_t)]{};
+
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK)
+        return fail(PNGManipErrorCode::MemoryAllocationError, "Cannot initialise zlib.");
+
+    stream.next_out = head;
+    stream.avail_out = sizeof(head);
+
+    int status{ Z_OK };
+    for (const idatSegment_t& segment : layout.idat)
+    {
+        stream.next_in = const_cast<Bytef*>(file + segment.fileOffset);
+        stream.avail_in = static_cast<uInt>(segment.length);
+
+        status = inflate(&stream, Z_SYNC_FLUSH);
+
+        if (stream.avail_out == 0 || (status != Z_OK && status != Z_BUF_ERROR))
+            break;
+    }
+
+    const bool complete = (stream.avail_out == 0);
+    inflateEnd(&stream);
+
+    m_stats.stop(CodecStage::Inflate, started, sizeof(head) - stream.avail_out);
+
+    if (!complete)
+        return fail(PNGManipErrorCode::DecodingError, "Corrupted image: missing header.");
+
+    // The first row has nothing above it, so Up stores it as it is and Average and Paeth reduce
+    // to fractions of Sub. Pixels of 4 bytes or more hold the whole prefix in the first pixel,
+    // which every filter stores as it is
+    const uint8_t filter = head[0];
+    uint8_t prefix[sizeof(uint32_t)];
+    memcpy(prefix, head + 1, sizeof(prefix));
+
+    const size_t stride = std::clamp<size_t>(m_info.pixelSize, 1, sizeof(prefix));
+
+    for (size_t left{ 0 }; left + stride < sizeof(prefix); ++left)
+    {
+        uint8_t& current = prefix[left + stride];
+
+        if (filter == PNG_FILTER_VALUE_SUB || filter == PNG_FILTER_VALUE_PAETH)
+            current = static_cast<uint8_t>(current + prefix[left]);
+        else if (filter == PNG_FILTER_VALUE_AVG)
+            current = static_cast<uint8_t>(current + (prefix[left] >> 1));
+    }
+
+    uint32_t storedSize{};
+    memcpy(&storedSize, prefix, sizeof(uint32_t));
+
+    const uint64_t capacity = static_cast<uint64_t>(layout.width) * layout.height * m_info.pixelSize;
+
+    if (capacity < sizeof(uint32_t) || storedSize > capacity - sizeof(uint32_t))
+        return fail(PNGManipErrorCode::DecodingError, "Invalid file size in header.");
+
+    // An encrypted payload's prefix counts its tags as well
+    const encryptionHeader_t& encryption = layout.encryption;
+
+    if (encryption.version && sealedSize(encryption.length, encryption.chunkBytes) != storedSize)
+        return fail(PNGManipErrorCode::DecodingError, "Encryption header does not match the size prefix.");
+
+    const uint64_t plainSize = encryption.version ? encryption.length : storedSize;
+
+    if (layout.payloadHeader.codec != PayloadCodec::None && layout.payloadHeader.storedSize != plainSize)
+        return fail(PNGManipErrorCode::DecodingError, "Payload header does not match the size prefix.");
+
+    m_info.payloadSize = (layout.payloadHeader.codec != PayloadCodec::None) ? layout.payloadHeader.originalSize : plainSize;
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+PNGManipErrorCode PNGCodec::embed(std::span<const std::byte> cover, std::span<const std::byte> payload, unsigned bits, ByteSink& sink)
+{
+    m_input = { reinterpret_cast<const uint8_t*>(cover.data()), cover.size() };
+    m_info = imageInfo_t{};
+    m_header = payloadHeader_t{};
+    m_encryption = encryptionHeader_t{};
+    m_error.clear();
+    m_stats.reset();
+
+    StatsSink timedSink(sink, m_stats);
+    ByteSink& output = m_stats.enabled() ? static_cast<ByteSink&>(timedSink) : sink;
+
+    PNGManipErrorCode result = (bits >= 1 && bits <= 4) ? decodeImage(true)
+        : fail(PNGManipErrorCode::EncodingError, "Between 1 and 4 low bits of each sample can carry the payload.");
+
+    m_input = {};
+
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    // The header takes the lowest bit of the first samples, the payload the low bits of the rest
+    const uint64_t headerCarriers = carriersFor(hiddenHeaderBytes, 1);
+    const uint64_t samples = pngImage.pixels.size();
+    const uint64_t capacity = (samples > headerCarriers) ? (samples - headerCarriers) / 8 * bits : 0;
+
+    m_info.hiddenBits = static_cast<uint8_t>(bits);
+    m_info.hiddenCapacity = capacity;
+    m_info.payloadSize = payload.size();
+    m_info.rangeEnd = payload.size();
+
+    if (samples < headerCarriers)
+        return fail(PNGManipErrorCode::EncodingError, "The cover is too small to hide anything in.");
+
+    if (payload.size() > capacity)
+        return fail(PNGManipErrorCode::EncodingError, "The cover holds at most " + std::to_string(capacity) + " bytes at "
+            + std::to_string(bits) + " bits per sample, the payload is " + std::to_string(payload.size()) + ".");
+
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(payload.data());
+
+    auto started = m_stats.start();
+    const hiddenHeader_t header{ hiddenVersion, static_cast<uint8_t>(bits), payload.size(), crc32c(0, bytes, payload.size()) };
+    m_stats.stop(CodecStage::Checksum, started, payload.size());
+
+    uint8_t serialized[hiddenHeaderBytes];
+    serializeHiddenHeader(header, serialized);
+
+    started = m_stats.start();
+    embedBitPlanes(pngImage.bytes(), serialized, sizeof(serialized), 1);
+    embedBitPlanes(pngImage.bytes() + headerCarriers, bytes, payload.size(), bits);
+    m_stats.stop(CodecStage::Pack, started, payload.size());
+
+    m_info.checksum = payloadChecksum_t{ checksumVersion, header.length, header.crc };
+
+    // Low bits full of payload look like noise to auto, so it would pick the settings for noise
+    chooseCompression(nullptr, 0);
+
+    return savePNG(output, true);
+}
+
+
+
+PNGManipErrorCode PNGCodec::extract(std::span<const std::byte> image, ByteSink& sink)
+{
+    // Groups extracted, checksummed and written at a time, so the payload is never held whole
+    static constexpr size_t sliceGroups = 64 * 1024;
+
+    m_input = { reinterpret_cast<const uint8_t*>(image.data()), image.size() };
+    m_info = imageInfo_t{};
+    m_error.clear();
+    m_stats.reset();
+
+    StatsSink timedSink(sink, m_stats);
+    ByteSink& output = m_stats.enabled() ? static_cast<ByteSink&>(timedSink) : sink;
+
+    PNGManipErrorCode result = decodeImage(true);
+    m_input = {};
+
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    const uint64_t headerCarriers = carriersFor(hiddenHeaderBytes, 1);
+    const uint64_t samples = pngImage.pixels.size();
+
+    uint8_t serialized[hiddenHeaderBytes]{};
+    hiddenHeader_t header;
+
+    if (samples < headerCarriers)
+        return fail(PNGManipErrorCode::InvalidFileFormat, "Nothing is hidden in the image.");
+
+    extractBitPlanes(pngImage.bytes(), serialized, sizeof(serialized), 1);
+
+    if (!parseHiddenHeader(serialized, header))
+        return fail(PNGManipErrorCode::InvalidFileFormat, "Nothing is hidden in the image, or it was hidden by a newer version.");
+
+    const uint64_t capacity = (samples - headerCarriers) / 8 * header.bits;
+
+    if (header.length > capacity)
+        return fail(PNGManipErrorCode::DecodingError, "Invalid hidden payload size, the image is damaged.");
+
+    m_info.hiddenBits = header.bits;
+    m_info.hiddenCapacity = capacity;
+    m_info.payloadSize = header.length;
+    m_info.rangeEnd = header.length;
+
+    std::vector<uint8_t> slice(sliceGroups * header.bits);
+    const uint8_t* carriers = pngImage.bytes() + headerCarriers;
+    uint32_t crc{ 0 };
+
+    for (uint64_t remaining = header.length; remaining; )
+    {
+        const size_t take = static_cast<size_t>(std::min<uint64_t>(remaining, slice.size()));
+
+        auto started = m_stats.start();
+        extractBitPlanes(carriers, slice.data(), take, header.bits);
+        m_stats.stop(CodecStage::Unpack, started, take);
+
+        started = m_stats.start();
+        crc = crc32c(crc, slice.data(), take);
+        m_stats.stop(CodecStage::Checksum, started, take);
+
+        if (!output.write(slice.data(), take))
+            return fail(PNGManipErrorCode::FileNotWritable, "Cannot write the payload to the output.");
+
+        carriers += sliceGroups * 8;
+        remaining -= take;
+    }
+
+    if (crc != header.crc)
+        return fail(PNGManipErrorCode::DecodingError, "Hidden payload checksum mismatch, the image is damaged.");
+
+    m_info.checksum = payloadChecksum_t{ checksumVersion, header.length, header.crc };
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+PNGManipErrorCode PNGCodec::encode(std::span<const std::byte> input, std::vector<std::byte>& output)
+{
+    VectorSink sink(output);
+    return encode(input, sink);
+}
+
+
+
+PNGManipErrorCode PNGCodec::decode(std::span<const std::byte> image, std::vector<std::byte>& output)
+{
+    VectorSink sink(output);
+    return decode(image, sink);
+}
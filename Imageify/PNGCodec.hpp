@@ -0,0 +1,486 @@
+#ifndef _PNGCODEC_H_
+#define _PNGCODEC_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <png.h>
+#include <zlib.h>
+
+#include "ErrorHandling.hpp"
+#include "BandIndex.hpp"
+#include "ByteSink.hpp"
+#include "ByteSource.hpp"
+#include "BitPlane.hpp"
+#include "CodecStats.hpp"
+#include "CompressionProfile.hpp"
+#include "Encryption.hpp"
+#include "PayloadCodec.hpp"
+#include "PixelFormat.hpp"
+#include "PNGWriter.hpp"
+
+
+// Define structs for pixel and bitmap
+
+/**
+* @brief A structure representing a pixel with RGBA color components, the default format.
+*/
+using pixel_t = pixel<PixelFormat::RGBA8>;
+
+/**
+* @brief A structure representing a bitmap image with pixel data and dimensions.
+*/
+struct alignas(16) bitmap_t
+{
+	uint16_t width;
+	uint16_t height;
+
+	// Bytes per pixel and bits per sample of the format
+	png_byte pixelSize;
+	png_byte pixelDepth;
+
+	PixelFormat format{ PixelFormat::RGBA8 };
+
+	// The rows back to back, in the layout of the format
+	std::vector<uint8_t> pixels;
+
+	/**
+	* @brief Returns the pixel buffer as the raw byte stream libpng reads and writes.
+	*/
+	uint8_t* bytes() { return pixels.data(); }
+
+	/**
+	* @brief Returns the pixel buffer as pixels of the given format.
+	*/
+	template <PixelFormat F>
+	pixel<F>* pixelsAs() { return reinterpret_cast<pixel<F>*>(pixels.data()); }
+
+	/**
+	* @brief Returns row pointers aimed straight into the pixel buffer.
+	*/
+	std::vector<png_bytep> rowPointers()
+	{
+		std::vector<png_bytep> rows(height);
+
+		for (size_t row{ 0 }; row < height; ++row)
+			rows[row] = bytes() + row * width * pixelSize;
+
+		return rows;
+	}
+};
+
+
+/**
+* @brief Optional behaviour switches for the codec, filled in from the command line.
+*/
+struct PNGManipOptions
+{
+	// Process the image one row at a time instead of holding the whole payload in memory
+	bool streaming{ false };
+
+	// Layout of the pixels the payload is packed into. Decoding reads it from the image
+	PixelFormat format{ PixelFormat::RGBA8 };
+
+	// Worker threads for the parallel deflate encoder; 1 keeps libpng's serial path, 0 uses every core
+	unsigned threads{ 1 };
+
+	// zlib level for every encoder, 0 (store) to 9, Z_DEFAULT_COMPRESSION for zlib's own default.
+	// Any profile but Default overrides it
+	int level{ Z_DEFAULT_COMPRESSION };
+	CompressionProfile profile{ CompressionProfile::Default };
+
+	// Compress the payload before it is packed into pixels, recording how in an ifPH chunk.
+	// The default profile then samples the compressed bytes the way auto does
+	PayloadCodec precompress{ PayloadCodec::None };
+	int precompressLevel{ payloadDefaultLevel };
+
+	// Set when the input is one shard of a larger payload, written to the image as an ifSH chunk
+	shardHeader_t shard{};
+
+	// Set when the input is several files packed back to back, written to the image as an ifAR chunk
+	archiveManifest_t archive{};
+
+	// Deflate rows in independent bands and store an ifBI index, so decoding can run in parallel.
+	// bandBytes is also the size of the buffers passed between pipeline stages
+	bool bands{ false };
+	size_t bandBytes{ 1024 * 1024 };
+
+	// Write the PNG with PNGWriter instead of libpng on the single-threaded encoders, every row
+	// filtered with None. libpng stays the reference, and the default
+	bool nativeWriter{ false };
+
+	// Encode with reading, packing, deflating and writing overlapped on their own threads
+	bool pipeline{ false };
+	size_t queueDepth{ 4 };
+
+	// Decode only payload bytes [rangeOffset, rangeOffset + rangeLength)
+	bool hasRange{ false };
+	uint64_t rangeOffset{ 0 };
+	uint64_t rangeLength{ 0 };
+
+	// Time every stage of each call, see PNGCodec::stats()
+	bool stats{ false };
+
+	// Encrypt the payload with ChaCha20-Poly1305, recording how in an ifEN chunk. Decoding an
+	// encrypted image needs the same key file or passphrase. Encrypted payloads are always
+	// sealed and packed by the pipelined encoder, and decoded serially
+	payloadKey_t key{};
+};
+
+
+/**
+* @brief What the last encode or decode call worked with, for callers that want to report it.
+*/
+struct imageInfo_t
+{
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+	uint8_t pixelDepth{ 0 };
+	uint8_t pixelSize{ 0 };
+	PixelFormat format{ PixelFormat::RGBA8 };
+
+	uint64_t payloadSize{ 0 };
+
+	// Bands written or read through the ifBI index, 0 for plain images
+	size_t bandCount{ 0 };
+
+	// Threads the parallel paths ran on, 1 for the serial ones
+	unsigned threads{ 1 };
+
+	// Payload bytes actually produced by a decode, the whole payload unless a range was asked for
+	uint64_t rangeStart{ 0 };
+	uint64_t rangeEnd{ 0 };
+
+	// What an encode compressed with, and the entropy of the sample the auto profile looked at
+	compressionSettings_t compression{};
+	double sampleEntropy{ -1.0 };
+
+	// How the payload was pre-compressed, codec None if it went into the pixels as is.
+	// payloadSize above is always the size of the original payload
+	payloadHeader_t precompression{};
+
+	// The ifVR format version written, or read by probe() and decode(). 0 for images made before it
+	uint8_t formatVersion{ 0 };
+
+	// The shard header written or read, count 0 for an image holding a whole payload
+	shardHeader_t shard{};
+
+	// The archive manifest read by probe(), version 0 unless the image is an archive
+	archiveManifest_t archive{};
+
+	// How the payload was encrypted, version 0 if it was not. The checksum below then covers
+	// the encrypted bytes, and every chunk of them was checked against its tag on decoding
+	encryptionHeader_t encryption{};
+
+	// The checksum written, or read and matched. Version 0 when the image has none, and after
+	// a range decode, which never sees the whole payload to check it
+	payloadChecksum_t checksum{};
+
+	// For a payload hidden in a cover image: the low bits of each sample it took, and the
+	// most the cover could hold at that depth. Both 0 for ordinary images
+	uint8_t hiddenBits{ 0 };
+	uint64_t hiddenCapacity{ 0 };
+};
+
+
+
+
+/**
+* @brief The Imageify codec: turns a byte buffer into a PNG and back, entirely in memory.
+*
+* The codec never opens files or prints anything. Input comes in as a span, output goes to a
+* ByteSink, and failures come back as a PNGManipErrorCode with the details in errorMessage().
+* One instance can be reused for any number of calls; it keeps its pixel buffer between them.
+*/
+class PNGCodec
+{
+private:
+
+	const PNGManipOptions options;
+
+	uint32_t m_fileSize{ 0 };
+	bitmap_t pngImage{};
+
+	// The buffer being encoded or decoded, only valid during a call
+	std::span<const uint8_t> m_input;
+
+	imageInfo_t m_info;
+	std::string m_error;
+
+	// Per-stage timing, only recorded when options.stats is set
+	CodecStats m_stats;
+
+	// Resolved from the profile at the start of each encode
+	compressionSettings_t m_compression{};
+
+	// The payload header of the current call, and the compressed payload it describes
+	payloadHeader_t m_header{};
+	std::vector<std::byte> m_stored;
+
+	// CRC-32C of the bytes packed into the pixels, written after the image data
+	payloadChecksum_t m_checksum{};
+
+	// The encryption header of the current call, version 0 while the stored bytes are plaintext
+	encryptionHeader_t m_encryption{};
+
+	// Filled in by the libpng error handler before it jumps back
+	std::string m_pngError;
+
+	// Row pointers into pngImage for the whole-image libpng calls. Kept here rather than in the
+	// calling frame, so a longjmp out of a corrupt row skips no destructor and leaks nothing
+	std::vector<png_bytep> m_rowPointers;
+
+
+	/**
+	* @brief Records the reason for a failure and returns its code.
+	*/
+	PNGManipErrorCode fail(PNGManipErrorCode, const std::string&);
+
+	/**
+	* @brief Function to insert information into the pixel of the image
+	*/
+	PNGManipErrorCode encodeToImage();
+
+	/**
+	* @brief Function to decode image, i.e., extract information from the pixel of the image.
+	*        A cover can be any PNG, and is expanded to Gray8, RGB8 or RGBA8 on the way in.
+	*/
+	PNGManipErrorCode decodeImage(bool cover = false);
+
+	/**
+	* @brief Compresses the pixel buffer into a PNG. A cover gets no Imageify chunks, which would give it away.
+	*/
+	PNGManipErrorCode savePNG(ByteSink&, bool cover = false);
+
+	/**
+	* @brief Encodes the input straight into the output PNG, one row at a time.
+	*/
+	PNGManipErrorCode streamEncodeToPNG(ByteSink&);
+
+	/**
+	* @brief Decodes the input PNG one row at a time, writing the payload out as rows arrive.
+	*/
+	PNGManipErrorCode streamDecodeFromPNG(ByteSink&);
+
+	/**
+	* @brief Encodes the input into the output PNG with PNGWriter, one batch of rows at a time.
+	*/
+	PNGManipErrorCode nativeEncodeToPNG(ByteSink&);
+
+	/**
+	* @brief Encodes m_input and then the rest of the stream into the output PNG at the unsized row
+	*        width, rewriting the height and the size prefix once the stream has ended.
+	*/
+	PNGManipErrorCode unsizedEncodeToPNG(StreamSource&, ByteSink&);
+
+	/**
+	* @brief Encodes the source into the output PNG through the read, pack, deflate and write pipeline.
+	*/
+	PNGManipErrorCode pipelinedEncodeToPNG(ByteSource&, ByteSink&);
+
+	/**
+	* @brief Encodes the input into the output PNG, deflating blocks of rows on a thread pool.
+	*/
+	PNGManipErrorCode parallelEncodeToPNG(ByteSink&);
+
+	/**
+	* @brief Decodes a banded PNG, inflating bands on a thread pool and writing each into its slice of the output.
+	*/
+	PNGManipErrorCode parallelDecodeFromPNG(const imageLayout_t&, ByteSink&);
+
+	/**
+	* @brief Decodes only the requested byte range, inflating just the bands that hold it.
+	*/
+	PNGManipErrorCode rangeDecodeFromPNG(const imageLayout_t&, ByteSink&);
+
+	/**
+	* @brief Decodes with whichever path suits the image and the options, writing the bytes the pixels hold.
+	*/
+	PNGManipErrorCode decodeStoredPayload(const imageLayout_t&, bool indexed, ByteSink&);
+
+	/**
+	* @brief Decodes the compressed payload whole, then decompresses it (or the requested range) into the sink.
+	*/
+	PNGManipErrorCode decodePrecompressed(const imageLayout_t&, bool indexed, ByteSink&);
+
+	/**
+	* @brief Opens an encrypted payload as it is decoded, checking every chunk before it is written to the sink.
+	*/
+	PNGManipErrorCode decodeEncrypted(const imageLayout_t&, ByteSink&);
+
+	/**
+	* @brief Seals the source chunk by chunk on the pipeline's reader thread, packing and deflating the ciphertext.
+	*/
+	PNGManipErrorCode encryptedEncodeToPNG(ByteSource&, ByteSink&);
+
+	/**
+	* @brief Compresses the source into m_stored and points m_input at it.
+	*/
+	PNGManipErrorCode precompress(ByteSource&);
+
+	/**
+	* @brief The chunks to write after IHDR: ifVR, then ifPH, ifSH, ifAR and ifEN for pre-compressed payloads, shards, archives and encrypted payloads.
+	*/
+	std::vector<std::pair<const char*, std::vector<uint8_t>>> headerChunks() const;
+
+	/**
+	* @brief Writes the header chunks through libpng or PNGWriter.
+	*/
+	void writeHeaderChunks(png_structp);
+	void writeHeaderChunks(PNGWriter&);
+
+	/**
+	* @brief Writes the ifCK chunk after the image data, once the payload has been checksummed.
+	*/
+	void writeTrailerChunks(png_structp);
+	void writeTrailerChunks(PNGWriter&);
+
+	/**
+	* @brief Checksums the payload held in m_input, for the encoders that are handed it whole.
+	*/
+	void checksumInput();
+
+	/**
+	* @brief Resolves the requested range (or the whole payload) against the payload size.
+	*        The stored bytes of a pre-compressed or encrypted payload are always wanted whole.
+	*/
+	PNGManipErrorCode getPayloadRange(uint64_t, uint64_t&, uint64_t&);
+
+	/**
+	* @brief Resolves the requested range against a size, whatever the stored bytes hold.
+	*/
+	PNGManipErrorCode clipRange(uint64_t, uint64_t&, uint64_t&);
+
+	/**
+	* @brief Fills one row of the image (size prefix, payload and zero padding) from the input.
+	*/
+	void fillRow(size_t, uint8_t*) const;
+
+	/**
+	* @brief Resolves the profile into zlib and filter settings, sampling the payload for auto.
+	*        A null sample makes auto fall back to the balanced settings.
+	*/
+	void chooseCompression(const uint8_t*, size_t);
+
+	/**
+	* @brief Hands the chosen settings to a libpng write struct.
+	*/
+	void applyCompression(png_structp) const;
+
+	/**
+	* @brief Sizes the output image for an input of the given size.
+	*/
+	PNGManipErrorCode setImageGeometry(uint64_t);
+
+	/**
+	* @brief Checks that a scanned image is in one of the pixel formats, and records its geometry in info().
+	*/
+	PNGManipErrorCode acceptLayout(const imageLayout_t&);
+
+	/**
+	* @brief Checks that the band index of an accepted layout tiles the image in order and that its
+	*        payload size fits the pixels, before any band is inflated from it.
+	*/
+	PNGManipErrorCode checkBandIndex(const imageLayout_t&);
+
+	/**
+	* @brief Writes the payload held in the decoded pixel buffer.
+	*/
+	PNGManipErrorCode saveDecodedPayload(ByteSink&);
+
+	/**
+	* @brief Creates a libpng read or write struct that reports through m_pngError instead of stderr.
+	*/
+	png_structp createReadStruct();
+	png_structp createWriteStruct();
+
+public:
+
+	// Largest payload one image can hold, limited by the 4-byte size prefix. Larger ones are sharded
+	static constexpr uint64_t maxPayloadBytes = UINT32_MAX - 8;
+
+	// Row length of an image encoded without knowing the payload size: its first row is stored
+	// in one deflate block, and the tallest image holds about as much as the size prefix counts
+	static constexpr size_t unsizedRowBytes = 65532;
+
+	/**
+	* @brief Largest payload one image of the given format can hold. Gray8 images run out of
+	*        rows and columns a little before the size prefix does.
+	*/
+	static uint64_t maxPayloadBytesFor(PixelFormat);
+
+	explicit PNGCodec(const PNGManipOptions& = {});
+
+	/**
+	* @brief Encodes the bytes into a PNG image, written to the sink.
+	*/
+	PNGManipErrorCode encode(std::span<const std::byte>, ByteSink&);
+	PNGManipErrorCode encode(std::span<const std::byte>, std::vector<std::byte>&);
+
+	/**
+	* @brief Encodes a source that is read front to back, through the pipelined encoder whatever the options.
+	*/
+	PNGManipErrorCode encode(ByteSource&, ByteSink&);
+
+	/**
+	* @brief Encodes a payload whose size is only known once the stream ends: the bytes already read,
+	*        then the rest of the stream. Rows go to the sink as they fill, and the height and size
+	*        prefix are rewritten after the last one, so the sink has to take writeAt() over what it
+	*        was given, as a file does. Pre-compression, encryption, bands, shards and archives all
+	*        need the size up front and are refused.
+	*/
+	PNGManipErrorCode encodeUnsized(std::span<const std::byte>, StreamSource&, ByteSink&);
+
+	/**
+	* @brief Decodes a PNG image made by encode(), writing the payload (or the requested range) to the sink.
+	*/
+	PNGManipErrorCode decode(std::span<const std::byte>, ByteSink&);
+	PNGManipErrorCode decode(std::span<const std::byte>, std::vector<std::byte>&);
+
+	/**
+	* @brief Hides the payload in the low bits of every sample of the cover PNG, writing the cover
+	*        back out otherwise unchanged. Fails if the cover is too small to hold it.
+	*/
+	PNGManipErrorCode embed(std::span<const std::byte> cover, std::span<const std::byte> payload, unsigned bits, ByteSink&);
+
+	/**
+	* @brief Writes out the payload embed() hid in the image, checked against its CRC-32C.
+	*/
+	PNGManipErrorCode extract(std::span<const std::byte> image, ByteSink&);
+
+	/**
+	* @brief Fills in info() for an image without decoding it: the chunks up to the first IDAT,
+	*        and just enough of the first row to read the size prefix. Fails on PNGs Imageify did
+	*        not make, told by their lack of an ifVR chunk, or of an ifCK one for older images.
+	*/
+	PNGManipErrorCode probe(std::span<const std::byte>);
+
+	/**
+	* @brief Geometry and sizes of the last call.
+	*/
+	const imageInfo_t& info() const { return m_info; }
+
+	/**
+	* @brief Per-stage time and bytes of the last call, all zero unless options.stats is set.
+	*/
+	const CodecStats& stats() const { return m_stats; }
+
+	/**
+	* @brief Why the last call failed, empty after a success.
+	*/
+	const std::string& errorMessage() const { return m_error; }
+
+	/**
+	* @brief Function to calculate the ideal dimension for the PNG Image
+	*/
+	static std::pair<size_t, size_t> getDimensions(size_t, size_t bytesPerPixel = 4);
+};
+
+
+#endif // !_PNGCODEC_H_
@@ -0,0 +1,874 @@
+#include "PNGDaemon.hpp"
+#include "MappedFile.hpp"
+#include "OutputFile.hpp"
+#include "ThreadPool.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <optional>
+
+#ifndef _WIN32
+    #include <cerrno>
+    #include <csignal>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+
+
+
+// Every message is a magic, the length of its body and the body. The request magic changes with the option layout
+static constexpr char requestMagic[4] = { 'I', 'F', 'J', '3' };
+static constexpr char responseMagic[4] = { 'I', 'F', 'R', '1' };
+static constexpr size_t frameBytes = 4 + 8;
+
+// An inline image holding the largest payload is a little larger than the payload
+static constexpr uint64_t maxBodyBytes = PNGCodec::maxPayloadBytes + (64ull << 20);
+
+// Workers drop buffers grown past this by one large job, instead of holding on to them
+static constexpr size_t keptBufferBytes = 64ull << 20;
+
+enum : uint8_t { jobEncode = 1, jobDecode = 2 };
+
+
+
+// Appends little-endian fields to a message
+struct messageWriter_t
+{
+    std::vector<uint8_t>& out;
+
+    void u8(uint8_t value) { out.push_back(value); }
+
+    void u32(uint32_t value)
+    {
+        for (int shift{ 0 }; shift < 32; shift += 8)
+            out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+
+    void u64(uint64_t value)
+    {
+        u32(static_cast<uint32_t>(value));
+        u32(static_cast<uint32_t>(value >> 32));
+    }
+
+    void string(const std::string& value)
+    {
+        u32(static_cast<uint32_t>(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+
+    // Starts a message, leaving its body length to finish()
+    void begin(const char (&magic)[4])
+    {
+        out.assign(frameBytes, 0);
+        memcpy(out.data(), magic, 4);
+    }
+
+    void finish(uint64_t trailingBytes = 0)
+    {
+        const uint64_t body = out.size() - frameBytes + trailingBytes;
+        for (int i{ 0 }; i < 8; ++i)
+            out[4 + i] = static_cast<uint8_t>(body >> (8 * i));
+    }
+};
+
+
+
+// Reads the fields back, failing once past the end instead of reading beyond it
+struct messageReader_t
+{
+    const uint8_t* data;
+    size_t size;
+    size_t position{ 0 };
+    bool ok{ true };
+
+    bool take(size_t length)
+    {
+        ok = ok && length <= size - position;
+        return ok;
+    }
+
+    uint8_t u8() { return take(1) ? data[position++] : 0; }
+
+    uint32_t u32()
+    {
+        if (!take(4))
+            return 0;
+
+        uint32_t value{ 0 };
+        for (int i{ 0 }; i < 4; ++i)
+            value |= static_cast<uint32_t>(data[position++]) << (8 * i);
+
+        return value;
+    }
+
+    uint64_t u64()
+    {
+        const uint64_t low = u32();
+        return low | (static_cast<uint64_t>(u32()) << 32);
+    }
+
+    std::string string()
+    {
+        const uint32_t length = u32();
+        if (!take(length))
+            return {};
+
+        std::string value(reinterpret_cast<const char*>(data + position), length);
+        position += length;
+        return value;
+    }
+
+    std::span<const std::byte> rest() const
+    {
+        return { reinterpret_cast<const std::byte*>(data + position), size - position };
+    }
+};
+
+
+
+// The codec switches a job carries. The same bytes also tell a worker whether its codec fits
+static void writeOptions(messageWriter_t& message, const PNGManipOptions& options)
+{
+    message.u8(options.streaming);
+    message.u8(static_cast<uint8_t>(options.format));
+    message.u32(options.threads);
+    message.u32(static_cast<uint32_t>(options.level));
+    message.u8(static_cast<uint8_t>(options.profile));
+    message.u8(static_cast<uint8_t>(options.precompress));
+    message.u32(static_cast<uint32_t>(options.precompressLevel));
+    message.u8(options.bands);
+    message.u64(options.bandBytes);
+    message.u8(options.nativeWriter);
+    message.u8(options.pipeline);
+    message.u64(options.queueDepth);
+    message.u8(options.hasRange);
+    message.u64(options.rangeOffset);
+    message.u64(options.rangeLength);
+
+    // The key goes over the socket as it is, which only its owner can connect to
+    message.u8(static_cast<uint8_t>(options.key.source));
+    message.string(options.key.secret);
+}
+
+static bool readOptions(messageReader_t& message, PNGManipOptions& options)
+{
+    options.streaming        = message.u8() != 0;
+    const uint8_t format     = message.u8();
+    options.threads          = message.u32();
+    options.level            = static_cast<int32_t>(message.u32());
+    const uint8_t profile    = message.u8();
+    const uint8_t codec      = message.u8();
+    options.precompressLevel = static_cast<int32_t>(message.u32());
+    options.bands            = message.u8() != 0;
+    options.bandBytes        = static_cast<size_t>(message.u64());
+    options.nativeWriter     = message.u8() != 0;
+    options.pipeline         = message.u8() != 0;
+    options.queueDepth       = static_cast<size_t>(message.u64());
+    options.hasRange         = message.u8() != 0;
+    options.rangeOffset      = message.u64();
+    options.rangeLength      = message.u64();
+    const uint8_t keySource  = message.u8();
+    options.key.secret       = message.string();
+
+    if (!message.ok || keySource > static_cast<uint8_t>(KeySource::Passphrase) || profile > static_cast<uint8_t>(CompressionProfile::Auto) || codec > static_cast<uint8_t>(PayloadCodec::Zstd)
+        || format > static_cast<uint8_t>(PixelFormat::RGBA16))
+        return false;
+
+    options.format = static_cast<PixelFormat>(format);
+    options.profile = static_cast<CompressionProfile>(profile);
+    options.precompress = static_cast<PayloadCodec>(codec);
+    options.key.source = static_cast<KeySource>(keySource);
+
+    return payloadCodecAvailable(options.precompress);
+}
+
+
+
+#ifndef _WIN32
+
+// Written to by the signal handlers; one daemon per process is all the command line starts
+static std::atomic<int> s_wakeFd{ -1 };
+
+static void wakeOnSignal(int)
+{
+    const int fd = s_wakeFd.load();
+    if (fd >= 0)
+    {
+        const char byte{ 0 };
+        [[maybe_unused]] const ssize_t written = ::write(fd, &byte, 1);
+    }
+}
+
+
+
+static bool readAll(int fd, uint8_t* data, size_t length)
+{
+    while (length)
+    {
+        const ssize_t got = ::recv(fd, data, length, 0);
+
+        if (got < 0 && errno == EINTR)
+            continue;
+
+        if (got <= 0)
+            return false;
+
+        data += got;
+        length -= static_cast<size_t>(got);
+    }
+
+    return true;
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t length)
+{
+    while (length)
+    {
+        // A client that hung up must not take the daemon down with SIGPIPE
+        const ssize_t sent = ::send(fd, data, length, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR)
+            continue;
+
+        if (sent <= 0)
+            return false;
+
+        data += sent;
+        length -= static_cast<size_t>(sent);
+    }
+
+    return true;
+}
+
+// Reads one message into the buffer, returning false at a clean hang-up as well as on errors
+static bool readMessage(int fd, const char (&magic)[4], std::vector<uint8_t>& message)
+{
+    uint8_t frame[frameBytes];
+
+    if (!readAll(fd, frame, frameBytes) || memcmp(frame, magic, 4) != 0)
+        return false;
+
+    uint64_t body{ 0 };
+    for (int i{ 0 }; i < 8; ++i)
+        body |= static_cast<uint64_t>(frame[4 + i]) << (8 * i);
+
+    if (body > maxBodyBytes)
+        return false;
+
+    try
+    {
+        message.resize(static_cast<size_t>(body));
+    }
+    catch (const std::bad_alloc&)
+    {
+        return false;
+    }
+
+    return readAll(fd, message.data(), message.size());
+}
+
+static bool socketAddress(const std::string& path, sockaddr_un& address)
+{
+    address = {};
+    address.sun_family = AF_UNIX;
+
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        return false;
+
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+#endif
+
+
+
+
+/**
+* DaemonConnection ---------------------------------------
+*/
+
+DaemonConnection::~DaemonConnection()
+{
+    close();
+}
+
+
+
+void DaemonConnection::close()
+{
+#ifndef _WIN32
+    if (m_fd >= 0)
+        ::close(m_fd);
+#endif
+
+    m_fd = -1;
+}
+
+
+
+#ifdef _WIN32
+
+PNGManipErrorCode DaemonConnection::open(const std::string&)
+{
+    return PNGManipErrorCode::UnknownError;
+}
+
+bool DaemonConnection::submit(const daemonJob_t&, daemonResult_t&)
+{
+    return false;
+}
+
+#else
+
+PNGManipErrorCode DaemonConnection::open(const std::string& path)
+{
+    close();
+
+    sockaddr_un address;
+    if (!socketAddress(path, address))
+        return PNGManipErrorCode::FileNotFound;
+
+    m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0)
+        return PNGManipErrorCode::UnknownError;
+
+    if (::connect(m_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close();
+        return PNGManipErrorCode::FileNotFound;
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+bool DaemonConnection::submit(const daemonJob_t& job, daemonResult_t& result)
+{
+    if (m_fd < 0)
+        return false;
+
+    messageWriter_t request{ m_message };
+
+    request.begin(requestMagic);
+    request.u8(job.encode ? jobEncode : jobDecode);
+    request.u8(job.inlinePayload);
+    writeOptions(request, job.options);
+
+    if (job.inlinePayload)
+        request.finish(job.payload.size());
+    else
+    {
+        request.string(job.input);
+        request.string(job.output);
+        request.finish();
+    }
+
+    if (!writeAll(m_fd, m_message.data(), m_message.size())
+        || (job.inlinePayload && !writeAll(m_fd, reinterpret_cast<const uint8_t*>(job.payload.data()), job.payload.size())))
+        return false;
+
+    if (!readMessage(m_fd, responseMagic, m_message))
+        return false;
+
+    messageReader_t response{ m_message.data(), m_message.size() };
+
+    result.result      = static_cast<PNGManipErrorCode>(response.u8());
+    result.message     = response.string();
+    result.width       = response.u32();
+    result.height      = response.u32();
+    result.payloadSize = response.u64();
+
+    if (!response.ok)
+        return false;
+
+    const std::span<const std::byte> output = response.rest();
+    result.output.assign(output.begin(), output.end());
+
+    return true;
+}
+
+#endif
+
+
+
+
+/**
+* PNGDaemon ---------------------------------------
+*/
+
+PNGDaemon::PNGDaemon(const std::string& socket, unsigned workerCount) :
+    socketPath{ socket },
+    workers{ workerCount }
+{
+}
+
+
+
+PNGDaemon::~PNGDaemon()
+{
+#ifndef _WIN32
+    for (int fd : { m_listener, m_wake[0], m_wake[1] })
+        if (fd >= 0)
+            ::close(fd);
+#endif
+}
+
+
+
+#ifdef _WIN32
+
+PNGManipErrorCode PNGDaemon::listen()
+{
+    return PNGManipErrorCode::UnknownError;
+}
+
+void PNGDaemon::serveConnection(int) {}
+void PNGDaemon::closeConnection(int) {}
+void PNGDaemon::stop() {}
+
+PNGManipErrorCode PNGDaemon::startProcess()
+{
+    logError("Daemon mode needs Unix domain sockets, which this build does not have.");
+    return PNGManipErrorCode::UnknownError;
+}
+
+#else
+
+PNGManipErrorCode PNGDaemon::listen()
+{
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address))
+    {
+        logError("Socket path is empty or too long: " + socketPath);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    // A socket file nobody answers on was left by a daemon that was killed
+    struct stat existing;
+    if (::lstat(socketPath.c_str(), &existing) == 0)
+    {
+        if (!S_ISSOCK(existing.st_mode))
+        {
+            logError("Not a socket, refusing to replace it: " + socketPath);
+            return PNGManipErrorCode::FileNotWritable;
+        }
+
+        DaemonConnection probe;
+        if (probe.open(socketPath) == PNGManipErrorCode::Success)
+        {
+            logError("Another daemon is already listening on " + socketPath);
+            return PNGManipErrorCode::FileNotWritable;
+        }
+
+        ::unlink(socketPath.c_str());
+    }
+
+    m_listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (m_listener < 0 || ::bind(m_listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        logError("Cannot create socket: " + socketPath + " (" + std::strerror(errno) + ")");
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    // Jobs name files to read and write as the daemon's user, so only that user may send them
+    if (::chmod(socketPath.c_str(), S_IRUSR | S_IWUSR) != 0 || ::listen(m_listener, SOMAXCONN) != 0)
+    {
+        logError("Cannot listen on socket: " + socketPath + " (" + std::strerror(errno) + ")");
+        ::unlink(socketPath.c_str());
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+void PNGDaemon::closeConnection(int fd)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_connections.erase(fd);
+    }
+
+    ::close(fd);
+}
+
+
+
+void PNGDaemon::serveConnection(int fd)
+{
+    // Everything a worker keeps warm between jobs: the codec with its pixel buffer, and
+    // the request and output buffers. A codec is only rebuilt when a job's options differ
+    struct worker_t
+    {
+        std::optional<PNGCodec> codec;
+        std::vector<uint8_t> codecOptions;
+
+        FileSink outputFile;
+
+        std::vector<uint8_t> request, options, reply;
+        std::vector<std::byte> output;
+    };
+
+    thread_local worker_t worker;
+
+    while (!m_stopping && readMessage(fd, requestMagic, worker.request))
+    {
+        messageReader_t request{ worker.request.data(), worker.request.size() };
+
+        const uint8_t operation = request.u8();
+        const bool inlinePayload = request.u8() != 0;
+
+        const size_t optionsStart = request.position;
+        PNGManipOptions options;
+        const bool validOptions = readOptions(request, options);
+
+        worker.options.assign(worker.request.begin() + optionsStart, worker.request.begin() + request.position);
+
+        std::string input, output;
+        if (!inlinePayload)
+        {
+            input = request.string();
+            output = request.string();
+        }
+
+        PNGManipErrorCode result{ PNGManipErrorCode::Success };
+        std::string message;
+        bool sendOutput{ false };
+
+        if (!request.ok || !validOptions || (operation != jobEncode && operation != jobDecode))
+        {
+            result = PNGManipErrorCode::InvalidFileFormat;
+            message = "Malformed job, or options this daemon does not support.";
+        }
+        else
+        {
+            if (!worker.codec || worker.codecOptions != worker.options)
+            {
+                worker.codec.emplace(options);
+                worker.codecOptions = worker.options;
+            }
+
+            PNGCodec& codec = *worker.codec;
+            const bool encode = (operation == jobEncode);
+
+            try
+            {
+                if (inlinePayload)
+                {
+                    VectorSink sink(worker.output);
+
+                    result = encode ? codec.encode(request.rest(), sink) : codec.decode(request.rest(), sink);
+                    sendOutput = (result == PNGManipErrorCode::Success);
+                }
+                else
+                {
+                    // Mapped for this job only, the file may well be replaced before the next
+                    MappedFile inputMapping;
+                    FileSource inputSource;
+
+                    const bool pipelined = encode && options.pipeline;
+
+                    result = pipelined ? inputSource.open(input) : inputMapping.open(input);
+
+                    if (result != PNGManipErrorCode::Success)
+                        message = ((result == PNGManipErrorCode::FileNotFound) ? "Input file not found: " : "Input file not readable: ") + input;
+
+                    else if ((encode ? worker.outputFile.open(output) : worker.outputFile.openReplacing(output)) != PNGManipErrorCode::Success)
+                    {
+                        result = PNGManipErrorCode::FileNotWritable;
+                        message = "Cannot open output file: " + output;
+                    }
+                    else
+                    {
+                        const std::span<const std::byte> mapped{ reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() };
+
+                        if (pipelined)
+                            result = codec.encode(inputSource, worker.outputFile);
+                        else
+                            result = encode ? codec.encode(mapped, worker.outputFile) : codec.decode(mapped, worker.outputFile);
+
+                        // A failed decode leaves the output as it was
+                        if (result != PNGManipErrorCode::Success)
+                            worker.outputFile.discard();
+                        else if (worker.outputFile.commit() != PNGManipErrorCode::Success)
+                        {
+                            result = PNGManipErrorCode::FileNotWritable;
+                            message = "Error writing output file: " + output;
+                        }
+                    }
+                }
+            }
+            catch (const std::bad_alloc&)
+            {
+                result = PNGManipErrorCode::MemoryAllocationError;
+            }
+
+            if (result != PNGManipErrorCode::Success && message.empty())
+                message = codec.errorMessage().empty() ? errorCodeToString(result) : codec.errorMessage();
+        }
+
+        const imageInfo_t* info = (result == PNGManipErrorCode::Success) ? &worker.codec->info() : nullptr;
+        const uint64_t outputBytes = sendOutput ? worker.output.size() : 0;
+
+        messageWriter_t reply{ worker.reply };
+
+        reply.begin(responseMagic);
+        reply.u8(static_cast<uint8_t>(result));
+        reply.string(message);
+        reply.u32(info ? info->width : 0);
+        reply.u32(info ? info->height : 0);
+        reply.u64(info ? info->payloadSize : 0);
+        reply.finish(outputBytes);
+
+        const bool sent = writeAll(fd, worker.reply.data(), worker.reply.size())
+            && writeAll(fd, reinterpret_cast<const uint8_t*>(worker.output.data()), outputBytes);
+
+        if (worker.request.capacity() > keptBufferBytes)
+            std::vector<uint8_t>().swap(worker.request);
+
+        if (worker.output.capacity() > keptBufferBytes)
+            std::vector<std::byte>().swap(worker.output);
+
+        if (!sent)
+            break;
+    }
+
+    closeConnection(fd);
+}
+
+
+
+void PNGDaemon::stop()
+{
+    m_stopping = true;
+
+    if (m_wake[1] >= 0)
+    {
+        const char byte{ 0 };
+        [[maybe_unused]] const ssize_t written = ::write(m_wake[1], &byte, 1);
+    }
+}
+
+
+
+PNGManipErrorCode PNGDaemon::startProcess()
+{
+    if (::pipe2(m_wake, O_CLOEXEC | O_NONBLOCK) != 0)
+    {
+        logError("Cannot start the daemon.");
+        return PNGManipErrorCode::UnknownError;
+    }
+
+    PNGManipErrorCode result = listen();
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    // No SA_RESTART, so a signal also breaks poll() out of its wait
+    struct sigaction action{};
+    action.sa_handler = wakeOnSignal;
+    sigemptyset(&action.sa_mask);
+
+    struct sigaction previousInt{}, previousTerm{};
+    s_wakeFd = m_wake[1];
+    ::sigaction(SIGINT, &action, &previousInt);
+    ::sigaction(SIGTERM, &action, &previousTerm);
+
+    {
+        ThreadPool pool(workers);
+
+        std::cout << "[INFO] Serving jobs on \033[36m" << socketPath << "\033[0m with \033[36m" << pool.size()
+            << "\033[0m workers, Ctrl+C to stop" << std::endl;
+
+        pollfd waits[2]{ { m_listener, POLLIN, 0 }, { m_wake[0], POLLIN, 0 } };
+
+        while (!m_stopping)
+        {
+            if (::poll(waits, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                result = PNGManipErrorCode::UnknownError;
+                break;
+            }
+
+            if (waits[1].revents)
+                break;
+
+            if (!(waits[0].revents & POLLIN))
+                continue;
+
+            const int connection = ::accept4(m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (connection < 0)
+                continue;
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_connections.insert(connection);
+            }
+
+            pool.submit([this, connection]() { serveConnection(connection); });
+        }
+
+        m_stopping = true;
+
+        // Connections waiting for their next job, or for a worker, are hung up on. Jobs
+        // already running finish, as the pool waits for them before it goes away
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (int connection : m_connections)
+            ::shutdown(connection, SHUT_RDWR);
+    }
+
+    s_wakeFd = -1;
+    ::sigaction(SIGINT, &previousInt, nullptr);
+    ::sigaction(SIGTERM, &previousTerm, nullptr);
+
+    ::unlink(socketPath.c_str());
+
+    std::cout << "[INFO] Daemon stopped." << std::endl;
+
+    return result;
+}
+
+#endif
+
+
+
+
+/**
+* PNGDaemonClient ---------------------------------------
+*/
+
+PNGDaemonClient::PNGDaemonClient(const std::string& type, const std::string& socket, const std::string& input, const std::string& output, const std::string& terminalDisp, const PNGManipOptions& opts) :
+    processType{ type },
+    socketPath{ socket },
+    inputFile{ input },
+    outputFile{ output },
+    terminalOutput{ terminalDisp },
+    options{ opts }
+{
+}
+
+
+
+PNGManipErrorCode PNGDaemonClient::startProcess()
+{
+    if (processType != "ENCODE" && processType != "DECODE")
+    {
+        logError("Only encode and decode jobs can be sent to a daemon.");
+        return PNGManipErrorCode::UnknownError;
+    }
+
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    DaemonConnection connection;
+    if (connection.open(socketPath) != PNGManipErrorCode::Success)
+    {
+        logError("No daemon is listening on " + socketPath);
+        return PNGManipErrorCode::FileNotFound;
+    }
+
+    daemonJob_t job;
+    job.encode = (processType == "ENCODE");
+    job.options = options;
+    job.options.stats = false;
+    job.inlinePayload = isStandardStream(inputFile) || isStandardStream(outputFile)
+        || (processType == "DECODE" && terminalOutput == "TRUE");
+
+    // Bytes carried over the socket are read here, from a file or standard input
+    MappedFile inputMapping;
+    std::vector<std::byte> inputBytes;
+
+    if (job.inlinePayload && isStandardStream(inputFile))
+    {
+        char buffer[64 * 1024];
+        for (size_t got; (got = std::fread(buffer, 1, sizeof(buffer), stdin)) != 0; )
+        {
+            const std::byte* bytes = reinterpret_cast<const std::byte*>(buffer);
+            inputBytes.insert(inputBytes.end(), bytes, bytes + got);
+        }
+
+        job.payload = inputBytes;
+    }
+    else if (job.inlinePayload)
+    {
+        const PNGManipErrorCode opened = inputMapping.open(inputFile);
+        if (opened != PNGManipErrorCode::Success)
+        {
+            logError(((opened == PNGManipErrorCode::FileNotFound) ? "Input file not found: " : "Input file not readable: ") + inputFile);
+            return opened;
+        }
+
+        job.payload = { reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() };
+    }
+    else
+    {
+        std::error_code error;
+        job.input = std::filesystem::absolute(inputFile, error).string();
+        job.output = std::filesystem::absolute(outputFile, error).string();
+    }
+
+    daemonResult_t result;
+    if (!connection.submit(job, result))
+    {
+        logError("Lost the connection to the daemon on " + socketPath);
+        return PNGManipErrorCode::UnknownError;
+    }
+
+    if (result.result != PNGManipErrorCode::Success)
+    {
+        logError(result.message);
+        return result.result;
+    }
+
+    if (job.inlinePayload)
+    {
+        const bool showOutput = (terminalOutput == "TRUE") && !job.encode;
+
+        FileSink output;
+        if (output.open(outputFile, showOutput ? &std::cout : nullptr) != PNGManipErrorCode::Success)
+        {
+            logError("Cannot open output file: " + outputFile);
+            return PNGManipErrorCode::FileNotWritable;
+        }
+
+        if (showOutput)
+            std::cout << "\nDecoded Output:\n";
+
+        if (!output.write(reinterpret_cast<const uint8_t*>(result.output.data()), result.output.size())
+            || output.close() != PNGManipErrorCode::Success)
+        {
+            logError("Error writing output file: " + outputFile);
+            return PNGManipErrorCode::FileNotWritable;
+        }
+
+        if (showOutput)
+            std::cout << std::endl;
+    }
+
+    const auto end = std::chrono::high_resolution_clock::now();
+
+    if (job.encode)
+        std::cout << "[INFO] Resultant Image Dimensions: \033[36m" << result.width << " x " << result.height << "\033[0m" << std::endl;
+    else
+        std::cout << "[INFO] Decoded \033[36m" << static_cast<float>(result.payloadSize / 1024.0) << " KB\033[0m from a \033[36m"
+            << result.width << " x " << result.height << "\033[0m image" << std::endl;
+
+    std::cout << "\n\033[32m" << (job.encode ? "Image encoded" : "Image decoded") << " by the daemon successfully!" << "\033[0m\n"
+        << "\nRound trip took: \033[36m" << std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()
+        << " microseconds\033[0m\n";
+
+    return PNGManipErrorCode::Success;
+}
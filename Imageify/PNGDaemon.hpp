@@ -0,0 +1,186 @@
+#ifndef _PNGDAEMON_H_
+#define _PNGDAEMON_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "ErrorHandling.hpp"
+#include "PNGCodec.hpp"
+
+
+
+/**
+* @brief One encode or decode for the daemon, either between two files it opens itself
+*        or on bytes carried over the socket both ways.
+*/
+struct daemonJob_t
+{
+	bool encode{ true };
+
+	// The payload travels in the request and the result in the response, no files involved
+	bool inlinePayload{ false };
+
+	// Only the codec switches; --stats, batch and shard options stay on the client
+	PNGManipOptions options{};
+
+	// Absolute paths, as the daemon does not share the client's working directory
+	std::string input, output;
+
+	// Inline jobs only
+	std::span<const std::byte> payload;
+};
+
+
+
+/**
+* @brief What the daemon sent back for a job.
+*/
+struct daemonResult_t
+{
+	PNGManipErrorCode result{ PNGManipErrorCode::UnknownError };
+	std::string message;
+
+	uint32_t width{ 0 };
+	uint32_t height{ 0 };
+	uint64_t payloadSize{ 0 };
+
+	// The encoded image or decoded payload of an inline job
+	std::vector<std::byte> output;
+};
+
+
+
+/**
+* @brief A client connection to a running daemon. Jobs go one after another over the same
+*        socket, so a caller with many small jobs pays for connecting only once.
+*/
+class DaemonConnection
+{
+private:
+
+	int m_fd{ -1 };
+
+	// Reused between jobs, like the daemon's own buffers
+	std::vector<uint8_t> m_message;
+
+public:
+
+	DaemonConnection() = default;
+	~DaemonConnection();
+
+	DaemonConnection(const DaemonConnection&) = delete;
+	DaemonConnection& operator=(const DaemonConnection&) = delete;
+
+	/**
+	* @brief Connects to the daemon listening on the given socket path.
+	*/
+	PNGManipErrorCode open(const std::string&);
+
+	/**
+	* @brief Sends the job and waits for its result. Returns false if the connection failed,
+	*        a job that failed in the daemon still returns true with the reason in the result.
+	*/
+	bool submit(const daemonJob_t&, daemonResult_t&);
+
+	void close();
+};
+
+
+
+/**
+* @brief Serves encode and decode jobs over a Unix domain socket until SIGINT or SIGTERM.
+*
+* A one-off conversion spends most of its time starting a process, not encoding. The daemon
+* starts once and keeps a pool of worker threads, each with its own codec and buffers that
+* stay allocated from one job to the next, so a small job costs little more than the codec
+* itself. Each worker serves one connection at a time, job after job; connections beyond
+* the number of workers wait their turn.
+*/
+class PNGDaemon
+{
+private:
+
+	const std::string socketPath;
+	const unsigned workers;
+
+	int m_listener{ -1 };
+
+	// Written to by stop() and the signal handlers, to wake the accept loop
+	int m_wake[2]{ -1, -1 };
+
+	std::atomic<bool> m_stopping{ false };
+
+	// Connections accepted and not yet closed, shut down when the daemon stops
+	std::mutex m_lock;
+	std::unordered_set<int> m_connections;
+
+
+	/**
+	* @brief Creates the socket, replacing one left behind by a daemon that did not shut down.
+	*/
+	PNGManipErrorCode listen();
+
+	/**
+	* @brief Runs the jobs of one connection on a worker until the client hangs up.
+	*/
+	void serveConnection(int);
+
+	void closeConnection(int);
+
+public:
+
+	/**
+	* @brief Constructor for PNGDaemon class. A worker count of 0 starts one per core.
+	*/
+	PNGDaemon(const std::string& socket, unsigned workers);
+	~PNGDaemon();
+
+	PNGDaemon(const PNGDaemon&) = delete;
+	PNGDaemon& operator=(const PNGDaemon&) = delete;
+
+	/**
+	* @brief Listens and serves jobs until stopped, then removes the socket.
+	*/
+	PNGManipErrorCode startProcess();
+
+	/**
+	* @brief Makes startProcess() return once the jobs in progress are done. Safe from any thread.
+	*/
+	void stop();
+};
+
+
+
+/**
+* @brief The thin client behind --connect: hands one encode or decode to a running daemon.
+*
+* File paths are passed as they are, made absolute. With "-" as input or output the bytes
+* go over the socket instead, read from standard input or written to standard output here.
+*/
+class PNGDaemonClient
+{
+private:
+
+	const std::string processType, socketPath, inputFile, outputFile, terminalOutput;
+	const PNGManipOptions options;
+
+public:
+
+	/**
+	* @brief Constructor for PNGDaemonClient class.
+	*/
+	PNGDaemonClient(const std::string&, const std::string&, const std::string&, const std::string&, const std::string&, const PNGManipOptions&);
+
+	PNGManipErrorCode startProcess();
+};
+
+
+#endif // !_PNGDAEMON_H_
@@ -1,23 +1,33 @@
 #include "PNGManip.hpp"
 #include "ErrorHandling.hpp"
+#include "OutputFile.hpp"
 
+#include <cstdio>
+#include <filesystem>
 
 
-// Validate input file
-PNGManipErrorCode PNGManip::validateInputFile() const 
+
+// Validate input file, mapping it into memory in the process
+PNGManipErrorCode PNGManip::validateInputFile()
 {
-    std::ifstream file(inputFile, std::ios::binary);
+    // The pipelined encoder does its own reading, on its reader thread. With a cache the input
+    // is hashed first, so it is mapped all the same
+    const bool pipelined = options.pipeline && processType == "ENCODE" && cacheOptions.directory.empty();
+
+    PNGManipErrorCode result = pipelined ? inputSource.open(inputFile) : inputMapping.open(inputFile);
     
-    if (!file.is_open()) 
+    if (result == PNGManipErrorCode::FileNotFound) 
     {
         logError("Input file not found: " + inputFile);
-        return PNGManipErrorCode::FileNotFound;
+        return result;
     }
     
-    if (!file.good()) {
+    if (result != PNGManipErrorCode::Success) {
         logError("Input file not readable: " + inputFile);
-        return PNGManipErrorCode::FileNotReadable;
+        return result;
     }
+
+    inputEnd = std::chrono::high_resolution_clock::now();
     
     return PNGManipErrorCode::Success;
 }
@@ -27,6 +37,10 @@ PNGManipErrorCode PNGManip::validateInputFile() const
 // Validate output file
 PNGManipErrorCode PNGManip::validateOutputFile() const 
 {
+    // Standard output is always there, and a file named "-" is not what was meant
+    if (isStandardStream(outputFile))
+        return PNGManipErrorCode::Success;
+
     std::ofstream file(outputFile, std::ios::binary | std::ios::app);
 
     if (!file.is_open()) {
@@ -40,423 +54,382 @@ PNGManipErrorCode PNGManip::validateOutputFile() const
 
 
 
-std::pair<size_t, size_t> PNGManip::getDimensions(size_t size)
+std::string PNGManip::getFileExtension(const std::string& fileName)
 {
-    // Find the next closest perfect square
-    size_t dimension = size / 4;
+    size_t dotPos = fileName.find_last_of('.');
+
+    if (dotPos == std::string::npos)
+        return "";
+
+    return fileName.substr(dotPos + 1);
+}
+
 
-    if (size % 4)
-        dimension += 1;
 
-    // Make it even
-    if (dimension % 2)
-        dimension++;
 
-    size_t row = static_cast<size_t>( std::sqrt(dimension) );
+void PNGManip::printImageInfo() const
+{
+    const imageInfo_t& info = codec.info();
+
+    std::cout << "[INFO] Image Dimensions:\033[36m"
+        << "\nWidth:\t\t"     << info.width
+        << "\nHeight:\t\t"    << info.height
+        << "\nFormat:\t\t"    << pixelFormatName(info.format)
+        << "\nDepth:\t\t"     << (int)info.pixelDepth
+        << "\nPixel Size:\t"  << (int)info.pixelSize;
 
-    if (row * row < dimension)
-        row++;
+    if (info.bandCount)
+        std::cout << "\nBands:\t\t"  << info.bandCount;
 
-    size_t column = (dimension + row - 1) / row;
+    if (info.precompression.codec != PayloadCodec::None)
+        std::cout << "\nPre-compressed:\t" << payloadCodecName(info.precompression.codec)
+            << ", " << static_cast<float>(info.precompression.storedSize / 1024.0) << " KB stored";
 
-    return std::make_pair(row, column);
+    if (info.encryption.version)
+        std::cout << "\nEncrypted:\t" << payloadCipherName(info.encryption.cipher) << ", " << keyDerivationName(info.encryption.kdf);
+
+    std::cout << "\033[0m\n";
 }
 
 
 
 
-size_t PNGManip::getFileSize(const char* filePath)
+
+void PNGManip::printDuration(const std::string& process) const
 {
-    std::unique_ptr<FILE, decltype(&fclose)> filePtr( fopen(filePath, "rb"), &fclose);
-    if (!filePtr)
-        return 0;
+    const auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 
-    fseek(filePtr.get(), 0, SEEK_END);
-    
-    size_t size = ftell(filePtr.get());
-    
-    return size;
+    std::cout << "\n" << process << " process took: " << "\033[36m";
+
+    if (duration.count() > 1'000'000)
+        std::cout << duration.count() / 1e6 << " seconds";
+    else if (duration.count() > 1'000)
+        std::cout << duration.count() / 1e3 << " milliseconds";
+    else
+        std::cout << duration.count() << " microseconds";
+
+    std::cout << "\033[0m\n";
 }
 
 
 
-std::string PNGManip::getFileExtension(const std::string& fileName)
+
+void PNGManip::printStats(const std::string& operation, uint64_t payloadBytes) const
 {
-    size_t dotPos = fileName.find_last_of('.');
+    if (!options.stats)
+        return;
 
-    if (dotPos == std::string::npos)
-        return "";
+    // Opening and mapping the input happens here, not in the codec. The pipelined encoder
+    // reads on its own thread and reports that itself, its mapping stays empty
+    CodecStats report(true);
+    report.add(CodecStage::Read, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(inputEnd - inputStart).count()), inputMapping.size());
+    report.merge(codec.stats());
 
-	return fileName.substr(dotPos + 1);
+    writeStatsJSON(std::cerr, operation, inputFile, report, std::chrono::duration<double>(end - inputStart).count(), payloadBytes);
 }
 
 
 
 
-PNGManipErrorCode PNGManip::encodeToImage() 
+
+PNGManipErrorCode PNGManip::encode() 
 {
-    std::unique_ptr<FILE, decltype(&fclose)> inputFilePtr( fopen(inputFile.c_str(), "rb"), &fclose);
-    if (!inputFilePtr) 
-    {
-        logError("Cannot open input file: " + inputFile);
-        return PNGManipErrorCode::FileNotFound;
-    }
+    inputStart = std::chrono::high_resolution_clock::now();
 
-    std::vector<uint8_t> buffer( m_fileSize + sizeof(uint32_t) ); // Allocate and size the buffer
+    PNGManipErrorCode result = validateInputFile();
+    if (result != PNGManipErrorCode::Success) 
+        return result;
 
-	// Put the size of the file in the first 4 bytes
-    memcpy(buffer.data(), &m_fileSize, sizeof(uint32_t));
+    const std::span<const std::byte> input{ reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() };
+    // Encrypting draws a fresh nonce every time, so an encrypted image is never worth reusing
+    const bool cached = !isStandardStream(outputFile) && !options.key.enabled() && cache.accepts(input.size());
 
-    size_t bytesRead = fread( buffer.data() + sizeof(uint32_t), 1, m_fileSize, inputFilePtr.get() );
+    start = std::chrono::high_resolution_clock::now();
 
-    if (bytesRead != m_fileSize) 
+    std::string cacheKey;
+    if (cached)
     {
-        logError("Error reading input file: " + inputFile);
-        return PNGManipErrorCode::FileNotReadable;
-	}
-
+        cacheKey = ResultCache::key(input, options);
 
-    size_t idx{ 0 };
-    for (size_t row{ 0 }; row < pngImage.height; ++row)
-    {
-        for (size_t col{ 0 }; col < pngImage.width; ++col)
+        if (cache.fetch(cacheKey, input.size(), outputFile, codec))
         {
-            pixel           = pixelAt(&pngImage, row, col);
-
-            pixel->red      = (idx < bytesRead) ? buffer[ idx++ ] : 0x00;
-            pixel->green    = (idx < bytesRead) ? buffer[ idx++ ] : 0x00;
-            pixel->blue     = (idx < bytesRead) ? buffer[ idx++ ] : 0x00;
-            pixel->alpha    = (idx < bytesRead) ? buffer[ idx++ ] : 0x00;
-        }
-    }
+            end = std::chrono::high_resolution_clock::now();
 
-    return PNGManipErrorCode::Success;
-}
+            std::cout << "[INFO] Resultant Image Dimensions: \033[36m" << codec.info().width << " x " << codec.info().height << "\033[0m" << std::endl
+                << "[INFO] Reused the image from the cache" << std::endl
+                << "\n\033[32m" << "Image encoded successfully!" << "\033[0m\n";
 
+            printDuration("Encoding");
+            printStats("encode", input.size());
 
+            return PNGManipErrorCode::Success;
+        }
+    }
 
+    // A new image for the cache is written inside it, and linked to the output from there
+    const std::string target = cached ? cache.temporaryPath() : outputFile;
 
-PNGManipErrorCode PNGManip::decodeImage() 
-{
-    std::unique_ptr<FILE, decltype(&fclose)> filePtr( fopen(inputFile.c_str(), "rb" ), &fclose );
+    // An output linked out of the cache by an earlier encode gets a file of its own, rather than
+    // truncating the cached image through the link
+    std::error_code unlinked;
+    if (!cached && cache.holds(outputFile))
+        std::filesystem::remove(outputFile, unlinked);
 
-    if (!filePtr) 
+    FileSink output;
+    if (output.open(target) != PNGManipErrorCode::Success)
     {
-        logError("Cannot open input file: " + inputFile);
-        return PNGManipErrorCode::FileNotFound;
+        logError(cached ? "Cannot write to the cache directory: " + cacheOptions.directory : "Cannot open output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
     }
-
     
-    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png_ptr) 
-    {
-        logError("Cannot read PNG image (struct creation failed).");
-        return PNGManipErrorCode::DecodingError;
-    }
+    if (options.pipeline && !cached)
+        result = codec.encode(inputSource, output);
+    else
+        result = codec.encode(input, output);
 
-    
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) 
+    const PNGManipErrorCode closed = output.close();
+
+    if (result == PNGManipErrorCode::Success && closed != PNGManipErrorCode::Success)
     {
-        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-        logError("Cannot read PNG image (info struct failed).");
-        return PNGManipErrorCode::DecodingError;
+        logError("Error writing output file: " + target);
+        result = PNGManipErrorCode::FileNotWritable;
     }
+    else if (result != PNGManipErrorCode::Success)
+        logError(codec.errorMessage());
 
-    
-    if (setjmp(png_jmpbuf(png_ptr))) 
+    if (cached && result == PNGManipErrorCode::Success && cache.store(target, cacheKey, outputFile) != PNGManipErrorCode::Success)
     {
-        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-        logError("PNG read error (setjmp).");
-        return PNGManipErrorCode::DecodingError;
+        logError("Error writing output file: " + outputFile);
+        result = PNGManipErrorCode::FileNotWritable;
     }
-    
-    
-    png_init_io(png_ptr, filePtr.get());
-    png_read_info(png_ptr, info_ptr);
-    
-    
-    pngImage.width      = static_cast<uint16_t>(png_get_image_width(png_ptr, info_ptr));
-    pngImage.height     = static_cast<uint16_t>(png_get_image_height(png_ptr, info_ptr));
-    pngImage.pixelDepth = png_get_bit_depth(png_ptr, info_ptr);
-    pngImage.pixelSize  = 4;
-	pngImage.pixels.resize(static_cast<size_t>(pngImage.width * pngImage.height));
-    
-    if (pngImage.pixels.empty()) 
+
+    if (result != PNGManipErrorCode::Success)
     {
-        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
-        logError("Memory allocation error for PNG pixels.");
-        return PNGManipErrorCode::MemoryAllocationError;
+        std::error_code ignored;
+        if (cached)
+            std::filesystem::remove(target, ignored);
+
+        return result;
     }
     
+    end = std::chrono::high_resolution_clock::now();
 
-    std::cout << "[INFO] Image Dimensions:\033[36m"
-        << "\nWidth:\t\t"     << pngImage.width
-        << "\nHeight:\t\t"    << pngImage.height
-        << "\nDepth:\t\t"     << (int)pngImage.pixelDepth
-        << "\nPixel Size:\t"  << (int)pngImage.pixelSize
-        << "\033[0m\n";
-    
-    
-    std::vector<std::vector<uint8_t>> rowStorage(
-        pngImage.height,
-        std::vector<uint8_t>(pngImage.width * pngImage.pixelSize)
-    );
 
-    std::vector<png_bytep> row_pointers;
-	row_pointers.reserve(pngImage.height);
+    const imageInfo_t& info = codec.info();
 
-    for (auto& row : rowStorage)
-        row_pointers.push_back(row.data());
- 
-    
-    png_read_image(png_ptr, row_pointers.data());
- 
-    pixel_t* px{};
-    for (size_t row{ 0 }; row < pngImage.height; ++row)
+    std::cout << "[INFO] Resultant Image Dimensions: \033[36m" << info.width << " x " << info.height << "\033[0m" << std::endl;
+
+    if (info.threads != 1)
+        std::cout << "[INFO] Deflated on \033[36m" << info.threads << "\033[0m threads" << std::endl;
+
+    if (info.precompression.codec != PayloadCodec::None)
+        std::cout << "[INFO] Pre-compressed with " << payloadCodecName(info.precompression.codec) << ": \033[36m"
+            << static_cast<float>(info.precompression.originalSize / 1024.0) << " KB -> "
+            << static_cast<float>(info.precompression.storedSize / 1024.0) << " KB\033[0m" << std::endl;
+
+    if (info.encryption.version)
+        std::cout << "[INFO] Encrypted with " << payloadCipherName(info.encryption.cipher) << " in \033[36m"
+            << static_cast<float>(info.encryption.chunkBytes / 1024.0) << " KB\033[0m chunks, key from "
+            << keyDerivationName(info.encryption.kdf) << " (" << cipherKernelName(cipherKernel()) << ")" << std::endl;
+
+    if (options.profile != CompressionProfile::Default || info.precompression.codec != PayloadCodec::None || info.encryption.version)
     {
-        auto *rowData = rowStorage[row].data();
-        for (size_t col{ 0 }; col < pngImage.width; ++col)
-        {
-            px = pixelAt(&pngImage, row, col);
+        std::cout << "[INFO] Compression: \033[36mlevel " << info.compression.level
+            << ((info.compression.strategy == Z_HUFFMAN_ONLY) ? ", Huffman only" : "") << "\033[0m";
 
-            px->red     = *rowData++;
-            px->green   = *rowData++;
-            px->blue    = *rowData++;
-            px->alpha   = *rowData++;
-        }
+        if (info.sampleEntropy >= 0.0)
+            std::cout << " (sample entropy \033[36m" << info.sampleEntropy << "\033[0m bits/byte)";
+
+        std::cout << std::endl;
     }
 
-        
-    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+    if (info.bandCount)
+        std::cout << "[INFO] Wrote \033[36m" << info.bandCount << "\033[0m independently compressed bands" << std::endl;
     
+    std::cout << "\n\033[32m" << "Image encoded successfully!" << "\033[0m\n";
     
+    printDuration("Encoding");
+    printStats("encode", info.payloadSize);
+
     return PNGManipErrorCode::Success;
 }
 
 
 
 
-PNGManipErrorCode PNGManip::savePNGToFile() 
+PNGManipErrorCode PNGManip::decode()
 {
-    std::unique_ptr<FILE, decltype(&fclose)> filePtr( fopen(outputFile.c_str(), "wb"), &fclose );
-    if (!filePtr) 
+    inputStart = std::chrono::high_resolution_clock::now();
+
+    PNGManipErrorCode result = validateInputFile();
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    // --show echoes the payload to the terminal as it is written
+    const bool showOutput = (terminalOutput == "TRUE");
+
+    // Written beside the output until the checksum matched, so a damaged payload never replaces it
+    FileSink output;
+    if (output.openReplacing(outputFile, showOutput ? &std::cout : nullptr) != PNGManipErrorCode::Success)
     {
         logError("Cannot open output file: " + outputFile);
         return PNGManipErrorCode::FileNotWritable;
     }
-    
-    
-    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-    if (!png_ptr) 
-    {
-        logError("Cannot create PNG write struct.");
-        return PNGManipErrorCode::EncodingError;
-    }
-    
-    
-    png_infop info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) 
+
+    if (showOutput)
+        std::cout << "\nDecoded Output:\n";
+
+    start = std::chrono::high_resolution_clock::now();
+
+    result = codec.decode({ reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() }, output);
+
+    if (result == PNGManipErrorCode::Success && output.commit() != PNGManipErrorCode::Success)
     {
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        logError("Cannot create PNG info struct.");
-        return PNGManipErrorCode::EncodingError;
+        logError("Error writing output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
     }
-    
-    
-    if (setjmp(png_jmpbuf(png_ptr))) 
+
+    end = std::chrono::high_resolution_clock::now();
+
+    if (showOutput)
+        std::cout << std::endl;
+
+    if (result != PNGManipErrorCode::Success)
     {
-        png_destroy_write_struct(&png_ptr, &info_ptr);
-        logError("PNG write error (setjmp).");
-        return PNGManipErrorCode::EncodingError;
+        logError(codec.errorMessage());
+        return result;
     }
-    
-    
-    png_set_IHDR(
-        png_ptr,        info_ptr,
-        pngImage.width, pngImage.height,
-        pngImage.pixelDepth,
-        PNG_COLOR_TYPE_RGBA,
-        PNG_INTERLACE_NONE,
-        PNG_COMPRESSION_TYPE_DEFAULT,
-        PNG_FILTER_TYPE_DEFAULT
-    );
-    
-    
-    std::vector<std::vector<uint8_t>> rowStorage(
-        pngImage.height,
-        std::vector<uint8_t>(pngImage.width * pngImage.pixelSize)
-	);
-    
-	pixel_t* pixel{};
-	size_t offset{ 0 };
-    for (size_t row{ 0 }; row < pngImage.height; ++row)
-    {
-        auto& rowVec = rowStorage[row];
 
-        for (size_t col{ 0 }; col < pngImage.width; ++col)
-        {
-            pixel = pixelAt(&pngImage, row, col);
-            offset = col * pngImage.pixelSize;
 
-            rowVec[offset]      = pixel->red;
-            rowVec[offset + 1]  = pixel->green;
-            rowVec[offset + 2]  = pixel->blue;
-            rowVec[offset + 3]  = pixel->alpha;
-        }
-    }
-    
+    const imageInfo_t& info = codec.info();
 
-    std::vector<png_bytep> row_pointers;
-    row_pointers.reserve(pngImage.height);
+    printImageInfo();
 
-    for (auto& row : rowStorage)
-        row_pointers.push_back(row.data());
+    if (options.hasRange)
+        std::cout << "\n[INFO] Extracted bytes \033[36m" << info.rangeStart << " to " << info.rangeEnd
+            << "\033[0m of \033[36m" << info.payloadSize << "\033[0m" << std::endl;
+    else
+        std::cout << "\n[INFO] Decoded file written: \033[36m"
+            << static_cast<float>(info.payloadSize / 1024.0) << " KB\033[0m" << std::endl;
+
+    std::cout << "\n\033[32m" << "Image decoded successfully!" << "\033[0m\n";
+
+    printDuration("Decoding");
+    printStats("decode", info.rangeEnd - info.rangeStart);
 
-    
-    png_init_io(png_ptr, filePtr.get());
-    png_set_rows(png_ptr, info_ptr, row_pointers.data());
-    png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, nullptr);
-    
-    
-    png_destroy_write_struct(&png_ptr, &info_ptr);
-    
-    
     return PNGManipErrorCode::Success;
 }
 
 
 
 
-PNGManipErrorCode PNGManip::saveDecodedPNGInfo()
+
+
+PNGManipErrorCode PNGManip::probe()
 {
-    std::unique_ptr<FILE, decltype(&fclose)> outputFilePtr(fopen(outputFile.c_str(), "wb"), &fclose);
-    if (!outputFilePtr) 
-    {
-        logError("Cannot open output file: " + outputFile);
-        return PNGManipErrorCode::FileNotWritable;
-    }
+    inputStart = std::chrono::high_resolution_clock::now();
 
-    // Flatten pixels
-    std::vector<uint8_t> buffer;
-    buffer.reserve(static_cast<size_t>(pngImage.width * pngImage.height * 4));
-    
-    pixel_t* px{};
-    for (size_t row{ 0 }; row < pngImage.height; ++row) 
-    {
-        for (size_t col{ 0 }; col < pngImage.width; ++col)
-        {
-            px = pixelAt(&pngImage, row, col);
+    PNGManipErrorCode result = validateInputFile();
+    if (result != PNGManipErrorCode::Success)
+        return result;
 
-            //buffer.assign({ px->red, px->green, px->blue, px->alpha });
-			buffer.push_back(px->red);
-			buffer.push_back(px->green);
-			buffer.push_back(px->blue);
-			buffer.push_back(px->alpha);
-        }
-    }
+    start = std::chrono::high_resolution_clock::now();
 
-    // Get file size from first 4 bytes
-    if (buffer.size() < sizeof(uint32_t)) 
-    {
-        logError("Corrupted image: missing header.");
-        return PNGManipErrorCode::DecodingError;
-    }
+    result = codec.probe({ reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() });
 
-    uint32_t fileSize{};
-	memcpy(&fileSize, buffer.data(), sizeof(uint32_t));
+    end = std::chrono::high_resolution_clock::now();
 
-    if (fileSize > buffer.size() - sizeof(uint32_t))
+    if (result != PNGManipErrorCode::Success)
     {
-        logError("Invalid file size in header.");
-        return PNGManipErrorCode::DecodingError;
+        logError(codec.errorMessage());
+        return result;
     }
 
-    // Write the actual file content
-    fwrite(buffer.data() + sizeof(uint32_t), 1, fileSize, outputFilePtr.get());
 
-    std::cout << "\n[INFO] Decoded file written: \033[36m"
-        << static_cast<float>(fileSize / 1024.0) << " KB\033[0m" << std::endl;
+    const imageInfo_t& info = codec.info();
 
-    if (terminalOutput._Equal("TRUE")) 
-    {
-        std::cout << "\nDecoded Output:\n";
-        std::cout.write(reinterpret_cast<const char*>(buffer.data() + sizeof(uint32_t)), fileSize);
-        std::cout << std::endl;
-	}
+    printImageInfo();
 
-    return PNGManipErrorCode::Success;
-}
+    std::cout << "\n[INFO] Payload: \033[36m" << info.payloadSize << " bytes\033[0m" << std::endl;
 
+    if (info.formatVersion)
+        std::cout << "[INFO] Imageify format: \033[36mv" << static_cast<int>(info.formatVersion) << "\033[0m" << std::endl;
+    else
+        std::cout << "[INFO] Imageify format: \033[36mlegacy\033[0m, made before format versions and known by its payload checksum" << std::endl;
 
+    if (info.precompression.codec != PayloadCodec::None)
+        std::cout << "[INFO] Payload header: \033[36mv" << static_cast<int>(info.precompression.version) << "\033[0m" << std::endl;
 
+    if (info.shard.flags & shardStreamed)
+        std::cout << "[INFO] Stream frame \033[36m" << info.shard.index << "\033[0m, bytes \033[36m" << info.shard.offset
+            << " to " << info.shard.offset + info.shard.length << "\033[0m"
+            << ((info.shard.flags & shardFinal) ? " (final, " + std::to_string(info.shard.totalSize) + " bytes in all)" : "")
+            << ", header \033[36mv" << static_cast<int>(info.shard.version) << "\033[0m" << std::endl;
+    else if (info.shard.count)
+        std::cout << "[INFO] Shard \033[36m" << info.shard.index + 1 << " of " << info.shard.count << "\033[0m, bytes \033[36m"
+            << info.shard.offset << " to " << info.shard.offset + info.shard.length << "\033[0m of \033[36m" << info.shard.totalSize
+            << "\033[0m, header \033[36mv" << static_cast<int>(info.shard.version) << "\033[0m" << std::endl;
 
+    printDuration("Probe");
+    printStats("info", 0);
 
-inline pixel_t* PNGManip::pixelAt(bitmap_t* bitmap, size_t row, size_t col)
-{
-    return &bitmap->pixels.at(row * bitmap->width + col);
+    return PNGManipErrorCode::Success;
 }
 
 
 
-void PNGManip::encode() 
+
+PNGManipErrorCode PNGManip::verify()
 {
-    if (validateInputFile() != PNGManipErrorCode::Success) 
-        return;
+    inputStart = std::chrono::high_resolution_clock::now();
 
-    start = std::chrono::high_resolution_clock::now();
-    
-    if (encodeToImage() != PNGManipErrorCode::Success) 
-        return;
-    
-    if (savePNGToFile() != PNGManipErrorCode::Success) 
-        return;
-    
-    end = std::chrono::high_resolution_clock::now();
-    
-    std::cout << "\n\033[32m" << "Image encoded successfully!" << "\033[0m\n";
-    
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    PNGManipErrorCode result = validateInputFile();
+    if (result != PNGManipErrorCode::Success)
+        return result;
 
-	if (duration.count() > 1'000'000)
-        std::cout << "\nEncoding process took: " << "\033[36m" << static_cast<float>(duration.count() / 1'000'000) << " seconds\033[0m\n";
-	else if (duration.count() > 1'000)
-        std::cout << "\nEncoding process took: " << "\033[36m" << static_cast<float>(duration.count() / 1'000) << " milliseconds\033[0m\n";
-    else
-        std::cout << "\nEncoding process took: " << "\033[36m" << duration.count() << " microseconds\033[0m\n";
-}
+    DiscardSink output;
 
+    start = std::chrono::high_resolution_clock::now();
 
+    result = codec.decode({ reinterpret_cast<const std::byte*>(inputMapping.data()), inputMapping.size() }, output);
 
+    end = std::chrono::high_resolution_clock::now();
 
-void PNGManip::decode()
-{
-    if (validateInputFile() != PNGManipErrorCode::Success)
-        return;
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(codec.errorMessage());
+        return result;
+    }
 
-    start = std::chrono::high_resolution_clock::now();
 
-    if (decodeImage() != PNGManipErrorCode::Success)
-        return;
+    const imageInfo_t& info = codec.info();
 
-    if (saveDecodedPNGInfo() != PNGManipErrorCode::Success)
-        return;
+    printImageInfo();
 
-    end = std::chrono::high_resolution_clock::now();
+    if (info.checksum.version)
+    {
+        char crc[9];
+        std::snprintf(crc, sizeof(crc), "%08x", info.checksum.crc);
 
-    std::cout << "\n\033[32m" << "Image decoded successfully!" << "\033[0m\n";
+        std::cout << "\n[INFO] Payload checksum matches: \033[36mCRC-32C " << crc << "\033[0m over \033[36m"
+            << info.checksum.length << " bytes\033[0m (" << crc32cImplementation() << ")" << std::endl;
+    }
+    else
+        std::cout << "\n[INFO] The image carries no payload checksum, only its PNG CRCs and size prefix were checked." << std::endl;
 
-    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+    if (info.precompression.codec != PayloadCodec::None)
+        std::cout << "[INFO] Decompressed payload matches its CRC-32C too." << std::endl;
 
-    if (duration.count() > 1'000'000)
-        std::cout << "\nDecoding process took: " << "\033[36m" << static_cast<float>(duration.count() / 1'000'000) << " seconds\033[0m\n";
-    else if (duration.count() > 1'000)
-        std::cout << "\nDecoding process took: " << "\033[36m" << static_cast<float>(duration.count() / 1'000) << " milliseconds\033[0m\n";
-    else
-        std::cout << "\nDecoding process took: " << "\033[36m" << duration.count() << " microseconds\033[0m\n";
-}
+    if (info.encryption.version)
+        std::cout << "[INFO] Every encrypted chunk matches its Poly1305 tag." << std::endl;
 
+    std::cout << "\n\033[32m" << "Image verified successfully!" << "\033[0m\n";
 
+    printDuration("Verification");
+    printStats("verify", info.payloadSize);
+
+    return PNGManipErrorCode::Success;
+}
 
 
 
@@ -465,52 +438,38 @@ void PNGManip::decode()
 * Public Functions -----------------------------------
 */
 
-PNGManip::PNGManip(const std::string& type, const std::string& input, const std::string& output, const std::string& terminalDisp) : 
+PNGManip::PNGManip(const std::string& type, const std::string& input, const std::string& output, const std::string& terminalDisp, const PNGManipOptions& opts, const PNGCacheOptions& cacheOpts) : 
     processType{ type },
 	inputFile{ input }, 
 	outputFile{ output },
-	pixel{ nullptr },
-    pngImage{},
-    m_fileSize( static_cast<uint32_t>(getFileSize(inputFile.c_str())) ),
-	terminalOutput{ terminalDisp }
+	terminalOutput{ terminalDisp },
+	options{ opts },
+    cacheOptions{ cacheOpts },
+    cache{ cacheOpts },
+    codec{ opts }
 {
-	if (processType._Equal("ENCODE"))
+	if (processType != "ENCODE" && processType != "DECODE" && processType != "INFO" && processType != "VERIFY")
 	{
-		// Get dimensions
-		const size_t headerSize = 8;
-		m_fileSize = static_cast<uint32_t>( getFileSize(inputFile.c_str()) );
-
-		auto dimensions = getDimensions( m_fileSize + headerSize );
-		pngImage.width = static_cast<uint16_t>(dimensions.first);
-		pngImage.height = static_cast<uint16_t>(dimensions.second);
-
-		std::cout << "[INFO] Resultant Image Dimensions: \033[36m" << pngImage.width << " x " << pngImage.height << "\033[0m" << std::endl;
-
-		pngImage.pixelDepth = static_cast<png_byte>(8);
-		pngImage.pixelSize = static_cast<png_byte>(4);
-		pngImage.pixels.resize(static_cast<size_t>(pngImage.width * pngImage.height));
-
-	}
-	else if (processType._Equal("DECODE"))
-	{
-        m_fileSize = static_cast<uint32_t>( getFileSize(inputFile.c_str()) );
-	}
-	else
-	{
-		logError("Invalid process type. Use 'ENCODE' or 'DECODE'.\n");
+		logError("Invalid process type. Use 'ENCODE', 'DECODE', 'INFO' or 'VERIFY'.\n");
 	}
 }
 
 
 
-void PNGManip::startProcess()
+PNGManipErrorCode PNGManip::startProcess()
 {
 	if (processType == "ENCODE")
-		encode();
+		return encode();
 	
-	else if (processType == "DECODE")
-		decode();
+	if (processType == "DECODE")
+		return decode();
+
+	if (processType == "INFO")
+		return probe();
+
+	if (processType == "VERIFY")
+		return verify();
 	
-	else
-        logError("Invalid process type. Use 'ENCODE' or 'DECODE'.\n");
+    logError("Invalid process type. Use 'ENCODE', 'DECODE', 'INFO' or 'VERIFY'.\n");
+    return PNGManipErrorCode::UnknownError;
 }
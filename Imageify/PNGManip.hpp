@@ -4,37 +4,9 @@
 
 #include "pngHeaders.h"
 #include "ErrorHandling.hpp"
-
-
-// Define structs for pixel and bitmap
-
-/**
-* @brief A structure representing a pixel with RGBA color components.
-*/
-struct alignas(4) pixel_t
-{
-	uint8_t red;
-	uint8_t green;
-	uint8_t blue;
-	uint8_t alpha;
-};
-
-/**
-* @brief A structure representing a bitmap image with pixel data and dimensions.
-*/
-struct alignas(16) bitmap_t
-{
-	uint16_t width;
-	uint16_t height;
-	
-	png_byte pixelSize;
-	png_byte pixelDepth;
-	
-	std::vector<pixel_t> pixels;
-};
-
-
-
+#include "MappedFile.hpp"
+#include "PNGCodec.hpp"
+#include "ResultCache.hpp"
 
 
 /**
@@ -44,45 +16,40 @@ class PNGManip
 {
 private:
 	
-	uint32_t m_fileSize;
 	const std::string processType, inputFile, outputFile, terminalOutput;
+	const PNGManipOptions options;
 
-	bitmap_t pngImage;
-	pixel_t* pixel;
+	// Encoded images kept from earlier runs, when a cache directory is given
+	const PNGCacheOptions cacheOptions;
+	ResultCache cache;
 
-	// For Timing
-	std::chrono::time_point<std::chrono::high_resolution_clock> start, end;
-	
-	
-	/**
-	* @brief Function to insert information into the pixel of the image
-	*/
-	PNGManipErrorCode encodeToImage();
+	// Does the actual work; PNGManip only handles files and reporting
+	PNGCodec codec;
 
-	/**
-	* @brief Function to decode image, i.e., extract information from the pixel of the image
-	*/
-	PNGManipErrorCode decodeImage();
+	// The input file, mapped once and handed to the codec as a span
+	MappedFile inputMapping;
 
-	/**
-	* @brief Returns a pointer to the pixel at the specified row and column in the bitmap.
-	*/
-	inline pixel_t* pixelAt(bitmap_t*, size_t, size_t);
+	// ...or read front to back by the pipelined encoder
+	FileSource inputSource;
 
+	// For Timing; inputStart to inputEnd is opening and mapping the input
+	std::chrono::time_point<std::chrono::high_resolution_clock> inputStart, inputEnd, start, end;
+	
+	
 	/**
-	* @brief Saves the PNG image to the specified output file.
+	* @brief Prints the geometry of the image the codec just worked on.
 	*/
-	PNGManipErrorCode savePNGToFile();
+	void printImageInfo() const;
 
 	/**
-	* @brief Function to calculate the ideal dimension for the PNG Image
+	* @brief Prints how long the codec took, in the largest unit that fits.
 	*/
-	std::pair<size_t, size_t> getDimensions(size_t);
+	void printDuration(const std::string&) const;
 
 	/**
-	* @brief Returns the size of the file at the given path.
+	* @brief With --stats, writes the per-stage timings of the run to stderr as JSON lines.
 	*/
-	size_t getFileSize(const char*);
+	void printStats(const std::string&, uint64_t) const;
 
 	/**
 	* @brief Returns the file extension of the given filename
@@ -90,34 +57,39 @@ private:
 	std::string getFileExtension(const std::string&);
 
 	/**
-	* @brief Reads and retrieves details from the PNG image file.
+	* @brief Encodes the input file into a PNG image and saves it to the output file.
 	*/
-	PNGManipErrorCode saveDecodedPNGInfo();
+	PNGManipErrorCode encode();
 
 	/**
-	* @brief Encodes the input file into a PNG image and saves it to the output file.
+	* @brief Decodes the PNG image from the input file and extracts the pixel data.
 	*/
-	void encode();
+	PNGManipErrorCode decode();
 
 	/**
-	* @brief Decodes the PNG image from the input file and extracts the pixel data.
+	* @brief Reports what an image holds from its header chunks and first row, without decoding it.
+	*/
+	PNGManipErrorCode probe();
+
+	/**
+	* @brief Decodes the image without writing the payload anywhere, checking it against its checksums.
 	*/
-	void decode();
+	PNGManipErrorCode verify();
 
 	/**
-	* @brief Validates the input file for existence and readability.
+	* @brief Validates the input file for existence and readability, and maps or opens it.
 	*/
-	PNGManipErrorCode validateInputFile() const;
+	PNGManipErrorCode validateInputFile();
 	PNGManipErrorCode validateOutputFile() const;
 
 public:
 	/**
 	* @brief Constructor for PNGManip class.
 	*/
-	PNGManip(const std::string&, const std::string&, const std::string&, const std::string&);
+	PNGManip(const std::string&, const std::string&, const std::string&, const std::string&, const PNGManipOptions& = {}, const PNGCacheOptions& = {});
 	~PNGManip() = default;
 
-	void startProcess();
+	PNGManipErrorCode startProcess();
 };
 
 #endif // !_PNGMANIP_H_
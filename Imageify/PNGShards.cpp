@@ -0,0 +1,413 @@
+#include "PNGShards.hpp"
+#include "WorkStealingPool.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <new>
+
+
+
+// Reads the ifSH chunk of a mapped image, false if it has none or is a frame of a stream
+static bool readShardHeader(const MappedFile& file, shardHeader_t& shard)
+{
+    imageLayout_t layout;
+
+    if (scanImageLayout(file.data(), file.size(), layout) != PNGManipErrorCode::Success || layout.shard.count == 0
+        || (layout.shard.flags & shardStreamed))
+        return false;
+
+    shard = layout.shard;
+    return true;
+}
+
+
+
+// output.003.png back to output.png, anything else as it is
+static std::string basePath(const std::string& shard)
+{
+    const std::filesystem::path path(shard);
+    const std::string stem = path.stem().string();
+
+    const size_t dot = stem.find_last_of('.');
+    if (dot == std::string::npos || dot + 1 == stem.size()
+        || !std::all_of(stem.begin() + dot + 1, stem.end(), [](unsigned char c) { return std::isdigit(c); }))
+        return shard;
+
+    return (path.parent_path() / (stem.substr(0, dot) + path.extension().string())).string();
+}
+
+
+
+// The input itself if it exists, otherwise the first shard named after it
+static std::string locateShard(const std::string& input)
+{
+    std::error_code error;
+
+    if (std::filesystem::exists(input, error))
+        return input;
+
+    // The number of digits depends on the shard count, which only the shards know
+    for (uint32_t count : { 1u, 10'000u, 100'000u, 1'000'000u })
+    {
+        const std::string first = PNGShards::shardPath(input, 0, count);
+
+        if (std::filesystem::exists(first, error))
+            return first;
+    }
+
+    return "";
+}
+
+
+
+
+std::string PNGShards::shardPath(const std::string& base, uint32_t index, uint32_t count)
+{
+    const std::filesystem::path path(base);
+
+    std::string number = std::to_string(index);
+    const size_t digits = std::max<size_t>(3, std::to_string(count ? count - 1 : 0).size());
+    number.insert(0, digits - std::min(digits, number.size()), '0');
+
+    return (path.parent_path() / (path.stem().string() + "." + number + path.extension().string())).string();
+}
+
+
+
+bool PNGShards::applies(const std::string& type, const std::string& input, const PNGShardOptions& shardOptions, PixelFormat format)
+{
+    std::error_code error;
+
+    if (type == "ENCODE")
+        return shardOptions.shardBytes != 0 || std::filesystem::file_size(input, error) > PNGCodec::maxPayloadBytesFor(format);
+
+    if (type != "DECODE")
+        return false;
+
+    const std::string shard = locateShard(input);
+
+    MappedFile file;
+    shardHeader_t header;
+
+    return !shard.empty() && file.open(shard) == PNGManipErrorCode::Success && readShardHeader(file, header);
+}
+
+
+
+
+PNGManipErrorCode PNGShards::collectShards(std::vector<std::unique_ptr<MappedFile>>& files, uint64_t& totalSize)
+{
+    const std::string first = locateShard(inputFile);
+
+    MappedFile probe;
+    shardHeader_t header;
+
+    if (first.empty() || probe.open(first) != PNGManipErrorCode::Success || !readShardHeader(probe, header))
+    {
+        logError("Not a shard set: " + inputFile);
+        return PNGManipErrorCode::InvalidFileFormat;
+    }
+
+    std::error_code error;
+    const std::string base = std::filesystem::exists(inputFile, error) ? basePath(inputFile) : inputFile;
+
+    totalSize = header.totalSize;
+    uint64_t expectedOffset{ 0 };
+
+    jobs.clear();
+    files.clear();
+
+    for (uint32_t i{ 0 }; i < header.count; ++i)
+    {
+        job_t job{ .path = shardPath(base, i, header.count) };
+
+        files.push_back(std::make_unique<MappedFile>());
+        PNGManipErrorCode result = files.back()->open(job.path);
+
+        if (result != PNGManipErrorCode::Success)
+        {
+            logError("Missing shard " + std::to_string(i) + " of " + std::to_string(header.count) + ": " + job.path);
+            return result;
+        }
+
+        // Every shard has to come from the same set and continue where the previous one stopped
+        if (!readShardHeader(*files.back(), job.shard) || job.shard.index != i || job.shard.count != header.count
+            || job.shard.totalSize != totalSize || job.shard.offset != expectedOffset)
+        {
+            logError("Shard does not belong to the set: " + job.path);
+            return PNGManipErrorCode::InvalidFileFormat;
+        }
+
+        expectedOffset += job.shard.length;
+        jobs.push_back(std::move(job));
+    }
+
+    if (expectedOffset != totalSize)
+    {
+        logError("Shards do not add up to the payload size.");
+        return PNGManipErrorCode::InvalidFileFormat;
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGShards::encode()
+{
+    MappedFile input;
+    PNGManipErrorCode result = input.open(inputFile);
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(((result == PNGManipErrorCode::FileNotFound) ? "Input file not found: " : "Input file not readable: ") + inputFile);
+        return result;
+    }
+
+    const uint64_t shardBytes = std::min(shardOptions.shardBytes ? shardOptions.shardBytes : defaultShardBytes, PNGCodec::maxPayloadBytesFor(options.format));
+
+    jobs.clear();
+    for (const shardHeader_t& shard : planShards(input.size(), shardBytes))
+        jobs.push_back({ .path = shardPath(outputFile, shard.index, shard.count), .shard = shard });
+
+
+    WorkStealingPool pool(shardOptions.jobs);
+
+    std::vector<std::unique_ptr<CodecStats>> stats;
+    for (unsigned w{ 0 }; w < pool.size(); ++w)
+        stats.push_back(std::make_unique<CodecStats>(options.stats));
+
+    std::cout << "[INFO] Encoding \033[36m" << jobs.size() << "\033[0m shards of up to \033[36m"
+        << shardBytes / (1024.0 * 1024.0) << " MB\033[0m on \033[36m" << pool.size() << "\033[0m workers" << std::endl;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    pool.run(jobs.size(), [&](size_t index, unsigned worker)
+    {
+        job_t& job = jobs[index];
+
+        PNGManipOptions codecOptions = options;
+        codecOptions.shard = job.shard;
+
+        PNGCodec codec(codecOptions);
+        FileSink output;
+
+        if (output.open(job.path) != PNGManipErrorCode::Success)
+        {
+            job.result = PNGManipErrorCode::FileNotWritable;
+            job.message = "Cannot open output file.";
+            return;
+        }
+
+        const std::span<const std::byte> slice{ reinterpret_cast<const std::byte*>(input.data()) + job.shard.offset, static_cast<size_t>(job.shard.length) };
+
+        try
+        {
+            job.result = codec.encode(slice, output);
+        }
+        catch (const std::bad_alloc&)
+        {
+            job.result = PNGManipErrorCode::MemoryAllocationError;
+        }
+
+        const PNGManipErrorCode closed = output.close();
+        stats[worker]->merge(codec.stats());
+
+        if (job.result != PNGManipErrorCode::Success)
+            job.message = codec.errorMessage().empty() ? errorCodeToString(job.result) : codec.errorMessage();
+        else if ((job.result = closed) != PNGManipErrorCode::Success)
+            job.message = "Error writing output file.";
+    });
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return report(stats, seconds, input.size());
+}
+
+
+
+
+PNGManipErrorCode PNGShards::decode()
+{
+    std::vector<std::unique_ptr<MappedFile>> files;
+    uint64_t totalSize{ 0 };
+
+    PNGManipErrorCode result = collectShards(files, totalSize);
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    // Same rules as a range into a single image
+    uint64_t rangeStart{ 0 }, rangeEnd{ totalSize };
+    if (options.hasRange)
+    {
+        if (options.rangeOffset > totalSize)
+        {
+            logError("Range starts past the end of the payload (" + std::to_string(totalSize) + " bytes).");
+            return PNGManipErrorCode::DecodingError;
+        }
+
+        rangeStart = options.rangeOffset;
+        rangeEnd = rangeStart + std::min(options.rangeLength, totalSize - rangeStart);
+    }
+
+    // --show echoes the payload to the terminal as it is written
+    const bool showOutput = (terminalOutput == "TRUE");
+
+    FileSink output;
+    if (output.openReplacing(outputFile, showOutput ? &std::cout : nullptr) != PNGManipErrorCode::Success)
+    {
+        logError("Cannot open output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    // A sink that cannot be written out of order gets the shards one after another
+    const bool positional = output.resize(rangeEnd - rangeStart);
+
+    WorkStealingPool pool(positional ? shardOptions.jobs : 1);
+
+    std::vector<std::unique_ptr<CodecStats>> stats;
+    for (unsigned w{ 0 }; w < pool.size(); ++w)
+        stats.push_back(std::make_unique<CodecStats>(options.stats));
+
+    std::cout << "[INFO] Decoding \033[36m" << jobs.size() << "\033[0m shards on \033[36m" << pool.size() << "\033[0m workers" << std::endl;
+
+    if (showOutput)
+        std::cout << "\nDecoded Output:\n";
+
+    const auto start = std::chrono::steady_clock::now();
+
+    pool.run(jobs.size(), [&](size_t index, unsigned worker)
+    {
+        job_t& job = jobs[index];
+
+        const uint64_t from = std::max(rangeStart, job.shard.offset);
+        const uint64_t to = std::min(rangeEnd, job.shard.offset + job.shard.length);
+
+        // Shards outside the range are never inflated
+        if (from >= to)
+        {
+            job.result = PNGManipErrorCode::Success;
+            return;
+        }
+
+        PNGManipOptions codecOptions = options;
+        codecOptions.hasRange = (to - from != job.shard.length);
+        codecOptions.rangeOffset = from - job.shard.offset;
+        codecOptions.rangeLength = to - from;
+
+        PNGCodec codec(codecOptions);
+        SliceSink slice(output, from - rangeStart, to - from);
+
+        const std::span<const std::byte> image{ reinterpret_cast<const std::byte*>(files[index]->data()), files[index]->size() };
+
+        try
+        {
+            job.result = codec.decode(image, positional ? static_cast<ByteSink&>(slice) : output);
+        }
+        catch (const std::bad_alloc&)
+        {
+            job.result = PNGManipErrorCode::MemoryAllocationError;
+        }
+
+        stats[worker]->merge(codec.stats());
+
+        if (job.result != PNGManipErrorCode::Success)
+            job.message = codec.errorMessage().empty() ? errorCodeToString(job.result) : codec.errorMessage();
+        else if (codec.info().rangeEnd - codec.info().rangeStart != to - from)
+        {
+            job.result = PNGManipErrorCode::DecodingError;
+            job.message = "Shard holds fewer bytes than its header says.";
+        }
+    });
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (showOutput)
+        std::cout << std::endl;
+
+    result = report(stats, seconds, rangeEnd - rangeStart);
+
+    // Only a set whose every shard decoded and matched its checksum replaces the output
+    if (result == PNGManipErrorCode::Success && output.commit() != PNGManipErrorCode::Success)
+    {
+        logError("Error writing output file: " + outputFile);
+        result = PNGManipErrorCode::FileNotWritable;
+    }
+
+    return result;
+}
+
+
+
+
+PNGManipErrorCode PNGShards::report(const std::vector<std::unique_ptr<CodecStats>>& stats, double seconds, uint64_t payloadBytes) const
+{
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+
+    for (const job_t& job : jobs)
+    {
+        if (job.result == PNGManipErrorCode::Success)
+            continue;
+
+        logError(job.path + ": " + job.message);
+
+        if (result == PNGManipErrorCode::Success)
+            result = job.result;
+    }
+
+    const bool encoding = (processType == "ENCODE");
+
+    if (result == PNGManipErrorCode::Success)
+        std::cout << "\n\033[32m" << jobs.size() << " shards " << (encoding ? "encoded" : "decoded") << " successfully!\033[0m\n"
+            << "\n[INFO] " << (encoding ? "Written: \033[36m" : "Read: \033[36m") << jobs.front().path
+            << ((jobs.size() > 1) ? " .. " + jobs.back().path : "") << "\033[0m\n";
+
+    std::cout << "\n" << (encoding ? "Encoding" : "Decoding") << " process took: \033[36m" << seconds << " seconds\033[0m"
+        << "  (\033[36m" << payloadBytes / (1024.0 * 1024.0) / seconds << "\033[0m MB/s)\n";
+
+    if (options.stats)
+    {
+        CodecStats total(true);
+        for (const auto& worker : stats)
+            total.merge(*worker);
+
+        writeStatsJSON(std::cerr, encoding ? "shard-encode" : "shard-decode", inputFile, total, seconds, payloadBytes);
+    }
+
+    return result;
+}
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+PNGShards::PNGShards(const std::string& type, const std::string& input, const std::string& output, const std::string& terminalDisp, const PNGManipOptions& opts, const PNGShardOptions& shardOpts) :
+    processType{ type },
+    inputFile{ input },
+    outputFile{ output },
+    terminalOutput{ terminalDisp },
+    options{ opts },
+    shardOptions{ shardOpts }
+{
+}
+
+
+
+PNGManipErrorCode PNGShards::startProcess()
+{
+    if (processType == "ENCODE")
+        return encode();
+
+    if (processType == "DECODE")
+        return decode();
+
+    logError("Invalid process type. Use 'ENCODE' or 'DECODE'.\n");
+    return PNGManipErrorCode::UnknownError;
+}
@@ -0,0 +1,102 @@
+#ifndef _PNGSHARDS_H_
+#define _PNGSHARDS_H_
+
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ErrorHandling.hpp"
+#include "MappedFile.hpp"
+#include "OutputFile.hpp"
+#include "PNGCodec.hpp"
+
+
+
+/**
+* @brief Sharding switches, filled in from the command line.
+*/
+struct PNGShardOptions
+{
+	// Payload bytes per shard. 0 only shards inputs too large for one image, in pieces of defaultShardBytes
+	uint64_t shardBytes{ 0 };
+
+	// Shards encoded or decoded at once, 0 for one per core
+	unsigned jobs{ 0 };
+};
+
+
+
+/**
+* @brief Splits one payload across a numbered set of PNGs and puts it back together.
+*
+* Encoding output.png writes output.000.png, output.001.png and so on, each holding one
+* slice of the input and an ifSH chunk saying which. Shards are encoded and decoded on a
+* work-stealing pool; decoding sizes the output once and every shard writes its slice in
+* place, so no shard waits for the ones before it. A range only decodes the shards it overlaps.
+*/
+class PNGShards
+{
+private:
+
+	struct job_t
+	{
+		std::string path{};
+		shardHeader_t shard{};
+
+		PNGManipErrorCode result{ PNGManipErrorCode::UnknownError };
+		std::string message{};
+	};
+
+	const std::string processType, inputFile, outputFile, terminalOutput;
+	const PNGManipOptions options;
+	const PNGShardOptions shardOptions;
+
+	std::vector<job_t> jobs;
+
+
+	/**
+	* @brief Encodes each slice of the input into its own shard.
+	*/
+	PNGManipErrorCode encode();
+
+	/**
+	* @brief Decodes every shard overlapping the requested range into its place in the output.
+	*/
+	PNGManipErrorCode decode();
+
+	/**
+	* @brief Maps every shard of the set and checks that their headers tile the payload.
+	*/
+	PNGManipErrorCode collectShards(std::vector<std::unique_ptr<MappedFile>>&, uint64_t&);
+
+	/**
+	* @brief Reports the failed shards and the totals of a run, returning the first error.
+	*/
+	PNGManipErrorCode report(const std::vector<std::unique_ptr<CodecStats>>&, double seconds, uint64_t payloadBytes) const;
+
+public:
+
+	// Shard size for inputs too large for one image when no size is given
+	static constexpr uint64_t defaultShardBytes = 1ull << 30;
+
+	/**
+	* @brief Names shard index of count: output.png becomes output.000.png, with more digits past 1000 shards.
+	*/
+	static std::string shardPath(const std::string& base, uint32_t index, uint32_t count);
+
+	/**
+	* @brief Whether an encode has to be sharded, or a decode input is (or names) a shard set.
+	*/
+	static bool applies(const std::string& type, const std::string& input, const PNGShardOptions&, PixelFormat = PixelFormat::RGBA8);
+
+	/**
+	* @brief Constructor for PNGShards class. input and output are the base paths for decode and encode respectively.
+	*/
+	PNGShards(const std::string&, const std::string&, const std::string&, const std::string&, const PNGManipOptions&, const PNGShardOptions&);
+
+	PNGManipErrorCode startProcess();
+};
+
+
+#endif // !_PNGSHARDS_H_
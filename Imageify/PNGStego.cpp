@@ -0,0 +1,164 @@
+#include "PNGStego.hpp"
+#include "OutputFile.hpp"
+
+#include <chrono>
+#include <iostream>
+
+
+
+PNGManipErrorCode PNGStego::mapInput(MappedFile& mapping, const std::string& path)
+{
+    const PNGManipErrorCode result = mapping.open(path);
+
+    if (result != PNGManipErrorCode::Success)
+        logError(((result == PNGManipErrorCode::FileNotFound) ? "Input file not found: " : "Input file not readable: ") + path);
+
+    return result;
+}
+
+
+
+
+PNGManipErrorCode PNGStego::hide()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    MappedFile payload, cover;
+
+    PNGManipErrorCode result = mapInput(payload, inputFile);
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    if ((result = mapInput(cover, stego.cover)) != PNGManipErrorCode::Success)
+        return result;
+
+    FileSink output;
+    if (output.open(outputFile) != PNGManipErrorCode::Success)
+    {
+        logError("Cannot open output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    PNGCodec codec(options);
+
+    result = codec.embed({ reinterpret_cast<const std::byte*>(cover.data()), cover.size() },
+        { reinterpret_cast<const std::byte*>(payload.data()), payload.size() }, stego.bits, output);
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(codec.errorMessage());
+        return result;
+    }
+
+    if (output.close() != PNGManipErrorCode::Success)
+    {
+        logError("Error writing output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    const imageInfo_t& info = codec.info();
+
+    std::cout << "[INFO] Cover: \033[36m" << info.width << " x " << info.height << " " << pixelFormatName(info.format)
+        << "\033[0m, holding up to \033[36m" << static_cast<float>(info.hiddenCapacity / 1024.0) << " KB\033[0m at \033[36m"
+        << static_cast<int>(info.hiddenBits) << "\033[0m bits per sample" << std::endl
+        << "[INFO] Hid \033[36m" << static_cast<float>(info.payloadSize / 1024.0) << " KB\033[0m ("
+        << static_cast<float>(info.hiddenCapacity ? 100.0 * info.payloadSize / info.hiddenCapacity : 0.0) << "% of the cover)" << std::endl
+        << "\n\033[32m" << "Payload hidden successfully!" << "\033[0m\n"
+        << "\nHiding took: \033[36m" << seconds << " seconds\033[0m\n";
+
+    if (options.stats)
+        writeStatsJSON(std::cerr, "hide", inputFile, codec.stats(), seconds, info.payloadSize);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGStego::reveal()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    MappedFile image;
+
+    PNGManipErrorCode result = mapInput(image, inputFile);
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    const bool showOutput = (terminalOutput == "TRUE");
+
+    FileSink output;
+    if (output.openReplacing(outputFile, showOutput ? &std::cout : nullptr) != PNGManipErrorCode::Success)
+    {
+        logError("Cannot open output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    if (showOutput)
+        std::cout << "\nDecoded Output:\n";
+
+    PNGCodec codec(options);
+
+    result = codec.extract({ reinterpret_cast<const std::byte*>(image.data()), image.size() }, output);
+
+    if (result == PNGManipErrorCode::Success && output.commit() != PNGManipErrorCode::Success)
+    {
+        logError("Error writing output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    if (showOutput)
+        std::cout << std::endl;
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(codec.errorMessage());
+        return result;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    const imageInfo_t& info = codec.info();
+
+    std::cout << "\n[INFO] Found \033[36m" << static_cast<float>(info.payloadSize / 1024.0) << " KB\033[0m hidden at \033[36m"
+        << static_cast<int>(info.hiddenBits) << "\033[0m bits per sample in a \033[36m" << info.width << " x " << info.height
+        << "\033[0m image, checksum matched" << std::endl
+        << "\n\033[32m" << "Payload recovered successfully!" << "\033[0m\n"
+        << "\nRecovery took: \033[36m" << seconds << " seconds\033[0m\n";
+
+    if (options.stats)
+        writeStatsJSON(std::cerr, "reveal", inputFile, codec.stats(), seconds, info.payloadSize);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+PNGStego::PNGStego(const std::string& type, const std::string& input, const std::string& output, const std::string& terminalDisp, const PNGManipOptions& opts, const PNGStegoOptions& stegoOpts) :
+    processType{ type },
+    inputFile{ input },
+    outputFile{ output },
+    terminalOutput{ terminalDisp },
+    options{ opts },
+    stego{ stegoOpts }
+{
+}
+
+
+
+PNGManipErrorCode PNGStego::startProcess()
+{
+    if (processType == "ENCODE" && !stego.cover.empty())
+        return hide();
+
+    if (processType == "DECODE" && stego.hidden)
+        return reveal();
+
+    logError("A payload is hidden with --encode and --cover, and recovered with --decode and --hidden.");
+    return PNGManipErrorCode::UnknownError;
+}
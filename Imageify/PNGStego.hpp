@@ -0,0 +1,69 @@
+#ifndef _PNGSTEGO_H_
+#define _PNGSTEGO_H_
+
+
+#include <string>
+
+#include "ErrorHandling.hpp"
+#include "MappedFile.hpp"
+#include "PNGCodec.hpp"
+
+
+
+/**
+* @brief Cover mode switches, filled in from the command line.
+*/
+struct PNGStegoOptions
+{
+	// --cover: the PNG to hide the -e input in
+	std::string cover;
+
+	// --cover-bits: low bits of each sample given to the payload, 1 to 4
+	unsigned bits{ 2 };
+
+	// --hidden: the -d image hides its payload in its low bits
+	bool hidden{ false };
+
+	bool enabled() const { return !cover.empty() || hidden; }
+};
+
+
+
+/**
+* @brief Hides a payload in the low bits of an existing PNG, and gets it back out.
+*
+* Every other mode makes an image out of the payload. This one leaves the cover looking as it
+* did: the payload takes the lowest 1 to 4 bits of each sample, a change of at most 1 to 15
+* levels out of 255, and the image is written back with no chunks of Imageify's own. A short
+* header in the lowest bit of the first samples gives the depth, length and CRC-32C, so the
+* payload can be read back without being told how it was hidden.
+*/
+class PNGStego
+{
+private:
+
+	const std::string processType, inputFile, outputFile, terminalOutput;
+	const PNGManipOptions options;
+	const PNGStegoOptions stego;
+
+
+	PNGManipErrorCode hide();
+	PNGManipErrorCode reveal();
+
+	/**
+	* @brief Maps a file, logging why it cannot be opened.
+	*/
+	static PNGManipErrorCode mapInput(MappedFile&, const std::string&);
+
+public:
+
+	/**
+	* @brief Constructor for PNGStego class.
+	*/
+	PNGStego(const std::string&, const std::string&, const std::string&, const std::string&, const PNGManipOptions&, const PNGStegoOptions&);
+
+	PNGManipErrorCode startProcess();
+};
+
+
+#endif // !_PNGSTEGO_H_
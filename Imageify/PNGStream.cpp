@@ -0,0 +1,581 @@
+#include "PNGStream.hpp"
+#include "MappedFile.hpp"
+#include "OutputFile.hpp"
+#include "Platform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#ifdef _WIN32
+    #include <fcntl.h>
+    #include <io.h>
+#endif
+
+
+
+// Reads a file, or standard input for "-", front to back without knowing its size
+struct streamReader_t : public StreamSource
+{
+    std::FILE* file{ nullptr };
+    bool owned{ false };
+
+    ~streamReader_t() override
+    {
+        if (owned)
+            std::fclose(file);
+    }
+
+    PNGManipErrorCode open(const std::string& path)
+    {
+        if (isStandardStream(path))
+        {
+#ifdef _WIN32
+            // Text mode would turn every \r\n of the payload into \n
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            file = stdin;
+            return PNGManipErrorCode::Success;
+        }
+
+        file = std::fopen(path.c_str(), "rb");
+        owned = (file != nullptr);
+
+        return file ? PNGManipErrorCode::Success : PNGManipErrorCode::FileNotFound;
+    }
+
+    size_t read(uint8_t* data, size_t length) override
+    {
+        size_t total{ 0 };
+
+        while (total < length)
+        {
+            const size_t got = std::fread(data + total, 1, length - total, file);
+            if (got == 0)
+                break;
+
+            total += got;
+        }
+
+        return total;
+    }
+
+    bool failed() const override { return std::ferror(file) != 0; }
+};
+
+
+
+// Reads on until the frame holds the limit or the stream ends. In steps, so a small input
+// never allocates a whole frame
+static void fillFrame(streamReader_t& input, std::vector<uint8_t>& frame, uint64_t limit)
+{
+    static constexpr size_t readBytes = 1024 * 1024;
+
+    while (frame.size() < limit)
+    {
+        const size_t filled = frame.size();
+        frame.resize(filled + static_cast<size_t>(std::min<uint64_t>(readBytes, limit - filled)));
+
+        const size_t got = input.read(frame.data() + filled, frame.size() - filled);
+        frame.resize(filled + got);
+
+        if (got == 0)
+            break;
+    }
+}
+
+
+
+// Forwards appends only, so a codec never resizes the output under the frames before it
+struct appendSink_t : public ByteSink
+{
+    ByteSink& target;
+
+    explicit appendSink_t(ByteSink& sink) : target{ sink } {}
+
+    bool write(const uint8_t* data, size_t length) override { return target.write(data, length); }
+};
+
+
+
+// Reads one whole PNG off the stream, chunk by chunk up to its IEND. A stream that ends
+// cleanly before the signature leaves the image empty
+static PNGManipErrorCode readImage(streamReader_t& input, std::vector<uint8_t>& image)
+{
+    static constexpr size_t chunkLimit = 0x7FFFFFFF;
+
+    image.resize(8);
+
+    const size_t signature = input.read(image.data(), 8);
+    if (signature == 0 && !input.failed())
+    {
+        image.clear();
+        return PNGManipErrorCode::Success;
+    }
+
+    if (signature != 8 || png_sig_cmp(image.data(), 0, 8) != 0)
+        return PNGManipErrorCode::InvalidFileFormat;
+
+    for (;;)
+    {
+        const size_t start = image.size();
+        image.resize(start + 8);
+
+        if (input.read(image.data() + start, 8) != 8)
+            return PNGManipErrorCode::InvalidFileFormat;
+
+        const size_t length = getBE32(image.data() + start);
+        if (length > chunkLimit)
+            return PNGManipErrorCode::InvalidFileFormat;
+
+        const bool last = (memcmp(image.data() + start + 4, "IEND", 4) == 0);
+
+        // The body and its CRC
+        image.resize(start + 8 + length + 4);
+
+        if (input.read(image.data() + start + 8, length + 4) != length + 4)
+            return PNGManipErrorCode::InvalidFileFormat;
+
+        if (last)
+            return PNGManipErrorCode::Success;
+    }
+}
+
+
+
+
+bool PNGStream::applies(const std::string& type, const std::string& input, const std::string& output)
+{
+    if (type == "ENCODE")
+        return isStandardStream(input) || isStandardStream(output);
+
+    if (isStandardStream(input))
+        return true;
+
+    if (type != "DECODE")
+        return false;
+
+    // A stream saved to a file starts with a frame like any other
+    MappedFile file;
+    imageLayout_t layout;
+
+    return file.open(input) == PNGManipErrorCode::Success
+        && scanImageLayout(file.data(), file.size(), layout) == PNGManipErrorCode::Success
+        && (layout.shard.flags & shardStreamed);
+}
+
+
+
+
+PNGManipErrorCode PNGStream::encode()
+{
+    streamReader_t input;
+
+    if (input.open(inputFile) != PNGManipErrorCode::Success)
+    {
+        logError("Input file not found: " + inputFile);
+        return PNGManipErrorCode::FileNotFound;
+    }
+
+    FileSink output;
+    if (output.open(outputFile) != PNGManipErrorCode::Success)
+    {
+        logError("Cannot open output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    std::vector<uint8_t> frame;
+    CodecStats stats(options.stats);
+
+    shardHeader_t shard;
+    shard.flags = shardStreamed;
+
+    // One byte read past a full frame tells whether another one follows
+    uint8_t carry{ 0 };
+    bool haveCarry{ false };
+
+    const auto start = std::chrono::steady_clock::now();
+
+    do
+    {
+        try
+        {
+            frame.assign(haveCarry ? 1 : 0, carry);
+            fillFrame(input, frame, frameBytes);
+        }
+        catch (const std::bad_alloc&)
+        {
+            logError("Not enough memory for a frame of " + std::to_string(frameBytes) + " bytes.");
+            return PNGManipErrorCode::MemoryAllocationError;
+        }
+
+        if (input.failed())
+        {
+            logError("Input file not readable: " + inputFile);
+            return PNGManipErrorCode::FileNotReadable;
+        }
+
+        haveCarry = (frame.size() == frameBytes) && input.read(&carry, 1) == 1;
+
+        shard.length = frame.size();
+
+        // The final frame is the trailer, the only one that knows how the stream ends
+        if (!haveCarry)
+        {
+            shard.flags |= shardFinal;
+            shard.count = shard.index + 1;
+            shard.totalSize = shard.offset + shard.length;
+        }
+
+        PNGManipOptions codecOptions = options;
+        codecOptions.shard = shard;
+
+        PNGCodec codec(codecOptions);
+        PNGManipErrorCode result{ PNGManipErrorCode::UnknownError };
+
+        try
+        {
+            result = codec.encode({ reinterpret_cast<const std::byte*>(frame.data()), frame.size() }, output);
+        }
+        catch (const std::bad_alloc&)
+        {
+            result = PNGManipErrorCode::MemoryAllocationError;
+        }
+
+        stats.merge(codec.stats());
+
+        if (result != PNGManipErrorCode::Success)
+        {
+            logError("Frame " + std::to_string(shard.index) + ": "
+                + (codec.errorMessage().empty() ? errorCodeToString(result) : codec.errorMessage()));
+            return result;
+        }
+
+        shard.offset += shard.length;
+        ++shard.index;
+    }
+    while (haveCarry);
+
+    if (output.close() != PNGManipErrorCode::Success)
+    {
+        logError("Error writing output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    report(stats, seconds, shard.offset, shard.index);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGStream::encodeToFile()
+{
+    streamReader_t input;
+
+    if (input.open(inputFile) != PNGManipErrorCode::Success)
+    {
+        logError("Input file not found: " + inputFile);
+        return PNGManipErrorCode::FileNotFound;
+    }
+
+    // Written beside the output until the image is whole, so a failure leaves whatever was there
+    FileSink output;
+    if (output.openReplacing(outputFile) != PNGManipErrorCode::Success)
+    {
+        logError("Cannot open output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    std::vector<uint8_t> head;
+    bool sized{ true };
+
+    const auto start = std::chrono::steady_clock::now();
+
+    // A stream that ends within the first frame has a size, and is encoded like a file input
+    try
+    {
+        fillFrame(input, head, frameBytes);
+
+        uint8_t next{ 0 };
+        if (head.size() == frameBytes && input.read(&next, 1) == 1)
+        {
+            head.push_back(next);
+            sized = false;
+        }
+    }
+    catch (const std::bad_alloc&)
+    {
+        logError("Not enough memory for a frame of " + std::to_string(frameBytes) + " bytes.");
+        return PNGManipErrorCode::MemoryAllocationError;
+    }
+
+    if (input.failed())
+    {
+        logError("Input file not readable: " + inputFile);
+        return PNGManipErrorCode::FileNotReadable;
+    }
+
+    if (!sized && shardSizeGiven)
+    {
+        logError("A shard set needs the size of its input up front: encode standard input to --output -, or from a file.");
+        return PNGManipErrorCode::EncodingError;
+    }
+
+    PNGCodec codec(options);
+    PNGManipErrorCode result{ PNGManipErrorCode::UnknownError };
+
+    const std::span<const std::byte> bytes{ reinterpret_cast<const std::byte*>(head.data()), head.size() };
+
+    try
+    {
+        result = sized ? codec.encode(bytes, output) : codec.encodeUnsized(bytes, input, output);
+    }
+    catch (const std::bad_alloc&)
+    {
+        result = PNGManipErrorCode::MemoryAllocationError;
+    }
+
+    if (result != PNGManipErrorCode::Success)
+    {
+        logError(codec.errorMessage().empty() ? errorCodeToString(result) : codec.errorMessage());
+        return result;
+    }
+
+    if (output.commit() != PNGManipErrorCode::Success)
+    {
+        logError("Error writing output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    report(codec.stats(), seconds, codec.info().payloadSize, 1);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+PNGManipErrorCode PNGStream::decode()
+{
+    streamReader_t input;
+
+    if (input.open(inputFile) != PNGManipErrorCode::Success)
+    {
+        logError("Input file not found: " + inputFile);
+        return PNGManipErrorCode::FileNotFound;
+    }
+
+    // --show echoes the payload to the terminal as it is written
+    const bool showOutput = (terminalOutput == "TRUE");
+
+    FileSink output;
+    if (output.openReplacing(outputFile, showOutput ? &std::cout : nullptr) != PNGManipErrorCode::Success)
+    {
+        logError("Cannot open output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    appendSink_t append(output);
+
+    // The total size is only known at the end, so the range is clipped frame by frame
+    const uint64_t rangeStart = options.hasRange ? options.rangeOffset : 0;
+    const uint64_t rangeEnd = options.hasRange ? rangeStart + std::min(options.rangeLength, UINT64_MAX - rangeStart) : UINT64_MAX;
+
+    std::vector<uint8_t> image;
+    CodecStats stats(options.stats);
+
+    uint32_t frames{ 0 };
+    uint64_t offset{ 0 }, written{ 0 };
+    bool finished{ false };
+
+    if (showOutput)
+        std::cout << "\nDecoded Output:\n";
+
+    const auto start = std::chrono::steady_clock::now();
+
+    while (!finished)
+    {
+        PNGManipErrorCode result{ PNGManipErrorCode::UnknownError };
+
+        try
+        {
+            result = readImage(input, image);
+        }
+        catch (const std::bad_alloc&)
+        {
+            result = PNGManipErrorCode::MemoryAllocationError;
+        }
+
+        if (result == PNGManipErrorCode::Success && image.empty())
+        {
+            logError(frames ? "Stream ended before its final frame." : "Input holds no image.");
+            return PNGManipErrorCode::DecodingError;
+        }
+
+        imageLayout_t layout;
+        if (result != PNGManipErrorCode::Success || scanImageLayout(image.data(), image.size(), layout) != PNGManipErrorCode::Success)
+        {
+            logError("Not a PNG image, or a damaged one: frame " + std::to_string(frames) + " of " + inputFile);
+            return (result == PNGManipErrorCode::Success) ? PNGManipErrorCode::InvalidFileFormat : result;
+        }
+
+        const shardHeader_t& shard = layout.shard;
+        const bool streamed = (shard.flags & shardStreamed);
+
+        PNGManipOptions codecOptions = options;
+        uint64_t from{ 0 }, to{ 0 };
+
+        if (streamed)
+        {
+            // Every frame has to continue where the previous one stopped
+            if (shard.index != frames || shard.offset != offset)
+            {
+                logError("Frame " + std::to_string(frames) + " does not follow on from the one before it.");
+                return PNGManipErrorCode::InvalidFileFormat;
+            }
+
+            from = std::max(rangeStart, shard.offset);
+            to = std::min(rangeEnd, shard.offset + shard.length);
+
+            codecOptions.hasRange = (from < to) && (to - from != shard.length);
+            codecOptions.rangeOffset = (from < to) ? from - shard.offset : 0;
+            codecOptions.rangeLength = (from < to) ? to - from : 0;
+
+            offset += shard.length;
+            finished = (shard.flags & shardFinal) != 0;
+        }
+        else if (frames == 0 && shard.count == 0)
+        {
+            // A single ordinary image piped in, decoded as it is
+            finished = true;
+        }
+        else
+        {
+            logError("Image is one shard of a set, decode it by name instead: " + inputFile);
+            return PNGManipErrorCode::InvalidFileFormat;
+        }
+
+        ++frames;
+
+        // Frames outside the range are read past, never inflated
+        if (streamed && from >= to)
+            continue;
+
+        PNGCodec codec(codecOptions);
+
+        try
+        {
+            result = codec.decode({ reinterpret_cast<const std::byte*>(image.data()), image.size() }, append);
+        }
+        catch (const std::bad_alloc&)
+        {
+            result = PNGManipErrorCode::MemoryAllocationError;
+        }
+
+        stats.merge(codec.stats());
+
+        if (result != PNGManipErrorCode::Success)
+        {
+            logError("Frame " + std::to_string(frames - 1) + ": "
+                + (codec.errorMessage().empty() ? errorCodeToString(result) : codec.errorMessage()));
+            return result;
+        }
+
+        const uint64_t decoded = codec.info().rangeEnd - codec.info().rangeStart;
+
+        if (streamed && decoded != to - from)
+        {
+            logError("Frame " + std::to_string(frames - 1) + " holds fewer bytes than its header says.");
+            return PNGManipErrorCode::DecodingError;
+        }
+
+        written += decoded;
+
+        // Nothing past the range is needed, and the rest of the stream is left unread
+        if (options.hasRange && offset >= rangeEnd)
+            break;
+    }
+
+    if (showOutput)
+        std::cout << std::endl;
+
+    if (finished && options.hasRange && written == 0 && rangeStart > offset)
+    {
+        logError("Range starts past the end of the payload (" + std::to_string(offset) + " bytes).");
+        return PNGManipErrorCode::DecodingError;
+    }
+
+    if (output.commit() != PNGManipErrorCode::Success)
+    {
+        logError("Error writing output file: " + outputFile);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    report(stats, seconds, written, frames);
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+
+void PNGStream::report(const CodecStats& stats, double seconds, uint64_t payloadBytes, uint32_t frames) const
+{
+    const bool encoding = (processType == "ENCODE");
+
+    // Standard input encoded into a file is one image, not a frame of a stream
+    const char* unit = (encoding && !isStandardStream(outputFile)) ? " image" : " frame";
+
+    std::cout << "\n\033[32m" << frames << unit << ((frames == 1) ? " " : "s ") << (encoding ? "encoded" : "decoded") << " successfully!\033[0m\n"
+        << "\n[INFO] " << (encoding ? "Written: \033[36m" : "Read: \033[36m") << (encoding ? outputFile : inputFile)
+        << "\033[0m, \033[36m" << static_cast<float>(payloadBytes / 1024.0) << " KB\033[0m of payload\n";
+
+    std::cout << "\n" << (encoding ? "Encoding" : "Decoding") << " process took: \033[36m" << seconds << " seconds\033[0m"
+        << "  (\033[36m" << payloadBytes / (1024.0 * 1024.0) / seconds << "\033[0m MB/s)\n";
+
+    if (options.stats)
+        writeStatsJSON(std::cerr, encoding ? "stream-encode" : "stream-decode", inputFile, stats, seconds, payloadBytes);
+}
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+PNGStream::PNGStream(const std::string& type, const std::string& input, const std::string& output, const std::string& terminalDisp, const PNGManipOptions& opts, uint64_t frame) :
+    processType{ type },
+    inputFile{ input },
+    outputFile{ output },
+    terminalOutput{ terminalDisp },
+    options{ opts },
+    frameBytes{ std::min(frame ? frame : defaultFrameBytes, PNGCodec::maxPayloadBytesFor(opts.format)) },
+    shardSizeGiven{ frame != 0 }
+{
+}
+
+
+
+PNGManipErrorCode PNGStream::startProcess()
+{
+    if (processType == "ENCODE")
+        return isStandardStream(outputFile) ? encode() : encodeToFile();
+
+    if (processType == "DECODE")
+        return decode();
+
+    logError("Invalid process type. Use 'ENCODE' or 'DECODE'.\n");
+    return PNGManipErrorCode::UnknownError;
+}
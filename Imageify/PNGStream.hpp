@@ -0,0 +1,73 @@
+#ifndef _PNGSTREAM_H_
+#define _PNGSTREAM_H_
+
+
+#include <string>
+
+#include "ErrorHandling.hpp"
+#include "PNGCodec.hpp"
+
+
+
+/**
+* @brief Encodes to standard output as a stream of PNG frames, and decodes them back.
+*
+* A pipe has no size up front, and an image needs its height before its first row. So the
+* input is read one frame at a time and each frame becomes a complete PNG, written as soon
+* as it is full, with an ifSH chunk flagged as streamed giving its index and offset. Only
+* the final frame knows the frame count and the total size, and carries them as a trailer.
+* An input that fits in one frame comes out as one ordinary PNG.
+*
+* Decoding reads the PNGs one after another from the stream, checks that they follow on,
+* and appends their payloads to the output; a single image without frame header decodes
+* as it is. Memory use stays at about one frame whatever the payload size.
+*
+* Frames only make sense on a pipe. Standard input encoded into a file becomes one image:
+* an input that ends within the first frame is encoded like a file, and a longer one goes
+* straight into the file row by row, its height and size prefix rewritten at the end.
+*/
+class PNGStream
+{
+private:
+
+	const std::string processType, inputFile, outputFile, terminalOutput;
+	const PNGManipOptions options;
+	const uint64_t frameBytes;
+
+	// Whether frameBytes came from --shard-size, which a file output cannot honour without a size
+	const bool shardSizeGiven;
+
+
+	PNGManipErrorCode encode();
+	PNGManipErrorCode decode();
+
+	/**
+	* @brief Encodes standard input into the output file as one image, without frames.
+	*/
+	PNGManipErrorCode encodeToFile();
+
+	/**
+	* @brief Prints the totals of a run and, with --stats, the merged stage timings.
+	*/
+	void report(const CodecStats&, double seconds, uint64_t payloadBytes, uint32_t frames) const;
+
+public:
+
+	// Payload bytes per frame when no --shard-size is given
+	static constexpr uint64_t defaultFrameBytes = 64ull << 20;
+
+	/**
+	* @brief Whether an encode input or output is "-", or a decode input is "-" or a stream written to a file.
+	*/
+	static bool applies(const std::string& type, const std::string& input, const std::string& output);
+
+	/**
+	* @brief Constructor for PNGStream class. frameBytes of 0 picks defaultFrameBytes.
+	*/
+	PNGStream(const std::string&, const std::string&, const std::string&, const std::string&, const PNGManipOptions&, uint64_t frameBytes);
+
+	PNGManipErrorCode startProcess();
+};
+
+
+#endif // !_PNGSTREAM_H_
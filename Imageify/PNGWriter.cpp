@@ -0,0 +1,555 @@
+#include "PNGWriter.hpp"
+#include "Platform.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define IMAGEIFY_CRC32_PCLMUL
+    #include <smmintrin.h>
+    #include <wmmintrin.h>
+#endif
+
+// As in Checksum.cpp, only the folding function is built for PCLMULQDQ and SSE 4.1
+#if defined(IMAGEIFY_CRC32_PCLMUL) && !defined(_MSC_VER)
+    #define IMAGEIFY_TARGET_PCLMUL __attribute__((target("pclmul,sse4.1")))
+#else
+    #define IMAGEIFY_TARGET_PCLMUL
+#endif
+
+
+
+static constexpr uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+// CMF and FLG of a zlib stream with a 32 KB window and no preset dictionary, as zlib writes for level 0
+static constexpr uint8_t storedZlibHeader[2] = { 0x78, 0x01 };
+
+// Largest stored deflate block, and the block that ends the stream: final, stored, empty
+static constexpr size_t storedBlockBytes = 65535;
+static constexpr uint8_t finalStoredBlock[5] = { 0x01, 0x00, 0x00, 0xFF, 0xFF };
+
+// Adler-32's modulus
+static constexpr uint64_t adlerBase = 65521;
+
+
+/**
+* CRC-32 ----------------------------------------------
+*/
+
+#ifdef IMAGEIFY_CRC32_PCLMUL
+
+// Folds 128 bits of the register into the next 16 bytes
+IMAGEIFY_TARGET_PCLMUL static inline __m128i fold16(__m128i value, __m128i next, __m128i constants)
+{
+    const __m128i low = _mm_clmulepi64_si128(value, constants, 0x00);
+    value = _mm_clmulepi64_si128(value, constants, 0x11);
+
+    return _mm_xor_si128(_mm_xor_si128(value, next), low);
+}
+
+// Folds whole 16-byte blocks, at least four of them, with the constants for the reflected
+// 0xEDB88320 polynomial from Intel's "Fast CRC Computation Using PCLMULQDQ". The CRC comes
+// in and goes out inverted, the way the register is kept between calls
+IMAGEIFY_TARGET_PCLMUL static uint32_t crc32Fold(uint32_t crc, const uint8_t* data, size_t length)
+{
+    alignas(16) static const uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+    alignas(16) static const uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+    alignas(16) static const uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+    __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+    __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+    __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+    __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+
+    __m128i x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+
+    data += 64;
+    length -= 64;
+
+    // Four independent lanes of 16 bytes, folded 64 bytes ahead
+    while (length >= 64)
+    {
+        const __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        const __m128i x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        const __m128i x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        const __m128i x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30)));
+
+        data += 64;
+        length -= 64;
+    }
+
+    // The four lanes into one, then any 16-byte blocks left
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+
+    x1 = fold16(x1, x2, x0);
+    x1 = fold16(x1, x3, x0);
+    x1 = fold16(x1, x4, x0);
+
+    for (; length >= 16; data += 16, length -= 16)
+        x1 = fold16(x1, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), x0);
+
+    // 128 bits to 64
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+    x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, mask32);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+
+    x2 = _mm_and_si128(x1, mask32);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, mask32);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+#endif
+
+
+uint32_t pngCrc32(uint32_t crc, const uint8_t* data, size_t length)
+{
+#ifdef IMAGEIFY_CRC32_PCLMUL
+    static const bool folding = cpuHasPCLMUL();
+
+    // Short chunks cost less through zlib's tables than setting up the fold
+    if (folding && length >= 64)
+    {
+        const size_t folded = length & ~static_cast<size_t>(15);
+
+        crc = ~crc32Fold(~crc, data, folded);
+        data += folded;
+        length -= folded;
+    }
+#endif
+
+    // zlib takes at most 4 GB at a time where uInt is 32 bits
+    while (length)
+    {
+        const uInt piece = static_cast<uInt>(std::min<size_t>(length, 1u << 30));
+
+        crc = static_cast<uint32_t>(::crc32(crc, data, piece));
+        data += piece;
+        length -= piece;
+    }
+
+    return crc;
+}
+
+
+
+const char* pngCrc32Implementation()
+{
+    return cpuHasPCLMUL() ? "pclmul" : "zlib";
+}
+
+
+
+
+/**
+* PNGWriter -------------------------------------------
+*/
+
+// One whole chunk as it goes into the file: length, name, data and CRC
+static std::vector<uint8_t> chunkBytes(const char* name, const uint8_t* data, size_t length)
+{
+    std::vector<uint8_t> bytes(12 + length);
+
+    putBE32(bytes.data(), static_cast<uint32_t>(length));
+    memcpy(bytes.data() + 4, name, 4);
+
+    if (length)
+        memcpy(bytes.data() + 8, data, length);
+
+    putBE32(bytes.data() + 8 + length, pngCrc32(0, bytes.data() + 4, 4 + length));
+
+    return bytes;
+}
+
+
+
+PNGWriter::PNGWriter(ByteSink& sink) :
+    m_sink{ sink }
+{
+}
+
+
+
+PNGWriter::~PNGWriter()
+{
+    if (m_deflating)
+        deflateEnd(&m_stream);
+}
+
+
+
+void PNGWriter::write(const uint8_t* data, size_t length)
+{
+    if (!m_failed && length && !m_sink.write(data, length))
+        m_failed = true;
+
+    m_written += length;
+}
+
+void PNGWriter::put(const uint8_t* data, size_t length, uint32_t& crc)
+{
+    crc = pngCrc32(crc, data, length);
+    write(data, length);
+}
+
+
+
+uint32_t PNGWriter::beginChunk(const char* name, size_t length)
+{
+    uint8_t header[8];
+    putBE32(header, static_cast<uint32_t>(length));
+    memcpy(header + 4, name, 4);
+
+    write(header, sizeof(header));
+
+    // The CRC covers the name and data but not the length
+    return pngCrc32(0, header + 4, 4);
+}
+
+void PNGWriter::endChunk(uint32_t crc)
+{
+    uint8_t trailer[4];
+    putBE32(trailer, crc);
+
+    write(trailer, sizeof(trailer));
+}
+
+
+
+void PNGWriter::begin(uint32_t width, uint32_t height, uint8_t bitDepth, uint8_t colorType)
+{
+    write(signature, sizeof(signature));
+
+    // Deflate, adaptive filtering (of which only None is used), no interlace
+    putBE32(m_header, width);
+    putBE32(m_header + 4, height);
+    m_header[8]  = bitDepth;
+    m_header[9]  = colorType;
+    m_header[10] = 0;
+    m_header[11] = 0;
+    m_header[12] = 0;
+
+    chunk("IHDR", m_header, sizeof(m_header));
+}
+
+
+
+void PNGWriter::chunk(const char* name, const uint8_t* data, size_t length)
+{
+    uint32_t crc = beginChunk(name, length);
+    put(data, length, crc);
+    endChunk(crc);
+}
+
+
+
+bool PNGWriter::beginImage(const compressionSettings_t& compression)
+{
+    m_compression = compression;
+    m_adler = adler32(0, nullptr, 0);
+    m_headerWritten = false;
+
+    m_head.clear();
+    m_tailAdler = adler32(0, nullptr, 0);
+    m_tailLength = 0;
+
+    if (m_compression.level == 0)
+        return true;
+
+    m_stream = z_stream{};
+    if (deflateInit2(&m_stream, m_compression.level, Z_DEFLATED, 15, m_compression.memLevel, m_compression.strategy) != Z_OK)
+        return false;
+
+    m_deflating = true;
+
+    m_idat.resize(idatBytes);
+    m_stream.next_out = m_idat.data();
+    m_stream.avail_out = static_cast<uInt>(m_idat.size());
+
+    return true;
+}
+
+
+
+void PNGWriter::storeRows(const uint8_t* data, size_t length)
+{
+    // One IDAT per call, holding the rows framed as stored blocks. Its length is known up front,
+    // so the rows go to the sink from where they are, with only the block headers in between
+    const size_t blocks = (length + storedBlockBytes - 1) / storedBlockBytes;
+    const size_t header = m_headerWritten ? 0 : sizeof(storedZlibHeader);
+
+    uint32_t crc = beginChunk("IDAT", header + 5 * blocks + length);
+
+    if (header)
+        put(storedZlibHeader, header, crc);
+
+    m_headerWritten = true;
+    m_adler = adler32_z(m_adler, data, length);
+
+    while (length)
+    {
+        const size_t blockLength = std::min(length, storedBlockBytes);
+
+        // Not final, stored, then LEN and NLEN little-endian
+        const uint8_t blockHeader[5] = {
+            0x00,
+            static_cast<uint8_t>(blockLength), static_cast<uint8_t>(blockLength >> 8),
+            static_cast<uint8_t>(~blockLength), static_cast<uint8_t>(~blockLength >> 8)
+        };
+
+        put(blockHeader, sizeof(blockHeader), crc);
+        put(data, blockLength, crc);
+
+        data += blockLength;
+        length -= blockLength;
+    }
+
+    endChunk(crc);
+}
+
+
+
+bool PNGWriter::deflateRows(const uint8_t* data, size_t length, int flush)
+{
+    do
+    {
+        const size_t piece = std::min<size_t>(length, 1u << 30);
+
+        m_stream.next_in = const_cast<Bytef*>(data);
+        m_stream.avail_in = static_cast<uInt>(piece);
+
+        data += piece;
+        length -= piece;
+
+        const int pieceFlush = length ? Z_NO_FLUSH : flush;
+
+        for (;;)
+        {
+            const int result = ::deflate(&m_stream, pieceFlush);
+
+            if (result == Z_STREAM_ERROR)
+                return false;
+
+            // A full buffer makes one IDAT, the last one is whatever the stream ends with
+            if (m_stream.avail_out == 0 || (result == Z_STREAM_END && m_stream.avail_out != m_idat.size()))
+            {
+                chunk("IDAT", m_idat.data(), m_idat.size() - m_stream.avail_out);
+
+                m_stream.next_out = m_idat.data();
+                m_stream.avail_out = static_cast<uInt>(m_idat.size());
+            }
+
+            if (pieceFlush == Z_FINISH ? result == Z_STREAM_END : m_stream.avail_in == 0)
+                break;
+        }
+    } while (length);
+
+    return !m_failed;
+}
+
+
+
+std::vector<uint8_t> PNGWriter::storedHead() const
+{
+    std::vector<uint8_t> data(storedZlibHeader, storedZlibHeader + sizeof(storedZlibHeader));
+
+    for (size_t done{ 0 }; done < m_head.size(); done += storedBlockBytes)
+    {
+        const size_t blockLength = std::min(m_head.size() - done, storedBlockBytes);
+
+        const uint8_t blockHeader[5] = {
+            0x00,
+            static_cast<uint8_t>(blockLength), static_cast<uint8_t>(blockLength >> 8),
+            static_cast<uint8_t>(~blockLength), static_cast<uint8_t>(~blockLength >> 8)
+        };
+
+        data.insert(data.end(), blockHeader, blockHeader + sizeof(blockHeader));
+        data.insert(data.end(), m_head.begin() + done, m_head.begin() + done + blockLength);
+    }
+
+    return data;
+}
+
+
+
+uLong PNGWriter::streamAdler() const
+{
+    const uLong head = adler32_z(adler32(0, nullptr, 0), m_head.data(), m_head.size());
+
+    // Only the length modulo the base enters the combination, which keeps it within any z_off_t
+    return adler32_combine(head, m_tailAdler, static_cast<z_off_t>(m_tailLength % adlerBase));
+}
+
+
+
+bool PNGWriter::imageHead(const uint8_t* data, size_t length)
+{
+    // The head comes ahead of anything deflate writes, so deflate must not write the zlib
+    // header itself, nor an Adler-32 that would only cover the head as it was first given
+    if (m_deflating)
+    {
+        deflateEnd(&m_stream);
+        m_deflating = false;
+
+        m_stream = z_stream{};
+        if (deflateInit2(&m_stream, m_compression.level, Z_DEFLATED, -15, m_compression.memLevel, m_compression.strategy) != Z_OK)
+            return false;
+
+        m_deflating = true;
+
+        m_stream.next_out = m_idat.data();
+        m_stream.avail_out = static_cast<uInt>(m_idat.size());
+    }
+
+    m_head.assign(data, data + length);
+    m_headOffset = m_written;
+    m_headerWritten = true;
+
+    const std::vector<uint8_t> head = storedHead();
+    chunk("IDAT", head.data(), head.size());
+
+    return !m_failed;
+}
+
+
+
+bool PNGWriter::imageData(const uint8_t* data, size_t length)
+{
+    if (!m_head.empty())
+    {
+        m_tailAdler = adler32_z(m_tailAdler, data, length);
+        m_tailLength += length;
+    }
+
+    if (!m_deflating)
+    {
+        for (size_t done{ 0 }; done < length; done += idatBytes)
+            storeRows(data + done, std::min(idatBytes, length - done));
+
+        return !m_failed;
+    }
+
+    return deflateRows(data, length, Z_NO_FLUSH);
+}
+
+
+
+bool PNGWriter::endImage()
+{
+    if (m_deflating)
+    {
+        const bool finished = deflateRows(nullptr, 0, Z_FINISH);
+
+        deflateEnd(&m_stream);
+        m_deflating = false;
+
+        if (!m_head.empty())
+        {
+            uint8_t adler[4];
+            putBE32(adler, static_cast<uint32_t>(streamAdler()));
+
+            m_adlerOffset = m_written;
+            chunk("IDAT", adler, sizeof(adler));
+        }
+
+        return finished && !m_failed;
+    }
+
+    // After a head, the Adler-32 gets an IDAT of its own that rewrite() can replace
+    if (!m_head.empty())
+    {
+        chunk("IDAT", finalStoredBlock, sizeof(finalStoredBlock));
+
+        uint8_t adler[4];
+        putBE32(adler, static_cast<uint32_t>(streamAdler()));
+
+        m_adlerOffset = m_written;
+        chunk("IDAT", adler, sizeof(adler));
+
+        return !m_failed;
+    }
+
+    const size_t header = m_headerWritten ? 0 : sizeof(storedZlibHeader);
+    uint32_t crc = beginChunk("IDAT", header + sizeof(finalStoredBlock) + 4);
+
+    if (header)
+        put(storedZlibHeader, header, crc);
+
+    uint8_t adler[4];
+    putBE32(adler, static_cast<uint32_t>(m_adler));
+
+    put(finalStoredBlock, sizeof(finalStoredBlock), crc);
+    put(adler, sizeof(adler), crc);
+    endChunk(crc);
+
+    return !m_failed;
+}
+
+
+
+void PNGWriter::end()
+{
+    chunk("IEND", nullptr, 0);
+}
+
+
+
+bool PNGWriter::rewrite(uint32_t height, const uint8_t* data, size_t length)
+{
+    if (m_failed || length != m_head.size())
+        return false;
+
+    putBE32(m_header + 4, height);
+    m_head.assign(data, data + length);
+
+    const std::vector<uint8_t> head = storedHead();
+
+    uint8_t adler[4];
+    putBE32(adler, static_cast<uint32_t>(streamAdler()));
+
+    const std::vector<uint8_t> chunks[] = {
+        chunkBytes("IHDR", m_header, sizeof(m_header)),
+        chunkBytes("IDAT", head.data(), head.size()),
+        chunkBytes("IDAT", adler, sizeof(adler))
+    };
+
+    const uint64_t offsets[] = { sizeof(signature), m_headOffset, m_adlerOffset };
+
+    if (!m_sink.flush())
+        return false;
+
+    for (size_t i{ 0 }; i < std::size(chunks); ++i)
+    {
+        if (!m_sink.writeAt(offsets[i], chunks[i].data(), chunks[i].size()))
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,162 @@
+#ifndef _PNGWRITER_H_
+#define _PNGWRITER_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include <zlib.h>
+
+#include "ByteSink.hpp"
+#include "CompressionProfile.hpp"
+
+
+
+/**
+* @brief Continues the CRC-32 PNG puts after every chunk (zlib's polynomial) over more bytes, starting from 0.
+*        Folds 64 bytes at a time with PCLMULQDQ where the CPU has it, and leaves the rest to zlib's crc32().
+*/
+uint32_t pngCrc32(uint32_t crc, const uint8_t*, size_t);
+
+/**
+* @brief Which pngCrc32() implementation this machine runs: "pclmul" or "zlib".
+*/
+const char* pngCrc32Implementation();
+
+
+
+/**
+* @brief Writes the PNGs Imageify makes, in any of its pixel formats and without interlacing, straight to a sink.
+*
+* libpng's writer is general: it tries every filter on every row, copies each row into its own
+* buffers and runs every chunk through the same generic path. Imageify's rows are bytes rather
+* than photographs, so here they arrive already filtered with None and are deflated as given.
+* Level 0 bypasses deflate entirely and frames the rows as stored blocks.
+*
+* Call begin(), then chunk() for anything ahead of the image data, beginImage(), imageData()
+* for consecutive runs of filtered rows, endImage(), any trailing chunk() calls and end().
+*
+* An image whose height is not known up front starts its data with imageHead(). Those rows
+* stay stored as they are, the rest is deflated without a zlib header or trailer of its own,
+* and rewrite() then fixes the height and the head rows, with every CRC and the Adler-32 over them.
+*/
+class PNGWriter
+{
+private:
+
+	ByteSink& m_sink;
+	bool m_failed{ false };
+
+	// Bytes given to the sink so far, and the IHDR fields as written
+	uint64_t m_written{ 0 };
+	uint8_t m_header[13]{};
+
+	compressionSettings_t m_compression{};
+
+	z_stream m_stream{};
+	bool m_deflating{ false };
+
+	// Stored blocks keep their own Adler-32 and zlib header, deflate keeps them in m_stream
+	uLong m_adler{ 1 };
+	bool m_headerWritten{ false };
+
+	// Deflated bytes not yet written out as an IDAT chunk
+	std::vector<uint8_t> m_idat;
+
+	// The rows of imageHead() and where their IDAT starts, the Adler-32 and length of the rows
+	// after them, and where the IDAT holding the stream's Adler-32 starts
+	std::vector<uint8_t> m_head;
+	uint64_t m_headOffset{ 0 };
+	uLong m_tailAdler{ 1 };
+	uint64_t m_tailLength{ 0 };
+	uint64_t m_adlerOffset{ 0 };
+
+
+	/**
+	* @brief Writes bytes to the sink, or bytes of the chunk being written, extending its CRC.
+	*/
+	void write(const uint8_t*, size_t);
+	void put(const uint8_t*, size_t, uint32_t& crc);
+
+	/**
+	* @brief Writes a chunk's length and name, returning the CRC of the name to continue.
+	*/
+	uint32_t beginChunk(const char* name, size_t length);
+	void endChunk(uint32_t crc);
+
+	void storeRows(const uint8_t*, size_t);
+	bool deflateRows(const uint8_t*, size_t, int flush);
+
+	/**
+	* @brief The zlib header and the head rows framed as stored blocks, the data of the first IDAT.
+	*/
+	std::vector<uint8_t> storedHead() const;
+
+	/**
+	* @brief Adler-32 of the whole zlib stream after imageHead(), from the head and the rows after it.
+	*/
+	uLong streamAdler() const;
+
+public:
+
+	// Filtered bytes per IDAT chunk, stored or deflated
+	static constexpr size_t idatBytes = 256 * 1024;
+
+	explicit PNGWriter(ByteSink&);
+	~PNGWriter();
+
+	PNGWriter(const PNGWriter&) = delete;
+	PNGWriter& operator=(const PNGWriter&) = delete;
+
+	/**
+	* @brief Writes the signature and IHDR.
+	*/
+	void begin(uint32_t width, uint32_t height, uint8_t bitDepth, uint8_t colorType);
+
+	/**
+	* @brief Writes one whole chunk.
+	*/
+	void chunk(const char* name, const uint8_t*, size_t);
+
+	/**
+	* @brief Starts the zlib stream with the given level, strategy and memory level. Filters are ignored.
+	*/
+	bool beginImage(const compressionSettings_t&);
+
+	/**
+	* @brief Stores the first filtered rows as they are, in an IDAT of their own, so rewrite() can
+	*        change them later. Only straight after beginImage().
+	*/
+	bool imageHead(const uint8_t*, size_t);
+
+	/**
+	* @brief Compresses the next filtered rows, each a filter type byte followed by the row.
+	*/
+	bool imageData(const uint8_t*, size_t);
+
+	/**
+	* @brief Finishes the zlib stream and writes what is left of it.
+	*/
+	bool endImage();
+
+	/**
+	* @brief Writes IEND.
+	*/
+	void end();
+
+	/**
+	* @brief After end(), rewrites the height in IHDR and the rows given to imageHead(), which keep
+	*        their length. Needs a sink that takes writeAt() over bytes it was given.
+	*/
+	bool rewrite(uint32_t height, const uint8_t*, size_t);
+
+	/**
+	* @brief True once the sink has refused a write.
+	*/
+	bool failed() const { return m_failed; }
+};
+
+
+#endif // !_PNGWRITER_H_
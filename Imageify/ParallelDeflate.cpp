@@ -0,0 +1,189 @@
+#include "ParallelDeflate.hpp"
+
+#include <algorithm>
+#include <deque>
+
+
+
+ParallelDeflate::ParallelDeflate(ThreadPool& pool, CodecStats& stats, const compressionSettings_t& compression, bool independentBlocks, size_t blockBytes) :
+    m_pool{ pool },
+    m_stats{ stats },
+    m_compression{ compression },
+    m_independentBlocks{ independentBlocks },
+    m_blockBytes{ std::max<size_t>(1, blockBytes) }
+{
+}
+
+
+
+ParallelDeflate::block_t ParallelDeflate::compressBlock(size_t rowBytes, size_t firstRow, size_t rowCount, bool isFirst, bool isLast, const RowSource& source) const
+{
+    block_t block;
+
+    const size_t lineBytes = rowBytes + 1;
+
+    // Rows before the block, re-filtered here so the dictionary matches what the previous block saw
+    const size_t dictionaryRows = (isFirst || m_independentBlocks) ? 0 : std::min(firstRow, (windowBytes + lineBytes - 1) / lineBytes);
+
+    std::vector<uint8_t> filtered((dictionaryRows + rowCount) * lineBytes);
+
+    auto started = m_stats.start();
+
+    for (size_t i{ 0 }; i < dictionaryRows + rowCount; ++i)
+    {
+        uint8_t* line = filtered.data() + i * lineBytes;
+
+        line[0] = 0; // Filter type None
+        source(firstRow - dictionaryRows + i, line + 1);
+    }
+
+    m_stats.stop(CodecStage::Pack, started, filtered.size());
+    started = m_stats.start();
+
+    const uint8_t* input = filtered.data() + dictionaryRows * lineBytes;
+    block.length = rowCount * lineBytes;
+    block.adler = adler32(adler32(0, nullptr, 0), input, static_cast<uInt>(block.length));
+
+
+    z_stream stream{};
+    if (deflateInit2(&stream, m_compression.level, Z_DEFLATED, -MAX_WBITS, m_compression.memLevel, m_compression.strategy) != Z_OK)
+        return block;
+
+    if (dictionaryRows)
+    {
+        const size_t dictionaryBytes = std::min(windowBytes, dictionaryRows * lineBytes);
+        deflateSetDictionary(&stream, input - dictionaryBytes, static_cast<uInt>(dictionaryBytes));
+    }
+
+
+    // Zlib header goes in front of the first block, the trailer is appended by compress()
+    size_t written{ 0 };
+    block.data.resize(deflateBound(&stream, static_cast<uLong>(block.length)) + 16);
+
+    if (isFirst)
+    {
+        // FLEVEL is informational only, but mirror what zlib itself would write
+        const int level = m_compression.level;
+
+        unsigned levelFlag{ 2 };
+        if (level == 0 || level == 1 || m_compression.strategy >= Z_HUFFMAN_ONLY)
+            levelFlag = 0;
+        else if (level >= 2 && level <= 5)
+            levelFlag = 1;
+        else if (level >= 7)
+            levelFlag = 3;
+
+        const unsigned cmf = 0x78;
+        unsigned flg = levelFlag << 6;
+        flg += 31 - ((cmf << 8) + flg) % 31;
+
+        block.data[0] = static_cast<uint8_t>(cmf);
+        block.data[1] = static_cast<uint8_t>(flg);
+        written = 2;
+        block.headerBytes = written;
+    }
+
+    stream.next_in = const_cast<Bytef*>(input);
+    stream.avail_in = static_cast<uInt>(block.length);
+
+    const int flush = isLast ? Z_FINISH : Z_SYNC_FLUSH;
+    int status{ Z_OK };
+
+    do
+    {
+        if (written == block.data.size())
+            block.data.resize(block.data.size() * 2);
+
+        stream.next_out = block.data.data() + written;
+        stream.avail_out = static_cast<uInt>(block.data.size() - written);
+
+        status = deflate(&stream, flush);
+        written = block.data.size() - stream.avail_out;
+
+    } while (status == Z_OK && (stream.avail_out == 0 || flush == Z_FINISH));
+
+    deflateEnd(&stream);
+
+    block.data.resize(written);
+    m_stats.stop(CodecStage::Deflate, started, block.length);
+
+    block.ok = isLast ? (status == Z_STREAM_END) : (status == Z_OK || status == Z_BUF_ERROR);
+
+    return block;
+}
+
+
+
+PNGManipErrorCode ParallelDeflate::compress(size_t rowBytes, size_t rowCount, const RowSource& source, const StreamSink& sink)
+{
+    const size_t rowsPerBlock = std::max<size_t>(1, m_blockBytes / (rowBytes + 1));
+    const size_t blockCount = (rowCount + rowsPerBlock - 1) / rowsPerBlock;
+
+    // Keep a bounded number of blocks in flight so memory stays flat
+    const size_t maxInFlight = 2 * m_pool.size();
+
+    std::deque<std::future<block_t>> inFlight;
+    size_t nextBlock{ 0 };
+
+    auto submitNext = [&]()
+    {
+        const size_t firstRow = nextBlock * rowsPerBlock;
+        const size_t count = std::min(rowsPerBlock, rowCount - firstRow);
+        const bool isFirst = (nextBlock == 0);
+        const bool isLast = (nextBlock + 1 == blockCount);
+
+        inFlight.push_back(m_pool.submit([this, rowBytes, firstRow, count, isFirst, isLast, &source]()
+        {
+            return compressBlock(rowBytes, firstRow, count, isFirst, isLast, source);
+        }));
+
+        ++nextBlock;
+    };
+
+
+    uLong adler = adler32(0, nullptr, 0);
+    uint64_t streamOffset{ 0 };
+    bool failed{ false };
+
+    m_blocks.clear();
+    m_blocks.reserve(blockCount);
+
+    while (nextBlock < blockCount && inFlight.size() < maxInFlight)
+        submitNext();
+
+    while (!inFlight.empty())
+    {
+        block_t block = inFlight.front().get();
+        inFlight.pop_front();
+
+        // Keep draining on failure, the workers still reference our locals
+        failed = failed || !block.ok;
+
+        if (!failed)
+        {
+            adler = adler32_combine(adler, block.adler, static_cast<z_off_t>(block.length));
+
+            const size_t firstRow = m_blocks.size() * rowsPerBlock;
+            m_blocks.push_back({
+                static_cast<uint32_t>(firstRow),
+                static_cast<uint32_t>(std::min(rowsPerBlock, rowCount - firstRow)),
+                streamOffset + block.headerBytes,
+                block.data.size() - block.headerBytes
+            });
+
+            if (inFlight.empty() && nextBlock == blockCount)
+            {
+                for (int shift{ 24 }; shift >= 0; shift -= 8)
+                    block.data.push_back(static_cast<uint8_t>(adler >> shift));
+            }
+
+            streamOffset += block.data.size();
+            sink(block.data.data(), block.data.size());
+        }
+
+        if (!failed && nextBlock < blockCount)
+            submitNext();
+    }
+
+    return failed ? PNGManipErrorCode::EncodingError : PNGManipErrorCode::Success;
+}
@@ -0,0 +1,83 @@
+#ifndef _PARALLELDEFLATE_H_
+#define _PARALLELDEFLATE_H_
+
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include <zlib.h>
+
+#include "BandIndex.hpp"
+#include "CodecStats.hpp"
+#include "CompressionProfile.hpp"
+#include "ErrorHandling.hpp"
+#include "ThreadPool.hpp"
+
+
+
+/**
+* @brief Compresses PNG scanlines into one zlib stream using a thread pool, the way pigz does.
+*
+* Rows are split into blocks that are filtered and deflated independently. Every block but
+* the last ends on a sync flush, so the pieces are byte aligned and simply concatenate, and
+* each block is primed with the last 32 KB of its predecessor to keep the ratio close to a
+* serial deflate. The Adler-32 checksums of the blocks are combined for the zlib trailer.
+*
+* With independent blocks the dictionary priming is skipped, so every block can later be
+* inflated on its own; blocks() then describes them as bands for the ifBI index.
+*/
+class ParallelDeflate
+{
+public:
+
+	// Fills one unfiltered scanline of the image; called concurrently from the workers
+	using RowSource = std::function<void(size_t row, uint8_t* out)>;
+
+	// Receives consecutive pieces of the zlib stream, in order, on the calling thread
+	using StreamSink = std::function<void(const uint8_t* data, size_t length)>;
+
+private:
+
+	struct block_t
+	{
+		std::vector<uint8_t> data;
+		uLong adler{ 0 };
+		size_t length{ 0 };
+		size_t headerBytes{ 0 };
+		bool ok{ false };
+	};
+
+	ThreadPool& m_pool;
+	CodecStats& m_stats;
+	const compressionSettings_t m_compression;
+	const bool m_independentBlocks;
+
+	// Filtered bytes handed to each worker
+	const size_t m_blockBytes;
+	static constexpr size_t windowBytes = 32 * 1024;
+
+	std::vector<band_t> m_blocks;
+
+	block_t compressBlock(size_t rowBytes, size_t firstRow, size_t rowCount, bool isFirst, bool isLast, const RowSource&) const;
+
+public:
+
+	static constexpr size_t defaultBlockBytes = 256 * 1024;
+
+	ParallelDeflate(ThreadPool&, CodecStats&, const compressionSettings_t&, bool independentBlocks = false, size_t blockBytes = defaultBlockBytes);
+
+	/**
+	* @brief Deflates rowCount scanlines of rowBytes bytes each, filter type None.
+	*/
+	PNGManipErrorCode compress(size_t rowBytes, size_t rowCount, const RowSource&, const StreamSink&);
+
+	/**
+	* @brief Where each block of the last compress() call landed in the zlib stream.
+	*/
+	const std::vector<band_t>& blocks() const { return m_blocks; }
+};
+
+
+#endif // !_PARALLELDEFLATE_H_
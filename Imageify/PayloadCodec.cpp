@@ -0,0 +1,526 @@
+#include "PayloadCodec.hpp"
+#include "Checksum.hpp"
+#include "Platform.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include <zlib.h>
+
+#ifdef IMAGEIFY_HAVE_ZSTD
+    #include <zstd.h>
+#endif
+
+
+
+// Layout: version, codec, level, 1 reserved byte, original size, stored size, CRC-32C of the original.
+// CRC-32C like ifCK, so one checksum covers the payload everywhere; zlib's CRC-32 is left to PNG's chunks
+static constexpr size_t headerBytes = 4 + 8 + 8 + 4;
+
+// Layout: version, flags, 2 reserved bytes, index, count, offset, length, total size
+static constexpr size_t shardHeaderBytes = 4 + 4 + 4 + 8 + 8 + 8;
+
+// Input is read and output produced in pieces of this size, so neither side is held twice
+static constexpr size_t chunkBytes = 1024 * 1024;
+
+
+
+bool parsePayloadCodec(const std::string& text, PayloadCodec& codec, int& level)
+{
+    const size_t separator = text.find(':');
+    const std::string name = text.substr(0, separator);
+
+    if (name == "none")
+        codec = PayloadCodec::None;
+    else if (name == "deflate")
+        codec = PayloadCodec::Deflate;
+    else if (name == "zstd")
+        codec = PayloadCodec::Zstd;
+    else
+        return false;
+
+    level = payloadDefaultLevel;
+
+    if (separator == std::string::npos)
+        return true;
+
+    char* end{};
+    const long parsed = std::strtol(text.c_str() + separator + 1, &end, 10);
+
+    const long maxLevel = (codec == PayloadCodec::Zstd) ? 22 : 9;
+    if (*end != '\0' || end == text.c_str() + separator + 1 || parsed < 1 || parsed > maxLevel)
+        return false;
+
+    level = static_cast<int>(parsed);
+    return true;
+}
+
+
+
+const char* payloadCodecName(PayloadCodec codec)
+{
+    switch (codec)
+    {
+        case PayloadCodec::None: return "none";
+
+        case PayloadCodec::Deflate: return "deflate";
+
+        case PayloadCodec::Zstd: return "zstd";
+
+        default: return "unknown";
+    }
+}
+
+
+
+bool payloadCodecAvailable(PayloadCodec codec)
+{
+#ifdef IMAGEIFY_HAVE_ZSTD
+    return codec <= PayloadCodec::Zstd;
+#else
+    return codec <= PayloadCodec::Deflate;
+#endif
+}
+
+
+
+std::vector<uint8_t> serializePayloadHeader(const payloadHeader_t& header)
+{
+    std::vector<uint8_t> out;
+    out.reserve(headerBytes);
+
+    out.push_back(header.version);
+    out.push_back(static_cast<uint8_t>(header.codec));
+    out.push_back(static_cast<uint8_t>(static_cast<int8_t>(header.level)));
+    out.push_back(0x00);
+    putBE64(out, header.originalSize);
+    putBE64(out, header.storedSize);
+    putBE32(out, header.checksum);
+
+    return out;
+}
+
+
+
+bool parsePayloadHeader(const uint8_t* data, size_t length, payloadHeader_t& header)
+{
+    // Later versions may append fields, but must keep these where they are
+    if (length < headerBytes || data[0] == 0 || data[0] > payloadHeaderVersion)
+        return false;
+
+    header.version      = data[0];
+    header.codec        = static_cast<PayloadCodec>(data[1]);
+    header.level        = static_cast<int8_t>(data[2]);
+    header.originalSize = getBE64(data + 4);
+    header.storedSize   = getBE64(data + 12);
+    header.checksum     = getBE32(data + 20);
+
+    return true;
+}
+
+
+
+
+std::vector<uint8_t> serializeShardHeader(const shardHeader_t& shard)
+{
+    std::vector<uint8_t> out;
+    out.reserve(shardHeaderBytes);
+
+    out.push_back(shard.version);
+    out.push_back(shard.flags);
+    out.insert(out.end(), 2, 0x00);
+    putBE32(out, shard.index);
+    putBE32(out, shard.count);
+    putBE64(out, shard.offset);
+    putBE64(out, shard.length);
+    putBE64(out, shard.totalSize);
+
+    return out;
+}
+
+
+
+bool parseShardHeader(const uint8_t* data, size_t length, shardHeader_t& shard)
+{
+    if (length < shardHeaderBytes || data[0] == 0 || data[0] > shardHeaderVersion)
+        return false;
+
+    shard.version   = data[0];
+    shard.flags     = data[1];
+    shard.index     = getBE32(data + 4);
+    shard.count     = getBE32(data + 8);
+    shard.offset    = getBE64(data + 12);
+    shard.length    = getBE64(data + 20);
+    shard.totalSize = getBE64(data + 28);
+
+    // Frames before the last of a stream cannot know where it ends
+    if ((shard.flags & shardStreamed) && !(shard.flags & shardFinal))
+        return shard.count == 0 && shard.totalSize == 0;
+
+    return shard.index < shard.count && shard.offset <= shard.totalSize && shard.length <= shard.totalSize - shard.offset;
+}
+
+
+
+std::vector<shardHeader_t> planShards(uint64_t totalSize, uint64_t shardBytes)
+{
+    const uint64_t count = std::max<uint64_t>(1, (totalSize + shardBytes - 1) / shardBytes);
+
+    std::vector<shardHeader_t> shards(static_cast<size_t>(count));
+
+    for (uint32_t i{ 0 }; i < shards.size(); ++i)
+    {
+        shards[i].index = i;
+        shards[i].count = static_cast<uint32_t>(count);
+        shards[i].offset = i * shardBytes;
+        shards[i].length = std::min(shardBytes, totalSize - shards[i].offset);
+        shards[i].totalSize = totalSize;
+    }
+
+    return shards;
+}
+
+
+
+
+/**
+* Deflate -----------------------------------
+*/
+
+static PNGManipErrorCode deflatePayload(ByteSource& input, ByteSink& output, payloadHeader_t& header)
+{
+    z_stream stream{};
+    if (deflateInit(&stream, header.level == payloadDefaultLevel ? Z_DEFAULT_COMPRESSION : header.level) != Z_OK)
+        return PNGManipErrorCode::MemoryAllocationError;
+
+    std::vector<uint8_t> in(static_cast<size_t>(std::min<uint64_t>(input.size(), chunkBytes)));
+    std::vector<uint8_t> out(chunkBytes);
+
+    uint64_t remaining = input.size();
+    uint32_t checksum{ 0 };
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+
+    int status{ Z_OK };
+
+    while (status != Z_STREAM_END && result == PNGManipErrorCode::Success)
+    {
+        const size_t take = static_cast<size_t>(std::min<uint64_t>(remaining, chunkBytes));
+
+        if (take && !input.read(in.data(), take))
+        {
+            result = PNGManipErrorCode::FileNotReadable;
+            break;
+        }
+
+        remaining -= take;
+        checksum = crc32c(checksum, in.data(), take);
+
+        stream.next_in = in.data();
+        stream.avail_in = static_cast<uInt>(take);
+
+        const int flush = remaining ? Z_NO_FLUSH : Z_FINISH;
+
+        // Drain everything this piece produces before reading the next one
+        do
+        {
+            stream.next_out = out.data();
+            stream.avail_out = static_cast<uInt>(out.size());
+
+            status = deflate(&stream, flush);
+
+            if (status == Z_STREAM_ERROR)
+            {
+                result = PNGManipErrorCode::EncodingError;
+                break;
+            }
+
+            const size_t produced = out.size() - stream.avail_out;
+            if (!output.write(out.data(), produced))
+            {
+                result = PNGManipErrorCode::MemoryAllocationError;
+                break;
+            }
+
+            header.storedSize += produced;
+        } while (stream.avail_out == 0);
+    }
+
+    deflateEnd(&stream);
+
+    header.checksum = checksum;
+    return result;
+}
+
+
+
+static PNGManipErrorCode inflatePayload(const uint8_t* data, size_t size, uint64_t rangeEnd, std::vector<uint8_t>& out, uint64_t& produced, uint32_t& checksum, const auto& emit)
+{
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK)
+        return PNGManipErrorCode::MemoryAllocationError;
+
+    uint32_t crc{ 0 };
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+
+    size_t consumed{ 0 };
+    int status{ Z_OK };
+
+    while (status != Z_STREAM_END && produced < rangeEnd)
+    {
+        if (stream.avail_in == 0)
+        {
+            const size_t take = std::min<size_t>(size - consumed, chunkBytes);
+
+            stream.next_in = const_cast<Bytef*>(data + consumed);
+            stream.avail_in = static_cast<uInt>(take);
+            consumed += take;
+        }
+
+        stream.next_out = out.data();
+        stream.avail_out = static_cast<uInt>(out.size());
+
+        status = inflate(&stream, Z_NO_FLUSH);
+
+        // Z_BUF_ERROR with nothing left to give it means the stream was cut short
+        if (status != Z_OK && status != Z_STREAM_END && !(status == Z_BUF_ERROR && consumed < size))
+        {
+            result = PNGManipErrorCode::DecodingError;
+            break;
+        }
+
+        const size_t length = out.size() - stream.avail_out;
+        crc = crc32c(crc, out.data(), length);
+
+        if (!emit(out.data(), length))
+        {
+            result = PNGManipErrorCode::FileNotWritable;
+            break;
+        }
+
+        produced += length;
+    }
+
+    inflateEnd(&stream);
+
+    checksum = crc;
+    return result;
+}
+
+
+
+
+/**
+* Zstd -----------------------------------
+*/
+
+#ifdef IMAGEIFY_HAVE_ZSTD
+
+static PNGManipErrorCode zstdCompressPayload(ByteSource& input, ByteSink& output, payloadHeader_t& header, unsigned threads)
+{
+    ZSTD_CCtx* context = ZSTD_createCCtx();
+    if (!context)
+        return PNGManipErrorCode::MemoryAllocationError;
+
+    ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, header.level == payloadDefaultLevel ? ZSTD_CLEVEL_DEFAULT : header.level);
+    ZSTD_CCtx_setPledgedSrcSize(context, input.size());
+
+    // Fails quietly on a libzstd built without threads, which then compresses on this one
+    if (threads != 1)
+        ZSTD_CCtx_setParameter(context, ZSTD_c_nbWorkers, static_cast<int>(threads));
+
+    std::vector<uint8_t> in(static_cast<size_t>(std::min<uint64_t>(input.size(), chunkBytes)));
+    std::vector<uint8_t> out(ZSTD_CStreamOutSize());
+
+    uint64_t remaining = input.size();
+    uint32_t checksum{ 0 };
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+
+    bool finished{ false };
+
+    while (!finished && result == PNGManipErrorCode::Success)
+    {
+        const size_t take = static_cast<size_t>(std::min<uint64_t>(remaining, chunkBytes));
+
+        if (take && !input.read(in.data(), take))
+        {
+            result = PNGManipErrorCode::FileNotReadable;
+            break;
+        }
+
+        remaining -= take;
+        checksum = crc32c(checksum, in.data(), take);
+
+        const ZSTD_EndDirective mode = remaining ? ZSTD_e_continue : ZSTD_e_end;
+        ZSTD_inBuffer source{ in.data(), take, 0 };
+
+        // Drain everything this piece produces before reading the next one
+        do
+        {
+            ZSTD_outBuffer target{ out.data(), out.size(), 0 };
+            const size_t pending = ZSTD_compressStream2(context, &target, &source, mode);
+
+            if (ZSTD_isError(pending))
+            {
+                result = PNGManipErrorCode::EncodingError;
+                break;
+            }
+
+            if (!output.write(out.data(), target.pos))
+            {
+                result = PNGManipErrorCode::MemoryAllocationError;
+                break;
+            }
+
+            header.storedSize += target.pos;
+            finished = (mode == ZSTD_e_end) ? (pending == 0) : (source.pos == source.size);
+        } while (!finished);
+
+        finished = finished && mode == ZSTD_e_end;
+    }
+
+    ZSTD_freeCCtx(context);
+
+    header.checksum = checksum;
+    return result;
+}
+
+
+
+static PNGManipErrorCode zstdDecompressPayload(const uint8_t* data, size_t size, uint64_t rangeEnd, std::vector<uint8_t>& out, uint64_t& produced, uint32_t& checksum, const auto& emit)
+{
+    ZSTD_DCtx* context = ZSTD_createDCtx();
+    if (!context)
+        return PNGManipErrorCode::MemoryAllocationError;
+
+    uint32_t crc{ 0 };
+    PNGManipErrorCode result{ PNGManipErrorCode::Success };
+
+    ZSTD_inBuffer source{ data, size, 0 };
+    size_t pending{ 1 };
+
+    while (pending != 0 && produced < rangeEnd)
+    {
+        ZSTD_outBuffer target{ out.data(), out.size(), 0 };
+        pending = ZSTD_decompressStream(context, &target, &source);
+
+        // Input used up mid-frame with nothing more produced means it was cut short
+        if (ZSTD_isError(pending) || (pending != 0 && target.pos == 0 && source.pos == source.size))
+        {
+            result = PNGManipErrorCode::DecodingError;
+            break;
+        }
+
+        crc = crc32c(crc, out.data(), target.pos);
+
+        if (!emit(out.data(), target.pos))
+        {
+            result = PNGManipErrorCode::FileNotWritable;
+            break;
+        }
+
+        produced += target.pos;
+    }
+
+    ZSTD_freeDCtx(context);
+
+    checksum = crc;
+    return result;
+}
+
+#endif
+
+
+
+
+PNGManipErrorCode compressPayload(ByteSource& input, ByteSink& output, payloadHeader_t& header, [[maybe_unused]] unsigned threads, CodecStats& stats)
+{
+    header.version = payloadHeaderVersion;
+    header.originalSize = input.size();
+    header.storedSize = 0;
+
+    if (!payloadCodecAvailable(header.codec))
+        return PNGManipErrorCode::EncodingError;
+
+    const auto started = stats.start();
+    PNGManipErrorCode result{ PNGManipErrorCode::EncodingError };
+
+    switch (header.codec)
+    {
+        case PayloadCodec::Deflate:
+            result = deflatePayload(input, output, header);
+            break;
+
+#ifdef IMAGEIFY_HAVE_ZSTD
+        case PayloadCodec::Zstd:
+            result = zstdCompressPayload(input, output, header, threads);
+            break;
+#endif
+
+        default:
+            break;
+    }
+
+    stats.stop(CodecStage::Precompress, started, header.originalSize);
+
+    return result;
+}
+
+
+
+PNGManipErrorCode decompressPayload(const payloadHeader_t& header, const uint8_t* data, size_t size, uint64_t rangeStart, uint64_t rangeEnd, ByteSink& output, CodecStats& stats)
+{
+    if (!payloadCodecAvailable(header.codec) || size != header.storedSize)
+        return PNGManipErrorCode::DecodingError;
+
+    std::vector<uint8_t> out(chunkBytes);
+    uint64_t produced{ 0 };
+    uint32_t checksum{ 0 };
+
+    // Only the part of each piece inside the range goes out; the writes are counted by the sink
+    uint64_t writeNanoseconds{ 0 };
+
+    auto emit = [&](const uint8_t* bytes, size_t length)
+    {
+        const uint64_t from = std::max(produced, rangeStart);
+        const uint64_t to = std::min(produced + length, rangeEnd);
+
+        if (from >= to)
+            return true;
+
+        const uint64_t before = stats.totals(CodecStage::Write).nanoseconds;
+        const bool ok = output.write(bytes + (from - produced), static_cast<size_t>(to - from));
+        writeNanoseconds += stats.totals(CodecStage::Write).nanoseconds - before;
+
+        return ok;
+    };
+
+    const auto started = stats.start();
+    PNGManipErrorCode result{ PNGManipErrorCode::DecodingError };
+
+    switch (header.codec)
+    {
+        case PayloadCodec::Deflate:
+            result = inflatePayload(data, size, rangeEnd, out, produced, checksum, emit);
+            break;
+
+#ifdef IMAGEIFY_HAVE_ZSTD
+        case PayloadCodec::Zstd:
+            result = zstdDecompressPayload(data, size, rangeEnd, out, produced, checksum, emit);
+            break;
+#endif
+
+        default:
+            break;
+    }
+
+    stats.stop(CodecStage::Decompress, started, produced, writeNanoseconds);
+
+    if (result != PNGManipErrorCode::Success)
+        return result;
+
+    // Stopping at the end of a range leaves the rest of the payload unchecked
+    if (rangeStart == 0 && rangeEnd == header.originalSize && (produced != header.originalSize || checksum != header.checksum))
+        return PNGManipErrorCode::DecodingError;
+
+    return PNGManipErrorCode::Success;
+}
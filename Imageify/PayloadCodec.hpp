@@ -0,0 +1,142 @@
+#ifndef _PAYLOADCODEC_H_
+#define _PAYLOADCODEC_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "ErrorHandling.hpp"
+#include "ByteSink.hpp"
+#include "ByteSource.hpp"
+#include "CodecStats.hpp"
+
+
+// Private, ancillary, not safe to copy: the header describes exactly what the pixels hold
+constexpr char payloadHeaderChunkName[5] = "ifPH";
+constexpr uint8_t payloadHeaderVersion = 1;
+
+// Same kind of chunk, placing the payload of one image inside a larger one split across several
+constexpr char shardHeaderChunkName[5] = "ifSH";
+constexpr uint8_t shardHeaderVersion = 1;
+
+// Shard header flags. A streamed shard is one frame of a stream of PNGs written back to back,
+// where the count and total size are only known, and only set, in the final frame
+constexpr uint8_t shardStreamed = 0x01;
+constexpr uint8_t shardFinal = 0x02;
+
+
+
+/**
+* @brief General-purpose compressors run over the payload before it is packed into pixels.
+*
+* PNG's deflate only sees the payload through row filters built for photographs; a codec
+* made for byte streams gets text and other structured data much smaller. Zstd is only
+* available when the build found it.
+*/
+enum class PayloadCodec : uint8_t
+{
+	None = 0,
+	Deflate,
+	Zstd
+};
+
+// Level that picks the codec's own default, as Z_DEFAULT_COMPRESSION does for zlib
+constexpr int payloadDefaultLevel = -1;
+
+
+/**
+* @brief The self-describing header of a pre-compressed payload, stored in an ifPH chunk.
+*
+* With a header, the size prefix and the pixels hold the compressed bytes and the decoder
+* inflates them back to originalSize bytes, checking them against the CRC-32C.
+*/
+struct payloadHeader_t
+{
+	uint8_t version{ payloadHeaderVersion };
+	PayloadCodec codec{ PayloadCodec::None };
+	int level{ payloadDefaultLevel };
+
+	uint64_t originalSize{ 0 };
+	uint64_t storedSize{ 0 };
+	uint32_t checksum{ 0 };
+};
+
+
+
+/**
+* @brief Where one image of a shard set sits in the whole payload, stored in an ifSH chunk.
+*
+* Shard index of count holds payload bytes [offset, offset + length) of totalSize. The
+* shards tile the payload in index order. count is 0 for an image holding a whole payload,
+* and for every streamed frame but the final one.
+*/
+struct shardHeader_t
+{
+	uint8_t version{ shardHeaderVersion };
+	uint8_t flags{ 0 };
+	uint32_t index{ 0 };
+	uint32_t count{ 0 };
+
+	uint64_t offset{ 0 };
+	uint64_t length{ 0 };
+	uint64_t totalSize{ 0 };
+};
+
+
+
+/**
+* @brief Parses CODEC[:LEVEL] where CODEC is none, deflate or zstd. Returns false for anything else.
+*/
+bool parsePayloadCodec(const std::string&, PayloadCodec&, int& level);
+
+const char* payloadCodecName(PayloadCodec);
+
+/**
+* @brief Whether this build can compress and decompress with the codec.
+*/
+bool payloadCodecAvailable(PayloadCodec);
+
+/**
+* @brief Serializes a header into the payload of an ifPH chunk.
+*/
+std::vector<uint8_t> serializePayloadHeader(const payloadHeader_t&);
+
+/**
+* @brief Reads an ifPH chunk. Returns false if it is truncated or from a newer version.
+*/
+bool parsePayloadHeader(const uint8_t*, size_t, payloadHeader_t&);
+
+/**
+* @brief Serializes a shard header into the payload of an ifSH chunk.
+*/
+std::vector<uint8_t> serializeShardHeader(const shardHeader_t&);
+
+/**
+* @brief Reads an ifSH chunk. Returns false if it is truncated, from a newer version or inconsistent.
+*/
+bool parseShardHeader(const uint8_t*, size_t, shardHeader_t&);
+
+/**
+* @brief Splits a payload into shards of at most shardBytes each, at least one even for an empty payload.
+*/
+std::vector<shardHeader_t> planShards(uint64_t totalSize, uint64_t shardBytes);
+
+/**
+* @brief Compresses the whole source into the sink, filling in every field of the header.
+*        Zstd spreads the work over the given number of threads where the library supports it.
+*/
+PNGManipErrorCode compressPayload(ByteSource&, ByteSink&, payloadHeader_t&, unsigned threads, CodecStats&);
+
+/**
+* @brief Decompresses a stored payload, writing bytes [rangeStart, rangeEnd) of the original to the sink.
+*
+* A full decode checks the size and the checksum; a range stops decompressing at its end
+* and so cannot.
+*/
+PNGManipErrorCode decompressPayload(const payloadHeader_t&, const uint8_t*, size_t, uint64_t rangeStart, uint64_t rangeEnd, ByteSink&, CodecStats&);
+
+
+#endif // !_PAYLOADCODEC_H_
@@ -0,0 +1,66 @@
+#include "PixelFormat.hpp"
+
+#include <array>
+
+
+
+template <PixelFormat F>
+static constexpr pixelFormatInfo_t describe(const char* name)
+{
+    return { F, name, pixelTraits<F>::channels, pixelTraits<F>::bitDepth, pixelTraits<F>::colorType, static_cast<uint8_t>(bytesPerPixel<F>) };
+}
+
+// In enum order
+static constexpr std::array<pixelFormatInfo_t, 4> formats = {
+    describe<PixelFormat::RGBA8>("rgba8"),
+    describe<PixelFormat::Gray8>("gray8"),
+    describe<PixelFormat::RGB8>("rgb8"),
+    describe<PixelFormat::RGBA16>("rgba16")
+};
+
+
+
+const pixelFormatInfo_t& pixelFormatInfo(PixelFormat format)
+{
+    const size_t index = static_cast<size_t>(format);
+    return formats[index < formats.size() ? index : 0];
+}
+
+
+
+bool parsePixelFormat(const std::string& name, PixelFormat& format)
+{
+    for (const pixelFormatInfo_t& info : formats)
+    {
+        if (name == info.name)
+        {
+            format = info.format;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+
+const char* pixelFormatName(PixelFormat format)
+{
+    return pixelFormatInfo(format).name;
+}
+
+
+
+bool pixelFormatFromPNG(uint8_t colorType, uint8_t bitDepth, PixelFormat& format)
+{
+    for (const pixelFormatInfo_t& info : formats)
+    {
+        if (info.colorType == colorType && info.bitDepth == bitDepth)
+        {
+            format = info.format;
+            return true;
+        }
+    }
+
+    return false;
+}
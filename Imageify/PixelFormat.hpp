@@ -0,0 +1,160 @@
+#ifndef _PIXELFORMAT_H_
+#define _PIXELFORMAT_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <type_traits>
+
+#include <png.h>
+
+
+
+/**
+* @brief The PNG layouts the payload can be packed into, chosen with --format.
+*
+* The payload is a byte stream either way, and PNG stores 16-bit samples big-endian, so the
+* bytes of a row are the bytes of the stream in every format. What changes is the pixel
+* size, which sets the image geometry, the distance the Sub, Average and Paeth filters look
+* back, and so how well the rows filter and deflate.
+*/
+enum class PixelFormat : uint8_t
+{
+	RGBA8 = 0,
+	Gray8,
+	RGB8,
+	RGBA16
+};
+
+
+
+/**
+* @brief Compile-time description of a format: channels, bits per sample and the PNG colour type.
+*/
+template <PixelFormat> struct pixelTraits;
+
+template <> struct pixelTraits<PixelFormat::Gray8>
+{
+	static constexpr uint8_t channels = 1;
+	static constexpr uint8_t bitDepth = 8;
+	static constexpr uint8_t colorType = PNG_COLOR_TYPE_GRAY;
+};
+
+template <> struct pixelTraits<PixelFormat::RGB8>
+{
+	static constexpr uint8_t channels = 3;
+	static constexpr uint8_t bitDepth = 8;
+	static constexpr uint8_t colorType = PNG_COLOR_TYPE_RGB;
+};
+
+template <> struct pixelTraits<PixelFormat::RGBA8>
+{
+	static constexpr uint8_t channels = 4;
+	static constexpr uint8_t bitDepth = 8;
+	static constexpr uint8_t colorType = PNG_COLOR_TYPE_RGBA;
+};
+
+template <> struct pixelTraits<PixelFormat::RGBA16>
+{
+	static constexpr uint8_t channels = 4;
+	static constexpr uint8_t bitDepth = 16;
+	static constexpr uint8_t colorType = PNG_COLOR_TYPE_RGBA;
+};
+
+/**
+* @brief Bytes per pixel, which is also the stride the PNG filters use.
+*/
+template <PixelFormat F>
+constexpr size_t bytesPerPixel = pixelTraits<F>::channels * pixelTraits<F>::bitDepth / 8;
+
+
+
+/**
+* @brief One pixel as it sits in a row, samples in PNG byte order.
+*/
+template <PixelFormat> struct pixel;
+
+template <> struct pixel<PixelFormat::Gray8>
+{
+	uint8_t gray;
+};
+
+template <> struct pixel<PixelFormat::RGB8>
+{
+	uint8_t red;
+	uint8_t green;
+	uint8_t blue;
+};
+
+template <> struct alignas(4) pixel<PixelFormat::RGBA8>
+{
+	uint8_t red;
+	uint8_t green;
+	uint8_t blue;
+	uint8_t alpha;
+};
+
+template <> struct pixel<PixelFormat::RGBA16>
+{
+	// Most significant byte first
+	uint8_t red[2];
+	uint8_t green[2];
+	uint8_t blue[2];
+	uint8_t alpha[2];
+};
+
+// Rows are handed to libpng as raw bytes, so there must be no padding
+static_assert(sizeof(pixel<PixelFormat::Gray8>) == bytesPerPixel<PixelFormat::Gray8>, "Gray8 pixel must be tightly packed");
+static_assert(sizeof(pixel<PixelFormat::RGB8>) == bytesPerPixel<PixelFormat::RGB8>, "RGB8 pixel must be tightly packed");
+static_assert(sizeof(pixel<PixelFormat::RGBA8>) == bytesPerPixel<PixelFormat::RGBA8>, "RGBA8 pixel must be tightly packed");
+static_assert(sizeof(pixel<PixelFormat::RGBA16>) == bytesPerPixel<PixelFormat::RGBA16>, "RGBA16 pixel must be tightly packed");
+
+
+
+/**
+* @brief The same description at run time, for formats read from the command line or an IHDR.
+*/
+struct pixelFormatInfo_t
+{
+	PixelFormat format;
+	const char* name;
+
+	uint8_t channels;
+	uint8_t bitDepth;
+	uint8_t colorType;
+	uint8_t bytesPerPixel;
+};
+
+const pixelFormatInfo_t& pixelFormatInfo(PixelFormat);
+
+/**
+* @brief Parses gray8, rgb8, rgba8 or rgba16. Returns false for anything else.
+*/
+bool parsePixelFormat(const std::string&, PixelFormat&);
+
+const char* pixelFormatName(PixelFormat);
+
+/**
+* @brief The format with this IHDR colour type and bit depth. Returns false for any other PNG.
+*/
+bool pixelFormatFromPNG(uint8_t colorType, uint8_t bitDepth, PixelFormat&);
+
+/**
+* @brief Calls fn with the format as a std::integral_constant, so it can instantiate a kernel for it.
+*/
+template <typename Fn>
+decltype(auto) dispatchPixelFormat(PixelFormat format, Fn&& fn)
+{
+	switch (format)
+	{
+		case PixelFormat::Gray8:  return fn(std::integral_constant<PixelFormat, PixelFormat::Gray8>{});
+		case PixelFormat::RGB8:   return fn(std::integral_constant<PixelFormat, PixelFormat::RGB8>{});
+		case PixelFormat::RGBA16: return fn(std::integral_constant<PixelFormat, PixelFormat::RGBA16>{});
+		default:                  return fn(std::integral_constant<PixelFormat, PixelFormat::RGBA8>{});
+	}
+}
+
+
+#endif // !_PIXELFORMAT_H_
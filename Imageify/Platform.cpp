@@ -0,0 +1,102 @@
+#include "Platform.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define IMAGEIFY_PLATFORM_X86
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+#endif
+
+
+
+#if defined(IMAGEIFY_PLATFORM_X86) && defined(_MSC_VER)
+
+// ECX of leaf 1, EBX of leaf 7
+static uint32_t leaf1ECX()
+{
+    int info[4]{};
+    __cpuid(info, 1);
+    return static_cast<uint32_t>(info[2]);
+}
+
+static uint32_t leaf7EBX()
+{
+    int info[4]{};
+    __cpuidex(info, 7, 0);
+    return static_cast<uint32_t>(info[1]);
+}
+
+static uint64_t xcr0()
+{
+    return _xgetbv(0);
+}
+
+#elif defined(IMAGEIFY_PLATFORM_X86)
+
+static uint32_t leaf1ECX()
+{
+    unsigned eax{}, ebx{}, ecx{}, edx{};
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) ? ecx : 0;
+}
+
+static uint32_t leaf7EBX()
+{
+    unsigned eax{}, ebx{}, ecx{}, edx{};
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) ? ebx : 0;
+}
+
+static uint64_t xcr0()
+{
+    uint32_t low{}, high{};
+    __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+    return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+#endif
+
+
+
+
+/**
+* Public Functions -----------------------------------
+*/
+
+bool cpuHasSSE42()
+{
+#ifdef IMAGEIFY_PLATFORM_X86
+    return (leaf1ECX() & (1u << 20)) != 0;
+#else
+    return false;
+#endif
+}
+
+
+
+bool cpuHasPCLMUL()
+{
+#ifdef IMAGEIFY_PLATFORM_X86
+    const uint32_t ecx = leaf1ECX();
+    return (ecx & (1u << 1)) && (ecx & (1u << 19));
+#else
+    return false;
+#endif
+}
+
+
+
+bool cpuHasAVX2()
+{
+#ifdef IMAGEIFY_PLATFORM_X86
+    const uint32_t ecx = leaf1ECX();
+
+    // XGETBV needs OSXSAVE, and the OS has to save the YMM registers too
+    if (!(ecx & (1u << 27)) || !(ecx & (1u << 28)) || (xcr0() & 6) != 6)
+        return false;
+
+    return (leaf7EBX() & (1u << 5)) != 0;
+#else
+    return false;
+#endif
+}
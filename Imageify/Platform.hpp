@@ -0,0 +1,104 @@
+#ifndef _PLATFORM_H_
+#define _PLATFORM_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+
+
+/**
+* Byte order ------------------------------------------
+*
+* Imageify's own chunks store their fields big-endian, as PNG does. ChaCha20 and Poly1305
+* work on little-endian words. The vector forms append, the pointer forms write in place.
+*/
+
+inline void putBE16(std::vector<uint8_t>& out, uint16_t value)
+{
+	out.push_back(static_cast<uint8_t>(value >> 8));
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+inline void putBE32(std::vector<uint8_t>& out, uint32_t value)
+{
+	for (int shift{ 24 }; shift >= 0; shift -= 8)
+		out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+inline void putBE64(std::vector<uint8_t>& out, uint64_t value)
+{
+	putBE32(out, static_cast<uint32_t>(value >> 32));
+	putBE32(out, static_cast<uint32_t>(value));
+}
+
+inline void putBE32(uint8_t* out, uint32_t value)
+{
+	out[0] = static_cast<uint8_t>(value >> 24);
+	out[1] = static_cast<uint8_t>(value >> 16);
+	out[2] = static_cast<uint8_t>(value >> 8);
+	out[3] = static_cast<uint8_t>(value);
+}
+
+inline uint16_t getBE16(const uint8_t* data)
+{
+	return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+inline uint32_t getBE32(const uint8_t* data)
+{
+	return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16)
+		| (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+}
+
+inline uint64_t getBE64(const uint8_t* data)
+{
+	return (static_cast<uint64_t>(getBE32(data)) << 32) | getBE32(data + 4);
+}
+
+inline void putLE32(uint8_t* out, uint32_t value)
+{
+	for (int i{ 0 }; i < 4; ++i)
+		out[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+inline void putLE64(uint8_t* out, uint64_t value)
+{
+	putLE32(out, static_cast<uint32_t>(value));
+	putLE32(out + 4, static_cast<uint32_t>(value >> 32));
+}
+
+inline uint32_t getLE32(const uint8_t* data)
+{
+	return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8)
+		| (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+}
+
+inline uint64_t getLE64(const uint8_t* data)
+{
+	return static_cast<uint64_t>(getLE32(data)) | (static_cast<uint64_t>(getLE32(data + 4)) << 32);
+}
+
+
+
+/**
+* CPU features ----------------------------------------
+*
+* What the x86-64 CPU running us offers beyond the SSE2 every one has, for the kernels that
+* pick an implementation at run time. Always false on other CPUs. Each call asks CPUID
+* again, so callers keep the answer.
+*/
+
+// SSE 4.2, for the CRC-32C instruction
+bool cpuHasSSE42();
+
+// PCLMULQDQ together with SSE 4.1, for folding CRC-32
+bool cpuHasPCLMUL();
+
+// AVX2, with the OS saving the YMM registers
+bool cpuHasAVX2();
+
+
+#endif // !_PLATFORM_H_
@@ -0,0 +1,416 @@
+#include "ResultCache.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <system_error>
+#include <vector>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <sys/file.h>
+    #include <sys/ioctl.h>
+    #include <unistd.h>
+    #ifdef __linux__
+        #include <linux/fs.h>
+    #endif
+#endif
+
+
+namespace fs = std::filesystem;
+
+
+// Bumped whenever the same input and options would encode to different bytes
+static constexpr uint8_t cacheKeyVersion = 1;
+
+// Temporary files older than this were left by a process that died mid-encode
+static constexpr auto abandonedAfter = std::chrono::hours(1);
+
+static constexpr char entryExtension[] = ".png";
+static constexpr char temporaryExtension[] = ".part";
+
+
+
+
+/**
+* XXH64 ---------------------------------------------
+*/
+
+static constexpr uint64_t prime1 = 11400714785074694791ull;
+static constexpr uint64_t prime2 = 14029467366897019727ull;
+static constexpr uint64_t prime3 = 1609587929392839161ull;
+static constexpr uint64_t prime4 = 9650029242287828579ull;
+static constexpr uint64_t prime5 = 2870177450012600261ull;
+
+static uint64_t rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t read64(const uint8_t* data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint32_t read32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t round64(uint64_t accumulator, uint64_t input)
+{
+    return rotl(accumulator + input * prime2, 31) * prime1;
+}
+
+static uint64_t mergeRound(uint64_t hash, uint64_t accumulator)
+{
+    return (hash ^ round64(0, accumulator)) * prime1 + prime4;
+}
+
+// XXH64 of little-endian input, several GB/s on one core: hashing the input costs little
+// next to encoding it
+static uint64_t xxh64(const uint8_t* data, size_t length, uint64_t seed)
+{
+    const uint8_t* const end = data + length;
+    uint64_t hash;
+
+    if (length >= 32)
+    {
+        uint64_t lanes[4] = { seed + prime1 + prime2, seed + prime2, seed, seed - prime1 };
+
+        for (; end - data >= 32; data += 32)
+            for (int lane{ 0 }; lane < 4; ++lane)
+                lanes[lane] = round64(lanes[lane], read64(data + 8 * lane));
+
+        hash = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+
+        for (uint64_t lane : lanes)
+            hash = mergeRound(hash, lane);
+    }
+    else
+        hash = seed + prime5;
+
+    hash += length;
+
+    for (; end - data >= 8; data += 8)
+        hash = rotl(hash ^ round64(0, read64(data)), 27) * prime1 + prime4;
+
+    if (end - data >= 4)
+    {
+        hash = rotl(hash ^ (read32(data) * prime1), 23) * prime2 + prime3;
+        data += 4;
+    }
+
+    for (; data < end; ++data)
+        hash = rotl(hash ^ (*data * prime5), 11) * prime1;
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    hash *= prime3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+
+
+
+static std::string randomSuffix()
+{
+    static thread_local std::mt19937_64 random{ std::random_device{}() ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) };
+
+    char suffix[17];
+    std::snprintf(suffix, sizeof(suffix), "%016llx", static_cast<unsigned long long>(random()));
+
+    return suffix;
+}
+
+
+
+// Clones the file's blocks instead of copying them, on file systems that share extents
+static bool reflink(const std::string& from, const std::string& to)
+{
+#if defined(__linux__) && defined(FICLONE)
+    const int source = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source < 0)
+        return false;
+
+    const int target = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    const bool cloned = (target >= 0) && ::ioctl(target, FICLONE, source) == 0;
+
+    if (target >= 0)
+        ::close(target);
+
+    ::close(source);
+
+    if (!cloned && target >= 0)
+        ::unlink(to.c_str());
+
+    return cloned;
+#else
+    (void)from;
+    (void)to;
+    return false;
+#endif
+}
+
+
+
+
+/**
+* ResultCache ---------------------------------------
+*/
+
+ResultCache::ResultCache(const PNGCacheOptions& options) :
+    directory{ options.directory },
+    capacity{ options.capacityBytes }
+{
+}
+
+
+
+std::string ResultCache::entryPath(const std::string& key) const
+{
+    return (fs::path(directory) / (key + entryExtension)).string();
+}
+
+
+
+PNGManipErrorCode ResultCache::place(const std::string& from, const std::string& output) const
+{
+    // Never written to in place, so an older output that is itself a link into the cache is left alone
+    const std::string staged = output + ".imageify-" + randomSuffix();
+    std::error_code error;
+
+    if (!reflink(from, staged))
+    {
+        fs::create_hard_link(from, staged, error);
+
+        if (error)
+        {
+            error.clear();
+            fs::copy_file(from, staged, error);
+
+            // A copy is the output's own, and need not stay read-only like the cached image
+            if (!error)
+                fs::permissions(staged, fs::perms::owner_write, fs::perm_options::add, error);
+        }
+    }
+
+    // rename() does nothing at all when both names are links to one file, as when the output
+    // already is this cached image
+    if (!error && fs::equivalent(staged, output, error))
+    {
+        fs::remove(staged, error);
+        return PNGManipErrorCode::Success;
+    }
+
+    error.clear();
+    fs::rename(staged, output, error);
+
+    if (error)
+    {
+        std::error_code ignored;
+        fs::remove(staged, ignored);
+        return PNGManipErrorCode::FileNotWritable;
+    }
+
+    return PNGManipErrorCode::Success;
+}
+
+
+
+void ResultCache::evict() const
+{
+#ifndef _WIN32
+    // One process trims at a time, the others leave it to that one
+    const int lock = ::open((fs::path(directory) / ".lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock < 0)
+        return;
+
+    if (::flock(lock, LOCK_EX | LOCK_NB) != 0)
+    {
+        ::close(lock);
+        return;
+    }
+#endif
+
+    struct entry_t
+    {
+        fs::path path;
+        uint64_t size;
+        fs::file_time_type used;
+    };
+
+    std::vector<entry_t> entries;
+    uint64_t total{ 0 };
+
+    std::error_code error;
+    const auto now = fs::file_time_type::clock::now();
+
+    for (const auto& file : fs::directory_iterator(directory, error))
+    {
+        std::error_code fileError;
+        const fs::file_time_type used = file.last_write_time(fileError);
+        const uint64_t size = file.file_size(fileError);
+
+        // Another process may have evicted or renamed it since the listing
+        if (fileError)
+            continue;
+
+        if (file.path().extension() == temporaryExtension)
+        {
+            if (now - used > abandonedAfter)
+                fs::remove(file.path(), fileError);
+        }
+        else if (file.path().extension() == entryExtension)
+        {
+            entries.push_back({ file.path(), size, used });
+            total += size;
+        }
+    }
+
+    if (total > capacity)
+    {
+        std::sort(entries.begin(), entries.end(), [](const entry_t& a, const entry_t& b) { return a.used < b.used; });
+
+        for (const entry_t& entry : entries)
+        {
+            if (total <= capacity)
+                break;
+
+            fs::remove(entry.path, error);
+            total -= entry.size;
+        }
+    }
+
+#ifndef _WIN32
+    ::close(lock);
+#endif
+}
+
+
+
+bool ResultCache::accepts(uint64_t inputSize) const
+{
+    return !directory.empty() && inputSize <= capacity;
+}
+
+
+
+std::string ResultCache::key(std::span<const std::byte> input, const PNGManipOptions& options)
+{
+    // Only what changes the bytes written: not the queue depth, nor anything decode-only
+    std::vector<uint8_t> settings;
+    auto add = [&](uint64_t value) { for (int i{ 0 }; i < 8; ++i) settings.push_back(static_cast<uint8_t>(value >> (8 * i))); };
+
+    add(cacheKeyVersion);
+    add(options.streaming);
+    add(options.threads);
+    add(static_cast<uint64_t>(options.level));
+    add(static_cast<uint64_t>(options.profile));
+    add(static_cast<uint64_t>(options.precompress));
+    add(static_cast<uint64_t>(options.precompressLevel));
+    add(options.bands);
+    add(options.bandBytes);
+    add(options.pipeline);
+    add(options.nativeWriter);
+    add(static_cast<uint64_t>(options.format));
+
+    const uint64_t seed = xxh64(settings.data(), settings.size(), 0);
+    const uint64_t hash = xxh64(reinterpret_cast<const uint8_t*>(input.data()), input.size(), seed);
+
+    char name[48];
+    std::snprintf(name, sizeof(name), "%016llx-%llu", static_cast<unsigned long long>(hash), static_cast<unsigned long long>(input.size()));
+
+    return name;
+}
+
+
+
+bool ResultCache::fetch(const std::string& key, uint64_t inputSize, const std::string& output, PNGCodec& codec) const
+{
+    const std::string entry = entryPath(key);
+
+    {
+        // The probe reads a few hundred bytes, enough to turn away a truncated or foreign file
+        MappedFile cached;
+        if (cached.open(entry) != PNGManipErrorCode::Success)
+            return false;
+
+        if (codec.probe({ reinterpret_cast<const std::byte*>(cached.data()), cached.size() }) != PNGManipErrorCode::Success
+            || codec.info().payloadSize != inputSize)
+            return false;
+    }
+
+    if (place(entry, output) != PNGManipErrorCode::Success)
+        return false;
+
+    // Marks the image as used for eviction; a hard-linked output shares the time, rightly, as it was just written
+    std::error_code error;
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), error);
+
+    return true;
+}
+
+
+
+std::string ResultCache::temporaryPath() const
+{
+    std::error_code error;
+    fs::create_directories(directory, error);
+
+    return (fs::path(directory) / (randomSuffix() + temporaryExtension)).string();
+}
+
+
+
+PNGManipErrorCode ResultCache::store(const std::string& temporary, const std::string& key, const std::string& output) const
+{
+    std::error_code error;
+
+    // Read-only, so no output hard-linked to it can be changed in place
+    fs::permissions(temporary, fs::perms::owner_read | fs::perms::group_read | fs::perms::others_read, error);
+
+    // Placed before it is published, so an eviction right after cannot take it away first
+    const PNGManipErrorCode result = place(temporary, output);
+
+    fs::rename(temporary, entryPath(key), error);
+
+    if (error)
+        fs::remove(temporary, error);
+    else
+        evict();
+
+    return result;
+}
+
+
+
+bool ResultCache::holds(const std::string& path) const
+{
+    std::error_code error;
+
+    if (directory.empty() || fs::hard_link_count(path, error) < 2 || error)
+        return false;
+
+    // Same device and inode (file index on Windows) as one of the entries
+    for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+    {
+        std::error_code ignored;
+
+        if (entry.path().extension() == entryExtension && fs::equivalent(entry.path(), path, ignored))
+            return true;
+    }
+
+    return false;
+}
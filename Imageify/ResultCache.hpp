@@ -0,0 +1,101 @@
+#ifndef _RESULTCACHE_H_
+#define _RESULTCACHE_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <span>
+#include <string>
+
+#include "ErrorHandling.hpp"
+#include "PNGCodec.hpp"
+
+
+
+/**
+* @brief Result cache switches, filled in from the command line.
+*/
+struct PNGCacheOptions
+{
+	// Directory holding the cached images, empty to encode without a cache
+	std::string directory;
+
+	// Size the cache is trimmed back to after each new image, least recently used first
+	uint64_t capacityBytes{ 1024ull << 20 };
+};
+
+
+
+/**
+* @brief An on-disk cache of encoded images, keyed by the input bytes and the encode options.
+*
+* Each image is one file named after a 64-bit hash of the input, seeded with the options that
+* change the bytes written, and the input size. Encoding an input seen before puts the cached
+* image at the output instead: a reflink where the file system has them, otherwise a hard link
+* (cached images are read-only, so the output cannot be changed in place under the cache),
+* and a copy across file systems.
+*
+* Several processes can share one directory. New images are written to a temporary file and
+* renamed into place, outputs are linked to a temporary name and renamed over the output, and
+* only one process trims the cache at a time. An image evicted while another process links it
+* is simply a miss. A use sets the image's modification time, which is what eviction goes by.
+*/
+class ResultCache
+{
+private:
+
+	const std::string directory;
+	const uint64_t capacity;
+
+	std::string entryPath(const std::string& key) const;
+
+	/**
+	* @brief Makes the output a copy of the file at the given path, replacing it in one step.
+	*/
+	PNGManipErrorCode place(const std::string& from, const std::string& output) const;
+
+	/**
+	* @brief Removes the least recently used images until the cache fits its capacity.
+	*/
+	void evict() const;
+
+public:
+
+	explicit ResultCache(const PNGCacheOptions&);
+
+	/**
+	* @brief Whether a cache directory was given and an input of this size may go in it.
+	*/
+	bool accepts(uint64_t inputSize) const;
+
+	/**
+	* @brief The key of an input under the given options.
+	*/
+	static std::string key(std::span<const std::byte>, const PNGManipOptions&);
+
+	/**
+	* @brief Puts the cached image for the key at the output. On a hit the codec's info()
+	*        describes the image; false when there is none or it does not fit the input size.
+	*/
+	bool fetch(const std::string& key, uint64_t inputSize, const std::string& output, PNGCodec&) const;
+
+	/**
+	* @brief A fresh path in the cache directory to encode a new image into, creating the directory.
+	*/
+	std::string temporaryPath() const;
+
+	/**
+	* @brief Moves the image encoded at the temporary path into the cache and puts it at the output.
+	*/
+	PNGManipErrorCode store(const std::string& temporary, const std::string& key, const std::string& output) const;
+
+	/**
+	* @brief Whether the file at the path is a hard link to one of the cached images, which
+	*        writing it in place would rewrite too.
+	*/
+	bool holds(const std::string& path) const;
+};
+
+
+#endif // !_RESULTCACHE_H_
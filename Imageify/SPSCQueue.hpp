@@ -0,0 +1,116 @@
+#ifndef _SPSCQUEUE_H_
+#define _SPSCQUEUE_H_
+
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+
+
+/**
+* @brief A bounded, lock-free queue between exactly one producer thread and one consumer thread.
+*
+* The producer only ever writes m_head and the consumer only ever writes m_tail, so neither
+* side takes a lock. A side that finds the queue full (or empty) sleeps on the other side's
+* index with std::atomic::wait, which costs nothing while the queue keeps moving.
+*/
+template <typename T>
+class SPSCQueue
+{
+private:
+
+	std::vector<T> m_slots;
+	const size_t m_capacity;
+
+	// Kept on separate cache lines, each is written by one thread only
+	alignas(64) std::atomic<size_t> m_head{ 0 };
+	alignas(64) std::atomic<size_t> m_tail{ 0 };
+
+public:
+
+	explicit SPSCQueue(size_t capacity) :
+		m_slots(std::max<size_t>(1, capacity)),
+		m_capacity{ std::max<size_t>(1, capacity) }
+	{
+	}
+
+	SPSCQueue(const SPSCQueue&) = delete;
+	SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+	/**
+	* @brief Adds a value, waiting for room if the queue is full. Producer side only.
+	*/
+	void push(T value)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+
+		for (size_t tail = m_tail.load(std::memory_order_acquire); head - tail == m_capacity; tail = m_tail.load(std::memory_order_acquire))
+			m_tail.wait(tail, std::memory_order_acquire);
+
+		m_slots[head % m_capacity] = std::move(value);
+
+		m_head.store(head + 1, std::memory_order_release);
+		m_head.notify_one();
+	}
+
+	/**
+	* @brief Adds a value only if there is room right now. Producer side only.
+	*/
+	bool tryPush(T& value)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+
+		if (head - m_tail.load(std::memory_order_acquire) == m_capacity)
+			return false;
+
+		m_slots[head % m_capacity] = std::move(value);
+
+		m_head.store(head + 1, std::memory_order_release);
+		m_head.notify_one();
+
+		return true;
+	}
+
+	/**
+	* @brief Removes the oldest value, waiting for one if the queue is empty. Consumer side only.
+	*/
+	T pop()
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+		for (size_t head = m_head.load(std::memory_order_acquire); head == tail; head = m_head.load(std::memory_order_acquire))
+			m_head.wait(head, std::memory_order_acquire);
+
+		T value = std::move(m_slots[tail % m_capacity]);
+
+		m_tail.store(tail + 1, std::memory_order_release);
+		m_tail.notify_one();
+
+		return value;
+	}
+
+	/**
+	* @brief Removes the oldest value only if there is one right now. Consumer side only.
+	*/
+	bool tryPop(T& value)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+		if (m_head.load(std::memory_order_acquire) == tail)
+			return false;
+
+		value = std::move(m_slots[tail % m_capacity]);
+
+		m_tail.store(tail + 1, std::memory_order_release);
+		m_tail.notify_one();
+
+		return true;
+	}
+};
+
+
+#endif // !_SPSCQUEUE_H_
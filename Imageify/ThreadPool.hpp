@@ -0,0 +1,108 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+
+/**
+* @brief A fixed-size pool of worker threads fed from a single FIFO queue.
+*/
+class ThreadPool
+{
+private:
+
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()>> m_tasks;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp;
+	bool m_stopping{ false };
+
+	void workerLoop()
+	{
+		for (;;)
+		{
+			std::function<void()> task;
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wakeUp.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+
+				if (m_stopping && m_tasks.empty())
+					return;
+
+				task = std::move(m_tasks.front());
+				m_tasks.pop();
+			}
+
+			task();
+		}
+	}
+
+public:
+
+	/**
+	* @brief Starts the given number of workers, or one per hardware thread when zero.
+	*/
+	explicit ThreadPool(unsigned threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		m_workers.reserve(threadCount);
+		for (unsigned i{ 0 }; i < threadCount; ++i)
+			m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+
+		m_wakeUp.notify_all();
+
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t size() const { return m_workers.size(); }
+
+	/**
+	* @brief Queues a task and returns a future for its result.
+	*/
+	template <typename Task>
+	auto submit(Task&& task) -> std::future<decltype(task())>
+	{
+		using Result = decltype(task());
+
+		auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<Task>(task));
+		std::future<Result> result = packaged->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_tasks.emplace([packaged]() { (*packaged)(); });
+		}
+
+		m_wakeUp.notify_one();
+
+		return result;
+	}
+};
+
+
+#endif // !_THREADPOOL_H_
@@ -0,0 +1,194 @@
+#ifndef _WORKSTEALINGPOOL_H_
+#define _WORKSTEALINGPOOL_H_
+
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+
+/**
+* @brief A fixed-size pool of workers that each own a queue of jobs and steal from the others when it runs dry.
+*
+* run() deals the jobs out as contiguous slices, one per worker. A worker takes jobs from the
+* front of its own slice and, once that is empty, steals from the back of someone else's, so
+* a few slow jobs never leave the other workers idle. Jobs are told which worker runs them,
+* which lets callers keep per-worker state that is reused from job to job.
+*/
+class WorkStealingPool
+{
+public:
+
+	// Runs one job; called concurrently from the workers
+	using Job = std::function<void(size_t job, unsigned worker)>;
+
+private:
+
+	struct alignas(64) queue_t
+	{
+		std::mutex mutex;
+		std::deque<size_t> jobs;
+	};
+
+	std::vector<std::thread> m_workers;
+	std::unique_ptr<queue_t[]> m_queues;
+
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp, m_finished;
+
+	const Job* m_job{ nullptr };
+	uint64_t m_generation{ 0 };
+	size_t m_remaining{ 0 };
+	unsigned m_active{ 0 };
+	bool m_stopping{ false };
+
+	bool takeJob(unsigned worker, size_t& job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_queues[worker].mutex);
+
+			if (!m_queues[worker].jobs.empty())
+			{
+				job = m_queues[worker].jobs.front();
+				m_queues[worker].jobs.pop_front();
+				return true;
+			}
+		}
+
+		for (unsigned i{ 1 }; i < m_workers.size(); ++i)
+		{
+			queue_t& victim = m_queues[(worker + i) % m_workers.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+
+			if (!victim.jobs.empty())
+			{
+				job = victim.jobs.back();
+				victim.jobs.pop_back();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void workerLoop(unsigned worker)
+	{
+		uint64_t seen{ 0 };
+
+		for (;;)
+		{
+			const Job* run{ nullptr };
+
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wakeUp.wait(lock, [&]() { return m_stopping || m_generation != seen; });
+
+				if (m_stopping)
+					return;
+
+				seen = m_generation;
+				run = m_job;
+				++m_active;
+			}
+
+			size_t job{};
+			size_t done{ 0 };
+
+			while (run && takeJob(worker, job))
+			{
+				(*run)(job, worker);
+				++done;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_remaining -= done;
+				--m_active;
+			}
+
+			m_finished.notify_all();
+		}
+	}
+
+public:
+
+	/**
+	* @brief Starts the given number of workers, or one per hardware thread when zero.
+	*/
+	explicit WorkStealingPool(unsigned threadCount)
+	{
+		if (threadCount == 0)
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+		m_queues = std::make_unique<queue_t[]>(threadCount);
+
+		m_workers.reserve(threadCount);
+		for (unsigned i{ 0 }; i < threadCount; ++i)
+			m_workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+	}
+
+	~WorkStealingPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stopping = true;
+		}
+
+		m_wakeUp.notify_all();
+
+		for (auto& worker : m_workers)
+			worker.join();
+	}
+
+	WorkStealingPool(const WorkStealingPool&) = delete;
+	WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+	unsigned size() const { return static_cast<unsigned>(m_workers.size()); }
+
+	/**
+	* @brief Runs job(0) to job(jobCount - 1) across the workers and returns once all of them are done.
+	*/
+	void run(size_t jobCount, const Job& job)
+	{
+		if (jobCount == 0)
+			return;
+
+		const size_t workers = m_workers.size();
+
+		{
+			// Dealt out under the pool lock, so no worker sees the jobs before the run they belong to
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			for (size_t w{ 0 }; w < workers; ++w)
+			{
+				std::lock_guard<std::mutex> queueLock(m_queues[w].mutex);
+
+				for (size_t j{ w * jobCount / workers }; j < (w + 1) * jobCount / workers; ++j)
+					m_queues[w].jobs.push_back(j);
+			}
+
+			m_job = &job;
+			m_remaining = jobCount;
+			++m_generation;
+		}
+
+		m_wakeUp.notify_all();
+
+		// Wait for the workers to leave the job too, so none of them can pick up the next run with this one
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_finished.wait(lock, [this]() { return m_remaining == 0 && m_active == 0; });
+
+		m_job = nullptr;
+	}
+};
+
+
+#endif // !_WORKSTEALINGPOOL_H_
@@ -0,0 +1,107 @@
+/*
+* Microbenchmark for the bit-plane kernels behind --cover and --hidden.
+*
+* Embeds random bytes into the low bits of a buffer of samples and extracts them again, at
+* 1 to 4 bits per sample, with every kernel this CPU runs. Throughput is counted in sample
+* bytes, each read and written once, so it compares directly with the memcpy line above the
+* table: a kernel at memcpy speed is limited by memory, not by the bit shuffling. Every
+* kernel's samples and extracted bytes are checked against the scalar kernel's.
+*
+* Build:  part of the CMake build, as imageify_bitplane_bench
+* Usage:  imageify_bitplane_bench [samples in MB, default 256]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "BitPlane.hpp"
+
+
+
+// Best of a few runs, in MB/s
+static double measure(size_t bytes, const std::function<void()>& stage)
+{
+    double best{ 0.0 };
+
+    for (int run{ 0 }; run < 5; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        best = std::max(best, (bytes / (1024.0 * 1024.0)) / seconds);
+    }
+
+    return best;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    const size_t megabytes = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 256;
+    const size_t sampleBytes = std::max<size_t>(megabytes, 1) * 1024 * 1024;
+
+    std::mt19937_64 rng{ 42 };
+
+    std::vector<uint8_t> cover(sampleBytes);
+    for (auto& byte : cover)
+        byte = static_cast<uint8_t>(rng());
+
+    std::vector<uint8_t> samples(sampleBytes);
+    std::vector<uint8_t> reference(sampleBytes);
+
+    const double copy = measure(sampleBytes, [&]() { memcpy(samples.data(), cover.data(), sampleBytes); });
+
+    std::cout << "samples " << megabytes << " MB, memcpy " << std::fixed << std::setprecision(0) << copy << " MB/s\n\n"
+        << "kernel\tbits\tembed MB/s\textract MB/s\tpayload in/out MB/s\n";
+
+    bool mismatch{ false };
+
+    for (unsigned bits{ 1 }; bits <= 4; ++bits)
+    {
+        // An odd length, so the short last group and the scalar tail run too
+        const size_t payloadBytes = sampleBytes / 8 * bits - 1;
+
+        std::vector<uint8_t> payload(payloadBytes);
+        for (auto& byte : payload)
+            byte = static_cast<uint8_t>(rng());
+
+        std::vector<uint8_t> extracted(payloadBytes);
+
+        reference = cover;
+        embedBitPlanes(reference.data(), payload.data(), payloadBytes, bits, BitPlaneKernel::Scalar);
+
+        for (BitPlaneKernel kernel : { BitPlaneKernel::Scalar, BitPlaneKernel::SSE2, BitPlaneKernel::AVX2 })
+        {
+            if (!bitPlaneKernelSupported(kernel))
+                continue;
+
+            // Embedding over its own output changes nothing, so every run does the same work
+            samples = cover;
+            const double embed = measure(sampleBytes, [&]() { embedBitPlanes(samples.data(), payload.data(), payloadBytes, bits, kernel); });
+
+            std::fill(extracted.begin(), extracted.end(), 0);
+            const double extract = measure(sampleBytes, [&]() { extractBitPlanes(samples.data(), extracted.data(), payloadBytes, bits, kernel); });
+
+            const bool matches = (samples == reference) && (extracted == payload);
+            mismatch |= !matches;
+
+            std::cout << bitPlaneKernelName(kernel) << "\t" << bits << "\t" << embed << "\t\t" << extract << "\t\t"
+                << embed * bits / 8 << " / " << extract * bits / 8
+                << (matches ? "" : "\tMISMATCH") << "\n";
+        }
+    }
+
+    std::cout << "\nfastest kernel here: " << bitPlaneKernelName(bitPlaneKernel()) << std::endl;
+
+    return mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+}
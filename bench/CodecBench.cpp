@@ -0,0 +1,424 @@
+/*
+* Round-trip benchmark for the in-memory codec.
+*
+* Encodes and decodes synthetic payloads through PNGCodec and reports end to end MB/s for
+* both directions, the compression ratio and the MB/s of every stage --stats knows about
+* (pack, filter, deflate, inflate, unpack, write). Every decode is compared with its input,
+* and the run fails on the first mismatch.
+*
+* The serial mode writes through libpng and the native mode through PNGWriter, on the same
+* input and settings, so the two rows side by side show what bypassing libpng buys. Both
+* decode through libpng's png_read_image.
+*
+* Corpora:
+*  - random  incompressible bytes, like ciphertext or already compressed data
+*  - text    words drawn from a small vocabulary with a skewed distribution, like logs or prose
+*  - repeat  one short line over and over, the best case for deflate
+*
+* Build:  cmake --build <build dir> --target imageify_bench
+* Usage:  imageify_bench [--sizes 1K,1M,64M] [--corpus random,text,repeat] [--modes serial,native,stream,parallel,bands,pipeline]
+*                        [--levels 1,6,9] [--profiles default,fastest,balanced,smallest,auto] [--precompress none,deflate,zstd:19]
+*                        [--formats gray8,rgb8,rgba8,rgba16] [--threads 1,4] [--runs 3] [--json]
+*
+* Sizes take K, M and G suffixes. Several GB need as much memory again for the output.
+* Levels only apply to the default profile, the others bring their own. --precompress takes
+* the same CODEC[:LEVEL] values as Imageify; zstd needs a build that found it.
+* --formats packs the same payload into each pixel format; the filters look back one pixel,
+* so the format changes how well the serial mode's rows filter and deflate.
+* --threads only changes the parallel and bands modes. --json also writes each run's stages
+* to stderr as JSON lines, the same as Imageify --stats.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "PNGCodec.hpp"
+
+
+
+struct benchConfig_t
+{
+    std::vector<uint64_t> sizes{ 1024, 1024 * 1024, 64 * 1024 * 1024 };
+    std::vector<std::string> corpora{ "random", "text", "repeat" };
+    std::vector<std::string> modes{ "serial", "native", "stream", "parallel", "bands", "pipeline" };
+    std::vector<int> levels{ Z_DEFAULT_COMPRESSION };
+    std::vector<std::string> profiles{ "default" };
+    std::vector<std::string> precompress{ "none" };
+    std::vector<std::string> formats{ "rgba8" };
+    std::vector<unsigned> threads{ 0 };
+    int runs{ 3 };
+    bool json{ false };
+};
+
+
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    std::stringstream stream(list);
+
+    for (std::string item; std::getline(stream, item, ','); )
+        if (!item.empty())
+            items.push_back(item);
+
+    return items;
+}
+
+static uint64_t parseSize(const std::string& text)
+{
+    char* suffix{};
+    uint64_t size = std::strtoull(text.c_str(), &suffix, 10);
+
+    switch (*suffix)
+    {
+        case 'G': case 'g': size *= 1024;
+            [[fallthrough]];
+        case 'M': case 'm': size *= 1024;
+            [[fallthrough]];
+        case 'K': case 'k': size *= 1024;
+            break;
+    }
+
+    return size;
+}
+
+static std::string formatSize(uint64_t size)
+{
+    if (size >= 1024ull * 1024 * 1024 && size % (1024ull * 1024 * 1024) == 0)
+        return std::to_string(size >> 30) + "G";
+    if (size >= 1024 * 1024 && size % (1024 * 1024) == 0)
+        return std::to_string(size >> 20) + "M";
+    if (size >= 1024 && size % 1024 == 0)
+        return std::to_string(size >> 10) + "K";
+
+    return std::to_string(size);
+}
+
+
+
+static std::vector<std::byte> makeCorpus(const std::string& corpus, uint64_t size)
+{
+    std::vector<std::byte> payload(static_cast<size_t>(size));
+    std::mt19937_64 rng{ 42 };
+
+    if (corpus == "random")
+    {
+        size_t i{ 0 };
+        for (; i + sizeof(uint64_t) <= payload.size(); i += sizeof(uint64_t))
+        {
+            const uint64_t word = rng();
+            memcpy(payload.data() + i, &word, sizeof(word));
+        }
+
+        for (; i < payload.size(); ++i)
+            payload[i] = static_cast<std::byte>(rng());
+    }
+    else if (corpus == "text")
+    {
+        static const char* words[] = {
+            "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by",
+            "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had",
+            "they", "you", "were", "their", "one", "all", "we", "can", "her", "has", "there", "been", "if",
+            "more", "when", "will", "would", "who", "so", "no", "image", "pixel", "encode", "decode", "buffer",
+            "stream", "error", "request", "latency", "throughput", "worker", "thread", "queue", "band", "index"
+        };
+        constexpr size_t wordCount = sizeof(words) / sizeof(words[0]);
+
+        // Squaring a uniform draw favours the common words at the front, roughly like real text
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+        size_t i{ 0 }, lineLength{ 0 };
+        while (i < payload.size())
+        {
+            const double u = uniform(rng);
+            const char* word = words[static_cast<size_t>(u * u * wordCount)];
+
+            for (const char* c = word; *c && i < payload.size(); ++c)
+                payload[i++] = static_cast<std::byte>(*c);
+
+            lineLength += strlen(word) + 1;
+
+            if (i < payload.size())
+                payload[i++] = static_cast<std::byte>(lineLength > 72 ? '\n' : ' ');
+
+            if (lineLength > 72)
+                lineLength = 0;
+        }
+    }
+    else
+    {
+        static const char line[] = "2026-10-17 12:00:00 INFO request served in 12 ms\n";
+
+        for (size_t i{ 0 }; i < payload.size(); ++i)
+            payload[i] = static_cast<std::byte>(line[i % (sizeof(line) - 1)]);
+    }
+
+    return payload;
+}
+
+
+
+static PNGManipOptions makeOptions(const std::string& mode, const std::string& profile, int level, const std::string& precompress, const std::string& format, unsigned threads)
+{
+    PNGManipOptions options;
+    options.level = level;
+    options.stats = true;
+
+    parsePixelFormat(format, options.format);
+    parseCompressionProfile(profile, options.profile);
+    parsePayloadCodec(precompress, options.precompress, options.precompressLevel);
+
+    if (mode == "stream")
+        options.streaming = true;
+    else if (mode == "native")
+        options.nativeWriter = true;
+    else if (mode == "parallel")
+        options.threads = threads;
+    else if (mode == "bands")
+    {
+        options.bands = true;
+        options.threads = threads;
+    }
+    else if (mode == "pipeline")
+        options.pipeline = true;
+
+    return options;
+}
+
+
+
+// Best of a few runs, in seconds; stats are copied from the fastest run
+static double timeBest(int runs, const std::function<PNGManipErrorCode()>& call, PNGCodec& codec, CodecStats& best, bool& failed)
+{
+    double bestSeconds{ 0.0 };
+
+    for (int run{ 0 }; run < runs; ++run)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const PNGManipErrorCode result = call();
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (result != PNGManipErrorCode::Success)
+        {
+            std::cout << "  failed: " << codec.errorMessage() << "\n";
+            failed = true;
+            return 0.0;
+        }
+
+        if (run == 0 || seconds < bestSeconds)
+        {
+            bestSeconds = seconds;
+            best.reset();
+            best.merge(codec.stats());
+        }
+    }
+
+    return bestSeconds;
+}
+
+static std::string stageRates(const CodecStats& stats)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(0);
+
+    for (size_t s{ 0 }; s < codecStageCount; ++s)
+    {
+        const stageTotals_t stage = stats.totals(static_cast<CodecStage>(s));
+        if (stage.calls == 0 || stage.nanoseconds == 0)
+            continue;
+
+        out << " " << stageName(static_cast<CodecStage>(s)) << "=" << (stage.bytes / (1024.0 * 1024.0)) / (stage.nanoseconds / 1e9);
+    }
+
+    return out.str();
+}
+
+
+
+static bool parseArguments(int argc, char* argv[], benchConfig_t& config)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        const bool hasValue = (i + 1 < argc);
+
+        if (argument == "--sizes" && hasValue)
+        {
+            config.sizes.clear();
+            for (const std::string& size : splitList(argv[++i]))
+                config.sizes.push_back(parseSize(size));
+        }
+        else if (argument == "--corpus" && hasValue)
+            config.corpora = splitList(argv[++i]);
+
+        else if (argument == "--modes" && hasValue)
+            config.modes = splitList(argv[++i]);
+
+        else if (argument == "--levels" && hasValue)
+        {
+            config.levels.clear();
+            for (const std::string& level : splitList(argv[++i]))
+                config.levels.push_back(std::atoi(level.c_str()));
+        }
+        else if (argument == "--profiles" && hasValue)
+        {
+            config.profiles = splitList(argv[++i]);
+
+            CompressionProfile profile;
+            for (const std::string& name : config.profiles)
+                if (name != "default" && !parseCompressionProfile(name, profile))
+                    return false;
+        }
+        else if (argument == "--precompress" && hasValue)
+        {
+            config.precompress = splitList(argv[++i]);
+
+            PayloadCodec codec;
+            int level;
+            for (const std::string& name : config.precompress)
+                if (!parsePayloadCodec(name, codec, level) || !payloadCodecAvailable(codec))
+                    return false;
+        }
+        else if (argument == "--formats" && hasValue)
+        {
+            config.formats = splitList(argv[++i]);
+
+            PixelFormat format;
+            for (const std::string& name : config.formats)
+                if (!parsePixelFormat(name, format))
+                    return false;
+        }
+        else if (argument == "--threads" && hasValue)
+        {
+            config.threads.clear();
+            for (const std::string& threads : splitList(argv[++i]))
+                config.threads.push_back(static_cast<unsigned>(std::strtoul(threads.c_str(), nullptr, 10)));
+        }
+        else if (argument == "--runs" && hasValue)
+            config.runs = std::max(1, std::atoi(argv[++i]));
+
+        else if (argument == "--json")
+            config.json = true;
+
+        else
+            return false;
+    }
+
+    return !config.sizes.empty() && !config.corpora.empty() && !config.modes.empty() && !config.levels.empty()
+        && !config.profiles.empty() && !config.precompress.empty() && !config.formats.empty() && !config.threads.empty();
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    benchConfig_t config;
+
+    if (!parseArguments(argc, argv, config))
+    {
+        std::cout << "Usage: imageify_bench [--sizes 1K,1M,64M] [--corpus random,text,repeat] [--modes serial,native,stream,parallel,bands,pipeline]\n"
+            << "                      [--levels 1,6,9] [--profiles default,fastest,balanced,smallest,auto] [--precompress none,deflate,zstd:19]\n"
+            << "                      [--formats gray8,rgb8,rgba8,rgba16] [--threads 1,4] [--runs 3] [--json]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::byte> image, decoded;
+    CodecStats encodeStats(true), decodeStats(true);
+    bool failed{ false };
+
+    // Levels only mean something to the default profile, the others pick their own
+    std::vector<std::tuple<std::string, int, std::string, std::string>> settings;
+    for (const std::string& format : config.formats)
+    {
+        for (const std::string& precompress : config.precompress)
+        {
+            for (const std::string& profile : config.profiles)
+            {
+                if (profile == "default")
+                    for (const int level : config.levels)
+                        settings.emplace_back(profile, level, precompress, format);
+                else
+                    settings.emplace_back(profile, Z_DEFAULT_COMPRESSION, precompress, format);
+            }
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+        << "corpus\tsize\tmode\t\tprofile\t\tpre\tformat\tlevel\tthreads\tratio\tenc MB/s\tdec MB/s\tstages (MB/s)\n";
+
+    for (const std::string& corpus : config.corpora)
+    {
+        for (const uint64_t size : config.sizes)
+        {
+            const std::vector<std::byte> payload = makeCorpus(corpus, size);
+            const double megabytes = size / (1024.0 * 1024.0);
+
+            for (const std::string& mode : config.modes)
+            {
+                // Thread counts only mean something to the parallel encoders
+                const bool threaded = (mode == "parallel" || mode == "bands");
+                const std::vector<unsigned> threadCounts = threaded ? config.threads : std::vector<unsigned>{ 1 };
+
+                for (const auto& [profile, level, precompress, format] : settings)
+                {
+                    for (const unsigned threads : threadCounts)
+                    {
+                        PNGCodec codec(makeOptions(mode, profile, level, precompress, format, threads));
+                        bool runFailed{ false };
+
+                        const double encodeSeconds = timeBest(config.runs, [&]() { return codec.encode(payload, image); }, codec, encodeStats, runFailed);
+                        const unsigned usedThreads = codec.info().threads;
+                        const int usedLevel = codec.info().compression.level;
+
+                        const double decodeSeconds = runFailed ? 0.0
+                            : timeBest(config.runs, [&]() { return codec.decode(image, decoded); }, codec, decodeStats, runFailed);
+
+                        const std::string label = corpus + " " + formatSize(size) + " " + mode + " " + profile
+                            + " precompress " + precompress + " format " + format + " level " + std::to_string(usedLevel) + " threads " + std::to_string(usedThreads);
+
+                        if (!runFailed && decoded != payload)
+                        {
+                            std::cout << "  round trip mismatch: " << label << "\n";
+                            runFailed = true;
+                        }
+
+                        if (runFailed)
+                        {
+                            failed = true;
+                            continue;
+                        }
+
+                        std::cout << corpus << "\t" << formatSize(size) << "\t" << std::left << std::setw(8) << mode << "\t" << std::setw(8) << profile << std::right << "\t"
+                            << precompress << "\t" << format << "\t" << usedLevel << "\t" << usedThreads << "\t"
+                            << static_cast<double>(size) / image.size() << "\t"
+                            << megabytes / encodeSeconds << "\t\t" << megabytes / decodeSeconds << "\t\t"
+                            << "enc:" << stageRates(encodeStats) << " dec:" << stageRates(decodeStats) << "\n";
+
+                        if (config.json)
+                        {
+                            writeStatsJSON(std::cerr, "encode", label, encodeStats, encodeSeconds, size);
+                            writeStatsJSON(std::cerr, "decode", label, decodeStats, decodeSeconds, size);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (failed)
+    {
+        std::cout << "\nSome runs failed\n";
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
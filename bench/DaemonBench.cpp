@@ -0,0 +1,146 @@
+/*
+* Latency benchmark for daemon mode.
+*
+* Starts a daemon in this process on a temporary socket, connects to it once and times
+* small inline jobs one after another: encode a payload, then decode the image back and
+* compare it with the payload. The same jobs are also timed on a codec in this process,
+* which is the floor the socket round trip adds to.
+*
+* Build:  cmake --build <build dir> --target imageify_daemon_bench
+* Usage:  imageify_daemon_bench [payload size in bytes, default 4096] [jobs, default 2000]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "PNGDaemon.hpp"
+
+
+
+using clock_type = std::chrono::steady_clock;
+
+
+static void printLatencies(const char* label, std::vector<double>& micros)
+{
+    std::sort(micros.begin(), micros.end());
+
+    auto percentile = [&](double p) { return micros[std::min(micros.size() - 1, static_cast<size_t>(p * micros.size()))]; };
+
+    std::cout << std::left << std::setw(22) << label << std::right
+        << "  p50 " << std::setw(8) << percentile(0.50)
+        << "  p90 " << std::setw(8) << percentile(0.90)
+        << "  p99 " << std::setw(8) << percentile(0.99)
+        << "  max " << std::setw(8) << micros.back() << "  us\n";
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    const size_t payloadBytes = (argc > 1) ? static_cast<size_t>(std::strtoull(argv[1], nullptr, 10)) : 4096;
+    const size_t jobs = (argc > 2) ? static_cast<size_t>(std::strtoull(argv[2], nullptr, 10)) : 2000;
+
+    if (jobs == 0)
+    {
+        std::cout << "Usage: imageify_daemon_bench [payload size in bytes, default 4096] [jobs, default 2000]\n";
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::byte> payload(payloadBytes);
+    std::mt19937 random(42);
+    for (std::byte& b : payload)
+        b = static_cast<std::byte>(random() % 64 + 32);
+
+    const std::string socketPath = "/tmp/imageify-bench-" + std::to_string(getpid()) + ".sock";
+
+    PNGDaemon daemon(socketPath, 1);
+    std::thread server([&]() { daemon.startProcess(); });
+
+    // The daemon needs a moment to create its socket
+    DaemonConnection connection;
+    for (int attempt{ 0 }; connection.open(socketPath) != PNGManipErrorCode::Success; ++attempt)
+    {
+        if (attempt == 500)
+        {
+            std::cout << "The daemon did not start\n";
+            daemon.stop();
+            server.join();
+            return EXIT_FAILURE;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::vector<double> encodeMicros, decodeMicros, localEncodeMicros, localDecodeMicros;
+    bool failed{ false };
+
+    daemonJob_t job;
+    job.inlinePayload = true;
+
+    daemonResult_t image, decoded;
+
+    for (size_t i{ 0 }; i < jobs && !failed; ++i)
+    {
+        job.encode = true;
+        job.payload = payload;
+
+        auto started = clock_type::now();
+        failed = !connection.submit(job, image) || image.result != PNGManipErrorCode::Success;
+        encodeMicros.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - started).count());
+
+        if (failed)
+            break;
+
+        job.encode = false;
+        job.payload = image.output;
+
+        started = clock_type::now();
+        failed = !connection.submit(job, decoded) || decoded.result != PNGManipErrorCode::Success || decoded.output != payload;
+        decodeMicros.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - started).count());
+    }
+
+    connection.close();
+    daemon.stop();
+    server.join();
+
+    if (failed)
+    {
+        std::cout << "A job failed: " << (image.message.empty() ? decoded.message : image.message) << "\n";
+        return EXIT_FAILURE;
+    }
+
+
+    PNGCodec codec;
+    std::vector<std::byte> localImage, localPayload;
+
+    for (size_t i{ 0 }; i < jobs; ++i)
+    {
+        auto started = clock_type::now();
+        codec.encode(payload, localImage);
+        localEncodeMicros.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - started).count());
+
+        started = clock_type::now();
+        codec.decode(localImage, localPayload);
+        localDecodeMicros.push_back(std::chrono::duration<double, std::micro>(clock_type::now() - started).count());
+    }
+
+
+    std::cout << std::fixed << std::setprecision(1)
+        << jobs << " jobs of " << payloadBytes << " bytes, " << image.output.size() << " byte images\n\n";
+
+    printLatencies("daemon encode", encodeMicros);
+    printLatencies("daemon decode", decodeMicros);
+    printLatencies("in-process encode", localEncodeMicros);
+    printLatencies("in-process decode", localDecodeMicros);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+/*
+* Microbenchmark for the pack and unpack stages of the in-memory codec.
+*
+* Compares the old per-pixel copies (pixelAt() through std::vector::at into per-row
+* vectors) with the zero-copy layout, where libpng's row pointers aim straight into
+* bitmap_t::pixels and packing or unpacking is a single memcpy: the payload in, or the
+* payload after its size prefix out.
+*
+* Build:  g++ -std=c++20 -O2 -I../Imageify PixelPackBench.cpp -lpng -o PixelPackBench
+* Usage:  PixelPackBench [payload size in MB, default 64]
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "PNGCodec.hpp"
+
+
+
+static pixel_t* pixelAt(bitmap_t* bitmap, size_t row, size_t col)
+{
+    return reinterpret_cast<pixel_t*>(&bitmap->pixels.at((row * bitmap->width + col) * sizeof(pixel_t)));
+}
+
+
+
+// Best of a few runs, in MB/s
+static double measure(size_t bytes, const std::function<void()>& stage)
+{
+    double best{ 0.0 };
+
+    for (int run{ 0 }; run < 5; ++run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        stage();
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        best = std::max(best, (bytes / (1024.0 * 1024.0)) / seconds);
+    }
+
+    return best;
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    const size_t megabytes = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 64;
+    const size_t payloadSize = megabytes * 1024 * 1024;
+
+    std::vector<uint8_t> payload(payloadSize);
+    std::mt19937 rng{ 42 };
+    for (auto& byte : payload)
+        byte = static_cast<uint8_t>(rng());
+
+    // Same geometry rules as PNGCodec::getDimensions(), capped to what bitmap_t can hold
+    size_t side = static_cast<size_t>(std::sqrt(payloadSize / 4.0)) + 1;
+    side = std::min<size_t>(side, UINT16_MAX);
+
+    bitmap_t image{};
+    image.width = static_cast<uint16_t>(side);
+    image.height = static_cast<uint16_t>(std::min<size_t>((payloadSize / 4 + side - 1) / side, UINT16_MAX));
+    image.pixelSize = 4;
+    image.pixelDepth = 8;
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * sizeof(pixel_t));
+
+    const size_t imageBytes = image.pixels.size();
+    const size_t copyBytes = std::min(imageBytes, payloadSize);
+    const size_t rowBytes = static_cast<size_t>(image.width) * image.pixelSize;
+
+
+    // Pack: payload bytes -> pixels -> rows handed to libpng
+    double legacyPack = measure(imageBytes, [&]()
+    {
+        size_t idx{ 0 };
+        for (size_t row{ 0 }; row < image.height; ++row)
+        {
+            for (size_t col{ 0 }; col < image.width; ++col)
+            {
+                pixel_t* pixel = pixelAt(&image, row, col);
+
+                pixel->red      = (idx < copyBytes) ? payload[ idx++ ] : 0x00;
+                pixel->green    = (idx < copyBytes) ? payload[ idx++ ] : 0x00;
+                pixel->blue     = (idx < copyBytes) ? payload[ idx++ ] : 0x00;
+                pixel->alpha    = (idx < copyBytes) ? payload[ idx++ ] : 0x00;
+            }
+        }
+
+        std::vector<std::vector<uint8_t>> rowStorage(image.height, std::vector<uint8_t>(rowBytes));
+        for (size_t row{ 0 }; row < image.height; ++row)
+        {
+            for (size_t col{ 0 }; col < image.width; ++col)
+            {
+                pixel_t* pixel = pixelAt(&image, row, col);
+                size_t offset = col * image.pixelSize;
+
+                rowStorage[row][offset]     = pixel->red;
+                rowStorage[row][offset + 1] = pixel->green;
+                rowStorage[row][offset + 2] = pixel->blue;
+                rowStorage[row][offset + 3] = pixel->alpha;
+            }
+        }
+    });
+
+    double zeroCopyPack = measure(imageBytes, [&]()
+    {
+        memcpy(image.bytes(), payload.data(), copyBytes);
+        memset(image.bytes() + copyBytes, 0x00, imageBytes - copyBytes);
+
+        std::vector<png_bytep> rows = image.rowPointers();
+        if (rows.empty())
+            std::abort();
+    });
+
+
+    // Unpack: rows filled by libpng -> pixels -> flat output buffer
+    double legacyUnpack = measure(imageBytes, [&]()
+    {
+        std::vector<std::vector<uint8_t>> rowStorage(image.height, std::vector<uint8_t>(rowBytes, 0x5A));
+        for (size_t row{ 0 }; row < image.height; ++row)
+        {
+            const uint8_t* rowData = rowStorage[row].data();
+            for (size_t col{ 0 }; col < image.width; ++col)
+            {
+                pixel_t* px = pixelAt(&image, row, col);
+
+                px->red     = *rowData++;
+                px->green   = *rowData++;
+                px->blue    = *rowData++;
+                px->alpha   = *rowData++;
+            }
+        }
+
+        std::vector<uint8_t> buffer;
+        buffer.reserve(imageBytes);
+        for (size_t row{ 0 }; row < image.height; ++row)
+        {
+            for (size_t col{ 0 }; col < image.width; ++col)
+            {
+                pixel_t* px = pixelAt(&image, row, col);
+
+                buffer.push_back(px->red);
+                buffer.push_back(px->green);
+                buffer.push_back(px->blue);
+                buffer.push_back(px->alpha);
+            }
+        }
+    });
+
+    // What saveDecodedPayload() does: read the size prefix, check it against the pixels and hand
+    // the payload bytes after it to the sink, here a flat buffer
+    const uint32_t prefix = static_cast<uint32_t>(std::min(imageBytes, payloadSize) - sizeof(uint32_t));
+    memcpy(image.bytes(), &prefix, sizeof(uint32_t));
+
+    std::vector<uint8_t> flat(prefix);
+
+    double zeroCopyUnpack = measure(imageBytes, [&]()
+    {
+        uint32_t fileSize{};
+        memcpy(&fileSize, image.bytes(), sizeof(uint32_t));
+
+        if (fileSize > imageBytes - sizeof(uint32_t) || fileSize != flat.size())
+            std::abort();
+
+        memcpy(flat.data(), image.bytes() + sizeof(uint32_t), fileSize);
+    });
+
+    if (memcmp(flat.data(), image.bytes() + sizeof(uint32_t), flat.size()) != 0)
+        std::abort();
+
+
+    std::cout << "Image " << image.width << " x " << image.height << " (" << imageBytes / (1024.0 * 1024.0) << " MB)\n"
+        << "Stage\t\tLegacy MB/s\tZero-copy MB/s\n"
+        << "pack\t\t" << legacyPack << "\t\t" << zeroCopyPack << "\n"
+        << "unpack\t\t" << legacyUnpack << "\t\t" << zeroCopyUnpack << "\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/*
+* Benchmark for random-access range extraction against a full decode.
+*
+* Takes a banded image (Imageify --encode <file> --bands) and times:
+*  - a full serial decode through libpng, the way --decode reads an image
+*  - a full decode through the band index
+*  - --range style extraction of small ranges at random offsets
+*
+* Build:  g++ -std=c++20 -O2 -I../Imageify RangeBench.cpp ../Imageify/BandIndex.cpp ../Imageify/MappedFile.cpp -lpng -lz -o RangeBench
+* Usage:  RangeBench <banded.png> [range size in KB, default 4] [ranges, default 200]
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "PNGManip.hpp"
+
+
+
+static void readFromMemory(png_structp png_ptr, png_bytep outBytes, size_t byteCount)
+{
+    auto* cursor = static_cast<std::pair<const MappedFile*, size_t>*>(png_get_io_ptr(png_ptr));
+
+    if (byteCount > cursor->first->size() - cursor->second)
+        png_error(png_ptr, "Unexpected end of PNG data");
+
+    memcpy(outBytes, cursor->first->data() + cursor->second, byteCount);
+    cursor->second += byteCount;
+}
+
+
+
+// Inflates every row with libpng, returning the payload size taken from the prefix
+static uint64_t libpngFullDecode(const MappedFile& image)
+{
+    std::pair<const MappedFile*, size_t> cursor{ &image, 0 };
+
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+
+    if (setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+        return 0;
+    }
+
+    png_set_read_fn(png_ptr, &cursor, readFromMemory);
+    png_read_info(png_ptr, info_ptr);
+
+    std::vector<uint8_t> row(png_get_rowbytes(png_ptr, info_ptr));
+    uint32_t payloadSize{ 0 };
+
+    for (png_uint_32 r{ 0 }; r < png_get_image_height(png_ptr, info_ptr); ++r)
+    {
+        png_read_row(png_ptr, row.data(), nullptr);
+
+        if (r == 0)
+            memcpy(&payloadSize, row.data(), sizeof(uint32_t));
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, nullptr);
+
+    return payloadSize;
+}
+
+
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cout << "Usage: RangeBench <banded.png> [range size in KB] [ranges]\n";
+        return EXIT_FAILURE;
+    }
+
+    const uint64_t rangeBytes = ((argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 4) * 1024;
+    const int rangeCount = (argc > 3) ? std::atoi(argv[3]) : 200;
+
+    MappedFile image;
+    imageLayout_t layout;
+
+    if (image.open(argv[1]) != PNGManipErrorCode::Success
+        || scanImageLayout(image.data(), image.size(), layout) != PNGManipErrorCode::Success
+        || layout.bands.empty())
+    {
+        std::cout << "Not a banded Imageify image: " << argv[1] << "\n";
+        return EXIT_FAILURE;
+    }
+
+
+    auto start = std::chrono::steady_clock::now();
+    const uint64_t libpngSize = libpngFullDecode(image);
+    const double libpngSeconds = secondsSince(start);
+
+    std::vector<uint8_t> full;
+    start = std::chrono::steady_clock::now();
+    PNGManipErrorCode result = extractRange(image.data(), layout, 4, 0, layout.payloadSize, full);
+    const double bandSeconds = secondsSince(start);
+
+    if (result != PNGManipErrorCode::Success || libpngSize != layout.payloadSize)
+    {
+        std::cout << "Full decode failed\n";
+        return EXIT_FAILURE;
+    }
+
+
+    // Random ranges, each checked against the full decode
+    std::mt19937_64 rng{ 7 };
+    std::vector<double> latencies;
+    std::vector<uint8_t> extracted;
+
+    const uint64_t span = std::min(rangeBytes, layout.payloadSize);
+
+    for (int i{ 0 }; i < rangeCount; ++i)
+    {
+        const uint64_t offset = (layout.payloadSize > span) ? rng() % (layout.payloadSize - span) : 0;
+
+        start = std::chrono::steady_clock::now();
+        result = extractRange(image.data(), layout, 4, offset, span, extracted);
+        latencies.push_back(secondsSince(start));
+
+        if (result != PNGManipErrorCode::Success || memcmp(extracted.data(), full.data() + offset, span) != 0)
+        {
+            std::cout << "Range " << offset << ":" << span << " does not match the full decode\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+
+    const double megabytes = layout.payloadSize / (1024.0 * 1024.0);
+
+    std::cout << "Payload " << megabytes << " MB in " << layout.bands.size() << " bands\n"
+        << "Full decode (libpng):      " << libpngSeconds * 1e3 << " ms\t" << megabytes / libpngSeconds << " MB/s\n"
+        << "Full decode (band index):  " << bandSeconds * 1e3 << " ms\t" << megabytes / bandSeconds << " MB/s\n"
+        << "Range of " << span << " bytes, " << rangeCount << " random offsets:\n"
+        << "  p50 " << latencies[latencies.size() / 2] * 1e3 << " ms"
+        << "  p99 " << latencies[latencies.size() * 99 / 100] * 1e3 << " ms"
+        << "  speedup over libpng full decode " << libpngSeconds / latencies[latencies.size() / 2] << "x\n";
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/*
+* Archive manifests must not be believed about their size before it is checked.
+*
+* An ifAR chunk of a few bytes can claim a member list of up to 1 GB. Every decode and probe
+* reads the manifest, so parsing one has to refuse such a claim before allocating anything
+* for it. Allocations above 64 MB fail in this test, as they might on a small machine. A real
+* manifest still parses, and so do an empty one and one with a name of the longest length.
+*/
+
+#include <cstdlib>
+#include <new>
+
+#include "Archive.hpp"
+#include "TestImage.hpp"
+
+
+
+// Nothing a sound manifest here needs comes close
+static constexpr size_t allocationLimit = 64ull << 20;
+
+void* operator new(size_t size)
+{
+    void* memory = (size <= allocationLimit) ? std::malloc(size ? size : 1) : nullptr;
+    if (!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, size_t) noexcept { std::free(memory); }
+
+
+
+static bool parses(const std::vector<uint8_t>& chunk, archiveManifest_t& manifest)
+{
+    try
+    {
+        return parseArchiveManifest(chunk.data(), chunk.size(), manifest);
+    }
+    catch (const std::bad_alloc&)
+    {
+        check(false, "parsing allocated more than the manifest can hold");
+        return false;
+    }
+}
+
+static std::vector<uint8_t> header(uint32_t count, uint64_t listBytes)
+{
+    std::vector<uint8_t> chunk(16, 0x00);
+    chunk[0] = archiveVersion;
+
+    writeBE32(reinterpret_cast<std::byte*>(chunk.data() + 4), count);
+    writeBE64(reinterpret_cast<std::byte*>(chunk.data() + 8), listBytes);
+
+    return chunk;
+}
+
+
+
+int main()
+{
+    archiveManifest_t manifest{ .version = archiveVersion };
+    manifest.members.push_back({ .name = "docs/a.txt", .offset = 0, .size = 10, .crc = 1 });
+    manifest.members.push_back({ .name = std::string(UINT16_MAX, 'n'), .offset = 10, .size = 5, .crc = 2 });
+
+    archiveManifest_t parsed;
+    check(parses(serializeArchiveManifest(manifest), parsed) && parsed.members.size() == 2
+        && parsed.members[1].name.size() == UINT16_MAX && parsed.members[1].offset == 10, "real manifest parses");
+
+    check(parses(serializeArchiveManifest(archiveManifest_t{ .version = archiveVersion }), parsed) && parsed.members.empty(),
+        "empty manifest parses");
+
+
+    // A few bytes of deflate claiming 1 GB, for no members and for a handful
+    std::vector<uint8_t> claim = header(0, 1ull << 30);
+    claim.insert(claim.end(), { 0x78, 0x9c, 0x03, 0x00 });
+
+    check(!parses(claim, parsed), "1 GB list for no members is refused");
+
+    claim = header(5, 1ull << 30);
+    claim.insert(claim.end(), { 0x78, 0x9c, 0x03, 0x00 });
+
+    check(!parses(claim, parsed), "1 GB list for 5 members is refused");
+
+    // As many members as the size claims room for, but far more than 4 KB of deflate can hold
+    claim = header(4000000, 4000000ull * 22);
+    claim.resize(claim.size() + 4096, 0x00);
+
+    check(!parses(claim, parsed), "list larger than its compressed bytes can inflate to is refused");
+
+    if (testFailures)
+        return EXIT_FAILURE;
+
+    std::cout << "archive: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
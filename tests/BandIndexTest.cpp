@@ -0,0 +1,144 @@
+/*
+* Corrupted band indexes must fail the banded decoders cleanly.
+*
+* Encodes a banded image, then rewrites its ifBI chunk (with a valid CRC, so nothing but the
+* index itself is wrong) to hold bands out of order, overlapping, empty, past the last row or
+* not covering the image. Every whole and ranged decode, serial and parallel, must then return
+* an error rather than crash or hand back the wrong bytes. The untouched image must decode.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <utility>
+
+#include "TestImage.hpp"
+
+
+
+// Layout of ifBI: version, 3 reserved bytes, payload size, band count, then one record per band
+static constexpr size_t countOffset = 12;
+static constexpr size_t recordsOffset = 16;
+static constexpr size_t recordBytes = 24;
+
+
+
+static PNGManipErrorCode decode(const std::vector<std::byte>& image, unsigned threads, bool ranged, uint64_t offset, uint64_t length, std::vector<std::byte>& output)
+{
+    PNGManipOptions options;
+    options.threads = threads;
+    options.hasRange = ranged;
+    options.rangeOffset = offset;
+    options.rangeLength = length;
+
+    PNGCodec codec(options);
+    return codec.decode(image, output);
+}
+
+
+
+int main()
+{
+    const std::vector<std::byte> payload = randomBytes(1000003, 7);
+
+    PNGManipOptions options;
+    options.bands = true;
+    options.bandBytes = 64 * 1024;
+    options.threads = 2;
+
+    std::vector<std::byte> image;
+    PNGCodec encoder(options);
+
+    if (encoder.encode(payload, image) != PNGManipErrorCode::Success)
+    {
+        std::cerr << "FAILED: banded encode: " << encoder.errorMessage() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    uint32_t indexLength{ 0 };
+    const size_t index = findChunk(image, bandIndexChunkName, &indexLength);
+    const uint32_t bandCount = index ? readBE32(image.data() + index + countOffset) : 0;
+
+    if (bandCount < 3)
+    {
+        std::cerr << "FAILED: expected an index of at least 3 bands, found " << bandCount << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    auto record = [&](std::vector<std::byte>& copy, uint32_t band) { return copy.data() + index + recordsOffset + band * recordBytes; };
+
+
+    // Whole payload, and ranges at the start, across band boundaries and at the end
+    struct range_t { uint64_t offset, length; };
+    const range_t ranges[] = { { 0, 10 }, { 65000, 300000 }, { 45468, 2164 }, { payload.size() - 10, 10 } };
+
+    std::vector<std::byte> output;
+
+    for (unsigned threads : { 1u, 4u })
+    {
+        check(decode(image, threads, false, 0, 0, output) == PNGManipErrorCode::Success && output == payload,
+            "intact image decodes with " + std::to_string(threads) + " threads");
+
+        for (const range_t& range : ranges)
+        {
+            const bool decoded = decode(image, threads, true, range.offset, range.length, output) == PNGManipErrorCode::Success;
+            check(decoded && output.size() == range.length && memcmp(output.data(), payload.data() + range.offset, range.length) == 0,
+                "intact image decodes range " + std::to_string(range.offset) + ":" + std::to_string(range.length));
+        }
+    }
+
+
+    const std::pair<const char*, std::function<void(std::vector<std::byte>&)>> corruptions[] = {
+        { "bands swapped", [&](std::vector<std::byte>& copy) {
+            std::swap_ranges(record(copy, 0), record(copy, 1), record(copy, 1));
+        } },
+        { "overlapping bands", [&](std::vector<std::byte>& copy) {
+            writeBE32(record(copy, 1), readBE32(record(copy, 1)) - 1);
+        } },
+        { "band starting past the last row", [&](std::vector<std::byte>& copy) {
+            writeBE32(record(copy, 1), 0x7fffffff);
+        } },
+        { "empty band", [&](std::vector<std::byte>& copy) {
+            writeBE32(record(copy, 0) + 4, 0);
+        } },
+        { "band of 2^32 - 1 rows", [&](std::vector<std::byte>& copy) {
+            writeBE32(record(copy, bandCount - 1) + 4, 0xffffffff);
+        } },
+        { "bands missing", [&](std::vector<std::byte>& copy) {
+            writeBE32(copy.data() + index + countOffset, bandCount - 1);
+        } },
+        { "payload larger than the pixels", [&](std::vector<std::byte>& copy) {
+            writeBE64(copy.data() + index + 4, UINT64_MAX - 2);
+        } },
+        { "band data past the stream", [&](std::vector<std::byte>& copy) {
+            for (uint32_t band{ 0 }; band < bandCount; ++band)
+                writeBE64(record(copy, band) + 8, UINT64_MAX - 1);
+        } },
+    };
+
+    for (const auto& [name, corrupt] : corruptions)
+    {
+        std::vector<std::byte> copy = image;
+        corrupt(copy);
+        resealChunk(copy, index);
+
+        for (unsigned threads : { 1u, 4u })
+        {
+            const std::string where = std::string(name) + ", " + std::to_string(threads) + " threads";
+
+            // The serial whole-image decode never reads the index, the banded paths must not trust it
+            if (threads != 1)
+                check(decode(copy, threads, false, 0, 0, output) != PNGManipErrorCode::Success, where + ": whole decode fails");
+
+            for (const range_t& range : ranges)
+                check(decode(copy, threads, true, range.offset, range.length, output) != PNGManipErrorCode::Success,
+                    where + ": range " + std::to_string(range.offset) + ":" + std::to_string(range.length) + " fails");
+        }
+    }
+
+    if (testFailures)
+        return EXIT_FAILURE;
+
+    std::cout << "band index: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
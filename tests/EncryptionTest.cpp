@@ -0,0 +1,261 @@
+/*
+* Known-answer tests for the primitives behind --key-file and --passphrase-file.
+*
+* ChaCha20 against RFC 8439 2.3.2 (block function) and 2.4.2 (encryption), Poly1305 against
+* 2.5.2, and the two composed into the AEAD of 2.8.2 the way EncryptingSource composes them.
+* ChaCha20 runs with every kernel this CPU has, on the RFC vectors and on a keystream long
+* enough for the SSE2 and AVX2 paths, started at offsets inside and across blocks. SHA-256 is
+* checked against FIPS 180-4's examples, PBKDF2-HMAC-SHA256 against RFC 7914 section 11. An
+* empty payload has to seal and open too.
+*/
+
+#include <cstdlib>
+
+#include "Encryption.hpp"
+#include "TestImage.hpp"
+
+
+
+static std::vector<uint8_t> fromHex(const std::string& hex)
+{
+    std::vector<uint8_t> bytes;
+
+    for (size_t i{ 0 }; i + 1 < hex.size(); i += 2)
+        bytes.push_back(static_cast<uint8_t>(std::stoul(hex.substr(i, 2), nullptr, 16)));
+
+    return bytes;
+}
+
+template <size_t N>
+static void copyHex(uint8_t (&out)[N], const std::string& hex)
+{
+    const std::vector<uint8_t> bytes = fromHex(hex);
+    memcpy(out, bytes.data(), N);
+}
+
+static bool matches(const uint8_t* data, size_t length, const std::string& hex)
+{
+    const std::vector<uint8_t> expected = fromHex(hex);
+    return expected.size() == length && memcmp(data, expected.data(), length) == 0;
+}
+
+
+
+static const std::string sunscreen = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+
+static const CipherKernel kernels[] = { CipherKernel::Scalar, CipherKernel::SSE2, CipherKernel::AVX2 };
+
+
+
+static void testChaCha20(CipherKernel kernel)
+{
+    const std::string name = std::string("chacha20 ") + cipherKernelName(kernel);
+
+    uint8_t key[payloadKeyBytes], nonce[cipherNonceBytes];
+    copyHex(key, "000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f");
+
+    // 2.3.2: one block of keystream, counter 1
+    copyHex(nonce, "000000090000004a00000000");
+
+    uint8_t block[64]{};
+    chacha20Xor(key, nonce, 1, 0, block, sizeof(block), kernel);
+
+    check(matches(block, sizeof(block), "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+        "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e"), name + ": RFC 8439 2.3.2 block");
+
+    // 2.4.2: two blocks and a tail
+    copyHex(nonce, "000000000000004a00000000");
+
+    std::vector<uint8_t> text(sunscreen.begin(), sunscreen.end());
+    chacha20Xor(key, nonce, 1, 0, text.data(), text.size(), kernel);
+
+    check(matches(text.data(), text.size(), "6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+        "f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d807ca0dbf500d6a6156a38e088a22b65e52"
+        "bc514d16ccf806818ce91ab77937365af90bbf74a35be6b40b8eedf2785e42874d"), name + ": RFC 8439 2.4.2 encryption");
+
+    // 64 blocks and a tail, so every kernel runs its widest path. Digest from an independent implementation
+    std::vector<uint8_t> stream(4133, 0x00);
+    chacha20Xor(key, nonce, 1, 0, stream.data(), stream.size(), kernel);
+
+    uint8_t digest[32];
+    sha256(stream.data(), stream.size(), digest);
+
+    check(matches(digest, sizeof(digest), "bed6ee0b6e463c42ecf3bdb00edc14f870900b94d572a518a4d846e93d2c35c7"),
+        name + ": 4133 bytes of keystream");
+
+    // Starting part way into the stream, inside a block and on block boundaries
+    for (uint64_t position : { 1, 37, 64, 100, 511, 512, 1000 })
+    {
+        std::vector<uint8_t> slice(2000, 0x00);
+        chacha20Xor(key, nonce, 1, position, slice.data(), slice.size(), kernel);
+
+        check(memcmp(slice.data(), stream.data() + position, slice.size()) == 0,
+            name + ": keystream from byte " + std::to_string(position));
+    }
+}
+
+
+
+static void testPoly1305()
+{
+    uint8_t key[32], tag[cipherTagBytes];
+    copyHex(key, "85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b");
+
+    const std::string message = "Cryptographic Forum Research Group";
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(message.data());
+
+    Poly1305 whole(key);
+    whole.update(data, message.size());
+    whole.finish(tag);
+
+    check(matches(tag, sizeof(tag), "a8061dc1305136c6c22b8baf0c0127a9"), "poly1305: RFC 8439 2.5.2");
+
+    // The same message fed in pieces that straddle the 16 byte blocks
+    Poly1305 pieces(key);
+    pieces.update(data, 1);
+    pieces.update(data + 1, 15);
+    pieces.update(data + 16, 17);
+    pieces.update(data + 33, message.size() - 33);
+    pieces.finish(tag);
+
+    check(matches(tag, sizeof(tag), "a8061dc1305136c6c22b8baf0c0127a9"), "poly1305: RFC 8439 2.5.2 in pieces");
+
+    // Empty updates, as an empty payload makes them, change nothing and read nothing
+    Poly1305 empty(key);
+    empty.update(nullptr, 0);
+    empty.update(data, message.size());
+    empty.update(nullptr, 0);
+    empty.finish(tag);
+
+    check(matches(tag, sizeof(tag), "a8061dc1305136c6c22b8baf0c0127a9"), "poly1305: RFC 8439 2.5.2 with empty updates");
+}
+
+
+
+// An empty payload seals to nothing but its tag, and opens back to nothing
+static void testEmptyPayload()
+{
+    PNGManipOptions options;
+    options.key.source = KeySource::KeyFile;
+    options.key.secret.assign(payloadKeyBytes, '\x5a');
+
+    std::vector<std::byte> image, output(1);
+    PNGCodec encoder(options), decoder(options);
+
+    check(encoder.encode(std::span<const std::byte>{}, image) == PNGManipErrorCode::Success, "empty payload: encrypted encode");
+    check(decoder.decode(image, output) == PNGManipErrorCode::Success && output.empty(), "empty payload: encrypted decode");
+}
+
+
+
+static void testAEAD(CipherKernel kernel)
+{
+    const std::string name = std::string("aead ") + cipherKernelName(kernel);
+
+    uint8_t key[payloadKeyBytes], nonce[cipherNonceBytes];
+    copyHex(key, "808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f");
+    copyHex(nonce, "070000004041424344454647");
+
+    const std::vector<uint8_t> aad = fromHex("50515253c0c1c2c3c4c5c6c7");
+    std::vector<uint8_t> text(sunscreen.begin(), sunscreen.end());
+
+    // The one-time key is the first half of block 0, the text is sealed from block 1
+    uint8_t oneTimeKey[32]{};
+    chacha20Xor(key, nonce, 0, 0, oneTimeKey, sizeof(oneTimeKey), kernel);
+    chacha20Xor(key, nonce, 1, 0, text.data(), text.size(), kernel);
+
+    uint8_t lengths[16];
+    for (int i{ 0 }; i < 8; ++i)
+    {
+        lengths[i] = static_cast<uint8_t>(static_cast<uint64_t>(aad.size()) >> (8 * i));
+        lengths[8 + i] = static_cast<uint8_t>(static_cast<uint64_t>(text.size()) >> (8 * i));
+    }
+
+    uint8_t tag[cipherTagBytes];
+
+    Poly1305 mac(oneTimeKey);
+    mac.update(aad.data(), aad.size());
+    mac.pad();
+    mac.update(text.data(), text.size());
+    mac.pad();
+    mac.update(lengths, sizeof(lengths));
+    mac.finish(tag);
+
+    check(matches(text.data(), text.size(), "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6"
+        "3dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b3692ddbd7f2d778b8c9803aee328091b58"
+        "fab324e4fad675945585808b4831d7bc3ff4def08e4b7a9de576d26586cec64b6116"), name + ": RFC 8439 2.8.2 ciphertext");
+
+    check(matches(tag, sizeof(tag), "1ae10b594f09e26a7e902ecbd0600691"), name + ": RFC 8439 2.8.2 tag");
+}
+
+
+
+static void testSHA256()
+{
+    const std::pair<std::string, const char*> vectors[] = {
+        { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+            "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+    };
+
+    for (const auto& [message, expected] : vectors)
+    {
+        uint8_t digest[32];
+        sha256(reinterpret_cast<const uint8_t*>(message.data()), message.size(), digest);
+
+        check(matches(digest, sizeof(digest), expected), "sha256: FIPS 180-4 example of " + std::to_string(message.size() * 8) + " bits");
+    }
+}
+
+
+
+static void testPBKDF2()
+{
+    struct vector_t { const char* password; const char* salt; uint32_t iterations; const char* expected; };
+
+    const vector_t vectors[] = {
+        { "passwd", "salt", 1, "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+            "49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783" },
+        { "Password", "NaCl", 80000, "4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56"
+            "a1d425a1225833549adb841b51c9b3176a272bdebba1d078478f62b397f33c8d" },
+    };
+
+    for (const vector_t& vector : vectors)
+    {
+        uint8_t key[64];
+        pbkdf2SHA256(reinterpret_cast<const uint8_t*>(vector.password), strlen(vector.password),
+            reinterpret_cast<const uint8_t*>(vector.salt), strlen(vector.salt), vector.iterations, key, sizeof(key));
+
+        check(matches(key, sizeof(key), vector.expected), "pbkdf2-sha256: RFC 7914 with " + std::to_string(vector.iterations) + " iterations");
+    }
+}
+
+
+
+int main()
+{
+    for (CipherKernel kernel : kernels)
+    {
+        if (!cipherKernelSupported(kernel))
+        {
+            std::cout << "encryption: " << cipherKernelName(kernel) << " not supported here, skipped" << std::endl;
+            continue;
+        }
+
+        testChaCha20(kernel);
+        testAEAD(kernel);
+    }
+
+    testPoly1305();
+    testEmptyPayload();
+    testSHA256();
+    testPBKDF2();
+
+    if (testFailures)
+        return EXIT_FAILURE;
+
+    std::cout << "encryption: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/*
+* Images wider or taller than bitmap_t holds must be refused, not cut down to 16 bits.
+*
+* A valid 70000 x 2 RGBA8 PNG, and a 4 x 70000 one, carry a size prefix like any Imageify
+* image. Every decoder (serial, streaming, banded, ranged), probe and cover extraction must
+* return an error for them instead of writing past the pixels, and embedding into one as a cover
+* must fail too. The widest image that still fits, 65535 x 1, must decode as usual.
+*/
+
+#include <cstdlib>
+
+#include "TestImage.hpp"
+
+
+
+// Pixels for an RGBA8 image whose size prefix announces payloadBytes bytes, followed by them
+static std::vector<uint8_t> prefixedPixels(uint32_t width, uint32_t height, const std::vector<std::byte>& payload)
+{
+    std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 4, 0x00);
+
+    const uint32_t prefix = static_cast<uint32_t>(payload.size());
+    memcpy(pixels.data(), &prefix, sizeof(prefix));
+    memcpy(pixels.data() + sizeof(prefix), payload.data(), payload.size());
+
+    return pixels;
+}
+
+
+
+static PNGManipErrorCode decode(const std::vector<std::byte>& image, PNGManipOptions options, std::vector<std::byte>& output)
+{
+    PNGCodec codec(options);
+    return codec.decode(image, output);
+}
+
+
+
+int main()
+{
+    const std::vector<std::byte> payload = randomBytes(1000, 3);
+
+    PNGManipOptions serial, streaming, parallel, ranged;
+    streaming.streaming = true;
+    parallel.threads = 4;
+    ranged.hasRange = true;
+    ranged.rangeOffset = 10;
+    ranged.rangeLength = 100;
+
+    std::vector<std::byte> output;
+
+
+    const std::pair<uint32_t, uint32_t> oversized[] = { { 70000, 2 }, { 4, 70000 } };
+
+    for (const auto& [width, height] : oversized)
+    {
+        const std::vector<std::byte> image = makePNG(width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA, prefixedPixels(width, height, payload), true);
+        const std::string where = std::to_string(width) + " x " + std::to_string(height);
+
+        check(decode(image, serial, output) != PNGManipErrorCode::Success, where + ": serial decode fails");
+        check(decode(image, streaming, output) != PNGManipErrorCode::Success, where + ": streaming decode fails");
+        check(decode(image, parallel, output) != PNGManipErrorCode::Success, where + ": parallel decode fails");
+        check(decode(image, ranged, output) != PNGManipErrorCode::Success, where + ": ranged decode fails");
+
+        PNGCodec codec(serial);
+        VectorSink sink(output);
+
+        check(codec.probe(image) != PNGManipErrorCode::Success, where + ": probe fails");
+        check(codec.extract(image, sink) != PNGManipErrorCode::Success, where + ": hidden payload extraction fails");
+        check(codec.embed(image, payload, 2, sink) != PNGManipErrorCode::Success, where + ": embedding into it as a cover fails");
+    }
+
+
+    // The limit itself is still a valid size
+    const std::vector<std::byte> widest = makePNG(maxImageSide, 1, 8, PNG_COLOR_TYPE_RGB_ALPHA, prefixedPixels(maxImageSide, 1, payload), true);
+
+    for (const PNGManipOptions& options : { serial, streaming, parallel })
+        check(decode(widest, options, output) == PNGManipErrorCode::Success && output == payload, "65535 x 1 image decodes");
+
+    check(decode(widest, ranged, output) == PNGManipErrorCode::Success && output.size() == ranged.rangeLength
+        && memcmp(output.data(), payload.data() + ranged.rangeOffset, ranged.rangeLength) == 0, "65535 x 1 image decodes a range");
+
+    PNGCodec codec(serial);
+    check(codec.probe(widest) == PNGManipErrorCode::Success && codec.info().payloadSize == payload.size(), "65535 x 1 image probes");
+
+    if (testFailures)
+        return EXIT_FAILURE;
+
+    std::cout << "image size: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
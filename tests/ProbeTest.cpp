@@ -0,0 +1,99 @@
+/*
+* probe() must only vouch for images Imageify made.
+*
+* Every encoder writes an ifVR chunk ahead of the image data, and probe() reports its version.
+* A PNG from anywhere else, even one whose first pixels read as a plausible size prefix, has
+* to be refused with InvalidFileFormat instead of reported as an empty payload. Images from
+* before ifVR are still known by their ifCK chunk, after the image data, and probe as legacy.
+* An ifVR from a newer format is refused by every path.
+*/
+
+#include <cstdlib>
+
+#include "TestImage.hpp"
+
+
+
+// Cuts the first chunk of the given type out of the image
+static void removeChunk(std::vector<std::byte>& image, const char* type)
+{
+    uint32_t length{ 0 };
+    const size_t body = findChunk(image, type, &length);
+
+    if (body)
+        image.erase(image.begin() + static_cast<ptrdiff_t>(body - 8), image.begin() + static_cast<ptrdiff_t>(body + length + 4));
+}
+
+
+
+int main()
+{
+    const std::vector<std::byte> payload = randomBytes(5000, 7);
+
+    PNGManipOptions serial, streaming, native, pipeline, parallel, encrypted;
+    streaming.streaming = true;
+    native.nativeWriter = true;
+    pipeline.pipeline = true;
+    parallel.threads = 4;
+    parallel.bands = true;
+    encrypted.key.source = KeySource::KeyFile;
+    encrypted.key.secret.assign(payloadKeyBytes, '\x5a');
+
+    std::vector<std::byte> image;
+
+    for (const PNGManipOptions& options : { serial, streaming, native, pipeline, parallel, encrypted })
+    {
+        PNGCodec encoder(options);
+        check(encoder.encode(payload, image) == PNGManipErrorCode::Success && encoder.info().formatVersion == imageFormatVersion, "encodes with ifVR");
+
+        const size_t marker = findChunk(image, formatChunkName);
+        check(marker != 0 && marker < findChunk(image, "IDAT"), "ifVR comes ahead of the image data");
+
+        PNGCodec prober;
+        check(prober.probe(image) == PNGManipErrorCode::Success && prober.info().formatVersion == imageFormatVersion
+            && prober.info().payloadSize == payload.size(), "image probes with its version");
+    }
+
+    PNGCodec encoder;
+    check(encoder.encode(payload, image) == PNGManipErrorCode::Success, "serial encode");
+
+
+    // A PNG from elsewhere whose first pixel holds a small size prefix
+    std::vector<uint8_t> pixels(64 * 64 * 4, 0x00);
+    pixels[0] = 0x10;
+
+    PNGCodec prober;
+    check(prober.probe(makePNG(64, 64, 8, PNG_COLOR_TYPE_RGB_ALPHA, pixels)) == PNGManipErrorCode::InvalidFileFormat, "foreign PNG is refused");
+    check(prober.probe(makePNG(64, 64, 8, PNG_COLOR_TYPE_RGB_ALPHA, pixels, true)) == PNGManipErrorCode::Success, "marked PNG probes");
+
+
+    // As made before ifVR, with and without its checksum
+    std::vector<std::byte> legacy = image;
+    removeChunk(legacy, formatChunkName);
+
+    check(prober.probe(legacy) == PNGManipErrorCode::Success && prober.info().formatVersion == 0
+        && prober.info().payloadSize == payload.size(), "image with only ifCK probes as legacy");
+
+    std::vector<std::byte> output;
+    PNGCodec decoder;
+    check(decoder.decode(legacy, output) == PNGManipErrorCode::Success && output == payload, "image with only ifCK decodes");
+
+    removeChunk(legacy, checksumChunkName);
+    check(prober.probe(legacy) == PNGManipErrorCode::InvalidFileFormat, "image with neither chunk is refused");
+
+
+    // From a format this build does not know
+    std::vector<std::byte> newer = image;
+    const size_t marker = findChunk(newer, formatChunkName);
+    newer[marker] = static_cast<std::byte>(imageFormatVersion + 1);
+    resealChunk(newer, marker);
+
+    check(prober.probe(newer) != PNGManipErrorCode::Success, "newer format version does not probe");
+    check(decoder.decode(newer, output) != PNGManipErrorCode::Success, "newer format version does not decode");
+
+    if (testFailures)
+        return EXIT_FAILURE;
+
+    std::cout << "probe: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+/*
+* Helpers shared by the tests: making Imageify images in memory and rewriting their chunks.
+*/
+
+#ifndef _TESTIMAGE_H_
+#define _TESTIMAGE_H_
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "PNGCodec.hpp"
+
+
+// Counts failed checks, so a test reports every one of them before it exits
+inline int testFailures{ 0 };
+
+inline void check(bool condition, const std::string& what)
+{
+	if (!condition)
+	{
+		std::cerr << "FAILED: " << what << std::endl;
+		++testFailures;
+	}
+}
+
+
+inline std::vector<std::byte> randomBytes(size_t length, uint64_t seed)
+{
+	std::mt19937_64 rng{ seed };
+	std::vector<std::byte> bytes(length);
+
+	for (auto& byte : bytes)
+		byte = static_cast<std::byte>(rng());
+
+	return bytes;
+}
+
+
+inline uint32_t readBE32(const std::byte* data)
+{
+	return (std::to_integer<uint32_t>(data[0]) << 24) | (std::to_integer<uint32_t>(data[1]) << 16)
+		| (std::to_integer<uint32_t>(data[2]) << 8) | std::to_integer<uint32_t>(data[3]);
+}
+
+inline void writeBE32(std::byte* data, uint32_t value)
+{
+	for (int i{ 0 }; i < 4; ++i)
+		data[i] = static_cast<std::byte>(value >> (24 - 8 * i));
+}
+
+inline void writeBE64(std::byte* data, uint64_t value)
+{
+	writeBE32(data, static_cast<uint32_t>(value >> 32));
+	writeBE32(data + 4, static_cast<uint32_t>(value));
+}
+
+
+/**
+* @brief Offset of the body of the first chunk of the given type, or 0 if there is none.
+*/
+inline size_t findChunk(const std::vector<std::byte>& image, const char* type, uint32_t* length = nullptr)
+{
+	for (size_t position{ 8 }; position + 12 <= image.size(); position += 12 + readBE32(image.data() + position))
+	{
+		if (memcmp(image.data() + position + 4, type, 4) == 0)
+		{
+			if (length)
+				*length = readBE32(image.data() + position);
+
+			return position + 8;
+		}
+	}
+
+	return 0;
+}
+
+/**
+* @brief Recomputes the CRC of the chunk whose body starts at the given offset, after it was edited.
+*/
+inline void resealChunk(std::vector<std::byte>& image, size_t body)
+{
+	const uint32_t length = readBE32(image.data() + body - 8);
+	const uLong crc = crc32(0, reinterpret_cast<const Bytef*>(image.data() + body - 4), length + 4);
+
+	writeBE32(image.data() + body + length, static_cast<uint32_t>(crc));
+}
+
+
+/**
+* @brief A plain PNG of the given rows, every one filtered with None, in one IDAT chunk. A marked
+*        one carries the ifVR chunk too, as the images Imageify makes do.
+*/
+inline std::vector<std::byte> makePNG(uint32_t width, uint32_t height, uint8_t bitDepth, uint8_t colorType, const std::vector<uint8_t>& pixels, bool marked = false)
+{
+	const size_t rowBytes = height ? pixels.size() / height : 0;
+
+	std::vector<uint8_t> filtered;
+	filtered.reserve(pixels.size() + height);
+
+	for (size_t row{ 0 }; row < height; ++row)
+	{
+		filtered.push_back(0);
+		filtered.insert(filtered.end(), pixels.begin() + row * rowBytes, pixels.begin() + (row + 1) * rowBytes);
+	}
+
+	uLongf compressedSize = compressBound(static_cast<uLong>(filtered.size()));
+	std::vector<uint8_t> compressed(compressedSize);
+	compress2(compressed.data(), &compressedSize, filtered.data(), static_cast<uLong>(filtered.size()), 1);
+	compressed.resize(compressedSize);
+
+	const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	std::vector<std::byte> image(reinterpret_cast<const std::byte*>(signature), reinterpret_cast<const std::byte*>(signature) + 8);
+
+	auto chunk = [&](const char* type, const uint8_t* data, size_t length)
+	{
+		const size_t start = image.size();
+		image.resize(start + 12 + length);
+
+		writeBE32(image.data() + start, static_cast<uint32_t>(length));
+		memcpy(image.data() + start + 4, type, 4);
+		if (length)
+			memcpy(image.data() + start + 8, data, length);
+
+		resealChunk(image, start + 8);
+	};
+
+	uint8_t header[13]{};
+	writeBE32(reinterpret_cast<std::byte*>(header), width);
+	writeBE32(reinterpret_cast<std::byte*>(header + 4), height);
+	header[8] = bitDepth;
+	header[9] = colorType;
+
+	chunk("IHDR", header, sizeof(header));
+
+	if (marked)
+		chunk(formatChunkName, &imageFormatVersion, 1);
+
+	chunk("IDAT", compressed.data(), compressed.size());
+	chunk("IEND", nullptr, 0);
+
+	return image;
+}
+
+
+#endif // !_TESTIMAGE_H_
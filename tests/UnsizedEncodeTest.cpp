@@ -0,0 +1,123 @@
+/*
+* Payloads whose size is only known once the stream ends must decode like any other.
+*
+* encodeUnsized() writes the rows as they fill and goes back to the height, the size prefix
+* and the Adler-32 afterwards. Streams that end at once, mid-row, or exactly on a row boundary,
+* handed over partly read ahead and partly still in the stream, must decode to the same bytes
+* in every pixel format, on the serial, streaming and banded decoders, with the checksum and
+* the geometry the image claims. Options that need the size up front must be refused.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "TestImage.hpp"
+
+
+
+// The bytes of a buffer as a stream of unknown length, handed out in uneven reads
+struct bufferStream_t : public StreamSource
+{
+    std::span<const std::byte> bytes;
+
+    size_t read(uint8_t* out, size_t length) override
+    {
+        length = std::min({ length, bytes.size(), size_t{ 70001 } });
+
+        if (length)
+            memcpy(out, bytes.data(), length);
+
+        bytes = bytes.subspan(length);
+        return length;
+    }
+
+    bool failed() const override { return false; }
+};
+
+
+
+static void roundTrip(PixelFormat format, size_t payloadBytes, size_t readAhead, const std::string& name)
+{
+    const std::vector<std::byte> payload = randomBytes(payloadBytes, payloadBytes + readAhead);
+    const std::span<const std::byte> all(payload);
+
+    PNGManipOptions options;
+    options.format = format;
+
+    bufferStream_t rest;
+    rest.bytes = all.subspan(readAhead);
+
+    std::vector<std::byte> image;
+    VectorSink sink(image);
+
+    PNGCodec encoder(options);
+    const PNGManipErrorCode result = encoder.encodeUnsized(all.first(readAhead), rest, sink);
+
+    check(result == PNGManipErrorCode::Success, name + ": encodes");
+    if (result != PNGManipErrorCode::Success)
+        return;
+
+    const size_t rowBytes = (PNGCodec::unsizedRowBytes / pixelFormatInfo(format).bytesPerPixel) * pixelFormatInfo(format).bytesPerPixel;
+    const size_t rows = std::max<size_t>(1, (payloadBytes + sizeof(uint32_t) + rowBytes - 1) / rowBytes);
+
+    check(encoder.info().height == rows && encoder.info().payloadSize == payloadBytes, name + ": height fits the payload");
+
+    for (int mode{ 0 }; mode < 3; ++mode)
+    {
+        PNGManipOptions decodeOptions;
+        decodeOptions.streaming = (mode == 1);
+        decodeOptions.threads = (mode == 2) ? 4 : 1;
+
+        std::vector<std::byte> output;
+        PNGCodec decoder(decodeOptions);
+
+        check(decoder.decode(image, output) == PNGManipErrorCode::Success && output == payload
+            && decoder.info().checksum.version != 0, name + ": decodes, mode " + std::to_string(mode));
+    }
+
+    PNGCodec prober;
+    check(prober.probe(image) == PNGManipErrorCode::Success && prober.info().payloadSize == payloadBytes, name + ": probes");
+}
+
+
+
+int main()
+{
+    const PixelFormat formats[] = { PixelFormat::Gray8, PixelFormat::RGB8, PixelFormat::RGBA8, PixelFormat::RGBA16 };
+
+    for (PixelFormat format : formats)
+    {
+        const std::string name = pixelFormatName(format);
+        const size_t rowBytes = (PNGCodec::unsizedRowBytes / pixelFormatInfo(format).bytesPerPixel) * pixelFormatInfo(format).bytesPerPixel;
+
+        roundTrip(format, 0, 0, name + " empty");
+        roundTrip(format, 1000, 1000, name + " all read ahead");
+        roundTrip(format, rowBytes - sizeof(uint32_t), 0, name + " one full row");
+        roundTrip(format, 3 * rowBytes - sizeof(uint32_t), 100, name + " ends on a row boundary");
+        roundTrip(format, 5 * rowBytes + 12345, 70000, name + " ends mid-row");
+    }
+
+    // Each of these needs the size before the first row
+    PNGManipOptions refused[4];
+    refused[0].precompress = PayloadCodec::Deflate;
+    refused[1].key.source = KeySource::KeyFile;
+    refused[1].key.secret.assign(payloadKeyBytes, '\x5a');
+    refused[2].bands = true;
+    refused[3].shard.count = 2;
+
+    for (const PNGManipOptions& options : refused)
+    {
+        bufferStream_t rest;
+        std::vector<std::byte> image;
+        VectorSink sink(image);
+
+        PNGCodec codec(options);
+        check(codec.encodeUnsized({}, rest, sink) != PNGManipErrorCode::Success, "options needing the size are refused");
+    }
+
+    if (testFailures)
+        return EXIT_FAILURE;
+
+    std::cout << "unsized encode: all checks passed" << std::endl;
+    return EXIT_SUCCESS;
+}